@@ -257,6 +257,7 @@ extern ScmObj Scm_SocketClose(ScmSocket *s);
 extern ScmObj Scm_SocketInputPort(ScmSocket *s, int buffered);
 extern ScmObj Scm_SocketOutputPort(ScmSocket *s, int buffered);
 
+extern ScmObj Scm_SocketSetNonblocking(ScmSocket *s, int flag);
 extern ScmObj Scm_SocketBind(ScmSocket *s, ScmSockAddr *addr);
 extern ScmObj Scm_SocketConnect(ScmSocket *s, ScmSockAddr *addr);
 extern ScmObj Scm_SocketListen(ScmSocket *s, int backlog);
@@ -250,6 +250,34 @@ ScmObj Scm_SocketOutputPort(ScmSocket *sock, int buffering)
         }                                                               \
     } while (0)
 
+/* The last socket call failed because a non-blocking socket isn't ready.
+   Operations return #f in that case, so that the caller can wait for
+   the socket (e.g. with gauche.selector) and retry. */
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+#define SOCKET_WOULD_BLOCK()  (errno == EAGAIN || errno == EWOULDBLOCK)
+#else
+#define SOCKET_WOULD_BLOCK()  (errno == EAGAIN)
+#endif
+
+ScmObj Scm_SocketSetNonblocking(ScmSocket *sock, int flag)
+{
+    CLOSE_CHECK(sock->fd, "change the blocking mode of", sock);
+#if defined(GAUCHE_WINDOWS)
+    u_long arg = flag? 1 : 0;
+    if (ioctlsocket(sock->fd, FIONBIO, &arg) == SOCKET_ERROR) {
+        Scm_SysError("ioctlsocket(FIONBIO) failed");
+    }
+#else  /* !GAUCHE_WINDOWS */
+    int fl, r;
+    SCM_SYSCALL(fl, fcntl(sock->fd, F_GETFL));
+    if (fl < 0) Scm_SysError("fcntl(F_GETFL) failed");
+    fl = flag? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK);
+    SCM_SYSCALL(r, fcntl(sock->fd, F_SETFL, fl));
+    if (r < 0) Scm_SysError("fcntl(F_SETFL) failed");
+#endif /* !GAUCHE_WINDOWS */
+    return SCM_OBJ(sock);
+}
+
 ScmObj Scm_SocketBind(ScmSocket *sock, ScmSockAddr *addr)
 {
     int r;
@@ -299,7 +327,7 @@ ScmObj Scm_SocketAccept(ScmSocket *sock)
     SCM_SYSCALL(newfd, accept(sock->fd, (struct sockaddr*)&addrbuf, &addrlen));
 #endif /* !GAUCHE_WINDOWS */
     if (SOCKET_INVALID(newfd)) {
-        if (errno == EAGAIN) {
+        if (SOCKET_WOULD_BLOCK()) {
             return SCM_FALSE;
         } else {
             Scm_SysError("accept(2) failed");
@@ -320,7 +348,16 @@ ScmObj Scm_SocketConnect(ScmSocket *sock, ScmSockAddr *addr)
     CLOSE_CHECK(sock->fd, "connect to", sock);
     SCM_SYSCALL(r, connect(sock->fd, &addr->addr, addr->addrlen));
     if (r < 0) {
-        Scm_SysError("connect failed to %S", addr);
+        /* On a non-blocking socket, the connection is established in
+           background.  Calling connect again after the socket becomes
+           writable completes it (EISCONN).  AF_UNIX sockets report
+           EAGAIN instead of EINPROGRESS when the backlog is full. */
+        if (errno == EINPROGRESS || errno == EALREADY
+            || SOCKET_WOULD_BLOCK()) return SCM_FALSE;
+        if (!(errno == EISCONN
+              && sock->status != SCM_SOCKET_STATUS_CONNECTED)) {
+            Scm_SysError("connect failed to %S", addr);
+        }
     }
     sock->address = addr;
     sock->status = SCM_SOCKET_STATUS_CONNECTED;
@@ -376,7 +413,10 @@ ScmObj Scm_SocketSend(ScmSocket *sock, ScmObj msg, int flags)
     CLOSE_CHECK(sock->fd, "send to", sock);
     const char *cmsg = get_message_body(msg, &size);
     SCM_SYSCALL(r, send(sock->fd, cmsg, size, flags));
-    if (r < 0) Scm_SysError("send(2) failed");
+    if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return SCM_FALSE;
+        Scm_SysError("send(2) failed");
+    }
     return SCM_MAKE_INT(r);
 }
 
@@ -389,7 +429,10 @@ ScmObj Scm_SocketSendTo(ScmSocket *sock, ScmObj msg, ScmSockAddr *to,
     const char *cmsg = get_message_body(msg, &size);
     SCM_SYSCALL(r, sendto(sock->fd, cmsg, size, flags,
                           &SCM_SOCKADDR(to)->addr, SCM_SOCKADDR(to)->addrlen));
-    if (r < 0) Scm_SysError("sendto(2) failed");
+    if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return SCM_FALSE;
+        Scm_SysError("sendto(2) failed");
+    }
     return SCM_MAKE_INT(r);
 }
 
@@ -401,7 +444,10 @@ ScmObj Scm_SocketSendMsg(ScmSocket *sock, ScmObj msg, int flags)
     CLOSE_CHECK(sock->fd, "send to", sock);
     const char *cmsg = get_message_body(msg, &size);
     SCM_SYSCALL(r, sendmsg(sock->fd, (struct msghdr*)cmsg, flags));
-    if (r < 0) Scm_SysError("sendmsg(2) failed");
+    if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return SCM_FALSE;
+        Scm_SysError("sendmsg(2) failed");
+    }
     return SCM_MAKE_INT(r);
 #else  /*GAUCHE_WINDOWS*/
     (void)sock;  /* suppress unused var warning */
@@ -419,6 +465,7 @@ ScmObj Scm_SocketRecv(ScmSocket *sock, int bytes, int flags)
     char *buf = SCM_NEW_ATOMIC2(char*, bytes);
     SCM_SYSCALL(r, recv(sock->fd, buf, bytes, flags));
     if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return SCM_FALSE;
         Scm_SysError("recv(2) failed");
     }
     return Scm_MakeString(buf, r, r, SCM_STRING_INCOMPLETE);
@@ -441,6 +488,7 @@ ScmObj Scm_SocketRecvX(ScmSocket *sock, ScmUVector *buf, int flags)
     char *z = get_message_buffer(buf, &size);
     SCM_SYSCALL(r, recv(sock->fd, z, size, flags));
     if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return SCM_FALSE;
         Scm_SysError("recv(2) failed");
     }
     return Scm_MakeInteger(r);
@@ -456,6 +504,7 @@ ScmObj Scm_SocketRecvFrom(ScmSocket *sock, int bytes, int flags)
     SCM_SYSCALL(r, recvfrom(sock->fd, buf, bytes, flags,
                             (struct sockaddr*)&from, &fromlen));
     if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return Scm_Values2(SCM_FALSE, SCM_FALSE);
         Scm_SysError("recvfrom(2) failed");
     }
     return Scm_Values2(Scm_MakeString(buf, r, r, SCM_STRING_INCOMPLETE),
@@ -482,6 +531,7 @@ ScmObj Scm_SocketRecvFromX(ScmSocket *sock, ScmUVector *buf,
     SCM_SYSCALL(r, recvfrom(sock->fd, z, size, flags,
                             (struct sockaddr*)&from, &fromlen));
     if (r < 0) {
+        if (SOCKET_WOULD_BLOCK()) return Scm_Values2(SCM_FALSE, SCM_FALSE);
         Scm_SysError("recvfrom(2) failed");
     }
     ScmObj cp;
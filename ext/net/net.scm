@@ -45,6 +45,7 @@
           SHUT_RD SHUT_WR SHUT_RDWR
           socket-address socket-status socket-input-port socket-output-port
           socket-shutdown socket-close socket-bind socket-connect socket-fd
+          socket-set-nonblocking!
           socket-listen socket-accept socket-setsockopt socket-getsockopt
           socket-getsockname socket-getpeername socket-ioctl
           socket-send socket-sendto socket-sendmsg socket-buildmsg
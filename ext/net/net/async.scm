@@ -0,0 +1,193 @@
+;;;
+;;; gauche.net.async - coroutine-style socket operations
+;;;
+;;;   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Runs tasks as coroutines on the calling thread.  Sockets are used in
+;; non-blocking mode; when an operation would block, the task captures
+;; its continuation up to the task boundary (reset/shift) and parks it on
+;; the scheduler's selector, and the scheduler resumes it when the socket
+;; becomes ready.  Other tasks run in the meantime.
+
+(define-module gauche.net.async
+  (use gauche.net)
+  (use gauche.selector)
+  (use gauche.partcont)
+  (use data.queue)
+  (export <async-scheduler> make-async-scheduler current-async-scheduler
+          async-spawn! async-run! async-yield async-sleep
+          async-wait-readable async-wait-writable
+          async-socket-accept async-socket-connect
+          async-socket-send async-socket-recv async-socket-recv!
+          async-socket-sendto async-socket-recvfrom))
+(select-module gauche.net.async)
+
+(define-class <async-scheduler> ()
+  ((selector :init-form (make <selector>))
+   (runq     :init-form (make-queue))   ; thunks ready to run
+   (waiting  :init-value 0)             ; number of parked tasks
+   (waiters  :init-form (make-hash-table 'equal?)) ; (fd . flag) -> queue
+   ))
+
+(define (make-async-scheduler) (make <async-scheduler>))
+
+;; The scheduler running the current task, or #f.
+(define current-async-scheduler (make-parameter #f))
+
+(define (%scheduler sched)
+  (or sched
+      (current-async-scheduler)
+      (error "no async scheduler is given or running")))
+
+;; Each task runs inside reset, so shift captures the rest of the task,
+;; not the scheduler loop.
+(define (async-spawn! thunk :optional (sched #f))
+  (assume-type thunk <procedure>)
+  (enqueue! (~ (%scheduler sched)'runq) (^[] (reset (thunk))))
+  (undefined))
+
+;; Runs tasks until all of them are finished.  An error in a task
+;; propagates out of async-run!.
+(define (async-run! sched)
+  (parameterize ([current-async-scheduler sched])
+    (let ([runq (~ sched'runq)]
+          [sel (~ sched'selector)])
+      (let loop ()
+        (cond [(not (queue-empty? runq)) ((dequeue! runq)) (loop)]
+              [(positive? (~ sched'waiting)) (selector-select sel) (loop)]
+              [else (undefined)])))))
+
+;; Parks the current task.  REGISTER! is called with a procedure that
+;; puts the task back to the run queue.
+(define (%park sched register!)
+  (shift k
+    (inc! (~ sched'waiting))
+    (register! (^[]
+                 (dec! (~ sched'waiting))
+                 (enqueue! (~ sched'runq) (^[] (k #t)))))))
+
+(define (async-yield)
+  (if-let1 sched (current-async-scheduler)
+    (shift k (enqueue! (~ sched'runq) (^[] (k #t))))
+    #t))
+
+(define (async-sleep seconds)
+  (if-let1 sched (current-async-scheduler)
+    (%park sched (^[wake] (selector-add-timer! (~ sched'selector) seconds
+                                               wake)))
+    (sys-nanosleep (exact (round (* seconds 1e9))))))
+
+;; The selector keeps one handler per fd and flag, so we register it
+;; once for the first waiter, and keep the wake procedures of all the
+;; tasks waiting on the same fd and flag in a queue.  When the fd becomes
+;; ready, we wake all of them; the ones that would still block come back
+;; here.
+(define (%add-waiter! sched fd flag wake)
+  (let ([key (cons (if (port? fd) (port-file-number fd) fd) flag)]
+        [tab (~ sched'waiters)]
+        [sel (~ sched'selector)])
+    (if-let1 q (hash-table-get tab key #f)
+      (enqueue! q wake)
+      (let1 q (make-queue)
+        (enqueue! q wake)
+        (hash-table-put! tab key q)
+        (selector-add! sel fd
+                       (^[_ _]
+                         (selector-delete! sel fd #f (list flag))
+                         (hash-table-delete! tab key)
+                         (for-each (^[w] (w)) (dequeue-all! q)))
+                       (list flag))))))
+
+;; Outside of a scheduler, these just block until the fd is ready.
+(define (%wait fd flag)
+  (if-let1 sched (current-async-scheduler)
+    (%park sched (cut %add-waiter! sched fd flag <>))
+    (let1 sel (make <selector>)
+      (selector-add! sel fd (^[_ _] #t) (list flag))
+      (let loop () (when (zero? (selector-select sel)) (loop)))
+      #t)))
+
+(define (async-wait-readable port-or-fd) (%wait port-or-fd 'r))
+(define (async-wait-writable port-or-fd) (%wait port-or-fd 'w))
+
+;;-----------------------------------------------------
+;; Socket operations
+;;
+;; Each retries the non-blocking socket operation, which returns #f
+;; when it would block, after the socket becomes ready.
+;;
+
+(define-syntax retry-until
+  (syntax-rules ()
+    [(_ sock wait expr)
+     (let loop ()
+       (or expr (begin (wait (socket-fd sock)) (loop))))]))
+
+;; The accepted socket is put in non-blocking mode.
+(define (async-socket-accept sock)
+  (socket-set-nonblocking!
+   (retry-until sock async-wait-readable (socket-accept sock))
+   #t))
+
+;; socket-connect returns #f while the connection is in progress, or,
+;; for AF_UNIX, when the listener's backlog is full; in the latter case
+;; the second call starts over, so we keep retrying until it succeeds.
+(define (async-socket-connect sock addr)
+  (socket-set-nonblocking! sock #t)
+  (let loop ()
+    (unless (socket-connect sock addr)
+      (async-wait-writable (socket-fd sock))
+      (let1 err (socket-getsockopt sock SOL_SOCKET SO_ERROR 0)
+        (unless (zero? err)
+          (errorf <system-error> :errno err
+                  "connect failed to ~s: ~a" addr (sys-strerror err))))
+      (loop)))
+  sock)
+
+(define (async-socket-send sock msg :optional (flags 0))
+  (retry-until sock async-wait-writable (socket-send sock msg flags)))
+
+(define (async-socket-recv sock bytes :optional (flags 0))
+  (retry-until sock async-wait-readable (socket-recv sock bytes flags)))
+
+(define (async-socket-recv! sock buf :optional (flags 0))
+  (retry-until sock async-wait-readable (socket-recv! sock buf flags)))
+
+(define (async-socket-sendto sock msg to :optional (flags 0))
+  (retry-until sock async-wait-writable (socket-sendto sock msg to flags)))
+
+;; socket-recvfrom returns two values, both #f when it would block.
+(define (async-socket-recvfrom sock bytes :optional (flags 0))
+  (let loop ()
+    (receive (msg from) (socket-recvfrom sock bytes flags)
+      (if msg
+        (values msg from)
+        (begin (async-wait-readable (socket-fd sock)) (loop))))))
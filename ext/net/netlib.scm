@@ -221,6 +221,9 @@
 (define-cproc socket-close (sock::<socket>)
   Scm_SocketClose)
 
+(define-cproc socket-set-nonblocking! (sock::<socket> flag::<boolean>)
+  Scm_SocketSetNonblocking)
+
 (define-cproc socket-bind (sock::<socket> addr::<socket-address>)
   Scm_SocketBind)
 
@@ -571,6 +571,117 @@
        (test* "udp sendmsg w/o sendbuf" '(#t #t) (xtest #f)))))]
  [else #f])
 
+;;-----------------------------------------------------------------
+(test-section "async socket operations")
+
+(use gauche.net.async)
+(test-module 'gauche.net.async)
+
+(cond-expand
+ [gauche.os.windows #f]
+ [else
+  (sys-unlink "async.o")
+  (let ([server (make-server-socket 'unix "async.o")]
+        [addr (make <sockaddr-un> :path "async.o")])
+    (socket-set-nonblocking! server #t)
+
+    (test* "non-blocking accept" #f (socket-accept server))
+    (let ([client (make-socket PF_UNIX SOCK_STREAM)])
+      (socket-connect client addr)
+      (let1 peer (socket-set-nonblocking! (socket-accept server) #t)
+        (test* "non-blocking recv" #f (socket-recv peer 10))
+        (socket-send client "abc")
+        (test* "non-blocking recv" "abc"
+               (string-incomplete->complete (socket-recv peer 10)))
+        (socket-close peer))
+      (socket-close client))
+
+    (test* "echo tasks" '("HELLO0" "HELLO1" "HELLO2")
+           (let ([sched (make-async-scheduler)]
+                 [replies '()])
+             (define (echo sock)
+               (let1 s (async-socket-recv sock 100)
+                 (if (string-null? s)
+                   (socket-close sock)
+                   (begin
+                     (async-socket-send sock
+                                        ($ string-upcase
+                                           $ string-incomplete->complete s))
+                     (echo sock)))))
+             (async-spawn! (^[]
+                             (dotimes [i 3]
+                               (let1 c (async-socket-accept server)
+                                 (async-spawn! (^[] (echo c))))))
+                           sched)
+             (dotimes [i 3]
+               (async-spawn!
+                (^[]
+                  (let1 c (async-socket-connect
+                           (make-socket PF_UNIX SOCK_STREAM) addr)
+                    (async-socket-send c (format "hello~a" i))
+                    (async-yield)
+                    (push! replies ($ string-incomplete->complete
+                                      $ async-socket-recv c 100))
+                    (socket-close c)))
+                sched))
+             (async-run! sched)
+             (sort replies)))
+
+    (test* "two tasks waiting on the same socket" '("x" "y")
+           (let* ([sched (make-async-scheduler)]
+                  [client (make-socket PF_UNIX SOCK_STREAM)]
+                  [peer (begin (socket-connect client addr)
+                               (socket-set-nonblocking! (socket-accept server)
+                                                        #t))]
+                  [got '()])
+             (define (reader)
+               (push! got ($ string-incomplete->complete
+                             $ async-socket-recv peer 100)))
+             (async-spawn! reader sched)
+             (async-spawn! reader sched)
+             (async-spawn! (^[]
+                             (socket-send client "x")
+                             (until (pair? got) (async-sleep 0.01))
+                             (socket-send client "y"))
+                           sched)
+             (async-run! sched)
+             (socket-close peer)
+             (socket-close client)
+             (sort got)))
+
+    (test* "async-sleep" '(b a)
+           (let ([sched (make-async-scheduler)]
+                 [r '()])
+             (async-spawn! (^[] (async-sleep 0.05) (push! r 'a)) sched)
+             (async-spawn! (^[] (async-sleep 0.01) (push! r 'b)) sched)
+             (async-run! sched)
+             (reverse r)))
+
+    (socket-close server))
+
+  (sys-unlink "async-dgram.o")
+  (let ([r (make-socket PF_UNIX SOCK_DGRAM)]
+        [s (make-socket PF_UNIX SOCK_DGRAM)]
+        [addr (make <sockaddr-un> :path "async-dgram.o")])
+    (socket-bind r addr)
+    (socket-set-nonblocking! r #t)
+    (test* "non-blocking recvfrom" '(#f #f)
+           (receive (msg from) (socket-recvfrom r 10) (list msg from)))
+    (test* "async datagram" "abc"
+           (let ([sched (make-async-scheduler)]
+                 [got #f])
+             (async-spawn! (^[]
+                             (receive (msg from) (async-socket-recvfrom r 10)
+                               (set! got (string-incomplete->complete msg))))
+                           sched)
+             (async-spawn! (^[] (async-socket-sendto s "abc" addr)) sched)
+             (async-run! sched)
+             got))
+    (socket-close s)
+    (socket-close r)
+    (sys-unlink "async-dgram.o"))
+  (sys-unlink "async.o")])
+
 ;;-----------------------------------------------------------------
 (test-section "srfi-106")
 
@@ -665,7 +665,7 @@
 
 ;;;============================================================
 ;;; rfc.json
-;;;   Test is here since the module uses parser.peg.
+;;;   Test is here since json-parser uses parser.peg.
 
 (test-section "rfc.json")
 (use rfc.json)
@@ -831,12 +831,39 @@
                (construct-json-string (cadr d))))))]
  [else])
 
+(test* "big numbers" '#(12345678901234567890 -1234567890123456789 100.0)
+       (parse-json-string "[12345678901234567890,-1234567890123456789,1e2]"))
+(test* "empty containers" '#(() #())
+       (parse-json-string "[{}, [ ]]"))
+(test* "parse error (nesting)" (test-error <json-parse-error>)
+       (parse-json-string (make-string 10000 #\[)))
+
+(test* "reading successive values" '((("a" . 1)) #(2) "c" 4 xyz)
+       (call-with-input-string "{\"a\":1}[2] \"c\"\n4 xyz"
+         (^p (let* ([a (parse-json p)]
+                    [b (parse-json p)]
+                    [c (parse-json p)]
+                    [d (parse-json p)])
+               (list a b c d (read p))))))
+(test* "port->json-generator" '(#(1) (("x" . null)) true)
+       (call-with-input-string "[1]{\"x\":null} true"
+         (^p (generator->list (port->json-generator p)))))
+
+(test* "json-parser" '#(1 "a" (("b" . false)))
+       (peg-parse-string json-parser "[1, \"a\", {\"b\": false}]"))
+
+(test* "writing numbers and keys" "{\"a\":0.5,\"b\":[1,-2.5,1.0e21]}"
+       (construct-json-string '((a . 1/2) (b . #(1 -2.5 1e21)))))
+(test* "writing specials" "[true,false,null,true,false]"
+       (construct-json-string '#(#t #f null true false)))
+
 (let ()
   (define (t obj)
     (test* #"writer error ~obj" (test-error <json-construct-error>)
            (construct-json-string obj)))
   (t "a")
   (t '#(1 2 x))
+  (t '#(+inf.0))
   (t '(("a" . 2) 9)))
 
 (test* "generalized array" "[1,2,3]"
@@ -0,0 +1,619 @@
+/*
+ * json.c - JSON parser and writer
+ *
+ *   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <gauche/priv/portP.h>
+
+#include "rfc-json.h"
+
+static ScmObj sym_true;
+static ScmObj sym_false;
+static ScmObj sym_null;
+
+/* The module rfc.json, and the Scheme procedures we call.  See json.scm */
+static ScmModule *json_module;
+static ScmObj parse_error_proc = SCM_UNDEFINED;
+static ScmObj construct_error_proc = SCM_UNDEFINED;
+static ScmObj x_to_string_proc = SCM_UNDEFINED;
+
+/*==================================================================
+ * Parser
+ *
+ *   We read bytes through the port's cursor, so that the common cases
+ *   (whitespaces and string bodies) are scanned directly in the port
+ *   buffer.  The parser never reads past the end of the JSON value,
+ *   so the caller can read subsequent data, e.g. another JSON value,
+ *   from the same port.
+ */
+
+/* Nesting limit, to keep a malicious input from exhausting C stack. */
+#define JSON_MAX_DEPTH  4096
+
+typedef struct json_parser_rec {
+    ScmPort *port;
+    ScmObj array_handler;       /* #f for the default */
+    ScmObj object_handler;      /* #f for the default */
+    ScmObj special_handler;     /* #f for the default */
+    int depth;
+} json_parser;
+
+static void parse_error(json_parser *ctx, const char *msg, ScmObj obj)
+{
+    SCM_BIND_PROC(parse_error_proc, "%json-parse-error", json_module);
+    Scm_ApplyRec3(parse_error_proc,
+                  Scm_MakeIntegerU(ctx->port->bytes),
+                  obj,
+                  Scm_Sprintf("%s at line %d", msg,
+                              Scm_PortLine(ctx->port)));
+    /*NOTREACHED*/
+}
+
+static void unexpected(json_parser *ctx, int b)
+{
+    if (b == EOF) {
+        parse_error(ctx, "unexpected EOF", SCM_EOF);
+    } else if (b < 0x80) {
+        parse_error(ctx, "unexpected character", SCM_MAKE_CHAR(b));
+    } else {
+        parse_error(ctx, "unexpected byte", SCM_MAKE_INT(b));
+    }
+}
+
+#define IS_WS(b)     ((b) == ' ' || (b) == '\t' || (b) == '\n' || (b) == '\r')
+#define IS_DIGIT(b)  ((b) >= '0' && (b) <= '9')
+
+/* Skips whitespaces, and returns the next byte without consuming it. */
+static int skip_ws(ScmPort *p)
+{
+    for (;;) {
+        const char *v;
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n == 0) return EOF;
+        if (n < 0) {
+            int b = Scm_PeekbUnsafe(p);
+            if (!IS_WS(b)) return b;
+            (void)Scm_GetbUnsafe(p);
+            continue;
+        }
+        ScmSize i = 0;
+        while (i < n && IS_WS(v[i])) i++;
+        int b = (i < n)? (unsigned char)v[i] : EOF;
+        Scm_PortCursorAdvance(p, i, TRUE);
+        if (i < n) return b;
+    }
+}
+
+static ScmObj parse_value(json_parser *ctx);
+
+static int read_hex4(json_parser *ctx)
+{
+    int r = 0;
+    for (int i=0; i<4; i++) {
+        int b = Scm_GetbUnsafe(ctx->port);
+        int d = (b == EOF)? -1 : Scm_DigitToInt(b, 16, FALSE);
+        if (d < 0) parse_error(ctx, "invalid \\u escape", SCM_MAKE_INT(b));
+        r = r*16 + d;
+    }
+    return r;
+}
+
+static void unpaired_surrogate(json_parser *ctx, int c)
+{
+    char buf[40];
+    snprintf(buf, sizeof(buf), "unpaired surrogate: \\u%04x", c);
+    parse_error(ctx, buf, SCM_MAKE_INT(c));
+}
+
+/* Called after a backslash in a string. */
+static void parse_escape(json_parser *ctx, ScmDString *ds)
+{
+    int b = Scm_GetbUnsafe(ctx->port);
+    switch (b) {
+    case '"': case '\\': case '/': SCM_DSTRING_PUTB(ds, b); break;
+    case 'b': SCM_DSTRING_PUTB(ds, '\b'); break;
+    case 'f': SCM_DSTRING_PUTB(ds, '\f'); break;
+    case 'n': SCM_DSTRING_PUTB(ds, '\n'); break;
+    case 'r': SCM_DSTRING_PUTB(ds, '\r'); break;
+    case 't': SCM_DSTRING_PUTB(ds, '\t'); break;
+    case 'u': {
+        int c = read_hex4(ctx);
+        if (c >= 0xd800 && c <= 0xdbff) {
+            if (Scm_GetbUnsafe(ctx->port) != '\\'
+                || Scm_GetbUnsafe(ctx->port) != 'u') {
+                unpaired_surrogate(ctx, c);
+            }
+            int c2 = read_hex4(ctx);
+            if (c2 < 0xdc00 || c2 > 0xdfff) unpaired_surrogate(ctx, c);
+            c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+        } else if (c >= 0xdc00 && c <= 0xdfff) {
+            unpaired_surrogate(ctx, c);
+        }
+        SCM_DSTRING_PUTC(ds, Scm_UcsToChar(c));
+        break;
+    }
+    case EOF:
+        unexpected(ctx, b);
+        break;
+    default:
+        parse_error(ctx, "invalid escape sequence", SCM_MAKE_CHAR(b));
+    }
+}
+
+/* Called after the opening double quote. */
+static ScmObj parse_string(json_parser *ctx)
+{
+    ScmPort *p = ctx->port;
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+
+    for (;;) {
+        const char *v;
+        int b;
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n > 0) {
+            ScmSize i = 0;
+            while (i < n && v[i] != '"' && v[i] != '\\') i++;
+            Scm_DStringPutz(&ds, v, i);
+            if (i == n) {
+                Scm_PortCursorAdvance(p, n, TRUE);
+                continue;
+            }
+            b = (unsigned char)v[i];
+            Scm_PortCursorAdvance(p, i+1, TRUE);
+        } else {
+            /* EOF, or the port doesn't have a buffer */
+            b = Scm_GetbUnsafe(p);
+            if (b != EOF && b != '"' && b != '\\') {
+                SCM_DSTRING_PUTB(&ds, b);
+                continue;
+            }
+        }
+        if (b == '"') break;
+        if (b == EOF) unexpected(ctx, b);
+        parse_escape(ctx, &ds);
+    }
+    /* DString loses track of the length when a multibyte character is
+       split between chunks, so we let Scm_MakeString count it. */
+    ScmSmallInt size = Scm_DStringSize(&ds);
+    return Scm_MakeString(Scm_DStringGetz(&ds), size, -1, 0);
+}
+
+/* Number of decimal digits that always fit in a long */
+#define JSON_LONG_DIGITS  ((int)(sizeof(long) >= 8 ? 18 : 9))
+
+static ScmObj parse_number(json_parser *ctx)
+{
+    ScmPort *p = ctx->port;
+    ScmDString ds;
+    int neg = FALSE, exact = TRUE, ndigits = 0;
+    long iv = 0;
+
+    Scm_DStringInit(&ds);
+    int b = Scm_PeekbUnsafe(p);
+    if (b == '-' || b == '+') {
+        neg = (b == '-');
+        if (neg) SCM_DSTRING_PUTB(&ds, b);
+        (void)Scm_GetbUnsafe(p);
+        b = Scm_PeekbUnsafe(p);
+    }
+    if (!IS_DIGIT(b)) unexpected(ctx, b);
+    while (IS_DIGIT(b)) {
+        if (ndigits++ < JSON_LONG_DIGITS) iv = iv*10 + (b - '0');
+        SCM_DSTRING_PUTB(&ds, b);
+        (void)Scm_GetbUnsafe(p);
+        b = Scm_PeekbUnsafe(p);
+    }
+    if (b == '.') {
+        exact = FALSE;
+        SCM_DSTRING_PUTB(&ds, b);
+        (void)Scm_GetbUnsafe(p);
+        b = Scm_PeekbUnsafe(p);
+        if (!IS_DIGIT(b)) unexpected(ctx, b);
+        while (IS_DIGIT(b)) {
+            SCM_DSTRING_PUTB(&ds, b);
+            (void)Scm_GetbUnsafe(p);
+            b = Scm_PeekbUnsafe(p);
+        }
+    }
+    if (b == 'e' || b == 'E') {
+        exact = FALSE;
+        SCM_DSTRING_PUTB(&ds, 'e');
+        (void)Scm_GetbUnsafe(p);
+        b = Scm_PeekbUnsafe(p);
+        if (b == '-' || b == '+') {
+            SCM_DSTRING_PUTB(&ds, b);
+            (void)Scm_GetbUnsafe(p);
+            b = Scm_PeekbUnsafe(p);
+        }
+        if (!IS_DIGIT(b)) unexpected(ctx, b);
+        while (IS_DIGIT(b)) {
+            SCM_DSTRING_PUTB(&ds, b);
+            (void)Scm_GetbUnsafe(p);
+            b = Scm_PeekbUnsafe(p);
+        }
+    }
+
+    /* Integers that fit in a long are the common case. */
+    if (exact && ndigits <= JSON_LONG_DIGITS) return Scm_MakeInteger(neg? -iv : iv);
+
+    ScmObj r = Scm_StringToNumber(SCM_STRING(Scm_DStringGet(&ds, 0)), 10, 0);
+    if (!SCM_NUMBERP(r)) {
+        parse_error(ctx, "invalid number", Scm_DStringGet(&ds, 0));
+    }
+    return r;
+}
+
+/* true, false or null */
+static ScmObj parse_special(json_parser *ctx, const char *name, ScmObj sym)
+{
+    for (const char *s = name; *s; s++) {
+        int b = Scm_GetbUnsafe(ctx->port);
+        if (b != *s) unexpected(ctx, b);
+    }
+    if (SCM_FALSEP(ctx->special_handler)) return sym;
+    return Scm_ApplyRec1(ctx->special_handler, sym);
+}
+
+static void enter(json_parser *ctx)
+{
+    if (++ctx->depth > JSON_MAX_DEPTH) {
+        parse_error(ctx, "JSON nesting too deep", SCM_MAKE_INT(ctx->depth));
+    }
+}
+
+/* Called after the opening bracket. */
+static ScmObj parse_array(json_parser *ctx)
+{
+    ScmPort *p = ctx->port;
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+
+    enter(ctx);
+    if (skip_ws(p) == ']') {
+        (void)Scm_GetbUnsafe(p);
+    } else {
+        for (;;) {
+            SCM_APPEND1(h, t, parse_value(ctx));
+            int b = skip_ws(p);
+            (void)Scm_GetbUnsafe(p);
+            if (b == ']') break;
+            if (b != ',') unexpected(ctx, b);
+        }
+    }
+    ctx->depth--;
+    if (SCM_FALSEP(ctx->array_handler)) return Scm_ListToVector(h, 0, -1);
+    return Scm_ApplyRec1(ctx->array_handler, h);
+}
+
+/* Called after the opening brace. */
+static ScmObj parse_object(json_parser *ctx)
+{
+    ScmPort *p = ctx->port;
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+
+    enter(ctx);
+    if (skip_ws(p) == '}') {
+        (void)Scm_GetbUnsafe(p);
+    } else {
+        for (;;) {
+            int b = skip_ws(p);
+            if (b != '"') unexpected(ctx, b);
+            (void)Scm_GetbUnsafe(p);
+            ScmObj key = parse_string(ctx);
+            b = skip_ws(p);
+            if (b != ':') unexpected(ctx, b);
+            (void)Scm_GetbUnsafe(p);
+            ScmObj val = parse_value(ctx);
+            SCM_APPEND1(h, t, Scm_Cons(key, val));
+            b = skip_ws(p);
+            (void)Scm_GetbUnsafe(p);
+            if (b == '}') break;
+            if (b != ',') unexpected(ctx, b);
+        }
+    }
+    ctx->depth--;
+    if (SCM_FALSEP(ctx->object_handler)) return h;
+    return Scm_ApplyRec1(ctx->object_handler, h);
+}
+
+static ScmObj parse_value(json_parser *ctx)
+{
+    int b = skip_ws(ctx->port);
+    switch (b) {
+    case '{': (void)Scm_GetbUnsafe(ctx->port); return parse_object(ctx);
+    case '[': (void)Scm_GetbUnsafe(ctx->port); return parse_array(ctx);
+    case '"': (void)Scm_GetbUnsafe(ctx->port); return parse_string(ctx);
+    case 't': return parse_special(ctx, "true", sym_true);
+    case 'f': return parse_special(ctx, "false", sym_false);
+    case 'n': return parse_special(ctx, "null", sym_null);
+    case '-': case '+':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        return parse_number(ctx);
+    default:
+        unexpected(ctx, b);
+        return SCM_UNDEFINED;   /* dummy */
+    }
+}
+
+static ScmObj parse_toplevel(json_parser *ctx)
+{
+    if (skip_ws(ctx->port) == EOF) return SCM_EOF;
+    return parse_value(ctx);
+}
+
+/* Reads one JSON value from PORT.  Returns EOF if there's nothing but
+   whitespaces before EOF. */
+ScmObj Scm_JsonParse(ScmPort *port, ScmObj array_handler,
+                     ScmObj object_handler, ScmObj special_handler)
+{
+    ScmVM *vm = Scm_VM();
+    volatile ScmObj r = SCM_UNDEFINED;
+    json_parser ctx;
+    ctx.port = port;
+    ctx.array_handler = array_handler;
+    ctx.object_handler = object_handler;
+    ctx.special_handler = special_handler;
+    ctx.depth = 0;
+
+    if (PORT_LOCKED(port, vm)) {
+        r = parse_toplevel(&ctx);
+    } else {
+        PORT_LOCK(port, vm);
+        PORT_SAFE_CALL(port, r = parse_toplevel(&ctx), /*no cleanup*/);
+        PORT_UNLOCK(port);
+    }
+    return r;
+}
+
+/*==================================================================
+ * Writer
+ *
+ *   The output is accumulated in a local buffer and written to
+ *   the port in chunks.  Objects other than lists, vectors, strings,
+ *   numbers and special values are passed to the fallback procedure,
+ *   after the buffer is flushed.
+ */
+
+#define JSON_WBUF_SIZE  4096
+
+typedef struct json_writer_rec {
+    ScmPort *port;
+    ScmObj fallback;
+    int nbuf;
+    char buf[JSON_WBUF_SIZE];
+} json_writer;
+
+static void wflush(json_writer *w)
+{
+    if (w->nbuf > 0) {
+        Scm_Putz(w->buf, w->nbuf, w->port);
+        w->nbuf = 0;
+    }
+}
+
+static inline void wputb(json_writer *w, char c)
+{
+    if (w->nbuf >= JSON_WBUF_SIZE) wflush(w);
+    w->buf[w->nbuf++] = c;
+}
+
+static void wputz(json_writer *w, const char *s, ScmSize size)
+{
+    if (w->nbuf + size > JSON_WBUF_SIZE) {
+        wflush(w);
+        if (size > JSON_WBUF_SIZE) {
+            Scm_Putz(s, size, w->port);
+            return;
+        }
+    }
+    memcpy(w->buf + w->nbuf, s, size);
+    w->nbuf += size;
+}
+
+static void construct_error(json_writer *w, const char *msg, ScmObj obj)
+{
+    wflush(w);
+    SCM_BIND_PROC(construct_error_proc, "%json-construct-error", json_module);
+    Scm_ApplyRec2(construct_error_proc, obj, SCM_MAKE_STR(msg));
+    /*NOTREACHED*/
+}
+
+static void write_value(json_writer *w, ScmObj obj);
+
+static void write_ucs(json_writer *w, int code)
+{
+    char buf[8];
+    if (code >= 0x10000) {
+        code -= 0x10000;
+        write_ucs(w, 0xd800 + (code >> 10));
+        write_ucs(w, 0xdc00 + (code & 0x3ff));
+    } else {
+        snprintf(buf, sizeof(buf), "\\u%04x", code);
+        wputz(w, buf, 6);
+    }
+}
+
+/* The output only contains ASCII characters. */
+static void write_string(json_writer *w, ScmString *s)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(s);
+    if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
+        construct_error(w, "json cannot represent an incomplete string",
+                        SCM_OBJ(s));
+    }
+    const char *p = SCM_STRING_BODY_START(b);
+    const char *e = p + SCM_STRING_BODY_SIZE(b);
+
+    wputb(w, '"');
+    while (p < e) {
+        const char *q = p;
+        while (q < e && *q >= 0x20 && *q < 0x7f && *q != '"' && *q != '\\') {
+            q++;
+        }
+        wputz(w, p, q - p);
+        if (q == e) break;
+        unsigned char c = *q;
+        p = q + 1;
+        switch (c) {
+        case '"':  wputz(w, "\\\"", 2); break;
+        case '\\': wputz(w, "\\\\", 2); break;
+        case '\b': wputz(w, "\\b", 2); break;
+        case '\f': wputz(w, "\\f", 2); break;
+        case '\n': wputz(w, "\\n", 2); break;
+        case '\r': wputz(w, "\\r", 2); break;
+        case '\t': wputz(w, "\\t", 2); break;
+        default:
+            if (c < 0x80) {
+                write_ucs(w, c);
+            } else {
+                ScmChar ch;
+                SCM_CHAR_GET(q, ch);
+                p = q + SCM_CHAR_NFOLLOWS(c) + 1;
+                write_ucs(w, Scm_CharToUcs(ch));
+            }
+        }
+    }
+    wputb(w, '"');
+}
+
+static void write_number(json_writer *w, ScmObj num)
+{
+    if (SCM_INTP(num)) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "%ld", SCM_INT_VALUE(num));
+        wputz(w, buf, n);
+        return;
+    }
+    if (!SCM_REALP(num) || !Scm_FiniteP(num)) {
+        construct_error(w, "json cannot represent a number", num);
+    }
+    if (SCM_RATNUMP(num)) num = Scm_MakeFlonum(Scm_GetDouble(num));
+    ScmSmallInt size;
+    const char *s =
+        Scm_GetStringContent(SCM_STRING(Scm_NumberToString(num, 10, 0)),
+                             &size, NULL, NULL);
+    wputz(w, s, size);
+}
+
+static void write_object(json_writer *w, ScmObj alist)
+{
+    ScmObj cp;
+    int first = TRUE;
+
+    wputb(w, '{');
+    SCM_FOR_EACH(cp, alist) {
+        ScmObj attr = SCM_CAR(cp);
+        if (!SCM_PAIRP(attr)) {
+            construct_error(w, "construct-json needs an assoc list or "
+                            "dictionary, but got:", alist);
+        }
+        if (!first) wputb(w, ',');
+        first = FALSE;
+
+        ScmObj key = SCM_CAR(attr);
+        if (SCM_SYMBOLP(key)) {
+            key = SCM_OBJ(SCM_SYMBOL_NAME(key));
+        } else if (!SCM_STRINGP(key)) {
+            SCM_BIND_PROC(x_to_string_proc, "x->string", Scm_GaucheModule());
+            key = Scm_ApplyRec1(x_to_string_proc, key);
+            if (!SCM_STRINGP(key)) {
+                construct_error(w, "invalid object key", SCM_CAR(attr));
+            }
+        }
+        write_string(w, SCM_STRING(key));
+        wputb(w, ':');
+        write_value(w, SCM_CDR(attr));
+    }
+    wputb(w, '}');
+}
+
+static void write_array(json_writer *w, ScmVector *v)
+{
+    ScmSmallInt len = SCM_VECTOR_SIZE(v);
+    wputb(w, '[');
+    for (ScmSmallInt i=0; i<len; i++) {
+        if (i > 0) wputb(w, ',');
+        write_value(w, SCM_VECTOR_ELEMENT(v, i));
+    }
+    wputb(w, ']');
+}
+
+static void write_value(json_writer *w, ScmObj obj)
+{
+    if (SCM_FALSEP(obj) || SCM_EQ(obj, sym_false)) {
+        wputz(w, "false", 5);
+    } else if (SCM_TRUEP(obj) || SCM_EQ(obj, sym_true)) {
+        wputz(w, "true", 4);
+    } else if (SCM_EQ(obj, sym_null)) {
+        wputz(w, "null", 4);
+    } else if (SCM_NULLP(obj) || (SCM_PAIRP(obj) && Scm_Length(obj) >= 0)) {
+        write_object(w, obj);
+    } else if (SCM_STRINGP(obj)) {
+        write_string(w, SCM_STRING(obj));
+    } else if (SCM_NUMBERP(obj)) {
+        write_number(w, obj);
+    } else if (SCM_VECTORP(obj)) {
+        write_array(w, SCM_VECTOR(obj));
+    } else {
+        wflush(w);
+        Scm_ApplyRec2(w->fallback, obj, SCM_OBJ(w->port));
+    }
+}
+
+void Scm_JsonWrite(ScmObj obj, ScmPort *port, ScmObj fallback)
+{
+    json_writer w;
+    w.port = port;
+    w.fallback = fallback;
+    w.nbuf = 0;
+    write_value(&w, obj);
+    wflush(&w);
+}
+
+/*==================================================================
+ * Initialization
+ */
+
+extern void Scm_Init_jsonlib(ScmModule *mod);
+
+SCM_EXTENSION_ENTRY void Scm_Init_rfc__json(void)
+{
+    SCM_INIT_EXTENSION(rfc__json);
+    json_module = SCM_FIND_MODULE("rfc.json", SCM_FIND_MODULE_CREATE);
+    sym_true  = SCM_INTERN("true");
+    sym_false = SCM_INTERN("false");
+    sym_null  = SCM_INTERN("null");
+    Scm_Init_jsonlib(json_module);
+}
@@ -0,0 +1,147 @@
+;;;
+;;; json.scm - JSON (RFC7159) Parser
+;;;
+;;;   Copyright (c) 2006 Rui Ueyama (rui314@gmail.com)
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;;; http://www.ietf.org/rfc/rfc7159.txt
+
+;; The parser and the writer are implemented in C (json.c).  The original
+;; parser built on parser.peg is in rfc/json/peg.scm.
+
+(define-module rfc.json
+  (use gauche.parameter)
+  (use gauche.sequence)
+  (export <json-parse-error> <json-construct-error>
+          parse-json parse-json-string
+          parse-json* port->json-generator
+          construct-json construct-json-string
+
+          json-array-handler json-object-handler json-special-handler
+
+          json-parser                   ;experimental
+          ))
+(select-module rfc.json)
+
+(dynamic-load "rfc--json")
+
+(autoload rfc.json.peg json-parser)
+
+(define-condition-type <json-parse-error> <error> #f
+  (position)                            ;stream position
+  (objects))                            ;offending object(s) or messages
+
+(define-condition-type <json-construct-error> <error> #f
+  (object))                             ;offending object
+
+(define json-array-handler   (make-parameter list->vector))
+(define json-object-handler  (make-parameter identity))
+(define json-special-handler (make-parameter identity))
+
+;; Called from the C routines
+(define (%json-parse-error pos obj msg)
+  (error <json-parse-error> :position pos :objects obj msg))
+(define (%json-construct-error obj msg)
+  (error <json-construct-error> :object obj msg obj))
+
+;;;============================================================
+;;; Parser
+;;;
+
+;; The native parser uses its built-in representation when a handler
+;; has the default value, saving a call.
+(define (parse-json :optional (port (current-input-port)))
+  (let ([ah (json-array-handler)]
+        [oh (json-object-handler)]
+        [sh (json-special-handler)])
+    (%parse-json port
+                 (and (not (eq? ah list->vector)) ah)
+                 (and (not (eq? oh identity)) oh)
+                 (and (not (eq? sh identity)) sh))))
+
+(define (parse-json-string str)
+  (call-with-input-string str (cut parse-json <>)))
+
+(define (parse-json* :optional (port (current-input-port)))
+  (let loop ([r '()])
+    (let1 v (parse-json port)
+      (if (eof-object? v)
+        (reverse! r)
+        (loop (cons v r))))))
+
+;; Returns a generator that reads JSON values from PORT one at a time.
+(define (port->json-generator :optional (port (current-input-port)))
+  (^[] (parse-json port)))
+
+;;;============================================================
+;;; Writer
+;;;
+
+;; The native writer handles lists, vectors, strings, numbers and
+;; special values by itself, and calls this for other objects.
+(define (print-fallback obj port)
+  (cond [(is-a? obj <dictionary>) (print-object obj port)]
+        [(is-a? obj <sequence>)   (print-array obj port)]
+        [else (error <json-construct-error> :object obj
+                     "can't convert Scheme object to json:" obj)]))
+
+(define (print-object obj port)
+  (display "{" port)
+  (fold (^[attr comma]
+          (unless (pair? attr)
+            (error <json-construct-error> :object obj
+                   "construct-json needs an assoc list or dictionary, \
+                    but got:" obj))
+          (display comma port)
+          (%write-json (x->string (car attr)) port print-fallback)
+          (display ":" port)
+          (%write-json (cdr attr) port print-fallback)
+          ",")
+        "" obj)
+  (display "}" port))
+
+(define (print-array obj port)
+  (display "[" port)
+  (for-each-with-index (^[i val]
+                         (unless (zero? i) (display "," port))
+                         (%write-json val port print-fallback))
+                       obj)
+  (display "]" port))
+
+(define (construct-json x :optional (oport (current-output-port)))
+  (cond [(or (list? x) (is-a? x <dictionary>)
+             (and (is-a? x <sequence>) (not (string? x))))
+         (%write-json x oport print-fallback)]
+        [else (error <json-construct-error> :object x
+                     "construct-json expects a list or a vector, \
+                      but got" x)]))
+
+(define (construct-json-string x)
+  (call-with-output-string (cut construct-json x <>)))
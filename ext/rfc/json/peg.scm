@@ -1,5 +1,5 @@
 ;;;
-;;; json.scm - JSON (RFC7159) Parser
+;;; rfc.json.peg - JSON parser built on parser.peg
 ;;;
 ;;;   Copyright (c) 2006 Rui Ueyama (rui314@gmail.com)
 ;;;
@@ -37,38 +37,16 @@
 ;; fixed.  Hence do not take this code as an example of parser.peg;
 ;; this will likely to be rewritten once parser.peg's API is changed.
 
-(define-module rfc.json
-  (use gauche.parameter)
-  (use gauche.sequence)
-  (use gauche.generator)
+;; This is the original parser of rfc.json.  rfc.json now uses the native
+;; parser, and autoloads this module only for the experimental json-parser.
+
+(define-module rfc.json.peg
   (use parser.peg)
+  (use rfc.json)
   (use gauche.unicode)
-  (use srfi-13)
   (use srfi-14)
-  (use srfi-43)
-  (export <json-parse-error> <json-construct-error>
-          parse-json parse-json-string
-          parse-json*
-          construct-json construct-json-string
-
-          json-array-handler json-object-handler json-special-handler
-
-          json-parser                   ;experimental
-          ))
-(select-module rfc.json)
-
-;; NB: We have <json-parse-error> independent from <parse-error> for
-;; now, since parser.peg's interface may be changed later.
-(define-condition-type <json-parse-error> <error> #f
-  (position)                            ;stream position
-  (objects))                            ;offending object(s) or messages
-
-(define-condition-type <json-construct-error> <error> #f
-  (object))                             ;offending object
-
-(define json-array-handler   (make-parameter list->vector))
-(define json-object-handler  (make-parameter identity))
-(define json-special-handler (make-parameter identity))
+  (export json-parser))
+(select-module rfc.json.peg)
 
 (define (build-array elts) ((json-array-handler) elts))
 (define (build-object pairs) ((json-object-handler) pairs))
@@ -176,102 +154,3 @@
               %end-object)))
 
 (define json-parser ($seq %ws ($or eof %value)))
-
-;; entry point
-(define (parse-json :optional (port (current-input-port)))
-  (guard (e [(<parse-error> e)
-             ;; not to expose parser.peg's <parse-error>.
-             (error <json-parse-error>
-                    :position (~ e'position) :objects (~ e'objects)
-                    :message (~ e'message))])
-    (peg-parse-port json-parser port)))
-
-(define (parse-json-string str)
-  (call-with-input-string str (cut parse-json <>)))
-
-(define (parse-json* :optional (port (current-input-port)))
-  (guard (e [(<parse-error> e)
-             ;; not to expose parser.peg's <parse-error>.
-             (error <json-parse-error>
-                    :position (~ e'position) :objects (~ e'objects)
-                    :message (~ e'message))])
-    (generator->list (peg-parser->generator json-parser port))))
-
-;;;============================================================
-;;; Writer
-;;;
-
-(define (print-value obj)
-  (cond [(or (eq? obj 'false) (eq? obj #f)) (display "false")]
-        [(or (eq? obj 'true) (eq? obj #t))  (display "true")]
-        [(eq? obj 'null)  (display "null")]
-        [(list? obj)      (print-object obj)]
-        [(string? obj)    (print-string obj)]
-        [(number? obj)    (print-number obj)]
-        [(is-a? obj <dictionary>) (print-object obj)]
-        [(is-a? obj <sequence>)   (print-array obj)]
-        [else (error <json-construct-error> :object obj
-                     "can't convert Scheme object to json:" obj)]))
-
-(define (print-object obj)
-  (display "{")
-  (fold (^[attr comma]
-          (unless (pair? attr)
-            (error <json-construct-error> :object obj
-                   "construct-json needs an assoc list or dictionary, \
-                    but got:" obj))
-          (display comma)
-          (print-string (x->string (car attr)))
-          (display ":")
-          (print-value (cdr attr))
-          ",")
-        "" obj)
-  (display "}"))
-
-(define (print-array obj)
-  (display "[")
-  (for-each-with-index (^[i val]
-                         (unless (zero? i) (display ","))
-                         (print-value val))
-                       obj)
-  (display "]"))
-
-(define (print-number num)
-  (cond [(or (not (real? num)) (not (finite? num)))
-         (error <json-construct-error> :object num
-                "json cannot represent a number" num)]
-        [(and (rational? num) (not (integer? num)))
-         (write (exact->inexact num))]
-        [else (write num)]))
-
-(define (print-string str)
-  (define specials
-    '((#\" . #\") (#\\ . #\\) (#\x08 . #\b) (#\page . #\f)
-      (#\newline . #\n) (#\return . #\r) (#\tab . #\t)))
-  (define (hexescape code) (format #t "\\u~4,'0x" code))
-  (define (print-char c)
-    (cond [(assv c specials) => (^p (write-char #\\) (write-char (cdr p)))]
-          [(and (char-set-contains? char-set:ascii c)
-                (not (eq? (char-general-category c) 'Cc)))
-           (write-char c)]
-          [else
-           (let1 code (char->ucs c)
-             (if (>= code #x10000)
-               (for-each hexescape (ucs4->utf16 code))
-               (hexescape code)))]))
-  (display "\"")
-  (string-for-each print-char str)
-  (display "\""))
-
-(define (construct-json x :optional (oport (current-output-port)))
-  (with-output-to-port oport
-    (^()
-      (cond [(or (list? x) (is-a? x <dictionary>)) (print-object x)]
-            [(and (is-a? x <sequence>) (not (string? x))) (print-array x)]
-            [else (error <json-construct-error> :object x
-                         "construct-json expects a list or a vector, \
-                          but got" x)]))))
-
-(define (construct-json-string x)
-  (call-with-output-string (cut construct-json x <>)))
-
@@ -0,0 +1,368 @@
+/*
+ * csv.c - CSV scanner
+ *
+ *   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <gauche/bits_inline.h>
+#include <gauche/priv/portP.h>
+
+#include "text-csv.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * The scanner works on bytes in the port's buffer (see
+ * Scm_PortCursorView).  The separator and the quote character must be
+ * ASCII, and the native encoding must not let ASCII bytes appear in
+ * the middle of a multibyte character, so that we can look for them
+ * without decoding.  That's true for utf-8, euc-jp and none, but not
+ * for sjis.
+ *
+ * The semantics is the same as the Scheme version in csv.scm:
+ *
+ *  - Whitespaces at the beginning of each field are skipped.
+ *  - An unquoted field runs up to the separator or a newline, with
+ *    the trailing whitespaces removed.
+ *  - In a quoted field, two quote characters stand for one quote
+ *    character.  The characters after the closing quote up to the
+ *    separator or a newline are ignored.
+ */
+
+int Scm_CsvScannableP(ScmChar sep, ScmChar quo)
+{
+#if defined(GAUCHE_CHAR_ENCODING_SJIS)
+    return FALSE;
+#else
+    return (SCM_CHAR_ASCII_P(sep) && SCM_CHAR_ASCII_P(quo)
+            && sep != '\n' && quo != '\n' && sep != quo);
+#endif
+}
+
+static inline int csv_space_p(ScmChar c)
+{
+    return (SCM_CHAR_ASCII_P(c) && isspace(c)) || SCM_CHAR_EXTRA_WHITESPACE(c);
+}
+
+/* Returns the index of the first occurrence of A or B in V[0..N),
+   or N if there's none. */
+static inline ScmSize find2(const char *v, ScmSize n, char a, char b)
+{
+    ScmSize i = 0;
+#if defined(__SSE2__)
+    __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+        u_long m = (u_long)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va),
+                                                         _mm_cmpeq_epi8(x, vb)));
+        if (m) return i + Scm__LowestBitNumber(m);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint8x8_t va = vdup_n_u8((uint8_t)a), vb = vdup_n_u8((uint8_t)b);
+    for (; i + 8 <= n; i += 8) {
+        uint8x8_t x = vld1_u8((const uint8_t*)(v + i));
+        uint8x8_t e = vorr_u8(vceq_u8(x, va), vceq_u8(x, vb));
+        u_long m = (u_long)(vget_lane_u64(vreinterpret_u64_u8(e), 0)
+                            & 0x8080808080808080UL);
+        if (m) return i + (Scm__LowestBitNumber(m) >> 3);
+    }
+#endif
+    for (; i < n; i++) {
+        if (v[i] == a || v[i] == b) return i;
+    }
+    return n;
+}
+
+/* Returns the size of S[0..SIZE) without trailing whitespaces. */
+static ScmSize trim_right(const char *s, ScmSize size)
+{
+    ScmSize e = size;
+    while (e > 0 && (unsigned char)s[e-1] < 0x80 && isspace((unsigned char)s[e-1])) {
+        e--;
+    }
+    if (e == 0 || (unsigned char)s[e-1] < 0x80) return e;
+
+    /* The field ends with a non-ASCII character.  We can't decode
+       multibyte characters backwards, so scan it from the beginning. */
+    ScmSize i = 0, last = 0;
+    while (i < e) {
+        int nb = SCM_CHAR_NFOLLOWS(s[i]) + 1;
+        ScmChar c;
+        if (i + nb > e) return e; /* incomplete character; leave it */
+        SCM_CHAR_GET(s + i, c);
+        i += nb;
+        if (!csv_space_p(c)) last = i;
+    }
+    return last;
+}
+
+typedef struct csv_scanner_rec {
+    ScmPort *port;
+    char sep;
+    char quo;
+    ScmObj columns;             /* #f or a vector of indexes */
+    int index;                  /* index of the current field */
+    ScmObj head, tail;          /* fields read so far, if columns is #f */
+    ScmObj *slots;              /* selected fields, if columns is a vector */
+} csv_scanner;
+
+static int want_field(csv_scanner *s)
+{
+    if (SCM_FALSEP(s->columns)) return TRUE;
+    ScmSmallInt k = SCM_VECTOR_SIZE(s->columns);
+    for (ScmSmallInt j = 0; j < k; j++) {
+        if (SCM_INT_VALUE(SCM_VECTOR_ELEMENT(s->columns, j)) == s->index) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void push_field(csv_scanner *s, ScmObj field)
+{
+    if (SCM_FALSEP(s->columns)) {
+        SCM_APPEND1(s->head, s->tail, field);
+    } else if (!SCM_FALSEP(field)) {
+        ScmSmallInt k = SCM_VECTOR_SIZE(s->columns);
+        for (ScmSmallInt j = 0; j < k; j++) {
+            if (SCM_INT_VALUE(SCM_VECTOR_ELEMENT(s->columns, j)) == s->index) {
+                s->slots[j] = field;
+            }
+        }
+    }
+    s->index++;
+}
+
+static ScmObj make_field(const char *str, ScmSize size, int flags)
+{
+    return Scm_MakeString(str, trim_right(str, size), -1, flags);
+}
+
+/* Reads up to the separator or a newline, and consumes it.  Stores the
+   delimiter (or EOF) in *DELIM.  If WANT is true, returns the bytes read
+   as a string with the trailing whitespaces removed; otherwise returns #f.
+   In the common case the field lies in a single buffer view, and we make
+   the string directly from it. */
+static ScmObj scan_unquoted(csv_scanner *s, int want, int *delim)
+{
+    ScmPort *p = s->port;
+    ScmDString ds;
+    int use_ds = FALSE;
+
+    for (;;) {
+        const char *v;
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n == 0) {
+            *delim = EOF;
+            break;
+        }
+        if (n < 0) {
+            int b = Scm_GetbUnsafe(p);
+            if (b == EOF || b == s->sep || b == '\n') {
+                *delim = b;
+                break;
+            }
+            if (want) {
+                if (!use_ds) { Scm_DStringInit(&ds); use_ds = TRUE; }
+                SCM_DSTRING_PUTB(&ds, b);
+            }
+            continue;
+        }
+        ScmSize i = find2(v, n, s->sep, '\n');
+        if (i < n) {
+            ScmObj r = SCM_FALSE;
+            *delim = (unsigned char)v[i];
+            if (want) {
+                if (use_ds) {
+                    Scm_DStringPutz(&ds, v, i);
+                } else {
+                    /* Make the string before advancing the cursor,
+                       for the view may be in the scratch buffer. */
+                    r = make_field(v, i, SCM_STRING_COPYING);
+                }
+            }
+            Scm_PortCursorAdvance(p, i+1, TRUE);
+            if (want && use_ds) break;
+            return r;
+        }
+        if (want) {
+            if (!use_ds) { Scm_DStringInit(&ds); use_ds = TRUE; }
+            Scm_DStringPutz(&ds, v, n);
+        }
+        Scm_PortCursorAdvance(p, n, TRUE);
+    }
+
+    if (!want) return SCM_FALSE;
+    if (!use_ds) return SCM_MAKE_STR("");
+    /* NB: We can't use Scm_DStringGet, for a multibyte character may
+       have been split between the chunks. */
+    ScmSize size = Scm_DStringSize(&ds);
+    return make_field(Scm_DStringGetz(&ds), size, 0);
+}
+
+/* Called after the opening quote. */
+static ScmObj scan_quoted(csv_scanner *s, int want)
+{
+    ScmPort *p = s->port;
+    ScmDString ds;
+    Scm_DStringInit(&ds);
+
+    for (;;) {
+        const char *v;
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n == 0) Scm_Error("unterminated quoted field");
+        if (n < 0) {
+            int b = Scm_GetbUnsafe(p);
+            if (b == EOF) Scm_Error("unterminated quoted field");
+            if (b != s->quo) {
+                if (want) SCM_DSTRING_PUTB(&ds, b);
+                continue;
+            }
+        } else {
+            const char *q = memchr(v, s->quo, n);
+            ScmSize i = q ? q - v : n;
+            if (want) Scm_DStringPutz(&ds, v, i);
+            if (q == NULL) {
+                Scm_PortCursorAdvance(p, n, TRUE);
+                continue;
+            }
+            Scm_PortCursorAdvance(p, i+1, TRUE);
+        }
+        /* We've seen a quote.  A doubled one stands for itself. */
+        if (Scm_PeekbUnsafe(p) != s->quo) break;
+        (void)Scm_GetbUnsafe(p);
+        if (want) SCM_DSTRING_PUTB(&ds, s->quo);
+    }
+
+    if (!want) return SCM_FALSE;
+    ScmSize size = Scm_DStringSize(&ds);
+    return Scm_MakeString(Scm_DStringGetz(&ds), size, -1, 0);
+}
+
+static ScmObj read_record(csv_scanner *s)
+{
+    ScmPort *p = s->port;
+    int delim;
+
+    if (Scm_PeekbUnsafe(p) == EOF) return SCM_EOF;
+
+    for (;;) {
+        int b = Scm_PeekbUnsafe(p);
+        if (b == EOF || b == '\n') {
+            if (b == '\n') (void)Scm_GetbUnsafe(p);
+            push_field(s, SCM_MAKE_STR(""));
+            break;
+        }
+        if (b == s->sep) {
+            (void)Scm_GetbUnsafe(p);
+            push_field(s, SCM_MAKE_STR(""));
+            continue;
+        }
+        if (b == s->quo) {
+            (void)Scm_GetbUnsafe(p);
+            push_field(s, scan_quoted(s, want_field(s)));
+            (void)scan_unquoted(s, FALSE, &delim);
+        } else if ((b < 0x80)? isspace(b) : csv_space_p(Scm_PeekcUnsafe(p))) {
+            (void)Scm_GetcUnsafe(p);
+            continue;
+        } else {
+            push_field(s, scan_unquoted(s, want_field(s), &delim));
+        }
+        if (delim != s->sep) break;
+    }
+
+    if (SCM_FALSEP(s->columns)) return s->head;
+    return Scm_ArrayToList(s->slots, SCM_VECTOR_SIZE(s->columns));
+}
+
+ScmObj Scm_CsvReadRecord(ScmPort *port, ScmChar sep, ScmChar quo,
+                         ScmObj columns)
+{
+    if (!Scm_CsvScannableP(sep, quo)) {
+        Scm_Error("separator and quote character not supported by "
+                  "the native scanner: %C, %C", sep, quo);
+    }
+
+    csv_scanner s;
+    s.port = port;
+    s.sep = (char)sep;
+    s.quo = (char)quo;
+    s.columns = columns;
+    s.index = 0;
+    s.head = s.tail = SCM_NIL;
+    s.slots = NULL;
+    if (SCM_VECTORP(columns)) {
+        ScmSmallInt k = SCM_VECTOR_SIZE(columns);
+        s.slots = SCM_NEW_ARRAY(ScmObj, k);
+        for (ScmSmallInt j = 0; j < k; j++) {
+            ScmObj c = SCM_VECTOR_ELEMENT(columns, j);
+            if (!SCM_INTP(c) || SCM_INT_VALUE(c) < 0) {
+                Scm_Error("column index must be a nonnegative fixnum, "
+                          "but got: %S", c);
+            }
+            /* Missing columns in short records are empty strings. */
+            s.slots[j] = SCM_MAKE_STR("");
+        }
+    } else if (!SCM_FALSEP(columns)) {
+        Scm_Error("vector of column indexes or #f required, but got: %S",
+                  columns);
+    }
+
+    ScmVM *vm = Scm_VM();
+    volatile ScmObj r = SCM_UNDEFINED;
+    if (PORT_LOCKED(port, vm)) {
+        r = read_record(&s);
+    } else {
+        PORT_LOCK(port, vm);
+        PORT_SAFE_CALL(port, r = read_record(&s), /*no cleanup*/);
+        PORT_UNLOCK(port);
+    }
+    return r;
+}
+
+/*
+ * Initialization
+ */
+
+extern void Scm_Init_csvlib(ScmModule *mod);
+
+SCM_EXTENSION_ENTRY void Scm_Init_text__csv(void)
+{
+    SCM_INIT_EXTENSION(text__csv);
+    Scm_Init_csvlib(SCM_FIND_MODULE("text.csv", SCM_FIND_MODULE_CREATE));
+}
@@ -39,6 +39,8 @@
   (use srfi-42)
   (use gauche.sequence)
   (export make-csv-reader
+          port->csv-generator
+          port->csv-lseq
           make-csv-writer
           make-csv-header-parser
           make-csv-record-parser
@@ -46,16 +48,65 @@
   )
 (select-module text.csv)
 
+(dynamic-load "text--csv")
+
 ;;;
 ;;;Low-level API - convert text into nested lists
 ;;;
 
+;; The records are read by the native scanner (csv.c) if it can handle
+;; the separator and the quote character; that is, both are ASCII and the
+;; native encoding isn't sjis.  Otherwise we use csv-reader below.
+
 ;; API
 (define (make-csv-reader separator :optional (quote-char #\"))
-  (^[:optional (port (current-input-port))]
-    (csv-reader separator quote-char port)))
+  (if (%csv-scannable? separator quote-char)
+    (^[:optional (port (current-input-port))]
+      (%read-csv-record port separator quote-char #f))
+    (^[:optional (port (current-input-port))]
+      (csv-reader separator quote-char port))))
+
+;; API
+;; Returns a generator that reads a record from PORT each time it is
+;; called.  If COLUMNS is given, it must be a list of column indexes,
+;; and each record only contains those columns in the given order.
+;; A column beyond the end of a record is an empty string.
+(define (port->csv-generator port :key (separator #\,) (quote-char #\")
+                                       (columns #f))
+  (let1 cols (and columns (%columns->vector columns))
+    (if (%csv-scannable? separator quote-char)
+      (^[] (%read-csv-record port separator quote-char cols))
+      (^[] (let1 r (csv-reader separator quote-char port)
+             (if (or (eof-object? r) (not cols))
+               r
+               (%project-columns r cols)))))))
+
+;; API
+(define (port->csv-lseq port . args)
+  (generator->lseq (apply port->csv-generator port args)))
 
+(define (%columns->vector columns)
+  (unless (and (list? columns)
+               (every (^i (and (exact-integer? i) (>= i 0))) columns))
+    (error "columns must be a list of nonnegative exact integers, but got:"
+           columns))
+  (list->vector columns))
+
+(define (%project-columns record cols)
+  (let* ([v (list->vector record)]
+         [len (vector-length v)])
+    (map (^i (if (< i len) (vector-ref v i) "")) (vector->list cols))))
+
+(define %read-string-until (with-module gauche.internal %read-string-until))
+
+;; The Scheme version of the reader, used when the native scanner
+;; can't handle the delimiters.  The fields are scanned in bulk by
+;; %read-string-until, which searches the delimiters directly in the
+;; port's buffer.
 (define (csv-reader sep quo port)
+  (define unquoted-delims (string sep #\newline))
+  (define quoted-delims (string quo))
+
   (define (eor? ch) (or (eqv? ch #\newline) (eof-object? ch)))
 
   (define (start fields)
@@ -64,26 +115,29 @@
             [(eqv? ch sep) (start (cons "" fields))]
             [(eqv? ch quo) (quoted fields)]
             [(char-whitespace? ch) (start fields)]
-            [else (unquoted (list ch) fields)])))
-
-  (define (unquoted chs fields)
-    (let loop ([ch (read-char port)] [last chs] [chs chs])
-      (cond [(eor? ch) (reverse! (cons (finish last) fields))]
-            [(eqv? ch sep) (start (cons (finish last) fields))]
-            [(char-whitespace? ch) (loop (read-char port) last (cons ch chs))]
-            [else (let1 chs (cons ch chs)
-                    (loop (read-char port) chs chs))])))
+            [else (unquoted ch fields)])))
 
-  (define (finish rchrs) (list->string (reverse! rchrs)))
+  ;; Trailing whitespaces are dropped.
+  (define (unquoted ch0 fields)
+    (let* ([s (%read-string-until port unquoted-delims)]
+           [field (string-trim-right
+                   (if (eof-object? s) (string ch0) (string-append (string ch0) s)))]
+           [ch (read-char port)])
+      (if (eor? ch)
+        (reverse! (cons field fields))
+        (start (cons field fields)))))
 
   (define (quoted fields)
-    (let loop ([ch (read-char port)] [chs '()])
-      (cond [(eof-object? ch) (error "unterminated quoted field")]
-            [(eqv? ch quo)
-             (if (eqv? (peek-char port) quo)
-               (begin (read-char port) (loop (read-char port) (cons quo chs)))
-               (quoted-tail (cons (finish chs) fields)))]
-            [else (loop (read-char port) (cons ch chs))])))
+    (let loop ([segs '()])
+      (let* ([s (%read-string-until port quoted-delims)]
+             [ch (read-char port)])
+        (cond [(eof-object? ch) (error "unterminated quoted field")]
+              [(eqv? (peek-char port) quo)
+               (read-char port)
+               (loop (list* quoted-delims s segs))]
+              [else
+               (quoted-tail
+                (cons (apply string-append (reverse! (cons s segs))) fields))]))))
 
   (define (quoted-tail fields)
     (let loop ([ch (read-char port)])
@@ -0,0 +1,204 @@
+;;
+;; testing text.csv
+;;
+
+(use gauche.test)
+(test-start "text.csv")
+
+(use text.csv)
+(use gauche.generator)
+(test-module 'text.csv)
+
+
+(test* "csv-reader" '("abc" "def" "" "ghi")
+       (call-with-input-string "abc  ,  def  ,, ghi  "
+         (make-csv-reader #\,)))
+
+(test* "csv-reader" '("abc" "def" "" ", ghi")
+       (call-with-input-string "abc  :  def  :: , ghi  "
+         (make-csv-reader #\:)))
+
+(test* "csv-reader" '("abc" "def" "ghi")
+       (call-with-input-string "abc  ,  \"def\"  , \"ghi\"  "
+         (make-csv-reader #\,)))
+
+(test* "csv-reader" '("abc" " de,f " "gh\ni" "jkl")
+       (call-with-input-string "   abc,  \" de,f \"  , \"gh\ni\", \"jkl\""
+         (make-csv-reader #\,)))
+
+(test* "csv-reader" '("ab\nc" "de \n\n \nf " "" "" "gh\"\n\"i")
+       (call-with-input-string "   \"ab\nc\" ,  \"de \n\n \nf \"  ,  , \"\" , \"gh\"\"\n\"\"i\""
+         (make-csv-reader #\,)))
+
+(test* "csv-reader" '(("" "") ("a" "") ("" "b"))
+       (let1 r (make-csv-reader #\,)
+         (call-with-input-string ",\na,  \n  ,b"
+           (^p (let* ([a (r p)] [b (r p)] [c (r p)] [d (r p)])
+                 (and (eof-object? d)
+                      (list a b c)))))))
+
+(test* "csv-reader" (test-error)
+       (call-with-input-string " abc,  def , \"ghi\"\"\n\n"
+         (make-csv-reader #\,)))
+
+(test* "csv-reader" #t
+       (eof-object?
+        (call-with-input-string "" (make-csv-reader #\,))))
+
+(test* "csv-reader (multibyte separator)" '("\u3042" "b c" "\"d\u3001\"")
+       (call-with-input-string "\u3042\u3001 b c \u3001\"\"\"d\u3001\"\"\"\n"
+         (make-csv-reader #\u3001)))
+
+(test* "csv-reader (file)" '(("a" "b\nc") ("d" "e"))
+       (begin
+         (with-output-to-file "test.o"
+           (cut display "a, \"b\nc\"\r\nd,e  \n"))
+         (let1 r (make-csv-reader #\,)
+           (begin0 (call-with-input-file "test.o"
+                     (^p (let* ([a (r p)] [b (r p)] [c (r p)])
+                           (and (eof-object? c) (list a b)))))
+             (sys-unlink "test.o")))))
+
+(test* "csv-writer"
+       "abc,def,123,\"what's up?\",\"he said, \"\"nothing new.\"\"\"\n"
+       (call-with-output-string
+         (lambda (out)
+           ((make-csv-writer #\,)
+            out
+            '("abc" "def" "123" "what's up?" "he said, \"nothing new.\""))))
+       )
+
+(test* "csv-writer"
+       "abc,def,123,\"what's up?\",\"he said, \"\"nothing new.\"\"\"\r\n"
+       (call-with-output-string
+         (lambda (out)
+           ((make-csv-writer #\, "\r\n")
+            out
+            '("abc" "def" "123" "what's up?" "he said, \"nothing new.\""))))
+       )
+
+(test* "csv-writer" "\n"
+       (call-with-output-string
+         (lambda (out)
+           ((make-csv-writer #\,) out '()))))
+
+;; middle-level API
+
+(let ([data '(("" "" "" "" "" "" "" "" "")
+              ("Exported data" "" "" "" "" "" "" "" "")
+              ("" "" "" "" "" "" "" "" "")
+              ("" "" "Year" "Country" "" "Population" "GDP" "" "Note")
+              ("" "" "1958" "Land of Lisp" "" "39994" "551,435,453" "" "")
+              ("" "" "1957" "United States of Formula Translators" "" "115333"
+               "4,343,225,434" "" "Estimated")
+              ("" "" "1959" "People's Republic of COBOL" ""
+               "82524" "3,357,551,143" "" "")
+              ("" "" "1970" "Kingdom of Pascal" "" "3785" "" "" "GDP missing")
+              ("" "" "" "" "" "" "" "" "")
+              ("" "" "1962" "APL Republic" "" "1545" "342,335,151" "" ""))]
+      [header-slots1  '("Country" "Year" "GDP" "Population")]
+      [header-slots2 '(#/country/i #/year/i #/gdp/i #/popu/i)])
+  (test* "make-csv-header-parser (strings)" '#(3 2 6 5)
+         (any (make-csv-header-parser header-slots1) data))
+
+  (test* "make-csv-header-parser (regexps)" '#(3 2 6 5)
+         (any (make-csv-header-parser header-slots2) data))
+  
+  (test* "make-csv-record-parser (strings)"
+         '(("Land of Lisp" "1958" "551,435,453" "39994")
+           ("United States of Formula Translators" "1957" "4,343,225,434"
+            "115333")
+           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
+           ("APL Republic" "1962" "342,335,151" "1545"))
+         (filter-map (make-csv-record-parser header-slots1 '#(3 2 6 5)
+                                             '(("Year" #/^\d+$/)
+                                               "Country" "Population" "GDP"))
+                     data))
+
+  (test* "make-csv-record-parser (regexps)"
+         '(("Land of Lisp" "1958" "551,435,453" "39994")
+           ("United States of Formula Translators" "1957" "4,343,225,434"
+            "115333")
+           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
+           ("APL Republic" "1962" "342,335,151" "1545"))
+         (filter-map (make-csv-record-parser header-slots2 '#(3 2 6 5)
+                                             '((#/year/i #/^\d+$/)
+                                               #/country/i #/popu/i #/gdp/i))
+                     data))
+  
+  (test* "csv-rows->tuples (allow-gap? #f)"
+         '(("Land of Lisp" "1958" "551,435,453" "39994")
+           ("United States of Formula Translators" "1957" "4,343,225,434"
+            "115333")
+           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
+           ("Kingdom of Pascal" "1970" "" "3785"))
+         (csv-rows->tuples data header-slots1))
+
+  (test* "csv-rows->tuples (allow-gap? #t)"
+         '(("Land of Lisp" "1958" "551,435,453" "39994")
+           ("United States of Formula Translators" "1957" "4,343,225,434"
+            "115333")
+           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
+           ("Kingdom of Pascal" "1970" "" "3785")
+           ("APL Republic" "1962" "342,335,151" "1545"))
+         (csv-rows->tuples data header-slots1 :allow-gap? #t))
+  )
+
+;; native scanner
+
+;; Compare the native scanner with the Scheme version.
+(let ([scheme-reader (^[sep quo]
+                       (^p ((with-module text.csv csv-reader) sep quo p)))]
+      [long-field (make-string 100 #\x)])
+  (define (read-all reader str)
+    (call-with-input-string str
+      (^p (let loop ([r '()])
+            (let1 rec (reader p)
+              (if (eof-object? rec)
+                (reverse r)
+                (loop (cons rec r))))))))
+  (dolist [input `("a,b,c\nd,e,f\n"
+                   "  a  ,\t b\t,c \r\nd\n\n,\n"
+                   "\"a\"\"b\" x ,\"c\nd\",e\n\"\"\n"
+                   "\u3042\u3000,\u3000\u3044 \u3046\u3000 ,\u3048\n"
+                   ,(string-append long-field ",\"" long-field "\"\"" "\","
+                                   long-field "  \n" long-field))]
+    (test* "native scanner vs. scheme reader"
+           (read-all (scheme-reader #\, #\") input)
+           (read-all (make-csv-reader #\,) input))
+    (test* "native scanner vs. scheme reader (tab, quote)"
+           (read-all (scheme-reader #\tab #\') input)
+           (read-all (make-csv-reader #\tab #\') input))))
+
+;; Fields spanning port buffers
+(test* "csv-reader (long fields)" '(50000 70000 3)
+       (let1 f (make-string 70000 #\y)
+         (with-output-to-file "test.o"
+           (^[] (display (make-string 50000 #\x)) (display ",\"")
+                (display f) (display "\", zzz\n")))
+         (begin0 (call-with-input-file "test.o"
+                   (^p (map string-length ((make-csv-reader #\,) p))))
+           (sys-unlink "test.o"))))
+
+(test* "port->csv-generator" '(("a" "b" "c") ("d" "e" "f"))
+       (call-with-input-string "a,b,c\nd,e,f\n"
+         (^p (generator->list (port->csv-generator p)))))
+
+(test* "port->csv-generator :columns" '(("c" "a") ("" "d") ("z" "x"))
+       (call-with-input-string "a,b,c\nd\nx,\"y\",z,w\n"
+         (^p (generator->list (port->csv-generator p :columns '(2 0))))))
+
+(test* "port->csv-generator :separator (scheme version)"
+       '(("b" "a") ("d" "c"))
+       (call-with-input-string "a\u3001b\nc\u3001d\n"
+         (^p (generator->list (port->csv-generator p :separator #\u3001
+                                                     :columns '(1 0))))))
+
+(test* "port->csv-generator :columns (invalid)" (test-error)
+       (port->csv-generator (open-input-string "") :columns '(-1)))
+
+(test* "port->csv-lseq" '(("1" "x") ("2" "y"))
+       (call-with-input-string "1, x\n2 ,\"y\"\n"
+         (^p (take (port->csv-lseq p) 2))))
+
+(test-end)
@@ -1,2 +1,3 @@
 (include "test-gettext.scm")
 (include "test-tr.scm")
+(include "test-csv.scm")
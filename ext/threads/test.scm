@@ -504,6 +504,40 @@
          (for-each thread-join! ts)
          (atom-ref a)))
 
+;;---------------------------------------------------------------------
+(test-section "concurrent hash tables")
+
+(test* "concurrent update!" '(300 300 300)
+       (let ([h (make-concurrent-hash-table 'eqv?)] [ts '()])
+         (dotimes [n 30]
+           (push! ts
+                  (thread-start! (make-thread
+                                  (^[] (dotimes [m 10]
+                                         (concurrent-hash-table-update!
+                                          h (modulo m 3) (pa$ + 10) 0)))))))
+         (for-each thread-join! ts)
+         (map (cut concurrent-hash-table-get h <>) '(0 1 2))))
+
+(test* "concurrent push!" 1000
+       (let ([h (make-concurrent-hash-table 'string=?)] [ts '()])
+         (dotimes [n 10]
+           (push! ts
+                  (thread-start! (make-thread
+                                  (^[] (dotimes [m 100]
+                                         (concurrent-hash-table-push!
+                                          h (number->string (modulo m 7))
+                                          m)))))))
+         (for-each thread-join! ts)
+         (apply + (map length (concurrent-hash-table-values h)))))
+
+(test* "concurrent symbol interning" #t
+       (let* ([names (map (^i #"concurrent-sym-~i") (iota 200))]
+              [ts (map (^_ (thread-start!
+                            (make-thread (^[] (map string->symbol names)))))
+                       (iota 8))]
+              [rs (map thread-join! ts)])
+         (every (^r (every eq? r (car rs))) rs)))
+
 ;;---------------------------------------------------------------------
 (test-section "threads and promise")
 
@@ -650,5 +684,37 @@
            (let1 r (list (dequeue/wait! qq) (dequeue/wait! qq))
              (list* r0 r1 r)))))
 
+;;---------------------------------------------------------------------
+(test-section "profiling all threads")
+
+(let ()
+  (define (pfib n) (if (< n 2) n (+ (pfib (- n 1)) (pfib (- n 2)))))
+  (define (worker) (dotimes [i 50] (pfib 20)))
+  (define (thread-frame e) (cadr e))
+  (profiler-reset)
+  (if (guard (e [(<error> e) #f])
+        (profiler-start :sampling-rate 1000 :all-threads #t)
+        #t)
+    (let1 ts (map (^i (thread-start! (make-thread worker #"prof~i")))
+                  '(0 1))
+      (for-each thread-join! ts)
+      (profiler-stop)
+      (let1 r (profiler-get-stack-result :threads #t)
+        (test* "thread attribution" #t
+               (and (pair? r)
+                    (every (^e (and (pair? (thread-frame e))
+                                    (eq? (car (thread-frame e)) 'thread)))
+                           r)))
+        (test* "terminated threads are sampled" '("prof0" "prof1")
+               (sort (delete-duplicates
+                      (filter-map (^e (and (member (cadr (thread-frame e))
+                                                   '("prof0" "prof1"))
+                                           (cadr (thread-frame e))))
+                                  r)))))
+      (test* "merged result" #t
+             (pair? (profiler-get-stack-result)))
+      (profiler-reset))
+    (format #t "profiling all threads is not supported on this platform\n")))
+
 (test-end)
 
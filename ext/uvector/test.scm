@@ -1418,6 +1418,37 @@
   (run-across test-reverse-endian)
   )
 
+(let ()
+  (define (test-write-uvectors name vecs)
+    (test* (format "write-uvectors (~a)" name)
+           (apply u8vector-append
+                  (map (^v (if (string? v)
+                             (string->u8vector v)
+                             (uvector-alias <u8vector> v)))
+                       vecs))
+           (begin
+             (call-with-output-file "test.o"
+               (cut write-uvectors vecs <>))
+             (call-with-input-file "test.o" port->uvector))))
+
+  (test-write-uvectors "empty" '())
+  (test-write-uvectors "small" '(#u8(1 2 3) "abc" #u16(1 2) #u8()))
+  ;; These don't fit in the port buffer
+  (test-write-uvectors "large" `("HTTP/1.1 200 OK\r\n\r\n"
+                                 ,(make-u8vector 20000 7)
+                                 #u8(1 2 3)
+                                 ,(make-u32vector 5000 #x01020304)))
+  (test-write-uvectors "many" (map (^i (make-u8vector 200 i)) (iota 150)))
+
+  (test* "write-uvectors (string port)" "abc\x01;\x02;def"
+         (call-with-output-string
+           (cut write-uvectors '("abc" #u8(1 2) "def") <>)))
+  (test* "write-uvectors (bad element)" (test-error)
+         (call-with-output-string
+           (cut write-uvectors '(#u8(1) abc) <>))))
+
+(sys-unlink "test.o")
+
 ;;-------------------------------------------------------------------
 (test-section "string <-> uvector")
 
@@ -2539,6 +2570,35 @@
        (equal? s (call-with-string-io s (^[in out]
                                           (copy-port in out :unit 100000)))))
 
+;; Between file ports, copy-port lets the kernel copy the data.
+(let ([data (string-append (make-string 20000 #\a) "xyz"
+                           (make-string 30000 #\b))])
+  (define (file-copy . args)
+    (sys-unlink "test2.o")
+    (with-output-to-file "test.o" (cut display data))
+    (let1 n (call-with-input-file "test.o"
+              (^[in]
+                (call-with-output-file "test2.o"
+                  (^[out]
+                    (display "head" out)
+                    (read-char in)
+                    (peek-char in)
+                    (apply copy-port in out args)))))
+      (list n (call-with-input-file "test2.o" port->string))))
+
+  (test* "copy-port (file to file)"
+         (list (- (string-length data) 1)
+               (string-append "head" (substring data 1 (string-length data))))
+         (file-copy))
+  (test* "copy-port (file to file, size)"
+         (list 20002 (string-append "head" (substring data 1 20003)))
+         (file-copy :size 20002))
+  (test* "copy-port (file to file, size 0)"
+         '(0 "head")
+         (file-copy :size 0))
+  (sys-unlink "test.o")
+  (sys-unlink "test2.o"))
+
 ;;-------------------------------------------------------------------
 (test-section "binary search")
 
@@ -180,7 +180,7 @@
           vector->s8vector vector->u16vector vector->u32vector
           vector->u64vector vector->u8vector
 
-          write-block write-uvector))
+          write-block write-uvector write-uvectors))
 (select-module gauche.uvector)
 
 ;; gauche.vport is used by port->uvector.  Technically it's on top
@@ -444,6 +444,11 @@
                                         (end::<fixnum> -1)
                                         (endian::<symbol>? #f))
    Scm_WriteBlock)
+
+ (define-cproc write-uvectors (vs::<list>
+                               :optional (port::<output-port>
+                                          (current-output-port)))
+   (return (Scm_WriteUVectors vs port)))
  )
 
 ;; copy
@@ -0,0 +1,206 @@
+;;;
+;;; gauche.image - Dump and reload precompiled library images
+;;;
+;;;   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; An image is a DSO that holds the precompiled code of the Scheme
+;; libraries loaded in a session.  Loading an image (gosh -P<image>)
+;; runs the library initialization code directly, skipping reading
+;; and compiling the sources, which dominates the startup time of
+;; short-lived scripts that use many libraries.
+;;
+;; We don't snapshot the heap itself.  The image is built with
+;; gauche.cgen.precomp, the same way as the libraries bundled with
+;; Gauche, so it is mapped by the system's dynamic loader and its
+;; literals are statically allocated.
+;;
+;; The image also records the interface part (what precomp writes
+;; out to *.sci) of each library, and the modification time of its
+;; source.  If a source has been changed after the image is dumped,
+;; we stop using the image at that point, and the rest of the libraries
+;; are loaded from their sources as usual.
+
+(define-module gauche.image
+  (use file.util)
+  (autoload gauche.cgen <cgen-unit> cgen-current-unit cgen-decl cgen-init
+                        cgen-emit-c cgen-safe-string)
+  (autoload gauche.cgen.precomp cgen-precompile
+                                cgen-scm-path->c-file cgen-c-file->initfn)
+  (autoload gauche.package.compile gauche-package-compile-and-link)
+  (export dump-image load-image image-build-options))
+(select-module gauche.image)
+
+;; The name of the initialization function of an image.
+(define-constant *image-initfn* "Scm_Init_gauche_image")
+
+;; Set by the initialization function of an image.
+;; (<gauche-version> (<feature> <source> <mtime> <interface-forms>) ...)
+(define %image-manifest #f)
+
+;;----------------------------------------------------------------
+;; Loading
+;;
+
+(define (load-image file)
+  (let1 path (sys-normalize-pathname file :absolute #t :canonicalize #t)
+    (dynamic-load path :init-function *image-initfn*)
+    (let1 manifest (read-from-string %image-manifest)
+      (unless (equal? (car manifest) (gauche-version))
+        (error "image is dumped by a different version of Gauche:"
+               path (car manifest)))
+      (let loop ([entries (cdr manifest)])
+        (unless (null? entries)
+          (let* ([entry (car entries)]
+                 [feature (car entry)]
+                 [src (cadr entry)])
+            (cond [(provided? feature) (loop (cdr entries))]
+                  [(not (eqv? (source-mtime src) (caddr entry)))
+                   (warn "image ~a is stale: ~a has been changed.  \
+                          Remaining libraries are loaded from sources."
+                         path src)]
+                  [else
+                   (load-interface (cadddr entry) path)
+                   (provide feature)
+                   (loop (cdr entries))])))))))
+
+(define (source-mtime src)
+  (and (file-exists? src) (sys-stat->mtime (sys-stat src))))
+
+;; Evaluate the interface forms of a library, as if we're loading its
+;; *.sci file, except that dynamic-load refers to the image.
+(define (load-interface forms path)
+  (define (fix form)
+    (if (and (pair? form) (eq? (car form) 'dynamic-load))
+      `(dynamic-load ,path ,@(cddr form))
+      form))
+  (load-from-port
+   (open-input-string
+    (with-output-to-string
+      (^[] (dolist [form forms] (write (fix form)) (newline)))))))
+
+;;----------------------------------------------------------------
+;; Dumping
+;;
+
+;; Default options passed to gauche-package-compile-and-link, after the
+;; ones given to dump-image.  Useful to customize gosh -D<image>, e.g.
+;; to build an image with Gauche that isn't installed yet.
+(define image-build-options (make-parameter '()))
+
+;; Precompiles the libraries loaded so far and links them into an image
+;; FILE.  A C compiler and Gauche headers are required, as in
+;; gauche-package compile.  OPTS are passed to
+;; gauche-package-compile-and-link (e.g. :cppflags, :verbose).
+(define (dump-image file . opts)
+  (let ([path (sys-normalize-pathname file :absolute #t :canonicalize #t)]
+        [srcs (image-sources)])       ; must be taken before autoloading
+    (call-with-temporary-directory
+     (^[dir]
+       (let1 cwd (current-directory)
+         (unwind-protect
+             (begin
+               (current-directory dir)
+               (let1 entries (filter-map precompile-source srcs)
+                 (when (null? entries)
+                   (error "no library loaded so far can be put in an image"))
+                 (emit-image-main entries)
+                 (apply gauche-package-compile-and-link
+                        "image"
+                        (cons "image_main.c" (map (cut list-ref <> 4) entries))
+                        :output path (append opts (image-build-options)))
+                 path))
+           (current-directory cwd))))
+     :prefix "gimage")))
+
+;; Returns a list of (<feature> . <source>) of the libraries that have been
+;; loaded from Scheme sources, in the order they have been provided.
+;; Libraries loaded through *.sci files are already precompiled.
+(define (image-sources)
+  (filter-map (^[feature]
+                (and-let* ([ (not (equal? feature "gauche/image")) ]
+                           [r ((with-module gauche.internal find-load-file)
+                               feature *load-path* *load-suffixes*)]
+                           [src (sys-normalize-pathname (car r) :absolute #t)]
+                           [ (equal? (path-extension src) "scm") ]
+                           [ (imageable-source? src) ])
+                  (cons feature src)))
+              ((with-module gauche.internal %provided-features))))
+
+;; Precomp only records the define-module form in the interface, so
+;; we can't put a library that imports or exports at the toplevel
+;; or that switches to another module.
+(define (imageable-source? src)
+  (guard (e [(<error> e) #f])
+    (let1 forms (file->sexp-list src)
+      (and (pair? forms)
+           (pair? (car forms))
+           (eq? (caar forms) 'define-module)
+           (let1 mod (cadar forms)
+             (every (^[form]
+                      (or (not (pair? form))
+                          (case (car form)
+                            [(use import require extend export export-all
+                              define-module) #f]
+                            [(select-module) (equal? form `(select-module ,mod))]
+                            [else #t])))
+                    (cdr forms)))))))
+
+;; Returns (<feature> <source> <mtime> <interface-forms> <c-file>), or #f
+;; if the source can't be precompiled.
+(define (precompile-source entry)
+  (let* ([feature (car entry)]
+         [src (cdr entry)]
+         [c-file (cgen-scm-path->c-file #"~|feature|.scm")]
+         [sci (path-swap-extension c-file "sci")])
+    (guard (e [(<error> e)
+               (warn "~a is not put in the image: ~a" src (~ e 'message))
+               #f])
+      (cgen-precompile src :out.c c-file :out.sci sci :dso-name "image"
+                       :initializer-name (cgen-c-file->initfn c-file))
+      (list feature src (source-mtime src) (file->sexp-list sci) c-file))))
+
+(define (emit-image-main entries)
+  (define manifest
+    (cons (gauche-version) (map (cut take <> 4) entries)))
+  (parameterize ([cgen-current-unit
+                  (make <cgen-unit>
+                    :name "image_main"
+                    :preamble "/* Generated by dump-image.  DO NOT EDIT */"
+                    :init-prologue #"SCM_EXTENSION_ENTRY void ~|*image-initfn*|(void) {"
+                    :init-epilogue "}")])
+    (cgen-decl "#include <gauche.h>"
+               "#include <gauche/extend.h>")
+    (cgen-init "  SCM_INIT_EXTENSION(gauche_image);"
+               "  Scm_Define(SCM_FIND_MODULE(\"gauche.image\", 0),"
+               "             SCM_SYMBOL(SCM_INTERN(\"%image-manifest\")),"
+               (format "             SCM_MAKE_STR_IMMUTABLE(~a));"
+                       (cgen-safe-string (write-to-string manifest))))
+    (cgen-emit-c (cgen-current-unit))))
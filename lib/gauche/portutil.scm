@@ -106,6 +106,14 @@
                   (begin (write-block buf dst 0 nr)
                          (loop (+ count nr))))))))))))
 
+;; If both ports are connected to file descriptors, the kernel can
+;; do the copy.  Returns #f if it's not possible.
+(define (%do-copy/fd src dst size)
+  (with-port-locking src
+    (^[]
+      (with-port-locking dst
+        (^[] ((with-module gauche.internal %port-copy-fd) src dst size))))))
+
 (define (copy-port src dst :key (unit 4096) (size -1))
   (check-arg input-port? src)
   (check-arg output-port? dst)
@@ -117,6 +125,9 @@
          (if (and (integer? size) (not (negative? size)))
            (%do-copy/limit1 (read-char src) (write-char data dst) size)
            (%do-copy (read-char src) (write-char data dst) (+ count 1)))]
+        [(and (integer? unit)
+              (or (fixnum? size) (not (integer? size)))
+              (%do-copy/fd src dst (if (fixnum? size) size -1)))]
         [(integer? unit)
          (let ((buf (make-u8vector (if (zero? unit) 4096 unit))))
            (if (and (integer? size) (not (negative? size)))
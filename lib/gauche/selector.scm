@@ -1,5 +1,5 @@
 ;;;
-;;; selector - simple event loop by select()
+;;; selector - simple event loop
 ;;;
 ;;;   Copyright (c) 2000-2018  Shiro Kawai  <shiro@acm.org>
 ;;;
@@ -32,19 +32,75 @@
 ;;;
 
 
+;; The selector watches file descriptors with <sys-poller> (epoll or
+;; poll(), depending on the platform), so the cost of a wakeup doesn't
+;; depend on the number of watched descriptors.  On platforms without
+;; them, we fall back to sys-select.
+
 (define-module gauche.selector
   (use srfi-1)
-  (export <selector> selector-add! selector-delete! selector-select)
+  (export <selector> selector-add! selector-delete! selector-select
+          selector-add-timer! selector-delete-timer!)
   )
 (select-module gauche.selector)
 
+(autoload data.heap make-binary-heap binary-heap-push! binary-heap-pop-min!
+          binary-heap-find-min binary-heap-empty?)
+
+;;-----------------------------------------------------
+;; Backend
+;;
+
+(cond-expand
+ [gauche.sys.poller
+  (define-constant *read*   SYS_POLL_READ)
+  (define-constant *write*  SYS_POLL_WRITE)
+  (define-constant *except* SYS_POLL_EXCEPT)
+  (define-constant *edge*   SYS_POLL_EDGE)
+  (define (make-backend) (make <sys-poller>))
+  (define (backend-watch! b fd mask) (sys-poller-set! b fd mask))
+  ;; Returns a list of (fd . mask)
+  (define (backend-wait b timeout) (sys-poller-wait b timeout))]
+ [else
+  (define-constant *read*   1)
+  (define-constant *write*  2)
+  (define-constant *except* 4)
+  (define-constant *edge*   8)              ;ignored
+  (define (make-backend)
+    (vector (make <sys-fdset>) (make <sys-fdset>) (make <sys-fdset>)))
+  (define (backend-watch! b fd mask)
+    (set! (sys-fdset-ref (vector-ref b 0) fd) (logtest mask *read*))
+    (set! (sys-fdset-ref (vector-ref b 1) fd) (logtest mask *write*))
+    (set! (sys-fdset-ref (vector-ref b 2) fd) (logtest mask *except*)))
+  (define (backend-wait b timeout)
+    (receive (n r w x) (sys-select (vector-ref b 0) (vector-ref b 1)
+                                   (vector-ref b 2) timeout)
+      (if (<= n 0)
+        '()
+        (map (^[fd]
+               (cons fd (logior (if (sys-fdset-ref r fd) *read* 0)
+                                (if (sys-fdset-ref w fd) *write* 0)
+                                (if (sys-fdset-ref x fd) *except* 0))))
+             (delete-duplicates (append (sys-fdset->list r)
+                                        (sys-fdset->list w)
+                                        (sys-fdset->list x)))))))])
+
+;;-----------------------------------------------------
+;; Selector
+;;
+
+;; For each watched fd, the handlers table keeps a list of handlers.
+;; The fd is registered to the backend with the union of their flags.
+(define-record-type <handler> (make-handler key proc flag edge?) handler?
+  (key   handler-key)                   ;port or fd given to selector-add!
+  (proc  handler-proc)
+  (flag  handler-flag)                  ;r, w or x
+  (edge? handler-edge?))
+
 (define-class <selector> ()
-  ((rfds :init-form #f)
-   (wfds :init-form #f)
-   (xfds :init-form #f)
-   (rhandlers :init-form '())  ; list of (port-or-fd . proc)
-   (whandlers :init-form '())  ; ditto
-   (xhandlers :init-form '())  ; ditto
+  ((backend  :init-form (make-backend))
+   (handlers :init-form (make-hash-table 'eqv?)) ; fd -> (<handler> ...)
+   (timers   :init-form #f)                      ; binary heap, on demand
   ))
 
 (define (canon-flag flag)
@@ -52,75 +108,155 @@
     [(r read) 'r]
     [(w write) 'w]
     [(x exception) 'x]
-    [else (errorf "invalid flag ~s, must be r, w, or x" flag)]))
+    [else (errorf "invalid flag ~s, must be r, w, x or edge" flag)]))
 
-(define (flag->fd-slot flag)
+(define (flag->mask flag)
   (case flag
-    [(r) 'rfds] [(w) 'wfds] [(x) 'xfds]))
+    [(r) *read*] [(w) *write*] [(x) *except*]))
 
-(define (flag->handler-slot flag)
-  (case flag
-    [(r) 'rhandlers] [(w) 'whandlers] [(x) 'xhandlers]))
+(define (->fd port-or-fd)
+  (if (integer? port-or-fd)
+    port-or-fd
+    (port-file-number port-or-fd)))
+
+(define (update-registration! selector fd)
+  (let* ([tab (slot-ref selector 'handlers)]
+         [hs (hash-table-get tab fd '())])
+    (when (null? hs) (hash-table-delete! tab fd))
+    (backend-watch! (slot-ref selector 'backend) fd
+                    (fold (^[h m]
+                            (logior m (flag->mask (handler-flag h))
+                                    (if (handler-edge? h) *edge* 0)))
+                          0 hs))))
 
 (define-method selector-add! ((selector <selector>) port-or-fd proc flags)
   (assume-type proc <procedure>)
   (assume-type flags <list>)
-  (dolist [flag (map canon-flag flags)]
-    (let* ([slot (flag->fd-slot flag)]
-           [fds (or (slot-ref selector slot)
-                    (rlet1 f (make <sys-fdset>)
-                      (slot-set! selector slot f)))])
-      (set! (sys-fdset-ref fds port-or-fd) #t))
-    (slot-push! selector (flag->handler-slot flag) (cons port-or-fd proc))))
+  (let ([fd (or (->fd port-or-fd)
+                (error "port without file descriptor can't be selected:"
+                       port-or-fd))]
+        [edge? (and (memq 'edge flags) #t)])
+    ;; A new handler replaces the one for the same port-or-fd and flag.
+    (dolist [flag (map canon-flag (delete 'edge flags))]
+      (hash-table-update! (slot-ref selector 'handlers) fd
+                          (^[hs]
+                            (cons (make-handler port-or-fd proc flag edge?)
+                                  (remove (^h (and (eq? (handler-flag h) flag)
+                                                   (equal? (handler-key h)
+                                                           port-or-fd)))
+                                          hs)))
+                          '()))
+    (update-registration! selector fd)))
 
 (define-method selector-delete! ((selector <selector>) port-or-fd proc flags)
-  (let1 flags (if flags (map canon-flag flags) '(r w x))
-    (for-each (^[fds handlers]
-                (cond
-                 [port-or-fd
-                  (if-let1 p (assoc port-or-fd (slot-ref selector handlers))
-                    (when (or (not proc) (eq? proc (cdr p)))
-                      (slot-set! selector handlers
-                                 (delete p (slot-ref selector handlers)))
-                      (if-let1 fds (slot-ref selector fds)
-                        (sys-fdset-set! fds port-or-fd #f))))]
-                 [proc
-                  (let loop ([h (slot-ref selector handlers)]
-                             [newh '()])
-                    (cond [(null? h)
-                           (slot-set! selector handlers (reverse newh))]
-                          [(eq? proc (cdar h))
-                           (if-let1 fds (slot-ref selector fds)
-                             (sys-fdset-set! fds (caar h) #f))
-                           (loop (cdr h) newh)]
-                          [else
-                           (loop (cdr h) (cons (car h) newh))]))]
-                 [else
-                  (slot-set! selector fds #f)
-                  (slot-set! selector handlers '())]))
-              (map flag->fd-slot flags)
-              (map flag->handler-slot flags))))
+  (let* ([flags (if flags (map canon-flag flags) '(r w x))]
+         [tab (slot-ref selector 'handlers)]
+         [fd (and port-or-fd (->fd port-or-fd))])
+    (define (doomed? h)
+      (and (memq (handler-flag h) flags)
+           (or (not port-or-fd) (equal? port-or-fd (handler-key h)))
+           (or (not proc) (eq? proc (handler-proc h)))))
+    ;; If the port is already closed, we don't know its fd.
+    (dolist [fd (if fd (list fd) (hash-table-keys tab))]
+      (let1 hs (hash-table-get tab fd '())
+        (when (any doomed? hs)
+          (hash-table-put! tab fd (remove doomed? hs))
+          (update-registration! selector fd))))))
 
+;; Returns the number of handlers called.
 (define-method selector-select ((selector <selector>) :optional (timeout #f))
+  (let* ([tab (slot-ref selector 'handlers)]
+         [ready (backend-wait (slot-ref selector 'backend)
+                              (timer-timeout selector timeout))]
+         [calls (append-map
+                 (^[fd&mask]
+                   (let1 hs (hash-table-get tab (car fd&mask) '())
+                     (filter-map (^[h]
+                                   (and (logtest (cdr fd&mask)
+                                                 (flag->mask (handler-flag h)))
+                                        (list (handler-proc h)
+                                              (handler-key h)
+                                              (handler-flag h))))
+                                 hs)))
+                 ready)])
+    (for-each (^c (apply (car c) (cdr c))) calls)
+    (run-timers! selector)
+    (length calls)))
+
+;;-----------------------------------------------------
+;; Timers
+;;
+
+(define-record-type <selector-timer>
+    (make-timer deadline interval proc active?) selector-timer?
+  (deadline timer-deadline timer-deadline-set!) ;monotonic, in seconds
+  (interval timer-interval)                     ;#f for one-shot
+  (proc     timer-proc)
+  (active?  timer-active? timer-active-set!))
+
+(define (now)
+  (receive (sec nsec) (sys-clock-gettime-monotonic)
+    (if sec
+      (+ sec (/. nsec 1e9))
+      (receive (sec usec) (sys-gettimeofday)
+        (+ sec (/. usec 1e6))))))
+
+;; Calls PROC with no arguments from selector-select after DELAY seconds,
+;; and then every INTERVAL seconds if it is given.  Returns a timer,
+;; which can be passed to selector-delete-timer!.
+(define-method selector-add-timer! ((selector <selector>) delay proc
+                                    :optional (interval #f))
+  (assume-type proc <procedure>)
+  (let ([heap (or (slot-ref selector 'timers)
+                  (rlet1 h (make-binary-heap :key timer-deadline)
+                    (slot-set! selector 'timers h)))]
+        [timer (make-timer (+ (now) delay) interval proc #t)])
+    (binary-heap-push! heap timer)
+    timer))
+
+;; Deleted timers stay in the heap until their deadline.
+(define-method selector-delete-timer! ((selector <selector>) timer)
+  (timer-active-set! timer #f))
+
+;; Drops deleted timers from the top of the heap, and returns the first
+;; active timer or #f.
+(define (next-timer selector)
+  (and-let* ([heap (slot-ref selector 'timers)])
+    (let loop ()
+      (cond [(binary-heap-empty? heap) #f]
+            [(timer-active? (binary-heap-find-min heap))
+             (binary-heap-find-min heap)]
+            [else (binary-heap-pop-min! heap) (loop)]))))
+
+;; Shorten TIMEOUT (in the format of sys-select) to the next deadline.
+(define (timer-timeout selector timeout)
+  (let1 usec (cond [(not timeout) #f]
+                   [(pair? timeout) (+ (* (car timeout) 1000000)
+                                       (cadr timeout))]
+                   [else timeout])
+    (if-let1 t (next-timer selector)
+      (let1 wait (exact (ceiling (* (max 0 (- (timer-deadline t) (now)))
+                                    1e6)))
+        (if usec (min usec wait) wait))
+      usec)))
 
-  (define (pick-handlers fds handlers flag)
-    (fold (^[entry tail]
-            (let1 fd (car entry)
-              (if (sys-fdset-ref fds fd)
-                (cons (list (cdr entry) fd flag) tail)
-                tail)))
-          '()
-          handlers))
-
-  (receive (nfds rfds wfds xfds)
-      (sys-select (slot-ref selector 'rfds)
-                  (slot-ref selector 'wfds)
-                  (slot-ref selector 'xfds)
-                  timeout)
-    (when (> nfds 0)
-      (for-each (^h (apply (car h) (cdr h)))
-                (append
-                 (pick-handlers rfds (slot-ref selector 'rhandlers) 'r)
-                 (pick-handlers wfds (slot-ref selector 'whandlers) 'w)
-                 (pick-handlers xfds (slot-ref selector 'xhandlers) 'x))))
-    nfds))
+(define (run-timers! selector)
+  (define t0 (now))
+  (define (due-timers heap)
+    (let loop ([ts '()])
+      (if-let1 t (next-timer selector)
+        (if (<= (timer-deadline t) t0)
+          (begin (binary-heap-pop-min! heap) (loop (cons t ts)))
+          (reverse! ts))
+        (reverse! ts))))
+  (and-let* ([heap (slot-ref selector 'timers)])
+    ;; Reschedule before calling, so that the handler can delete the timer.
+    ;; A handler may also delete other due timers.
+    (dolist [t (due-timers heap)]
+      (when (timer-active? t)
+        (if-let1 iv (timer-interval t)
+          (let1 d (+ (timer-deadline t) iv)
+            (timer-deadline-set! t (if (<= d t0) (+ t0 iv) d))
+            (binary-heap-push! heap t))
+          (timer-active-set! t #f))
+        ((timer-proc t))))))
@@ -34,8 +34,10 @@
 (define-module gauche.vm.profiler
   (use srfi-13)
   (use util.match)
+  (use gauche.uvector)
   (extend gauche.internal)
-  (export profiler-show profiler-get-result
+  (export profiler-show profiler-get-result profiler-get-stack-result
+          profiler-write-collapsed profiler-write-pprof
           profiler-show-load-stats with-profiler)
   )
 (select-module gauche.vm.profiler)
@@ -45,14 +47,100 @@
 ;;;
 
 ;;
-;; Returns a portable representation of the current profiler result
+;; Returns a portable representation of the current profiler result.
+;; If the profiler has run on all threads, the results of all threads
+;; are merged.
 ;;
 (define (profiler-get-result)
-  ;; NB: this part depends on the result object of profiler-raw-result,
-  ;; which may be changed later.  Keep this in sync with src/prof.c.
-  (if-let1 r (profiler-raw-result)
-    (hash-table-map r (^(k v) (cons (entry-name k) v)))
-    #f))
+  (if-let1 rs (thread-raw-results)
+    (merge-stats (map (^r (stat->list (cadr r))) rs))
+    (if-let1 r (profiler-raw-result)
+      (stat->list r)
+      #f)))
+
+;;
+;; Returns the sampled call stacks, aggregated.  Each entry is
+;; (<sample-hits> <name> ...), where names are ordered from the
+;; outermost caller to the sampled function.
+;; If the profiler has run on all threads, the stacks of all threads
+;; are merged.  If THREADS is true, each stack begins with a pseudo
+;; frame (thread <thread-name> <thread-id>) to tell which thread it
+;; is sampled in.
+;;
+(define (profiler-get-stack-result :key (threads #f))
+  (if-let1 rs (thread-raw-results)
+    (merge-stacks
+     (append-map (^r (let1 stacks (stack-trie->list (cddr r))
+                       (if threads
+                         (let1 frame `(thread ,(~ (car r)'name)
+                                              ,(~ (car r)'vmid))
+                           (map (^e (cons* (car e) frame (cdr e))) stacks))
+                         stacks)))
+                 rs))
+    (and-let1 trie (profiler-raw-stack-result)
+      (stack-trie->list trie))))
+
+;;
+;; Write the sampled stacks in the "collapsed" format, which is
+;; one line per distinct stack, frames separated by semicolons and
+;; followed by the count.  It can be fed to flamegraph.pl etc.
+;;
+(define (profiler-write-collapsed :key (results #f)
+                                       (port (current-output-port)))
+  (dolist [e (or results (profiler-get-stack-result) '())]
+    (format port "~a ~d\n"
+            (string-join (map frame-name->string (cdr e)) ";")
+            (car e))))
+
+;;
+;; Write the sampled stacks in pprof's profile.proto format (uncompressed).
+;; Each sample has two values, the number of samples and the cpu time
+;; in nanoseconds.
+;;
+(define (profiler-write-pprof :key (results #f)
+                                   (port (current-output-port)))
+  (let ([results (or results (profiler-get-stack-result) '())]
+        [period-ns (* (profiler-sampling-period) 1000)]
+        [strings (make-hash-table 'equal?)]  ; string -> index
+        [funcs (make-hash-table 'equal?)])   ; name -> function id
+    (define (string-index s)
+      (or (hash-table-get strings s #f)
+          (rlet1 i (hash-table-num-entries strings)
+            (hash-table-put! strings s i))))
+    (define (function-id name)
+      (or (hash-table-get funcs name #f)
+          (rlet1 i (+ (hash-table-num-entries funcs) 1)
+            (hash-table-put! funcs name i))))
+    (define (value-type type unit)
+      (^[] (pb-int 1 (string-index type)) (pb-int 2 (string-index unit))))
+    (string-index "")                   ; index 0 must be an empty string
+    (let1 body
+        (with-output-to-string
+          (^[]
+            (pb-message 1 (value-type "samples" "count"))
+            (pb-message 1 (value-type "cpu" "nanoseconds"))
+            (dolist [e results]
+              (pb-message 2 (^[]
+                              (pb-packed 1 (map function-id (reverse (cdr e))))
+                              (pb-packed 2 (list (car e)
+                                                 (* (car e) period-ns))))))
+            ;; We have one location per function.
+            (dolist [f (sort (hash-table->alist funcs) < cdr)]
+              (pb-message 4 (^[]
+                              (pb-int 1 (cdr f))
+                              (pb-message 4 (^[] (pb-int 1 (cdr f))))))
+              (pb-message 5 (^[]
+                              (pb-int 1 (cdr f))
+                              (pb-int 2 (string-index
+                                         (frame-name->string (car f))))))
+              )
+            (pb-message 11 (value-type "cpu" "nanoseconds"))
+            (pb-int 12 period-ns)
+            ;; string table has to be the last, since the above may
+            ;; add strings.
+            (dolist [s (sort (hash-table->alist strings) < cdr)]
+              (pb-bytes 6 (car s)))))
+      (write-uvector (string->u8vector body) port))))
 
 ;;
 ;; Show the profiler result.
@@ -70,16 +158,7 @@
       (show-stats r sort-by max-rows)
       (print "No profiling data has been gathered."))
     ;; gather all the results
-    (let1 ht (make-hash-table 'equal?)
-      ;; gather stats
-      (dolist (r results)
-        (dolist (e r)
-          (let1 p (hash-table-get ht (car e) '(0 . 0))
-            (hash-table-put! ht (car e)
-                             (cons (+ (cadr e) (car p))
-                                   (+ (cddr e) (cdr p)))))))
-      ;; show 'em.
-      (show-stats (hash-table-map ht cons) sort-by max-rows))))
+    (show-stats (merge-stats results) sort-by max-rows)))
 
 ;; *EXPERIMENTAL*
 ;; Show the load statistics.
@@ -133,10 +212,57 @@
 ;;; Internal routines
 ;;;
 
+;; NB: the following routines depend on the result objects of
+;; profiler-raw-result, profiler-raw-stack-result and
+;; profiler-raw-thread-results, which may be changed later.
+;; Keep them in sync with src/prof.c and src/gauche/prof.h.
+
+;; Returns a list of (<thread> <stat> . <stack-trie>) if the profiler
+;; has run on all threads, #f otherwise.
+(define (thread-raw-results)
+  (let1 rs (profiler-raw-thread-results)
+    (and (pair? rs) rs)))
+
+(define (stat->list stat)
+  (hash-table-map stat (^(k v) (cons (entry-name k) v))))
+
+;; Merge lists of results of profiler-get-result.
+(define (merge-stats results)
+  (let1 ht (make-hash-table 'equal?)
+    (dolist (r results)
+      (dolist (e r)
+        (let1 p (hash-table-get ht (car e) '(0 . 0))
+          (hash-table-put! ht (car e)
+                           (cons (+ (cadr e) (car p))
+                                 (+ (cddr e) (cdr p)))))))
+    (hash-table-map ht cons)))
+
+(define (stack-trie->list trie)
+  (let walk ([tab trie] [path '()] [acc '()])
+    (hash-table-fold tab
+                     (^[func node acc]
+                       (let* ([path (cons (entry-name func) path)]
+                              [acc (if (zero? (car node))
+                                     acc
+                                     (cons (cons (car node) (reverse path))
+                                           acc))])
+                         (if (cdr node)
+                           (walk (cdr node) path acc)
+                           acc)))
+                     acc)))
+
+;; Different code may have the same name; we merge such stacks.
+(define (merge-stacks stacks)
+  (let1 ht (make-hash-table 'equal?)
+    (dolist [e stacks]
+      (hash-table-update! ht (cdr e) (cut + <> (car e)) 0))
+    (hash-table-map ht (^(k v) (cons v k)))))
+
 ;; Show the result in a comprehensive way
 (define (show-stats stat sort-by max-rows)
   (let* ([num-samples (fold (^(entry cnt) (+ (cddr entry) cnt)) 0 stat)]
-         [sum-time (* num-samples 0.01)]
+         [period (/ (profiler-sampling-period) 1000000.0)]
+         [sum-time (* num-samples period)]
          [sorter (case sort-by
                    [(time)
                     (^(a b) (or (> (cddr a) (cddr b))
@@ -160,7 +286,7 @@
     (dolist [e (if (integer? max-rows) (take* sorted max-rows) sorted)]
       (match-let1 (name ncalls . samples) e
         (format #t "~50a ~7d ~5a ~5d(~3d%)\n"
-                name ncalls (time/call samples ncalls) samples
+                name ncalls (time/call samples ncalls period) samples
                 (if (zero? num-samples)
                   0
                   (exact (round (* 100 (/ samples num-samples))))))))
@@ -171,8 +297,8 @@
 ;; If the time is under 100ms:  ##.####
 ;; If the time is under 10^6ms: ###.### - ######.
 ;; Else print as is.
-(define (time/call samples ncalls)
-  (let1 time (* 10.0 (/ samples ncalls)) ;; in ms
+(define (time/call samples ncalls period)
+  (let1 time (* period 1000 (/ samples ncalls)) ;; in ms
     (receive (frac int) (modf (* time 10000))
       (let1 val (exact (if (>= frac 0.5) (+ int 1) int))
         (receive (q r) (quotient&remainder val 10000)
@@ -198,3 +324,28 @@
              ,(map class-name (~ obj'specializers)))]
    [else (write-to-string obj)]))
 
+;; A frame name as a single-line string without semicolons, which
+;; are used as the separator in the collapsed format.
+(define (frame-name->string name)
+  (regexp-replace-all #/[;\n]/
+                      (if (string? name) name (write-to-string name display))
+                      " "))
+
+;; Minimal protocol buffer encoder for profiler-write-pprof.
+;; The output goes to the current output port.
+(define (pb-varint n)
+  (if (< n 128)
+    (write-byte n)
+    (begin (write-byte (logior (logand n 127) 128))
+           (pb-varint (ash n -7)))))
+(define (pb-int field n)                ; n must be nonnegative
+  (pb-varint (ash field 3))
+  (pb-varint n))
+(define (pb-bytes field str)            ; str may be incomplete
+  (pb-varint (logior (ash field 3) 2))
+  (pb-varint (string-size str))
+  (write-uvector (string->u8vector str)))
+(define (pb-message field thunk)
+  (pb-bytes field (with-output-to-string thunk)))
+(define (pb-packed field ns)
+  (pb-message field (^[] (for-each pb-varint ns))))
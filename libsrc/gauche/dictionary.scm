@@ -153,7 +153,7 @@
      ,@(map (^p (gen-def (car p) (cadr p))) (slices clauses 2))))
 
 ;;-----------------------------------------------
-;; Methods for hash-table, tree-map
+;; Methods for hash-table, concurrent-hash-table, tree-map
 ;;
 
 (define-dict-interface <hash-table>
@@ -174,6 +174,29 @@
   :->alist    hash-table->alist
   :comparator hash-table-comparator)
 
+(define (concurrent-hash-table-comparator ht)
+  (ecase (concurrent-hash-table-type ht)
+    [(eq?)      eq-comparator]
+    [(eqv?)     eqv-comparator]
+    [(equal?)   equal-comparator]
+    [(string=?) string-comparator]))
+
+(define-dict-interface <concurrent-hash-table>
+  :get        concurrent-hash-table-get
+  :put!       concurrent-hash-table-put!
+  :delete!    concurrent-hash-table-delete!
+  :clear!     concurrent-hash-table-clear!
+  :exists?    concurrent-hash-table-exists?
+  :fold       concurrent-hash-table-fold
+  :for-each   concurrent-hash-table-for-each
+  :keys       concurrent-hash-table-keys
+  :values     concurrent-hash-table-values
+  :pop!       concurrent-hash-table-pop!
+  :push!      concurrent-hash-table-push!
+  :update!    concurrent-hash-table-update!
+  :->alist    concurrent-hash-table->alist
+  :comparator concurrent-hash-table-comparator)
+
 (define-dict-interface <tree-map>
   :get        tree-map-get
   :put!       tree-map-put!
@@ -141,7 +141,9 @@
           debug-print-pre debug-print-post debug-funcall-pre)
 
 (autoload gauche.vm.profiler
-          profiler-show profiler-show-load-stats with-profiler)
+          profiler-show profiler-show-load-stats with-profiler
+          profiler-get-result profiler-get-stack-result
+          profiler-write-collapsed profiler-write-pprof)
 
 (autoload srfi-0  (:macro cond-expand))
 (autoload srfi-7  (:macro program))
@@ -807,6 +807,595 @@ static ScmBignum *bignum_lshift(ScmBignum *br, const ScmBignum *bx, int amount)
     return br;
 }
 
+/*-----------------------------------------------------------------------
+ * Subquadratic multiplication
+ *
+ *   The routines here work on raw word arrays (least significant word
+ *   first) of unsigned magnitude, so that they can recurse without
+ *   allocating intermediate bignums.  The caller passes a scratch area
+ *   of at least MUL_SCRATCH_SIZE(n) words.
+ *
+ *   Which algorithm is used is decided by the operand size in words,
+ *   compared to the thresholds below.  They can be tuned at runtime
+ *   by Scm_BignumSetThreshold(); see test-arith.c for the benchmark
+ *   to find crossover points.
+ *
+ *   Cf. Bodrato & Zanoni: "Integer and Polynomial Multiplication:
+ *   Towards Optimal Toom-Cook Matrices", ISSAC 2007, for the Toom-3
+ *   interpolation sequence.
+ */
+
+static int bignum_thresholds[SCM_BIGNUM_NUM_THRESHOLDS] = {
+    32,                         /* SCM_BIGNUM_KARATSUBA_THRESHOLD */
+    128,                        /* SCM_BIGNUM_TOOM3_THRESHOLD */
+    1024,                       /* SCM_BIGNUM_NTT_THRESHOLD */
+    48,                         /* SCM_BIGNUM_DC_RADIX_THRESHOLD */
+};
+
+#define KARATSUBA_THRESHOLD bignum_thresholds[SCM_BIGNUM_KARATSUBA_THRESHOLD]
+#define TOOM3_THRESHOLD     bignum_thresholds[SCM_BIGNUM_TOOM3_THRESHOLD]
+#define NTT_THRESHOLD       bignum_thresholds[SCM_BIGNUM_NTT_THRESHOLD]
+#define DC_RADIX_THRESHOLD  bignum_thresholds[SCM_BIGNUM_DC_RADIX_THRESHOLD]
+
+/* Enough for both Karatsuba and Toom-3 recursion. */
+#define MUL_SCRATCH_SIZE(n)  (8*(n) + 8*WORD_BITS)
+
+/* r[0..n) = a[0..n) + b[0..n), returns carry.  r may be a or b. */
+static u_long mpn_add_n(u_long *r, const u_long *a, const u_long *b, int n)
+{
+    u_long c = 0;
+    for (int i=0; i<n; i++) {
+        u_long x = a[i], y = b[i], z;
+        UADD(z, c, x, y);
+        r[i] = z;
+    }
+    return c;
+}
+
+/* r[0..n) = a[0..n) - b[0..n), returns borrow.  r may be a or b. */
+static u_long mpn_sub_n(u_long *r, const u_long *a, const u_long *b, int n)
+{
+    u_long c = 0;
+    for (int i=0; i<n; i++) {
+        u_long x = a[i], y = b[i], z;
+        USUB(z, c, x, y);
+        r[i] = z;
+    }
+    return c;
+}
+
+/* r[0..an) = a[0..an) + b[0..bn), an >= bn.  returns carry. */
+static u_long mpn_add(u_long *r, const u_long *a, int an,
+                      const u_long *b, int bn)
+{
+    u_long c = mpn_add_n(r, a, b, bn);
+    for (int i=bn; i<an; i++) {
+        u_long x = a[i], z;
+        UADD(z, c, x, 0);
+        r[i] = z;
+    }
+    return c;
+}
+
+/* r[0..an) = a[0..an) - b[0..bn), an >= bn.  returns borrow. */
+static u_long mpn_sub(u_long *r, const u_long *a, int an,
+                      const u_long *b, int bn)
+{
+    u_long c = mpn_sub_n(r, a, b, bn);
+    for (int i=bn; i<an; i++) {
+        u_long x = a[i], z;
+        USUB(z, c, x, 0);
+        r[i] = z;
+    }
+    return c;
+}
+
+/* r[0..rn) += b[0..bn), rn >= bn.  Stops as soon as the carry is
+   absorbed.  Returns carry out of r[rn-1]. */
+static u_long mpn_add_to(u_long *r, int rn, const u_long *b, int bn)
+{
+    u_long c = mpn_add_n(r, r, b, bn);
+    for (int i=bn; c && i<rn; i++) {
+        u_long x = r[i], z;
+        UADD(z, c, x, 0);
+        r[i] = z;
+    }
+    return c;
+}
+
+/* Compare a[0..n) and b[0..n) */
+static int mpn_cmp(const u_long *a, const u_long *b, int n)
+{
+    for (int i=n-1; i>=0; i--) {
+        if (a[i] > b[i]) return 1;
+        if (a[i] < b[i]) return -1;
+    }
+    return 0;
+}
+
+/* r[0..n) = |a - b|, returns 1 if a >= b, -1 otherwise. */
+static int mpn_absdiff(u_long *r, const u_long *a, const u_long *b, int n)
+{
+    if (mpn_cmp(a, b, n) >= 0) {
+        mpn_sub_n(r, a, b, n);
+        return 1;
+    } else {
+        mpn_sub_n(r, b, a, n);
+        return -1;
+    }
+}
+
+static void mpn_zero(u_long *r, int n)
+{
+    for (int i=0; i<n; i++) r[i] = 0;
+}
+
+static void mpn_copy(u_long *r, const u_long *a, int n)
+{
+    for (int i=0; i<n; i++) r[i] = a[i];
+}
+
+/* r[0..an+bn) = a[0..an) * b[0..bn).  Schoolbook. */
+static void mpn_mul_basecase(u_long *r, const u_long *a, int an,
+                             const u_long *b, int bn)
+{
+    mpn_zero(r, an+bn);
+    for (int j=0; j<bn; j++) {
+        u_long y = b[j], c = 0;
+        if (y == 0) continue;
+        for (int i=0; i<an; i++) {
+            u_long hi, lo, x = a[i], t, u;
+            UMUL(hi, lo, x, y);
+            u_long c1 = 0;
+            u = r[i+j];
+            UADD(t, c1, u, lo);
+            u_long c2 = 0;
+            UADD(u, c2, t, c);
+            r[i+j] = u;
+            c = hi + c1 + c2;   /* never overflows */
+        }
+        r[an+j] = c;
+    }
+}
+
+static void mpn_mul_n(u_long *r, const u_long *a, const u_long *b, int n,
+                      u_long *scratch);
+
+/* Karatsuba.  r[0..2n) = a[0..n) * b[0..n).
+   a = a1*W^h + a0, b = b1*W^h + b0, where W is the word base.
+   a*b = a0b0 + (a0b0 + a1b1 - (a0-a1)(b0-b1))W^h + a1b1W^2h */
+static void mpn_mul_karatsuba(u_long *r, const u_long *a, const u_long *b,
+                              int n, u_long *scratch)
+{
+    int h = (n+1)/2, l = n - h;
+    u_long *ad = scratch;       /* h words */
+    u_long *bd = ad + h;        /* h words */
+    u_long *zm = bd + h;        /* 2h words */
+    u_long *t  = zm + 2*h;      /* 2h+1 words */
+    u_long *next = t + 2*h + 1;
+
+    /* |a0-a1|, |b0-b1|; a1 and b1 are zero-extended to h words. */
+    mpn_copy(ad, a+h, l); if (l < h) ad[l] = 0;
+    mpn_copy(bd, b+h, l); if (l < h) bd[l] = 0;
+    int as = mpn_absdiff(ad, a, ad, h);
+    int bs = mpn_absdiff(bd, b, bd, h);
+
+    mpn_mul_n(zm, ad, bd, h, next);
+    mpn_mul_n(r, a, b, h, next);              /* z0 */
+    mpn_mul_n(r+2*h, a+h, b+h, l, next);      /* z2 */
+
+    /* t = z0 + z2 -/+ zm */
+    t[2*h] = mpn_add(t, r, 2*h, r+2*h, 2*l);
+    if (as == bs) {
+        t[2*h] -= mpn_sub_n(t, t, zm, 2*h);
+    } else {
+        t[2*h] += mpn_add_n(t, t, zm, 2*h);
+    }
+    int tn = 2*h+1;
+    while (tn > 2*n-h) {
+        SCM_ASSERT(t[tn-1] == 0);
+        tn--;
+    }
+    u_long c = mpn_add_to(r+h, 2*n-h, t, tn);
+    SCM_ASSERT(c == 0);
+    (void)c;
+}
+
+/* Two's complement helpers used by Toom-3 interpolation.  All values
+   are m words wide. */
+static void mpn_neg(u_long *r, int m)
+{
+    u_long c = 1;
+    for (int i=0; i<m; i++) {
+        u_long x = ~r[i], z;
+        UADD(z, c, x, 0);
+        r[i] = z;
+    }
+}
+
+/* arithmetic shift right by 1 */
+static void mpn_sar1(u_long *r, int m)
+{
+    for (int i=0; i<m-1; i++) {
+        r[i] = (r[i] >> 1) | (r[i+1] << (WORD_BITS-1));
+    }
+    r[m-1] = (u_long)((long)r[m-1] >> 1);
+}
+
+/* r = r / 3, assuming r is an exact multiple of 3 (mod W^m).
+   We multiply by the inverse of 3 modulo W^m word by word. */
+static void mpn_divexact_by3(u_long *r, int m)
+{
+    const u_long inv3 = (SCM_ULONG_MAX/3)*2+1; /* 3*inv3 == 1 mod W */
+    u_long c = 0;
+    for (int i=0; i<m; i++) {
+        u_long x = r[i], s, b = 0, hi, lo;
+        USUB(s, b, x, c);
+        u_long q = s * inv3;
+        r[i] = q;
+        UMUL(hi, lo, q, 3);
+        (void)lo;
+        c = hi + b;
+    }
+}
+
+/* Toom-3.  r[0..2n) = a[0..n) * b[0..n).
+   Split into three pieces of k words (the highest piece has s words),
+   evaluate at 0, 1, -1, 2 and infinity, and interpolate. */
+static void mpn_mul_toom3(u_long *r, const u_long *a, const u_long *b,
+                          int n, u_long *scratch)
+{
+    int k = (n+2)/3, s = n - 2*k;
+    int m = 2*k+2;              /* width of interpolation values */
+    const u_long *a0 = a, *a1 = a+k, *a2 = a+2*k;
+    const u_long *b0 = b, *b1 = b+k, *b2 = b+2*k;
+    u_long *ea = scratch;       /* k+1 words */
+    u_long *eb = ea + k+1;      /* k+1 words */
+    u_long *w1 = eb + k+1;      /* m words */
+    u_long *wm1 = w1 + m;       /* m words */
+    u_long *w2 = wm1 + m;       /* m words */
+    u_long *t  = w2 + m;        /* m words */
+    u_long *next = t + m;
+
+    SCM_ASSERT(s > 0);
+
+    /* ea = a0 + a2 */
+    ea[k] = mpn_add(ea, a0, k, a2, s);
+    eb[k] = mpn_add(eb, b0, k, b2, s);
+
+    /* w1 = (a0+a1+a2)(b0+b1+b2)  -- uses t as temporary */
+    t[k] = ea[k] + mpn_add_n(t, ea, a1, k);
+    u_long *tb = t + k+1;       /* t has m = 2k+2 >= 2(k+1) words */
+    tb[k] = eb[k] + mpn_add_n(tb, eb, b1, k);
+    mpn_mul_n(w1, t, tb, k+1, next);
+
+    /* wm1 = (a0-a1+a2)(b0-b1+b2) */
+    int sa, sb;
+    {
+        if (ea[k] != 0 || mpn_cmp(ea, a1, k) >= 0) {
+            t[k] = ea[k] - mpn_sub_n(t, ea, a1, k);
+            sa = 1;
+        } else {
+            mpn_sub_n(t, a1, ea, k);
+            t[k] = 0;
+            sa = -1;
+        }
+        if (eb[k] != 0 || mpn_cmp(eb, b1, k) >= 0) {
+            tb[k] = eb[k] - mpn_sub_n(tb, eb, b1, k);
+            sb = 1;
+        } else {
+            mpn_sub_n(tb, b1, eb, k);
+            tb[k] = 0;
+            sb = -1;
+        }
+    }
+    mpn_mul_n(wm1, t, tb, k+1, next);
+    if (sa != sb) mpn_neg(wm1, m);
+
+    /* w2 = (a0+2a1+4a2)(b0+2b1+4b2), evaluated as (a2*2 + a1)*2 + a0 */
+    {
+        u_long c;
+        mpn_copy(t, a2, s); mpn_zero(t+s, k+1-s);
+        c = mpn_add_n(t, t, t, k+1); SCM_ASSERT(c == 0);
+        c = mpn_add(t, t, k+1, a1, k); SCM_ASSERT(c == 0);
+        c = mpn_add_n(t, t, t, k+1); SCM_ASSERT(c == 0);
+        c = mpn_add(t, t, k+1, a0, k); SCM_ASSERT(c == 0);
+        mpn_copy(tb, b2, s); mpn_zero(tb+s, k+1-s);
+        c = mpn_add_n(tb, tb, tb, k+1); SCM_ASSERT(c == 0);
+        c = mpn_add(tb, tb, k+1, b1, k); SCM_ASSERT(c == 0);
+        c = mpn_add_n(tb, tb, tb, k+1); SCM_ASSERT(c == 0);
+        c = mpn_add(tb, tb, k+1, b0, k); SCM_ASSERT(c == 0);
+        (void)c;
+    }
+    mpn_mul_n(w2, t, tb, k+1, next);
+
+    /* w0 and winf go directly to their places in r. */
+    mpn_mul_n(r, a0, b0, k, next);              /* r[0..2k) */
+    mpn_mul_n(r+4*k, a2, b2, s, next);          /* r[4k..4k+2s) */
+    mpn_zero(r+2*k, 2*k);
+    const u_long *w0 = r, *winf = r+4*k;
+
+    /* Interpolation (all in m-word two's complement).  With the
+       coefficients c0..c4 of the product,
+         r3 = (w2 - wm1)/3           = c1 + c2 + 3c3 + 5c4
+         r1 = (w1 - wm1)/2           = c1 + c3
+         r2 = wm1 - w0 + r1 - winf   = c2
+         r3 = (r3 - r1 - r2 - 5winf)/2 = c3
+         r1 = r1 - r3                = c1                         */
+    u_long *r3 = w2, *r1 = w1, *r2 = t;
+    mpn_sub_n(r3, w2, wm1, m);
+    mpn_divexact_by3(r3, m);
+    mpn_sub_n(r1, w1, wm1, m);
+    mpn_sar1(r1, m);
+    mpn_copy(r2, wm1, m);
+    mpn_sub(r2, r2, m, w0, 2*k);
+    mpn_add_n(r2, r2, r1, m);
+    mpn_sub(r2, r2, m, winf, 2*s);
+    mpn_sub_n(r3, r3, r1, m);
+    mpn_sub_n(r3, r3, r2, m);
+    for (int i=0; i<5; i++) mpn_sub(r3, r3, m, winf, 2*s);
+    mpn_sar1(r3, m);
+    mpn_sub_n(r1, r1, r3, m);
+
+    /* Accumulate.  Each coefficient is nonnegative and the total fits
+       in 2n words, so we can trim the upper zero words. */
+    u_long *coefs[3] = { r1, r2, r3 };
+    for (int i=0; i<3; i++) {
+        int off = (i+1)*k;
+        int cn = m;
+        while (cn > 0 && coefs[i][cn-1] == 0) cn--;
+        SCM_ASSERT(cn <= 2*n - off);
+        if (cn == 0) continue;
+        u_long c = mpn_add_to(r+off, 2*n-off, coefs[i], cn);
+        SCM_ASSERT(c == 0);
+        (void)c;
+    }
+}
+
+/* r[0..2n) = a[0..n) * b[0..n), choosing the algorithm by size. */
+static void mpn_mul_n(u_long *r, const u_long *a, const u_long *b, int n,
+                      u_long *scratch)
+{
+    if (n < KARATSUBA_THRESHOLD || n < 4) {
+        mpn_mul_basecase(r, a, n, b, n);
+    } else if (n < TOOM3_THRESHOLD || n < 9) {
+        mpn_mul_karatsuba(r, a, b, n, scratch);
+    } else {
+        mpn_mul_toom3(r, a, b, n, scratch);
+    }
+}
+
+/* Number theoretic transform.
+
+   For very large operands, we split them into 32-bit digits, compute
+   the convolution modulo three primes by NTT, and reconstruct the
+   coefficients by CRT.  The product of the primes is about 2^85, so
+   a coefficient, which is less than len*2^64, can be recovered as long
+   as the transform length is at most 2^21.  Arithmetic modulo each
+   prime is done in Montgomery form with R = 2^32.
+ */
+
+#define NTT_NPRIMES    3
+#define NTT_MAX_LOG2   21
+#define NTT_DIGIT_BITS 32
+#define NTT_DIGITS_PER_WORD ((WORD_BITS+NTT_DIGIT_BITS-1)/NTT_DIGIT_BITS)
+
+static const uint32_t ntt_primes[NTT_NPRIMES] = {
+    469762049,                  /* 7*2^26+1 */
+    167772161,                  /* 5*2^25+1 */
+    754974721,                  /* 45*2^24+1 */
+};
+static const uint32_t ntt_generators[NTT_NPRIMES] = { 3, 3, 11 };
+
+typedef struct ntt_mod_rec {
+    uint32_t p;
+    uint32_t pinv;              /* -p^-1 mod 2^32 */
+    uint32_t r2;                /* 2^64 mod p */
+} ntt_mod;
+
+static inline uint32_t ntt_redc(const ntt_mod *m, uint64_t t)
+{
+    uint32_t q = (uint32_t)t * m->pinv;
+    uint32_t u = (uint32_t)((t + (uint64_t)q * m->p) >> 32);
+    return (u >= m->p)? u - m->p : u;
+}
+
+static inline uint32_t ntt_mulmod(const ntt_mod *m, uint32_t a, uint32_t b)
+{
+    return ntt_redc(m, (uint64_t)a * b);
+}
+
+static inline uint32_t ntt_to_mont(const ntt_mod *m, uint32_t a)
+{
+    return ntt_redc(m, (uint64_t)a * m->r2);
+}
+
+/* Plain modular power, used for setup only. */
+static uint32_t ntt_powmod(uint32_t b, uint32_t e, uint32_t p)
+{
+    uint64_t r = 1, x = b % p;
+    while (e) {
+        if (e & 1) r = r * x % p;
+        x = x * x % p;
+        e >>= 1;
+    }
+    return (uint32_t)r;
+}
+
+static void ntt_mod_init(ntt_mod *m, uint32_t p)
+{
+    uint32_t inv = p;           /* Newton iteration for p^-1 mod 2^32 */
+    for (int i=0; i<4; i++) inv *= 2 - p * inv;
+    m->p = p;
+    m->pinv = (uint32_t)0 - inv;
+    uint64_t r = ((uint64_t)1 << 32) % p;
+    m->r2 = (uint32_t)(r * r % p);
+}
+
+/* In-place transform of f[0..2^lg), whose elements are in Montgomery
+   form.  If inverse, the result is scaled by 2^-lg. */
+static void ntt_transform(uint32_t *f, int lg, const ntt_mod *m, uint32_t g,
+                          int inverse)
+{
+    u_long len = 1UL << lg;
+    uint32_t p = m->p;
+    for (u_long i=1, j=0; i<len; i++) {
+        u_long bit = len >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) { uint32_t t = f[i]; f[i] = f[j]; f[j] = t; }
+    }
+    for (u_long h=1; h<len; h<<=1) {
+        uint32_t w = ntt_powmod(g, (p-1)/(uint32_t)(h*2), p);
+        if (inverse) w = ntt_powmod(w, p-2, p);
+        uint32_t wm = ntt_to_mont(m, w);
+        for (u_long k=0; k<len; k+=h*2) {
+            uint32_t wk = ntt_to_mont(m, 1);
+            for (u_long j=0; j<h; j++) {
+                uint32_t u = f[k+j];
+                uint32_t v = ntt_mulmod(m, f[k+j+h], wk);
+                f[k+j]   = (u + v >= p)? u + v - p : u + v;
+                f[k+j+h] = (u >= v)? u - v : u + p - v;
+                wk = ntt_mulmod(m, wk, wm);
+            }
+        }
+    }
+    if (inverse) {
+        uint32_t il = ntt_to_mont(m, ntt_powmod((uint32_t)(len % p), p-2, p));
+        for (u_long i=0; i<len; i++) f[i] = ntt_mulmod(m, f[i], il);
+    }
+}
+
+static uint32_t ntt_digit(const u_long *a, int an, u_long k)
+{
+    u_long i = k / NTT_DIGITS_PER_WORD;
+    if (i >= (u_long)an) return 0;
+#if SIZEOF_LONG > 4
+    return (uint32_t)(a[i] >> (NTT_DIGIT_BITS * (k % NTT_DIGITS_PER_WORD)));
+#else
+    return (uint32_t)a[i];
+#endif
+}
+
+static void ntt_load(uint32_t *f, u_long len, const u_long *a, int an,
+                     const ntt_mod *m)
+{
+    for (u_long k=0; k<len; k++) f[k] = ntt_to_mont(m, ntt_digit(a, an, k));
+}
+
+/* r[0..an+bn) = a * b by NTT.  Returns FALSE if the operands are too
+   large for the transform, in which case the caller should use other
+   algorithms. */
+static int mpn_mul_ntt(u_long *r, const u_long *a, int an,
+                       const u_long *b, int bn)
+{
+    u_long ndigits = (u_long)(an+bn) * NTT_DIGITS_PER_WORD;
+    int lg = 0;
+    while ((1UL << lg) < ndigits) lg++;
+    if (lg > NTT_MAX_LOG2) return FALSE;
+    u_long len = 1UL << lg;
+
+    uint32_t *res[NTT_NPRIMES];
+    uint32_t *fb = SCM_NEW_ATOMIC_ARRAY(uint32_t, len);
+    for (int i=0; i<NTT_NPRIMES; i++) {
+        ntt_mod m;
+        ntt_mod_init(&m, ntt_primes[i]);
+        uint32_t *fa = res[i] = SCM_NEW_ATOMIC_ARRAY(uint32_t, len);
+        ntt_load(fa, len, a, an, &m);
+        ntt_load(fb, len, b, bn, &m);
+        ntt_transform(fa, lg, &m, ntt_generators[i], FALSE);
+        ntt_transform(fb, lg, &m, ntt_generators[i], FALSE);
+        for (u_long k=0; k<len; k++) fa[k] = ntt_mulmod(&m, fa[k], fb[k]);
+        ntt_transform(fa, lg, &m, ntt_generators[i], TRUE);
+        for (u_long k=0; k<len; k++) fa[k] = ntt_redc(&m, fa[k]);
+    }
+
+    /* Garner's CRT.  Each coefficient is less than 2^86, so we keep it
+       and the running carry in a pair of 64-bit words (hi:lo). */
+    const uint64_t p0 = ntt_primes[0], p1 = ntt_primes[1], p2 = ntt_primes[2];
+    const uint64_t p01 = p0 * p1;
+    const uint64_t inv_p0 = ntt_powmod((uint32_t)(p0 % p1), (uint32_t)p1-2,
+                                       (uint32_t)p1);
+    const uint64_t inv_p01 = ntt_powmod((uint32_t)(p01 % p2), (uint32_t)p2-2,
+                                        (uint32_t)p2);
+    uint64_t chi = 0, clo = 0;
+    mpn_zero(r, an+bn);
+    for (u_long k=0; k<ndigits; k++) {
+        uint64_t x0 = res[0][k];
+        uint64_t x1 = (res[1][k] + p1 - x0 % p1) % p1 * inv_p0 % p1;
+        uint64_t v = x0 + p0 * x1;                      /* < p0*p1 */
+        uint64_t x2 = (res[2][k] + p2 - v % p2) % p2 * inv_p01 % p2;
+        /* (hi:lo) = v + p01 * x2 */
+        uint64_t pl = (p01 & 0xffffffffU) * x2;
+        uint64_t ph = (p01 >> 32) * x2;
+        uint64_t lo = pl + (ph << 32);
+        uint64_t hi = (ph >> 32) + (lo < pl);
+        uint64_t lo2 = lo + v;
+        hi += (lo2 < lo);
+        /* carry += (hi:lo2) */
+        clo += lo2;
+        chi += hi + (clo < lo2);
+#if SIZEOF_LONG > 4
+        r[k/NTT_DIGITS_PER_WORD]
+            |= (u_long)(uint32_t)clo
+               << (NTT_DIGIT_BITS*(k%NTT_DIGITS_PER_WORD));
+#else
+        r[k] = (u_long)(uint32_t)clo;
+#endif
+        clo = (clo >> NTT_DIGIT_BITS) | (chi << (64-NTT_DIGIT_BITS));
+        chi >>= NTT_DIGIT_BITS;
+    }
+    SCM_ASSERT(clo == 0 && chi == 0);
+    return TRUE;
+}
+
+int Scm_BignumThreshold(int which)
+{
+    if (which < 0 || which >= SCM_BIGNUM_NUM_THRESHOLDS) {
+        Scm_Error("bignum threshold index out of range: %d", which);
+    }
+    return bignum_thresholds[which];
+}
+
+/* Returns the previous value. */
+int Scm_BignumSetThreshold(int which, int value)
+{
+    int prev = Scm_BignumThreshold(which);
+    if (value < 1) Scm_Error("bignum threshold must be positive: %d", value);
+    bignum_thresholds[which] = value;
+    return prev;
+}
+
+/* r[0..an+bn) = a[0..an) * b[0..bn), where an >= bn.
+   r must not overlap with a or b. */
+static void mpn_mul(u_long *r, const u_long *a, int an,
+                    const u_long *b, int bn)
+{
+    if (bn < KARATSUBA_THRESHOLD) {
+        mpn_mul_basecase(r, a, an, b, bn);
+        return;
+    }
+    if (bn >= NTT_THRESHOLD && mpn_mul_ntt(r, a, an, b, bn)) return;
+
+    u_long *scratch = SCM_NEW_ATOMIC_ARRAY(u_long,
+                                           MUL_SCRATCH_SIZE(bn) + 2*bn);
+    if (an == bn) {
+        mpn_mul_n(r, a, b, bn, scratch);
+        return;
+    }
+    /* Unbalanced case.  Slice A into BN-word pieces. */
+    u_long *t = scratch + MUL_SCRATCH_SIZE(bn);
+    mpn_zero(r, an+bn);
+    for (int off=0; off<an; off+=bn) {
+        int len = min(bn, an-off);
+        if (len == bn) mpn_mul_n(t, a+off, b, bn, scratch);
+        else           mpn_mul(t, b, bn, a+off, len);
+        u_long c = mpn_add_to(r+off, an+bn-off, t, bn+len);
+        SCM_ASSERT(c == 0);
+        (void)c;
+    }
+}
+
 /*-----------------------------------------------------------------------
  * Multiplication
  */
@@ -842,8 +1431,10 @@ static ScmBignum *bignum_mul_word(ScmBignum *br, const ScmBignum *bx,
 static ScmBignum *bignum_mul(const ScmBignum *bx, const ScmBignum *by)
 {
     ScmBignum *br = make_bignum(bx->size + by->size);
-    for (u_int i=0; i<by->size; i++) {
-        bignum_mul_word(br, bx, by->values[i], i);
+    if (bx->size >= by->size) {
+        mpn_mul(br->values, bx->values, bx->size, by->values, by->size);
+    } else {
+        mpn_mul(br->values, by->values, by->size, bx->values, bx->size);
     }
     br->sign = bx->sign * by->sign;
     return br;
@@ -1277,24 +1868,171 @@ int Scm_BignumLogCount(const ScmBignum *b)
  * Printing
  */
 
+/* Radix conversion.
+
+   We peel off a "chunk" of digits at a time, where the chunk is the
+   largest power of radix that fits in a half word, so that we can use
+   bignum_sdiv.  That's still quadratic, so for large numbers we divide
+   the number by radix^(2^k) recursively and convert both halves
+   independently (Cf. Knuth, section 4.4, and Brent & Zimmermann,
+   "Modern Computer Arithmetic", section 1.7).  The divisions are
+   done by Barrett reduction, so that they benefit from the subquadratic
+   multiplication.
+ */
+
+#define DC_RADIX_MAX_LEVEL 64
+
+typedef struct dc_radix_rec {
+    int radix;
+    const char *tab;
+    u_long chunk;               /* radix^chunk_digits */
+    int chunk_digits;
+    ScmObj pows[DC_RADIX_MAX_LEVEL];  /* chunk^(2^i) */
+    ScmObj mus[DC_RADIX_MAX_LEVEL];   /* reciprocal of pows[i], or #f */
+    long bits[DC_RADIX_MAX_LEVEL];    /* integer length of pows[i] */
+} dc_radix;
+
+/* integer length of nonnegative integer n */
+static long integer_bits(ScmObj n)
+{
+    if (SCM_INTP(n)) {
+        u_long v = (u_long)SCM_INT_VALUE(n);
+        long k = 0;
+        for (; v; v >>= 1) k++;
+        return k;
+    }
+    return Scm_BitsHighest1((ScmBits*)SCM_BIGNUM(n)->values, 0,
+                            (int)SCM_BIGNUM_SIZE(n)*WORD_BITS) + 1;
+}
+
+/* floor(2^(2b)/p), where p is a positive integer of b bits.
+   We get the reciprocal of the upper half of p recursively, then
+   refine it with one Newton iteration. */
+static ScmObj dc_reciprocal(ScmObj p, long b)
+{
+    ScmObj w = Scm_Ash(SCM_MAKE_INT(1), 2*b);
+    if (b <= (long)DC_RADIX_THRESHOLD * WORD_BITS) {
+        return Scm_Quotient(w, p, NULL);
+    }
+    long h = b/2 + 1;
+    ScmObj x = Scm_Ash(dc_reciprocal(Scm_Ash(p, -(b-h)), h), b-h);
+    ScmObj e = Scm_Sub(w, Scm_Mul(p, x));
+    x = Scm_Add(x, Scm_Ash(Scm_Mul(x, e), -2*b));
+    /* x is off by a few at most. */
+    ScmObj r = Scm_Sub(w, Scm_Mul(p, x));
+    while (Scm_Sign(r) < 0) {
+        x = Scm_Sub(x, SCM_MAKE_INT(1));
+        r = Scm_Add(r, p);
+    }
+    while (Scm_NumCmp(r, p) >= 0) {
+        x = Scm_Add(x, SCM_MAKE_INT(1));
+        r = Scm_Sub(r, p);
+    }
+    return x;
+}
+
+/* Writes n (0 <= n < radix^width) to buf[0..width), padding zeros. */
+static void radix_basecase(const dc_radix *d, ScmObj n, char *buf, long width)
+{
+    char *p = buf + width;
+    if (SCM_INTP(n)) {
+        for (u_long v = (u_long)SCM_INT_VALUE(n); v; v /= d->radix) {
+            *--p = d->tab[v % d->radix];
+        }
+    } else {
+        ScmBignum *q = SCM_BIGNUM(Scm_BignumCopy(SCM_BIGNUM(n)));
+        while (q->size > 0) {
+            u_long rem = bignum_sdiv(q, d->chunk);
+            while (q->size > 0 && q->values[q->size-1] == 0) q->size--;
+            for (int k=0; k<d->chunk_digits; k++) {
+                if (rem == 0 && q->size == 0) break;
+                *--p = d->tab[rem % d->radix];
+                rem /= d->radix;
+            }
+        }
+    }
+    SCM_ASSERT(p >= buf);
+    while (p > buf) *--p = '0';
+}
+
+/* Writes n (0 <= n < pows[i+1]) to buf, which has chunk_digits*2^(i+1)
+   characters. */
+static void radix_dc(dc_radix *d, ScmObj n, char *buf, int i)
+{
+    long width = (long)d->chunk_digits << (i+1);
+    if (i < 0 || !SCM_BIGNUMP(n)
+        || (int)SCM_BIGNUM_SIZE(n) < DC_RADIX_THRESHOLD) {
+        radix_basecase(d, n, buf, width);
+        return;
+    }
+    /* Barrett reduction: n = q * pows[i] + r */
+    ScmObj p = d->pows[i];
+    long b = d->bits[i];
+    if (SCM_FALSEP(d->mus[i])) d->mus[i] = dc_reciprocal(p, b);
+    ScmObj q = Scm_Ash(Scm_Mul(Scm_Ash(n, -(b-1)), d->mus[i]), -(b+1));
+    ScmObj r = Scm_Sub(n, Scm_Mul(q, p));
+    while (Scm_Sign(r) < 0) {
+        q = Scm_Sub(q, SCM_MAKE_INT(1));
+        r = Scm_Add(r, p);
+    }
+    while (Scm_NumCmp(r, p) >= 0) {
+        q = Scm_Add(q, SCM_MAKE_INT(1));
+        r = Scm_Sub(r, p);
+    }
+    radix_dc(d, q, buf, i-1);
+    radix_dc(d, r, buf + width/2, i-1);
+}
+
 ScmObj Scm_BignumToString(const ScmBignum *b, int radix, int use_upper)
 {
     static const char ltab[] = "0123456789abcdefghijklmnopqrstuvwxyz";
     static const char utab[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    const char *tab = use_upper? utab : ltab;
-    ScmObj h = SCM_NIL, t = SCM_NIL;
     if (radix < 2 || radix > 36)
         Scm_Error("radix out of range: %d", radix);
-    ScmBignum *q = SCM_BIGNUM(Scm_BignumCopy(b));
-    for (;q->size > 0;) {
-        long rem = bignum_sdiv(q, radix);
-        SCM_ASSERT(rem >= 0 && rem < radix);
-        SCM_APPEND1(h, t, SCM_MAKE_CHAR(tab[rem]));
-        for (; q->values[q->size-1] == 0 && q->size > 0; q->size--)
-            ;
-    }
-    if (q->sign < 0) SCM_APPEND1(h, t, SCM_MAKE_CHAR('-'));
-    return Scm_ListToString(Scm_ReverseX(h));
+
+    dc_radix d;
+    d.radix = radix;
+    d.tab = use_upper? utab : ltab;
+    d.chunk = radix;
+    d.chunk_digits = 1;
+    while (d.chunk * radix < (1UL << HALF_BITS)) {
+        d.chunk *= radix;
+        d.chunk_digits++;
+    }
+
+    ScmBignum *a = SCM_BIGNUM(Scm_BignumCopy(b));
+    a->sign = 1;
+    ScmObj n = SCM_OBJ(a);
+    long width;
+    int top = -1;
+    if ((int)a->size < DC_RADIX_THRESHOLD) {
+        int lg = 0;
+        while ((2 << lg) <= radix) lg++;
+        width = (long)a->size * WORD_BITS / lg + 1;
+    } else {
+        /* find the smallest top such that pows[top]^2 > n */
+        d.pows[0] = Scm_MakeIntegerU(d.chunk);
+        for (top = 0;; top++) {
+            SCM_ASSERT(top < DC_RADIX_MAX_LEVEL-1);
+            d.bits[top] = integer_bits(d.pows[top]);
+            d.mus[top] = SCM_FALSE;
+            d.pows[top+1] = Scm_Mul(d.pows[top], d.pows[top]);
+            if (Scm_NumCmp(d.pows[top+1], n) > 0) break;
+        }
+        width = (long)d.chunk_digits << (top+1);
+    }
+
+    char *buf = SCM_NEW_ATOMIC2(char*, width+1);
+    char *digits = buf + 1;
+    if (top < 0) radix_basecase(&d, n, digits, width);
+    else         radix_dc(&d, n, digits, top);
+
+    long s = 0;
+    while (s < width-1 && digits[s] == '0') s++;
+    char *start = digits + s;
+    if (b->sign < 0) *--start = '-';
+    long len = digits + width - start;
+    return Scm_MakeString(start, len, len, SCM_STRING_COPYING);
 }
 
 int Scm_DumpBignum(const ScmBignum *b, ScmPort *out)
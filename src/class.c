@@ -40,6 +40,7 @@
 #include "gauche/priv/macroP.h"
 #include "gauche/priv/writerP.h"
 #include "gauche/priv/dispatchP.h"
+#include "gauche/priv/atomicP.h"
 
 /* Some routines uses small array on stack to keep data about
    arguments to dispatch.  If the # of args used for dispach is bigger
@@ -2020,6 +2021,53 @@ static ScmObj fallback_compare(ScmObj *argv, int argc, ScmGeneric *gf)
  * Generic function
  */
 
+/* The state of automatic dispatcher building is kept in a separate
+   structure pointed by gf->dispatcher, instead of ScmGeneric itself,
+   so that the layout of ScmGeneric (which extensions allocate statically
+   with SCM_DEFINE_GENERIC) doesn't change.  It is created on demand,
+   and once created, gf->dispatcher keeps pointing to it.
+   The fields are modified while holding gf->lock, except callCount. */
+typedef struct generic_state_rec {
+    ScmMethodDispatcher *dis;   /* the dispatcher, or NULL */
+    u_long callCount;           /* # of calls while dis is NULL.  Not
+                                   exact under concurrent calls, and
+                                   stays once it reaches the threshold. */
+    int numMethods;             /* length of gf->methods */
+} generic_state;
+
+/* Returns the state of GF, or NULL if it hasn't been created. */
+static inline generic_state *gf_state(ScmGeneric *gf)
+{
+    return (generic_state*)AO_load_acquire((AO_t*)&gf->dispatcher);
+}
+
+/* Returns the state of GF, creating it if necessary.
+   Must be called without holding gf->lock. */
+static generic_state *gf_state_ensure(ScmGeneric *gf)
+{
+    generic_state *st = gf_state(gf);
+    if (st == NULL) {
+        generic_state *z = SCM_NEW(generic_state);
+        z->dis = NULL;
+        z->callCount = 0;
+        (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
+        st = (generic_state*)gf->dispatcher;
+        if (st == NULL) {
+            z->numMethods = Scm_Length(gf->methods);
+            AO_store_release((AO_t*)&gf->dispatcher, (AO_t)z);
+            st = z;
+        }
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+    }
+    return st;
+}
+
+static inline ScmMethodDispatcher *gf_dispatcher(ScmGeneric *gf)
+{
+    generic_state *st = gf_state(gf);
+    return st ? st->dis : NULL;
+}
+
 static ScmObj generic_allocate(ScmClass *klass, ScmObj initargs SCM_UNUSED)
 {
     ScmGeneric *gf = SCM_NEW_INSTANCE(ScmGeneric, klass);
@@ -2068,9 +2116,10 @@ static ScmObj generic_methods(ScmGeneric *gf)
 
 static void generic_methods_set(ScmGeneric *gf, ScmObj val)
 {
-    int reqs = 0;
+    int reqs = 0, nmethods = 0;
     ScmObj cp;
     SCM_FOR_EACH(cp, val) {
+        nmethods++;
         if (!SCM_METHODP(SCM_CAR(cp))) {
             Scm_Error("The methods slot of <generic> must be a list of method, but given: %S", val);
         }
@@ -2081,9 +2130,14 @@ static void generic_methods_set(ScmGeneric *gf, ScmObj val)
     if (!SCM_NULLP(cp)) {
         Scm_Error("The methods slot of <generic> cannot contain an improper list: %S", val);
     }
+    generic_state *st = gf_state_ensure(gf);
     (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
     gf->methods = val;
     gf->maxReqargs = reqs;
+    st->dis = NULL;
+    st->callCount = 0;
+    st->numMethods = nmethods;
+    Scm__MethodGenerationBump();
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
 }
 
@@ -2143,12 +2197,56 @@ int Scm_MethodApplicableForClasses(ScmMethod *m, ScmClass *types[], int nargs)
     return TRUE;
 }
 
+/* Build dispatcher of GF with axis 0 if it is worth to do so.
+   Called when GF crosses one of the thresholds in priv/dispatchP.h.
+   ST is the state of GF.  Caller must hold gf->lock iff LOCKED is TRUE. */
+static ScmMethodDispatcher *maybe_build_dispatcher(ScmGeneric *gf,
+                                                   generic_state *st,
+                                                   int locked)
+{
+    if (disable_generic_dispatcher) return NULL;
+    if (!locked) (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
+    if (st->dis == NULL
+        && Scm__MethodDispatcherWorthBuilding(gf->methods, 0)) {
+        st->dis = Scm__BuildMethodDispatcher(gf->methods, 0);
+    }
+    ScmMethodDispatcher *dis = st->dis;
+    if (!locked) (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+    return dis;
+}
+
+/* Pick applicable methods for TYPEV from the method list METHODS. */
+static ScmObj applicable_methods(ScmObj methods, ScmClass **typev, int argc)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL, mp;
+
+    SCM_ASSERT(SCM_PAIRP(methods));
+    if (SCM_NULLP(SCM_CDR(methods))) {
+        /* We have only one method, so just check its applicability
+           and retrun the list without allocation if possible. */
+        if (Scm_MethodApplicableForClasses(SCM_METHOD(SCM_CAR(methods)),
+                                           typev, argc)) {
+            return methods;
+        } else {
+            return SCM_NIL;
+        }
+    } else {
+        SCM_FOR_EACH(mp, methods) {
+            ScmObj m = SCM_CAR(mp);
+            SCM_ASSERT(SCM_METHODP(m));
+            if (Scm_MethodApplicableForClasses(SCM_METHOD(m), typev, argc)) {
+                SCM_APPEND1(h, t, SCM_OBJ(m));
+            }
+        }
+        return h;
+    }
+}
+
 /* compute-applicable-methods */
 ScmObj Scm_ComputeApplicableMethods(ScmGeneric *gf, ScmObj *argv, int argc,
                                     int applyargs)
 {
-    ScmObj methods = gf->methods, mp, ap;
-    ScmObj h = SCM_NIL, t = SCM_NIL;
+    ScmObj methods = gf->methods, ap;
     ScmClass *typev_s[PREALLOC_SIZE], **typev = typev_s;
     int i, nsel;
 
@@ -2169,34 +2267,32 @@ ScmObj Scm_ComputeApplicableMethods(ScmGeneric *gf, ScmObj *argv, int argc,
         }
     }
 
-    if (gf->dispatcher
+    /* The counter isn't atomic, so concurrent calls may lose updates.
+       We only care that someone sees it reach the threshold; after that
+       it stays there and we don't try again. */
+    generic_state *st = gf_state(gf);
+    ScmMethodDispatcher *dis = st ? st->dis : NULL;
+    if (dis == NULL) {
+        if (st == NULL) st = gf_state_ensure(gf);
+        if (st->callCount < SCM_DISPATCHER_CALL_THRESHOLD
+            && ++st->callCount >= SCM_DISPATCHER_CALL_THRESHOLD) {
+            dis = maybe_build_dispatcher(gf, st, FALSE);
+        }
+    }
+
+    if (dis
         && argc <= SCM_DISPATCHER_MAX_NARGS
         && argc >= 1) {
-        ScmMethodDispatcher *dis = (ScmMethodDispatcher*)gf->dispatcher;
         ScmObj p = Scm__MethodDispatcherLookup(dis, typev, argc);
-        if (SCM_PAIRP(p)) methods = p;
-    }
-
-    SCM_ASSERT(SCM_PAIRP(methods));
-    if (SCM_NULLP(SCM_CDR(methods))) {
-        /* We have only one method, so just check its applicability
-           and retrun the list without allocation if possible. */
-        if (Scm_MethodApplicableForClasses(SCM_METHOD(SCM_CAR(methods)),
-                                           typev, argc)) {
-            return methods;
-        } else {
-            return SCM_NIL;
+        if (SCM_PAIRP(p)) {
+            ScmObj r = applicable_methods(p, typev, argc);
+            if (!SCM_NULLP(r)) return r;
+            /* The leaf methods on the axis class don't match the
+               rest of arguments.  Less specific methods may. */
+            Scm__MethodDispatcherFallback(dis);
         }
-    } else {
-        SCM_FOR_EACH(mp, methods) {
-            ScmObj m = SCM_CAR(mp);
-            SCM_ASSERT(SCM_METHODP(m));
-            if (Scm_MethodApplicableForClasses(SCM_METHOD(m), typev, argc)) {
-                SCM_APPEND1(h, t, SCM_OBJ(m));
-            }
-        }
-        return h;
     }
+    return applicable_methods(methods, typev, argc);
 }
 
 static ScmObj compute_applicable_methods(ScmNextMethod *nm SCM_UNUSED,
@@ -2341,8 +2437,9 @@ ScmObj Scm__GenericBuildDispatcher(ScmGeneric *gf, int axis)
 {
     if (!disable_generic_dispatcher
         && axis >= 0 && axis < SCM_DISPATCHER_MAX_NARGS) {
+        generic_state *st = gf_state_ensure(gf);
         (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
-        gf->dispatcher = Scm__BuildMethodDispatcher(gf->methods, axis);
+        st->dis = Scm__BuildMethodDispatcher(gf->methods, axis);
         (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
         return SCM_TRUE;
     } else {
@@ -2350,19 +2447,25 @@ ScmObj Scm__GenericBuildDispatcher(ScmGeneric *gf, int axis)
     }
 }
 
-/* Developer API */
+/* Developer API.
+   Resetting callCount lets the dispatcher be rebuilt automatically
+   after the gf is called enough times again. */
 void Scm__GenericInvalidateDispatcher(ScmGeneric *gf)
 {
+    generic_state *st = gf_state(gf);
+    if (st == NULL) return;
     (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
-    gf->dispatcher = NULL;
+    st->dis = NULL;
+    st->callCount = 0;
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
 }
 
 /* Developer API */
 ScmObj Scm__GenericDispatcherInfo(ScmGeneric *gf)
 {
-    if (gf->dispatcher) {
-        return Scm__MethodDispatcherInfo(gf->dispatcher);
+    ScmMethodDispatcher *dis = gf_dispatcher(gf);
+    if (dis) {
+        return Scm__MethodDispatcherInfo(dis);
     } else {
         return SCM_FALSE;
     }
@@ -2371,9 +2474,10 @@ ScmObj Scm__GenericDispatcherInfo(ScmGeneric *gf)
 /* Developer API */
 void Scm__GenericDispatcherDump(ScmGeneric *gf, ScmPort *port)
 {
-    if (gf->dispatcher) {
+    ScmMethodDispatcher *dis = gf_dispatcher(gf);
+    if (dis) {
         Scm_Printf(port, "%S's dispatcher:\n", gf);
-        Scm__MethodDispatcherDump((ScmMethodDispatcher*)gf->dispatcher, port);
+        Scm__MethodDispatcherDump(dis, port);
     } else {
         Scm_Printf(port, "%S doesn't have a dispatcher.\n", gf);
     }
@@ -2579,6 +2683,7 @@ ScmObj Scm_UpdateDirectMethod(ScmMethod *m, ScmClass *old, ScmClass *newc)
        dispatcher table for every invocation of it.
      */
     Scm__GenericInvalidateDispatcher(m->generic);
+    Scm__MethodGenerationBump();
     return SCM_OBJ(m);
 }
 
@@ -2627,6 +2732,7 @@ ScmObj Scm_AddMethod(ScmGeneric *gf, ScmMethod *method)
        If so, we replace the method instead of adding it.  */
     ScmMethod *replaced = NULL;
     ScmMethod *method_locked = NULL;
+    generic_state *st = gf_state_ensure(gf);
     (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
     ScmObj mp;
     SCM_FOR_EACH(mp, gf->methods) {
@@ -2653,13 +2759,18 @@ ScmObj Scm_AddMethod(ScmGeneric *gf, ScmMethod *method)
     }
     if (!replaced && (method_locked == NULL)) {
         gf->methods = pair;
+        st->numMethods++;
         gf->maxReqargs = reqs;
     }
-    if (gf->dispatcher && (method_locked == NULL)) {
-        ScmMethodDispatcher *dis = (ScmMethodDispatcher*)gf->dispatcher;
+    if (st->dis && (method_locked == NULL)) {
+        ScmMethodDispatcher *dis = st->dis;
         if (replaced) Scm__MethodDispatcherDelete(dis, replaced);
         Scm__MethodDispatcherAdd(dis, method);
+    } else if (!replaced && (method_locked == NULL)
+               && st->numMethods > SCM_DISPATCHER_METHOD_THRESHOLD) {
+        (void)maybe_build_dispatcher(gf, st, TRUE);
     }
+    if (method_locked == NULL) Scm__MethodGenerationBump();
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
 
     if (method_locked != NULL) {
@@ -2693,16 +2804,19 @@ ScmObj Scm_DeleteMethod(ScmGeneric *gf, ScmMethod *method)
 {
     if (!method->generic || method->generic != gf) return SCM_UNDEFINED;
 
+    generic_state *st = gf_state_ensure(gf);
     (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
     ScmObj mp = gf->methods;
     if (SCM_PAIRP(mp)) {
         if (SCM_EQ(SCM_CAR(mp), SCM_OBJ(method))) {
             gf->methods = SCM_CDR(mp);
+            st->numMethods--;
             method->generic = NULL;
         } else {
             while (SCM_PAIRP(SCM_CDR(mp))) {
                 if (SCM_EQ(SCM_CADR(mp), SCM_OBJ(method))) {
                     SCM_CDR(mp) = SCM_CDDR(mp);
+                    st->numMethods--;
                     method->generic = NULL;
                     break;
                 }
@@ -2710,9 +2824,8 @@ ScmObj Scm_DeleteMethod(ScmGeneric *gf, ScmMethod *method)
             }
         }
     }
-    if (gf->dispatcher) {
-        Scm__MethodDispatcherDelete((ScmMethodDispatcher*)gf->dispatcher,
-                                    method);
+    if (st->dis) {
+        Scm__MethodDispatcherDelete(st->dis, method);
     }
     SCM_FOR_EACH(mp, gf->methods) {
         /* sync # of required selector */
@@ -2720,6 +2833,7 @@ ScmObj Scm_DeleteMethod(ScmGeneric *gf, ScmMethod *method)
             gf->maxReqargs = SCM_PROCEDURE_REQUIRED(SCM_CAR(mp));
         }
     }
+    Scm__MethodGenerationBump();
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
     return SCM_UNDEFINED;
 }
@@ -3406,6 +3520,7 @@ void Scm__InitClass(void)
 
     /* hash.c */
     CINIT(SCM_CLASS_HASH_TABLE,       "<hash-table>");
+    CINIT(SCM_CLASS_CONCURRENT_HASH_TABLE, "<concurrent-hash-table>");
 
     /* list.c */
     CINIT(SCM_CLASS_LIST,             "<list>");
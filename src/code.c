@@ -79,6 +79,9 @@ static ScmCompiledCode *make_compiled_code(void)
     cc->name = SCM_FALSE;
     cc->parent = SCM_FALSE;
     cc->builder = NULL;
+    cc->callCache = NULL;
+    cc->jitCount = 0;
+    cc->jitEntries = NULL;
     return cc;
 }
 
@@ -93,6 +96,9 @@ void Scm_CompiledCodeCopyX(ScmCompiledCode *dest,
     SCM_ASSERT(src->builder == NULL);
 
     memcpy(dest, src, sizeof(ScmCompiledCode));
+    dest->callCache = NULL;     /* keyed by src's pc; useless for dest */
+    dest->jitCount = 0;         /* ditto */
+    dest->jitEntries = NULL;
 }
 
 /*----------------------------------------------------------------------
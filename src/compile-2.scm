@@ -454,7 +454,67 @@
         ($call-args-set! jcall (adjust-arglist nreqs nopts ($call-args jcall)
                                                name))
         ($call-proc-set! jcall call)
-        ($call-flag-set! jcall 'jump)))))
+        ($call-flag-set! jcall 'jump)))
+    ($call-flonum-loop-set! call (pass2/flonum-loop? lambda-node call
+                                                     rec-calls))))
+
+;; Type inference of loop variables.
+;; Returns #t if the embedded local function LAMBDA-NODE is a loop that
+;; carries flonums in its arguments.  Pass 5 lets such a loop reuse the
+;; same flonum registers across iterations, instead of consuming fpstack
+;; on every iteration (see pass5/embed-call).
+;;
+;; An argument is regarded as a flonum if its initial value and all the
+;; values passed to it by jump calls are flonum expressions, assuming
+;; the same of the other arguments.  We start from all immutable
+;; arguments, and drop the ones that fail the condition until it converges.
+;; Note that this is merely a heuristic to pick the loops that can benefit;
+;; the code Pass 5 generates works no matter what the arguments really are.
+(define (pass2/flonum-loop? lambda-node call rec-calls)
+  (define arglists
+    (cons ($call-args call) (imap (^[c] ($call-args c)) rec-calls)))
+  (define (narrow cands)
+    (let loop ([lvars ($lambda-lvars lambda-node)] [k 0] [r '()])
+      (cond [(null? lvars) (reverse r)]
+            [(and (memq (car lvars) cands)
+                  (every (^[args] (pass2/flonum-expr? (list-ref args k)
+                                                      cands 3))
+                         arglists))
+             (loop (cdr lvars) (+ k 1) (cons (car lvars) r))]
+            [else (loop (cdr lvars) (+ k 1) r)])))
+  (and (pair? rec-calls)
+       (let loop ([cands (filter lvar-immutable? ($lambda-lvars lambda-node))])
+         (and (pair? cands)
+              (let1 cands2 (narrow cands)
+                (or (= (length cands2) (length cands))
+                    (loop cands2)))))))
+
+;; Returns #t if IFORM is likely to yield a flonum, given that lvars
+;; in CANDS hold flonums.  DEPTH limits how far we follow the initial
+;; values of local variables.
+(define (pass2/flonum-expr? iform cands depth)
+  (case/unquote
+   (iform-tag iform)
+   [($CONST) (flonum? ($const-value iform))]
+   [($LREF) (let1 lvar ($lref-lvar iform)
+              (or (memq lvar cands)
+                  (and (> depth 0)
+                       (and-let1 init (lvar-const-value lvar)
+                         (pass2/flonum-expr? init cands (- depth 1))))))]
+   [($ASM) (case/unquote
+            (car ($asm-insn iform))
+            [(NUMIADD2 NUMISUB2 NUMIMUL2 NUMIDIV2) #t]
+            [(NUMADD2 NUMSUB2 NUMMUL2 NUMDIV2)
+             (any (cut pass2/flonum-expr? <> cands depth) ($asm-args iform))]
+            [(NEGATE) (pass2/flonum-expr? (car ($asm-args iform)) cands depth)]
+            [else #f])]
+   [($IF) (and (pass2/flonum-expr? ($if-then iform) cands depth)
+               (pass2/flonum-expr? ($if-else iform) cands depth))]
+   [($LET) (pass2/flonum-expr? ($let-body iform) cands depth)]
+   [($SEQ) (let1 body ($seq-body iform)
+             (and (pair? body)
+                  (pass2/flonum-expr? (car (last-pair body)) cands depth)))]
+   [else #f]))
 
 ;; Called when the local function (lambda-node) doesn't have recursive
 ;; calls, can be inlined, and called from multiple places.
@@ -714,20 +714,38 @@
 ;;   $call-proc has $lambda node.  We inline its body.
 ;;   We also record the RENV to the current node, so that the jump calls
 ;;   to the inlined body can adjust env frame properly.
+;;
+;;   If Pass 2 found the embedded body is a loop carrying flonums
+;;   ($call-flonum-loop is #t), we make it a "flonum loop".  Without
+;;   special treatment, each iteration allocates new flonum registers
+;;   on fpstack for the loop arguments, and once fpstack is full, the
+;;   VM flushes it and moves all the live flonums to the heap.  In a
+;;   flonum loop, FPSTACK-MARK reserves a flonum register for each
+;;   argument at the loop entry, and FPSTACK-RESET at each back edge
+;;   moves the new arguments into them and reclaims the registers used
+;;   in the iteration.  The mark FPSTACK-MARK pushes is kept as the
+;;   hidden first slot of the loop's env frame; since we count the offset
+;;   of local variables from the end of the frame, the real arguments
+;;   are accessed as usual.
 (define (pass5/embed-call iform ccb renv ctx)
   (let* ([proc ($call-proc iform)]
          [args ($call-args iform)]
          [nargs (length args)]
+         [flonum-loop? ($call-flonum-loop iform)]
+         [nslots (if flonum-loop? (+ nargs 1) nargs)]
          [label ($lambda-body proc)]
          [lvars ($lambda-lvars proc)]
          [newenv (if (= nargs 0) renv (cons lvars renv))]
          [merge-label (compiled-code-new-label ccb)])
     ($call-renv-set! iform (reverse renv))
     (unless (tail-context? ctx)
-      (compiled-code-emit1oi! ccb PRE-CALL nargs merge-label ($*-src iform)))
+      (compiled-code-emit1oi! ccb PRE-CALL nslots merge-label ($*-src iform)))
+    (when flonum-loop?
+      (compiled-code-emit1i! ccb FPSTACK-MARK nargs ($*-src iform)))
     (let1 dinit (if (> nargs 0)
-                  (rlet1 d (pass5/prepare-args args ccb renv ctx)
-                    (compiled-code-emit1i! ccb LOCAL-ENV nargs ($*-src iform))
+                  (rlet1 d (+ (pass5/prepare-args args ccb renv ctx)
+                              (- nslots nargs))
+                    (compiled-code-emit1i! ccb LOCAL-ENV nslots ($*-src iform))
                     (pass5/box-mutable-lvars lvars ccb))
                   0)
       (compiled-code-set-label! ccb (pass5/ensure-label ccb label))
@@ -736,40 +754,58 @@
         (compiled-code-set-label! ccb merge-label)
         (if (= nargs 0)
           (+ CONT_FRAME_SIZE dbody)
-          (imax dinit (+ nargs ENV_HEADER_SIZE CONT_FRAME_SIZE dbody)))))
+          (imax dinit (+ nslots ENV_HEADER_SIZE CONT_FRAME_SIZE dbody)))))
     ))
 
 ;; Jump call
 ;;   $call-proc has a $call[embed] node, whose proc slot has $lambda
 ;;   node, whose proc slot has $label node.
+;;   If the embed node is a flonum loop, we pass the mark as the hidden
+;;   first argument.  A tail jump passes the mark of the current iteration
+;;   and resets fpstack to it; a non-tail jump needs to keep the registers
+;;   of the current iteration, so it makes a new mark.
 ;; NB: we're not sure whether we'll have non-tail jump call yet.
 (define (pass5/jump-call iform ccb renv ctx)
   (let ([args ($call-args iform)]
         [embed-node ($call-proc iform)])
-    (let ([nargs (length args)]
-          [label ($lambda-body ($call-proc embed-node))]
-          [lvars ($lambda-lvars ($call-proc embed-node))]
-          [renv-diff (list-remove-prefix ($call-renv embed-node)
-                                         (reverse renv))])
+    (let* ([nargs (length args)]
+           [flonum-loop? ($call-flonum-loop embed-node)]
+           [nslots (if flonum-loop? (+ nargs 1) nargs)]
+           [label ($lambda-body ($call-proc embed-node))]
+           [lvars ($lambda-lvars ($call-proc embed-node))]
+           [renv-diff (list-remove-prefix ($call-renv embed-node)
+                                          (reverse renv))])
       (unless renv-diff
         (errorf "[internal error] $call[jump] appeared out of context of related $call[embed] (~s vs ~s)"
                 ($call-renv embed-node) renv))
       (if (tail-context? ctx)
-        (let1 dinit (pass5/prepare-args args ccb renv ctx)
-          (pass5/emit-local-env-jump ccb lvars (length renv-diff)
-                                     (pass5/ensure-label ccb label)
-                                     ($*-src iform))
-          (if (= nargs 0) 0 (imax dinit (+ nargs ENV_HEADER_SIZE))))
+        (begin
+          (when flonum-loop?
+            (compiled-code-emit2i! ccb LREF (- (length renv-diff) 1) nargs
+                                   '%fpstack-mark)
+            (compiled-code-emit-PUSH! ccb))
+          (let1 dinit (+ (pass5/prepare-args args ccb renv ctx)
+                         (- nslots nargs))
+            (when flonum-loop?
+              (compiled-code-emit0! ccb FPSTACK-RESET))
+            (pass5/emit-local-env-jump ccb lvars (length renv-diff)
+                                       (pass5/ensure-label ccb label)
+                                       ($*-src iform))
+            (if (= nargs 0) 0 (imax dinit (+ nslots ENV_HEADER_SIZE)))))
         (let1 merge-label (compiled-code-new-label ccb)
-          (compiled-code-emit1oi! ccb PRE-CALL nargs merge-label ($*-src iform))
-          (let1 dinit (pass5/prepare-args args ccb renv ctx)
+          (compiled-code-emit1oi! ccb PRE-CALL nslots merge-label
+                                  ($*-src iform))
+          (when flonum-loop?
+            (compiled-code-emit1i! ccb FPSTACK-MARK nargs ($*-src iform)))
+          (let1 dinit (+ (pass5/prepare-args args ccb renv ctx)
+                         (- nslots nargs))
             (pass5/emit-local-env-jump ccb lvars (length renv-diff)
                                        (pass5/ensure-label ccb label)
                                        ($*-src iform))
             (compiled-code-set-label! ccb merge-label)
             (if (= nargs 0)
               CONT_FRAME_SIZE
-              (imax dinit (+ nargs ENV_HEADER_SIZE CONT_FRAME_SIZE)))))
+              (imax dinit (+ nslots ENV_HEADER_SIZE CONT_FRAME_SIZE)))))
         ))))
 
 (define (pass5/emit-local-env-jump ccb lvars env-depth label src)
@@ -615,6 +615,8 @@
    ;; Transient slots
    (renv '()) ; runtime env.  used in embed calls to record depth of env
               ;   in Pass 5.
+   (flonum-loop #f) ; #t if this is an embed call of a loop that mostly
+              ;   carries flonums.  Set by Pass 2; see pass2/flonum-loop?.
    ))
 
 (define-inline ($call? iform) (has-tag? iform $CALL))
@@ -81,6 +81,7 @@ extern void Scm__InitRead(void);
 extern void Scm__InitSignal(void);
 extern void Scm__InitSystem(void);
 extern void Scm__InitVM(void);
+extern void Scm__InitJit(void);
 extern void Scm__InitAutoloads(void);
 extern void Scm__InitCollection(void);
 extern void Scm__InitComparator(void);
@@ -153,6 +154,7 @@ void Scm_Init(const char *signature)
        rely on the other components to be initialized. */
     Scm__InitParameter();
     Scm__InitVM();
+    Scm__InitJit();
     Scm__InitHash();
     Scm__InitSymbol();
     Scm__InitModule();
@@ -33,13 +33,15 @@
 
 #define LIBGAUCHE_BODY
 #include "gauche.h"
+#include "gauche/code.h"
 #include "gauche/priv/atomicP.h"
 #include "gauche/priv/dispatchP.h"
 
 /*
  * Method dispatch acceleration
  *
- *  gf->dispatcher may contain a structure that accelerates method dispatch.
+ *  A gf may have a structure that accelerates method dispatch.  class.c
+ *  keeps it in the per-gf state pointed by gf->dispatcher.
  *  The structure must be treated as opaque from other parts.
  *
  *  In the current implementation, we use special open-addressing hash table.
@@ -51,13 +53,14 @@
  *   - It is in performance critical path, and we can take advantage of
  *     domain knowledge to make it faster than generic implementation.
  *
- *  At this moment, the dispatch accelerator isn't built automatically.
- *  You need to call gauche.object#generic-build-dispatcher! explicitly
- *  on a generic function.  The effect varies depending on the methods
- *  the GF has, so we selectively turn on this feature for speed-sensitive
- *  GFs and see how it goes.  If it is proven to be effective enough,
- *  we might implement an automated mechanism when GF meets certain
- *  criteria.
+ *  The dispatch accelerator can be built explicitly by calling
+ *  gauche.object#generic-build-dispatcher! on a generic function.
+ *  Besides that, class.c counts the calls of GFs that don't have
+ *  a dispatcher, and builds one with axis 0 automatically once the GF is
+ *  called often enough or gets many methods (see SCM_DISPATCHER_*_THRESHOLD
+ *  in priv/dispatchP.h).  We only do so when the dispatcher can actually
+ *  narrow down the candidates, which is checked by
+ *  Scm__MethodDispatcherWorthBuilding.
  *
  *  We take advantage of the following facts:
  *
@@ -119,6 +122,8 @@ struct ScmMethodDispatcherRec {
                                    This is immutable. */
     AO_t methodHash;            /* mhash.  In case mhash is extended,
                                    we atomically swap reference. */
+    u_long hits;                /* statistics.  we don't lock to update */
+    u_long misses;              /*   them, so they're not exact under MT. */
 };
 
 typedef struct mhash_entry_rec {
@@ -267,7 +272,7 @@ static mhash *mhash_delete(mhash *h, ScmClass *k, int nargs, ScmMethod *m)
                 mn = Scm_Delete(SCM_OBJ(m), mn, SCM_CMP_EQ);
             }
 
-            if (SCM_NULLP(ml) && SCM_NULLP(ml)) {
+            if (SCM_NULLP(ml) && SCM_NULLP(mn)) {
                 h->num_entries--;
                 AO_store(&h->bins[j], 1); /* mark as deleted */
             } else {
@@ -308,7 +313,7 @@ static void mhash_print(mhash *h, ScmPort *out)
 static mhash *add_method_to_dispatcher(mhash *h, int axis, ScmMethod *m)
 {
     int req = SCM_PROCEDURE_REQUIRED(m);
-    if (req >= axis) {
+    if (req > axis) {
         ScmClass *klass = m->specializers[axis];
         if (SCM_PROCEDURE_OPTIONAL(m)) {
             for (int k = req; k < SCM_DISPATCHER_MAX_NARGS; k++)
@@ -323,7 +328,7 @@ static mhash *add_method_to_dispatcher(mhash *h, int axis, ScmMethod *m)
 static mhash *delete_method_from_dispatcher(mhash *h, int axis, ScmMethod *m)
 {
     int req = SCM_PROCEDURE_REQUIRED(m);
-    if (req >= axis) {
+    if (req > axis) {
         ScmClass *klass = m->specializers[axis];
         if (SCM_PROCEDURE_OPTIONAL(m)) {
             for (int k = req; k < SCM_DISPATCHER_MAX_NARGS; k++)
@@ -356,9 +361,30 @@ ScmMethodDispatcher *Scm__BuildMethodDispatcher(ScmObj methods, int axis)
     ScmMethodDispatcher *dis = SCM_NEW(ScmMethodDispatcher);
     dis->axis = axis;
     dis->methodHash = (AO_t)mh;
+    dis->hits = 0;
+    dis->misses = 0;
     return dis;
 }
 
+/* Returns TRUE iff building dispatcher on AXIS can make difference,
+   that is, there are at least two leaf methods specialized by
+   different classes on AXIS.   Called from class.c to decide whether
+   we build the dispatcher automatically. */
+int Scm__MethodDispatcherWorthBuilding(ScmObj methods, int axis)
+{
+    ScmClass *first = NULL;
+    ScmObj mm;
+    SCM_FOR_EACH(mm, methods) {
+        ScmMethod *m = SCM_METHOD(SCM_CAR(mm));
+        if (!SCM_METHOD_LEAF_P(m) || SCM_PROCEDURE_REQUIRED(m) <= axis) {
+            continue;
+        }
+        if (first == NULL) first = m->specializers[axis];
+        else if (first != m->specializers[axis]) return TRUE;
+    }
+    return FALSE;
+}
+
 void Scm__MethodDispatcherAdd(ScmMethodDispatcher *dis, ScmMethod *m)
 {
     mhash *h = (mhash*)AO_load(&dis->methodHash);
@@ -376,15 +402,28 @@ void Scm__MethodDispatcherDelete(ScmMethodDispatcher *dis, ScmMethod *m)
 ScmObj Scm__MethodDispatcherLookup(ScmMethodDispatcher *dis,
                                    ScmClass **typev, int argc)
 {
-    if (dis->axis <= argc) {
+    if (dis->axis < argc) {
         ScmClass *selector = typev[dis->axis];
         mhash *h = (mhash*)AO_load(&dis->methodHash);
-        return mhash_probe(h, selector, argc);
+        ScmObj r = mhash_probe(h, selector, argc);
+        if (SCM_PAIRP(r)) dis->hits++;
+        else dis->misses++;
+        return r;
     } else {
+        dis->misses++;
         return SCM_FALSE;
     }
 }
 
+/* Called when Lookup returned candidates but none of them turned out
+   to be applicable, so the caller had to take the normal path.  We count
+   it as a miss. */
+void Scm__MethodDispatcherFallback(ScmMethodDispatcher *dis)
+{
+    dis->hits--;
+    dis->misses++;
+}
+
 ScmObj Scm__MethodDispatcherInfo(const ScmMethodDispatcher *dis)
 {
     ScmObj h = SCM_NIL, t = SCM_NIL;
@@ -393,12 +432,180 @@ ScmObj Scm__MethodDispatcherInfo(const ScmMethodDispatcher *dis)
     SCM_APPEND1(h, t, SCM_MAKE_INT(dis->axis));
     SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("num-entries"));
     SCM_APPEND1(h, t, SCM_MAKE_INT(mh->num_entries));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("hits"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(dis->hits));
+    SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("misses"));
+    SCM_APPEND1(h, t, Scm_MakeIntegerU(dis->misses));
     return h;
 }
 
 void Scm__MethodDispatcherDump(ScmMethodDispatcher *dis, ScmPort *port)
 {
-    Scm_Printf(port, "MethodDispatcher axis=%d\n", dis->axis);
+    Scm_Printf(port, "MethodDispatcher axis=%d hits=%lu misses=%lu\n",
+               dis->axis, dis->hits, dis->misses);
     mhash_print((mhash*)dis->methodHash, port);
 }
 
+
+/*
+ * Call site cache
+ *
+ *  The dispatcher above is per-GF.  In addition, VM keeps the result of
+ *  method lookup (sorted list of applicable methods) per call site,
+ *  so that the generic function call from the same place with the same
+ *  argument types can skip compute-applicable-methods and sort-methods
+ *  entirely.
+ *
+ *  Each ScmCompiledCode has a lazily allocated table (callCache), whose
+ *  bins are direct-mapped by the offset of the call site.  Each bin
+ *  holds a call_site record, which can cache up to CALL_SITE_WAYS
+ *  entries of (gf, argc, types of args) -> methods.  If a site sees
+ *  more variations, we mark it megamorphic and stop caching there.
+ *
+ *  Invalidation: The cached result is valid only while the set of
+ *  methods is intact.  Class.c bumps the global method generation
+ *  whenever methods of any GF are modified, and each call_site record
+ *  is valid only if its generation matches the current one.  Since the
+ *  key includes the GF itself, redefining the global binding of the
+ *  callee naturally misses the cache.
+ *
+ *  The call_site records are immutable once published; we replace
+ *  the record atomically, so readers don't need locking, just like mhash.
+ */
+
+#define CALL_SITE_WAYS       4  /* # of entries per call site */
+#define CALL_SITE_MAX_NARGS  SCM_DISPATCHER_MAX_NARGS
+#define CALL_CACHE_MIN_SIZE  4
+#define CALL_CACHE_MAX_SIZE  64
+
+typedef struct call_site_entry_rec {
+    ScmGeneric *gf;
+    int argc;
+    ScmClass *types[CALL_SITE_MAX_NARGS];
+    ScmObj methods;             /* sorted applicable methods */
+} call_site_entry;
+
+typedef struct call_site_rec {
+    const ScmWord *pc;          /* call site */
+    AO_t generation;            /* method generation of this record */
+    int megamorphic;            /* TRUE if we gave up caching */
+    int num_entries;
+    call_site_entry entries[CALL_SITE_WAYS];
+} call_site;
+
+typedef struct call_cache_rec {
+    u_long size;                /* # of bins.  power of 2 */
+    AO_t bins[1];               /* call_site or 0 */
+} call_cache;
+
+static AO_t method_generation = 0;
+
+/* Called by class.c whenever methods of any GF are changed. */
+void Scm__MethodGenerationBump(void)
+{
+    AO_fetch_and_add1_full(&method_generation);
+}
+
+static inline int code_has_pc(const ScmCompiledCode *base, const ScmWord *pc)
+{
+    return (base != NULL && base->code != NULL
+            && pc >= base->code && pc < base->code + base->codeSize);
+}
+
+static call_cache *get_call_cache(ScmCompiledCode *base)
+{
+    call_cache *c = (call_cache*)AO_load((AO_t*)&base->callCache);
+    if (c != NULL) return c;
+
+    u_long size = CALL_CACHE_MIN_SIZE;
+    while (size < CALL_CACHE_MAX_SIZE && size*8 < (u_long)base->codeSize) {
+        size *= 2;
+    }
+    c = SCM_NEW2(call_cache*, sizeof(call_cache)+sizeof(AO_t)*(size-1));
+    c->size = size;
+    for (u_long i=0; i<size; i++) c->bins[i] = (AO_t)0;
+    if (!AO_compare_and_swap_full((AO_t*)&base->callCache, 0, (AO_t)c)) {
+        /* Another thread won. */
+        c = (call_cache*)AO_load((AO_t*)&base->callCache);
+    }
+    return c;
+}
+
+static inline AO_t *call_site_bin(call_cache *c, const ScmCompiledCode *base,
+                                  const ScmWord *pc)
+{
+    return &c->bins[(pc - base->code) & (c->size - 1)];
+}
+
+/* Returns cached list of sorted methods, or #f if there's no valid
+   cache.  In the latter case, *gen is set to the current generation,
+   which should be passed to Scm__CallSiteCacheStore after computing
+   the methods. */
+ScmObj Scm__CallSiteCacheLookup(ScmCompiledCode *base, const ScmWord *pc,
+                                ScmGeneric *gf, ScmObj *argv, int argc,
+                                u_long *gen)
+{
+    AO_t g = AO_load_full(&method_generation);
+    *gen = (u_long)g;
+    if (argc > CALL_SITE_MAX_NARGS || !code_has_pc(base, pc)) {
+        return SCM_FALSE;
+    }
+    call_cache *c = (call_cache*)AO_load((AO_t*)&base->callCache);
+    if (c == NULL) return SCM_FALSE;
+    call_site *s = (call_site*)AO_load(call_site_bin(c, base, pc));
+    if (s == NULL || s->pc != pc || s->generation != g || s->megamorphic) {
+        return SCM_FALSE;
+    }
+
+    ScmClass *typev[CALL_SITE_MAX_NARGS];
+    for (int i=0; i<argc; i++) typev[i] = Scm_ClassOf(argv[i]);
+    for (int k=0; k<s->num_entries; k++) {
+        const call_site_entry *e = &s->entries[k];
+        if (e->gf != gf || e->argc != argc) continue;
+        int i = 0;
+        for (; i<argc; i++) {
+            if (e->types[i] != typev[i]) break;
+        }
+        if (i == argc) return e->methods;
+    }
+    return SCM_FALSE;
+}
+
+void Scm__CallSiteCacheStore(ScmCompiledCode *base, const ScmWord *pc,
+                             ScmGeneric *gf, ScmObj *argv, int argc,
+                             ScmObj methods, u_long gen)
+{
+    if (argc > CALL_SITE_MAX_NARGS || !code_has_pc(base, pc)) return;
+    if (!SCM_PAIRP(methods)) return;
+
+    call_cache *c = get_call_cache(base);
+    AO_t *bin = call_site_bin(c, base, pc);
+    call_site *s = (call_site*)AO_load(bin);
+    call_site *ns = SCM_NEW(call_site);
+    ns->pc = pc;
+    ns->generation = (AO_t)gen;
+    ns->megamorphic = FALSE;
+    ns->num_entries = 0;
+
+    if (s != NULL && s->pc == pc && s->generation == (AO_t)gen) {
+        if (s->megamorphic) return;
+        if (s->num_entries == CALL_SITE_WAYS) {
+            ns->megamorphic = TRUE;
+            AO_store_full(bin, (AO_t)ns);
+            return;
+        }
+        /* keep existing entries */
+        for (int k=0; k<s->num_entries; k++) {
+            ns->entries[k] = s->entries[k];
+        }
+        ns->num_entries = s->num_entries;
+    }
+
+    call_site_entry *e = &ns->entries[ns->num_entries++];
+    e->gf = gf;
+    e->argc = argc;
+    for (int i=0; i<argc; i++) e->types[i] = Scm_ClassOf(argv[i]);
+    for (int i=argc; i<CALL_SITE_MAX_NARGS; i++) e->types[i] = NULL;
+    e->methods = methods;
+    AO_store_full(bin, (AO_t)ns);
+}
@@ -1936,6 +1936,8 @@ SCM_EXTERN void   Scm_SetSigmask(sigset_t *mask);
 SCM_EXTERN void   Scm_ProfilerStart(void);
 SCM_EXTERN int    Scm_ProfilerStop(void);
 SCM_EXTERN void   Scm_ProfilerReset(void);
+SCM_EXTERN void   Scm_ProfilerConfigure(int samplingPeriod, int stackDepth);
+SCM_EXTERN int    Scm_ProfilerSamplingPeriod(void);
 
 /*---------------------------------------------------
  * UTILITY STUFF
@@ -89,5 +89,18 @@ SCM_EXTERN ScmBignum *Scm_BignumAccMultAddUI(ScmBignum *acc,
 
 SCM_EXTERN int Scm_DumpBignum(const ScmBignum *b, ScmPort *out);
 
+/* Tunable algorithm thresholds, in words.  Operands smaller than
+   the threshold use the simpler algorithm. */
+enum {
+    SCM_BIGNUM_KARATSUBA_THRESHOLD,  /* schoolbook -> Karatsuba */
+    SCM_BIGNUM_TOOM3_THRESHOLD,      /* Karatsuba -> Toom-3 */
+    SCM_BIGNUM_NTT_THRESHOLD,        /* Toom-3 -> number theoretic transform */
+    SCM_BIGNUM_DC_RADIX_THRESHOLD,   /* divide & conquer radix conversion */
+    SCM_BIGNUM_NUM_THRESHOLDS
+};
+
+SCM_EXTERN int Scm_BignumThreshold(int which);
+SCM_EXTERN int Scm_BignumSetThreshold(int which, int value);
+
 #endif /* GAUCHE_BIGNUM_H */
 
@@ -75,6 +75,14 @@ struct ScmCompiledCodeRec {
                                    #f otherwise. (*5) */
     void *builder;              /* An opaque data used during consturcting
                                    the code vector.  Usually NULL. */
+    void *callCache;            /* An opaque data to cache method lookup
+                                   results per call site.  Managed by
+                                   dispatch.c.  Initially NULL. (*6) */
+    u_int jitCount;             /* # of times the control entered this
+                                   code, until it gets jitEntries. (*7) */
+    void **jitEntries;          /* Native code entry points, indexed by
+                                   the offset in code vector.  Managed by
+                                   jit.c.  Initially NULL. (*7) */
 };
 
 /* Footnotes on ScmCompiledCodeRec
@@ -100,6 +108,12 @@ struct ScmCompiledCodeRec {
  *       metainfo about closure interface, e.g. types.
  *   *5) This IForm is a direct result of Pass1, i.e. non-optimized form.
  *       Pass2 scans it when IForm is inlined into the caller site.
+ *   *6) Allocated lazily when a generic function is called from this
+ *       code.  It is keyed by the pc of the call site, and never affects
+ *       the semantics; it's just a cache.
+ *   *7) See jit.c.  jitCount is updated without locking; it is just
+ *       a heuristic.  Once jitEntries is set, it is never changed
+ *       (except by Scm_CompiledCodeCopyX).
  */
 
 SCM_CLASS_DECL(Scm_CompiledCodeClass);
@@ -117,7 +131,8 @@ SCM_CLASS_DECL(Scm_CompiledCodeClass);
     { { SCM_CLASS_STATIC_TAG(Scm_CompiledCodeClass) },   \
       (code), NULL, (codesize), 0, (maxstack),           \
       (reqargs), (optargs), (name), (debuginfo), (signatureinfo),   \
-      (parent), (iform), NULL /*builder*/ }
+      (parent), (iform), NULL /*builder*/, NULL /*callCache*/, \
+      0 /*jitCount*/, NULL /*jitEntries*/ }
 
 SCM_EXTERN void   Scm_CompiledCodeCopyX(ScmCompiledCode *dest,
                                         const ScmCompiledCode *src);
@@ -51,6 +51,13 @@ typedef enum {
     SCM_HASH_WORD
 } ScmHashType;
 
+/* Hash core layouts.  See hash.c for the details. */
+typedef enum {
+    SCM_HASH_CORE_DEFAULT,          /* Choose appropriate one by type */
+    SCM_HASH_CORE_CHAINED,          /* Buckets of chained entries */
+    SCM_HASH_CORE_OPEN_ADDRESSING   /* Open addressing with control bytes */
+} ScmHashCoreLayout;
+
 typedef struct ScmHashCoreRec ScmHashCore;
 typedef struct ScmHashIterRec ScmHashIter;
 
@@ -85,6 +92,21 @@ SCM_EXTERN void Scm_HashCoreInitGeneral(ScmHashCore *core,
                                         unsigned int initSize,
                                         void *data);
 
+SCM_EXTERN void Scm_HashCoreInitSimpleWithLayout(ScmHashCore *core,
+                                                 ScmHashType type,
+                                                 ScmHashCoreLayout layout,
+                                                 unsigned int initSize,
+                                                 void *data);
+
+SCM_EXTERN void Scm_HashCoreInitGeneralWithLayout(ScmHashCore *core,
+                                                  ScmHashProc *hashfn,
+                                                  ScmHashCompareProc *cmpfn,
+                                                  ScmHashCoreLayout layout,
+                                                  unsigned int initSize,
+                                                  void *data);
+
+SCM_EXTERN ScmHashCoreLayout Scm_HashCoreLayout(const ScmHashCore *core);
+
 SCM_EXTERN int  Scm_HashCoreTypeToProcs(ScmHashType type,
                                         ScmHashProc **hashfn,
                                         ScmHashCompareProc **cmpfn);
@@ -166,6 +188,71 @@ SCM_EXTERN ScmObj Scm_HashTableValues(ScmHashTable *table);
 
 SCM_EXTERN ScmObj Scm_HashTableStat(ScmHashTable *table);
 
+/*================================================================
+ * ScmConcurrentHashTable
+ *
+ *   A hash table that can be shared among threads without extra locking.
+ *   Keys are distributed over a fixed number of stripes by their hash
+ *   value; each stripe is a ScmHashCore with its own lock, so threads
+ *   that touch different stripes don't serialize each other.
+ *
+ *   Each operation is atomic.  Iteration is weakly consistent; it walks
+ *   the stripes in order, taking a snapshot of each stripe as it reaches
+ *   it, so it never sees a torn entry but may or may not see the changes
+ *   made during the iteration.
+ */
+
+#define SCM_CONCURRENT_HASH_TABLE_STRIPES 16  /* must be power of 2 */
+
+typedef struct ScmConcurrentHashStripeRec {
+    ScmInternalMutex mutex;
+    ScmHashCore core;
+} ScmConcurrentHashStripe;
+
+typedef struct ScmConcurrentHashTableRec {
+    SCM_HEADER;
+    ScmHashType type;
+    ScmConcurrentHashStripe stripes[SCM_CONCURRENT_HASH_TABLE_STRIPES];
+} ScmConcurrentHashTable;
+
+SCM_CLASS_DECL(Scm_ConcurrentHashTableClass);
+#define SCM_CLASS_CONCURRENT_HASH_TABLE  (&Scm_ConcurrentHashTableClass)
+#define SCM_CONCURRENT_HASH_TABLE(obj)   ((ScmConcurrentHashTable*)(obj))
+#define SCM_CONCURRENT_HASH_TABLE_P(obj) \
+    SCM_ISA(obj, SCM_CLASS_CONCURRENT_HASH_TABLE)
+
+/* Weakly consistent iterator */
+typedef struct ScmConcurrentHashIterRec {
+    ScmConcurrentHashTable *table;
+    int stripe;                 /* next stripe to snapshot */
+    ScmObj pending;             /* alist of snapshot of the current stripe */
+} ScmConcurrentHashIter;
+
+SCM_EXTERN ScmObj Scm_MakeConcurrentHashTable(ScmHashType type,
+                                              unsigned int initSize);
+SCM_EXTERN ScmObj Scm_ConcurrentHashTableRef(ScmConcurrentHashTable *ht,
+                                             ScmObj key, ScmObj fallback);
+SCM_EXTERN ScmObj Scm_ConcurrentHashTableSet(ScmConcurrentHashTable *ht,
+                                             ScmObj key, ScmObj value,
+                                             int flags);
+SCM_EXTERN ScmObj Scm_ConcurrentHashTableDelete(ScmConcurrentHashTable *ht,
+                                                ScmObj key);
+SCM_EXTERN int    Scm_ConcurrentHashTableCompareAndSwap(ScmConcurrentHashTable *ht,
+                                                        ScmObj key,
+                                                        ScmObj expected,
+                                                        ScmObj value);
+SCM_EXTERN void   Scm_ConcurrentHashTablePush(ScmConcurrentHashTable *ht,
+                                              ScmObj key, ScmObj value);
+SCM_EXTERN ScmObj Scm_ConcurrentHashTablePop(ScmConcurrentHashTable *ht,
+                                             ScmObj key, ScmObj fallback);
+SCM_EXTERN long   Scm_ConcurrentHashTableNumEntries(ScmConcurrentHashTable *ht);
+SCM_EXTERN void   Scm_ConcurrentHashTableClear(ScmConcurrentHashTable *ht);
+SCM_EXTERN ScmObj Scm_ConcurrentHashTableToAlist(ScmConcurrentHashTable *ht);
+
+SCM_EXTERN void   Scm_ConcurrentHashIterInit(ScmConcurrentHashIter *iter,
+                                             ScmConcurrentHashTable *ht);
+SCM_EXTERN int    Scm_ConcurrentHashIterNext(ScmConcurrentHashIter *iter,
+                                             ScmObj *key, ScmObj *value);
 
 /*====================================================================
  * For backward compatibility.  DEPRECATED.
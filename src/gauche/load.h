@@ -117,6 +117,7 @@ SCM_EXTERN ScmObj Scm_DLObjs(void);
 SCM_EXTERN int Scm_Require(ScmObj feature, int flags, ScmLoadPacket *p);
 SCM_EXTERN ScmObj Scm_Provide(ScmObj feature);
 SCM_EXTERN int    Scm_ProvidedP(ScmObj feature);
+SCM_EXTERN ScmObj Scm_ProvidedFeatures(void);
 
 /*=================================================================
  * Autoloads
@@ -169,6 +169,8 @@ struct ScmPortRec {
             const char *start;
             const char *current;
             const char *end;
+            ScmObj owner;       /* u8vector owning the content if the
+                                   port is a mapped file, or #f */
         } istr;                 /* input string port */
         ScmDString ostr;        /* output string port */
         ScmPortVTable vt;       /* virtual port */
@@ -355,12 +357,16 @@ SCM_EXTERN void   Scm_Putb(ScmByte b, ScmPort *port);
 SCM_EXTERN void   Scm_Putc(ScmChar c, ScmPort *port);
 SCM_EXTERN void   Scm_Puts(ScmString *s, ScmPort *port);
 SCM_EXTERN void   Scm_Putz(const char *s, ScmSize len, ScmPort *port);
+SCM_EXTERN void   Scm_Putzv(const char **ss, const ScmSize *lens, int n,
+                            ScmPort *port);
 SCM_EXTERN void   Scm_Flush(ScmPort *port);
 
 SCM_EXTERN void   Scm_PutbUnsafe(ScmByte b, ScmPort *port);
 SCM_EXTERN void   Scm_PutcUnsafe(ScmChar c, ScmPort *port);
 SCM_EXTERN void   Scm_PutsUnsafe(ScmString *s, ScmPort *port);
 SCM_EXTERN void   Scm_PutzUnsafe(const char *s, ScmSize len, ScmPort *port);
+SCM_EXTERN void   Scm_PutzvUnsafe(const char **ss, const ScmSize *lens, int n,
+                                  ScmPort *port);
 SCM_EXTERN void   Scm_FlushUnsafe(ScmPort *port);
 
 SCM_EXTERN void   Scm_Ungetc(ScmChar ch, ScmPort *port);
@@ -385,6 +391,15 @@ SCM_EXTERN ScmObj Scm_UngottenBytesUnsafe(ScmPort *port);
 
 SCM_EXTERN ScmObj Scm_ReadLine(ScmPort *port);
 SCM_EXTERN ScmObj Scm_ReadLineUnsafe(ScmPort *port);
+SCM_EXTERN ScmObj Scm_ReadString(ScmPort *port, ScmSize nchars);
+SCM_EXTERN ScmObj Scm_ReadStringUnsafe(ScmPort *port, ScmSize nchars);
+SCM_EXTERN ScmObj Scm_ReadStringUntil(ScmPort *port, ScmString *delims);
+SCM_EXTERN ScmObj Scm_ReadStringUntilUnsafe(ScmPort *port, ScmString *delims);
+
+/* Bulk input.  The caller must hold the port lock.  See portapi.c */
+SCM_EXTERN ScmSize Scm_PortCursorView(ScmPort *port, const char **start);
+SCM_EXTERN void    Scm_PortCursorAdvance(ScmPort *port, ScmSize nbytes,
+                                         int count_lines);
 
 /*================================================================
  * File ports
@@ -392,6 +407,10 @@ SCM_EXTERN ScmObj Scm_ReadLineUnsafe(ScmPort *port);
 
 SCM_EXTERN ScmObj Scm_OpenFilePort(const char *path, int flags,
                                    int buffering, int perm);
+SCM_EXTERN ScmObj Scm_OpenMappedFilePort(const char *path,
+                                        int buffering);
+SCM_EXTERN ScmObj Scm_PortMappedBytes(ScmPort *port,
+                                      ScmSmallInt start, ScmSmallInt end);
 
 SCM_EXTERN ScmObj Scm_Stdin(void);
 SCM_EXTERN ScmObj Scm_Stdout(void);
@@ -436,6 +455,7 @@ SCM_EXTERN ScmObj Scm_MakePortWithFd(ScmObj name,
                                      int fd,
                                      int bufmode,
                                      int ownerp);
+SCM_EXTERN ScmSize Scm_PortCopyFd(ScmPort *src, ScmPort *dst, ScmSize limit);
 SCM_EXTERN ScmObj Scm_MakeCodingAwarePort(ScmPort *iport);
 
 #endif /*GAUCHE_PORT_H*/
@@ -34,22 +34,42 @@
 #ifndef GAUCHE_PRIV_DISPATCHP_H
 #define GAUCHE_PRIV_DISPATCHP_H
 
-/* This file is only shared between class.c and dispatch.c.
+/* This file is only shared among class.c, dispatch.c and vm.c.
    Other parts must use Scm__Generic* API. */
 
 /* We might use fast dispatch table when args to gf is equal to or
    smaller than this */
 #define SCM_DISPATCHER_MAX_NARGS   4
 
+/* Criteria to build the dispatcher automatically.  A gf without
+   dispatcher gets one when it is called more than
+   SCM_DISPATCHER_CALL_THRESHOLD times, or it has more than
+   SCM_DISPATCHER_METHOD_THRESHOLD methods.  In either case, the gf
+   must have at least two methods that can be placed in the dispatch
+   table.  See maybe_build_dispatcher() in class.c. */
+#define SCM_DISPATCHER_CALL_THRESHOLD    64
+#define SCM_DISPATCHER_METHOD_THRESHOLD  8
+
 typedef struct ScmMethodDispatcherRec ScmMethodDispatcher;
 
 ScmMethodDispatcher *Scm__BuildMethodDispatcher(ScmObj methods, int axis);
+int    Scm__MethodDispatcherWorthBuilding(ScmObj methods, int axis);
 
 void   Scm__MethodDispatcherAdd(ScmMethodDispatcher *dis, ScmMethod *m);
 void   Scm__MethodDispatcherDelete(ScmMethodDispatcher *dis, ScmMethod *m);
 ScmObj Scm__MethodDispatcherLookup(ScmMethodDispatcher *dis,
                                    ScmClass **typev, int argc);
+void   Scm__MethodDispatcherFallback(ScmMethodDispatcher *dis);
 ScmObj Scm__MethodDispatcherInfo(const ScmMethodDispatcher *dis);
 void   Scm__MethodDispatcherDump(ScmMethodDispatcher *dis, ScmPort *port);
 
+/* Call site cache.  Used by VM; see dispatch.c for the details. */
+void   Scm__MethodGenerationBump(void);
+ScmObj Scm__CallSiteCacheLookup(ScmCompiledCode *base, const ScmWord *pc,
+                                ScmGeneric *gf, ScmObj *argv, int argc,
+                                u_long *gen);
+void   Scm__CallSiteCacheStore(ScmCompiledCode *base, const ScmWord *pc,
+                               ScmGeneric *gf, ScmObj *argv, int argc,
+                               ScmObj methods, u_long gen);
+
 #endif  /*GAUCHE_PRIV_DISPATCHP_H*/
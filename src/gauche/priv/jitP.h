@@ -0,0 +1,72 @@
+/*
+ * gauche/priv/jitP.h - Baseline JIT private API
+ *
+ *   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GAUCHE_PRIV_JITP_H
+#define GAUCHE_PRIV_JITP_H
+
+/* This file is only shared among core.c, jit.c, vm.c and libcode.scm. */
+
+/* We only have a code generator for x86-64, and it needs mmap/mprotect
+   to get executable memory. */
+#if defined(__x86_64__) && defined(HAVE_SYS_MMAN_H) && !defined(GAUCHE_WINDOWS)
+#define GAUCHE_JIT 1
+#else
+#define GAUCHE_JIT 0
+#endif
+
+/* A compiled code is translated into native code after the control
+   enters it (by a call or a jump) this many times. */
+#define SCM_JIT_THRESHOLD    500
+
+/* The total size of native code we generate.  Once we reach it, the
+   code that gets hot afterwards is left to the interpreter.  Native code
+   is never freed, and each compiled code takes at least a page. */
+#define SCM_JIT_CODE_LIMIT   (16*1024*1024)
+
+/* Returns the native entry table of CC, indexed by the offset in
+   CC's code vector.  An entry is NULL where there's no native code.
+   Returns NULL if JIT is disabled by SCM_NO_JIT runtime flag. */
+void **Scm__JitCompile(ScmVM *vm, ScmCompiledCode *cc);
+
+/* Runs native code from ENTRY.  Returns when it reaches an instruction
+   it can't handle, with vm->pc pointing to that instruction. */
+void   Scm__JitRun(ScmVM *vm, void *entry);
+
+/* Returns TRUE if CC has been translated (jitEntries is set).  For tests. */
+int    Scm__JitCompiledP(ScmCompiledCode *cc);
+
+/* Defined in vm.c; native code of LOCAL-ENV-JUMP calls it. */
+void   Scm__VMLocalEnvShift(ScmVM *vm, int env_depth);
+
+#endif  /*GAUCHE_PRIV_JITP_H*/
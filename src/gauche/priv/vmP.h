@@ -51,6 +51,10 @@ struct ScmCallTraceRec {
 
 ScmCallTrace *Scm__MakeCallTraceQueue(u_long size);
 
+/* Used by the sampling profiler */
+SCM_EXTERN int Scm__VMRecordStack(ScmVM *vm, ScmWord *buf, int max);
+SCM_EXTERN ScmObj Scm__VMRegisteredVMs(void);
+
 SCM_DECL_END
 
 #endif /*GAUCHE_PRIV_VMP_H*/
@@ -41,7 +41,8 @@
 /* We have two types of profilers, a statistic sampler and call-counter.
  *
  * The statistic sampler uses ITIMER_PROF and records the current code
- * base and PC for every SIGPROF.
+ * base and PC for every SIGPROF, as well as the code bases of the
+ * continuation frames up to the configured stack depth.
  * (NB: in order for this to work, VM's PC must always be saved
  * in VM structure; in another word, vm.c must be compiled with
  * SMALL_REGS == 0).
@@ -50,8 +51,12 @@
  * execution on the thread.   Each entry just records the address of
  * the called object.
  *
- * TODO: It is not known if sampling profiler works when more than one
- * thread requests profiling.  Should be considrered later.
+ * Normally the profiler only samples the thread that started it.  With
+ * Scm_ProfilerStartAll, every VM known to the system (and every VM attached
+ * while profiling) is sampled by its own per-thread CPU-time timer, and
+ * each VM keeps its own buffers; the results are collected per VM by
+ * Scm_ProfilerRawThreadResults.  It is only available on platforms that
+ * can deliver a timer signal to a specific thread (SCM_PROF_THREAD_TIMER).
  *
  * When the on-memory buffer of the call counter gets full, it is collected
  * to a hash table.  When the statistic sampling buffer gets full, it
@@ -74,6 +79,14 @@
  * state.
  */
 
+#if defined(GAUCHE_USE_PTHREADS) && defined(__linux__)
+#include <time.h>
+#include <signal.h>
+#if defined(SIGEV_THREAD_ID)
+#define SCM_PROF_THREAD_TIMER 1
+#endif
+#endif /* GAUCHE_USE_PTHREADS && __linux__ */
+
 /* Profiler status */
 enum {
     SCM_PROFILER_INACTIVE,
@@ -81,14 +94,25 @@ enum {
     SCM_PROFILER_PAUSING
 };
 
-/* A sample of statistic sampler */
+/* A sample of statistic sampler.  In the sample buffer, it is followed
+   by DEPTH words of the callers' ScmCompiledCode, innermost first. */
 typedef struct ScmProfSampleRec {
     ScmObj func;                /* ScmCompiledCode or ScmSubr */
     ScmWord *pc;
+    ScmWord depth;              /* # of callers recorded */
 } ScmProfSample;
 
-/* # of on-memory samples for the statistic sampler. */
-#define SCM_PROF_SAMPLES_IN_BUFFER  6000
+#define SCM_PROF_SAMPLE_HEADER_WORDS  (sizeof(ScmProfSample)/sizeof(ScmWord))
+
+/* Size of on-memory sample buffer for the statistic sampler, in words. */
+#define SCM_PROF_SAMPLE_BUFFER_WORDS  65536
+
+/* Default and maximum depth of the stack to be recorded per sample. */
+#define SCM_PROF_DEFAULT_STACK_DEPTH  32
+#define SCM_PROF_MAX_STACK_DEPTH      1024
+
+/* Default sampling period, in microseconds. */
+#define SCM_PROF_DEFAULT_SAMPLING_PERIOD  10000
 
 /* A record of call counter */
 typedef struct ScmProfCountRec {
@@ -105,24 +129,50 @@ typedef struct ScmProfCountRec {
 struct ScmVMProfilerRec {
     int state;                  /* profiler state */
     int samplerFd;              /* temporary file for the sampler */
-    int currentSample;          /* index to the current sample */
+    int currentSample;          /* index to the sample buffer, in words */
     int totalSamples;           /* total # of samples */
     int errorOccurred;          /* TRUE if error has occurred during I/O */
     int currentCount;           /* index to the current counter */
+    int samplingPeriod;         /* in microseconds */
+    int stackDepth;             /* max # of callers to record */
+    int allThreads;             /* TRUE if started by Scm_ProfilerStartAll */
+    volatile int timerRequest;  /* set by other thread to ask this VM to
+                                   arm its own timer */
+    volatile size_t sampling;   /* TRUE while the sampler is running.
+                                   Accessed as AO_t. */
     ScmHashTable* statHash;     /* hashtable for collected data.
                                    value is a pair of integers,
                                    (<call-count> . <sample-hits>) */
+    ScmHashTable* stackTrie;    /* collected stacks.  Maps the outermost
+                                   code to a node, which is a pair of
+                                   (<sample-hits> . <children>), where
+                                   <sample-hits> counts the samples that
+                                   ends at the node, and <children> is
+                                   #f or a hashtable of the same
+                                   structure for the callees. */
 #if defined(GAUCHE_WINDOWS)
     HANDLE hTargetThread;       /* target thread */
     HANDLE hObserverThread;     /* observer thread */
     HANDLE hTimerEvent;         /* sampling timer event */
     char *samplerFileName;      /* temporary file name to remove the file */
 #endif /* GAUCHE_WINDOWS */
-    ScmProfSample samples[SCM_PROF_SAMPLES_IN_BUFFER];
+#if defined(SCM_PROF_THREAD_TIMER)
+    timer_t cpuTimer;           /* per-thread CPU-time timer */
+    int cpuTimerArmed;
+#endif /* SCM_PROF_THREAD_TIMER */
+    ScmWord       samples[SCM_PROF_SAMPLE_BUFFER_WORDS];
     ScmProfCount  counts[SCM_PROF_COUNTER_IN_BUFFER];
 };
 
 SCM_EXTERN ScmObj Scm_ProfilerRawResult(void);
+SCM_EXTERN ScmObj Scm_ProfilerRawStackResult(void);
+SCM_EXTERN void   Scm_ProfilerStartAll(void);
+SCM_EXTERN ScmObj Scm_ProfilerRawThreadResults(void);
+
+/* Hooks called from vm.c */
+SCM_EXTERN void Scm__ProfilerAttachVM(ScmVM *vm);
+SCM_EXTERN void Scm__ProfilerDetachVM(ScmVM *vm);
+SCM_EXTERN void Scm__ProfilerProcessRequest(ScmVM *vm);
 
 /* Call Counter API */
 
@@ -69,11 +69,23 @@
    As of 0.9.7, we switch to use ScmSmallInt for length and size, breaking
    the backward compatibility.
 */
+/* NB: 'aux.index' is a sparse character index of a multibyte string, built
+   lazily on random access.  If the body has SCM_STRING_ROPE flag, 'start'
+   is NULL and 'aux.rope' holds the tree of the chunks instead.  Both are
+   opaque outside of string.c.
+   A rope body is created by string concatenation and substring of large
+   strings, and converted to a flat body when SCM_STRING_BODY is taken.
+   Code that only needs the length, size and flags may use
+   SCM_STRING_RAW_BODY to avoid the conversion. */
 typedef struct ScmStringBodyRec {
     u_long flags;
     ScmSmallInt length;
     ScmSmallInt size;
     const char *start;
+    union {
+        const struct ScmStringIndexRec *index; /* may be NULL */
+        const struct ScmStringRopeRec *rope;   /* if SCM_STRING_ROPE */
+    } aux;
 } ScmStringBody;
 
 #if SIZEOF_LONG == 4
@@ -99,6 +111,8 @@ enum ScmStringFlags {
     SCM_STRING_TERMINATED = (1L<<2),     /* [R] The string content is
                                             NUL-terminated.  This flag is used
                                             internally. */
+    SCM_STRING_ROPE       = (1L<<3),     /* [R] The body is a rope.  This
+                                            flag is used internally. */
     SCM_STRING_COPYING = (1L<<16),       /* [C]   Need to copy the content
                                             given to the constructor. */
 };
@@ -109,9 +123,20 @@ SCM_CLASS_DECL(Scm_StringClass);
 
 #define SCM_STRINGP(obj)        SCM_XTYPEP(obj, SCM_CLASS_STRING)
 #define SCM_STRING(obj)         ((ScmString*)(obj))
-#define SCM_STRING_BODY(obj) \
+#define SCM_STRING_RAW_BODY(obj) \
     ((const ScmStringBody*)(SCM_STRING(obj)->body?SCM_STRING(obj)->body:&SCM_STRING(obj)->initialBody))
 
+SCM_EXTERN const ScmStringBody *Scm__StringFlatten(ScmString *str);
+
+/* Returns a flat body of STR.  If STR has a rope body, it is replaced
+   by a flat one, so this isn't a pure accessor. */
+static inline const ScmStringBody *Scm__StringFlatBody(ScmString *str)
+{
+    const ScmStringBody *b = SCM_STRING_RAW_BODY(str);
+    return (b->flags & SCM_STRING_ROPE)? Scm__StringFlatten(str) : b;
+}
+#define SCM_STRING_BODY(obj)    Scm__StringFlatBody(SCM_STRING(obj))
+
 /* Accessor macros for string body */
 #define SCM_STRING_BODY_LENGTH(body)       ((body)->length)
 #define SCM_STRING_BODY_SIZE(body)         ((body)->size)
@@ -129,19 +154,19 @@ SCM_CLASS_DECL(Scm_StringClass);
 
 /* This is MT-safe, for string immutability won't change */
 #define SCM_STRING_IMMUTABLE_P(obj)  \
-    SCM_STRING_BODY_IMMUTABLE_P(SCM_STRING_BODY(obj))
+    SCM_STRING_BODY_IMMUTABLE_P(SCM_STRING_RAW_BODY(obj))
 
 #define SCM_STRING_NULL_P(obj) \
-    (SCM_STRING_BODY_SIZE(SCM_STRING_BODY(obj)) == 0)
+    (SCM_STRING_BODY_SIZE(SCM_STRING_RAW_BODY(obj)) == 0)
 
 /* Macros for backward compatibility.  Use of these are deprecated,
    since they are not MT-safe.  Use SCM_STRING_BODY_* macros or
    Scm_GetString* API. */
-#define SCM_STRING_LENGTH(obj)  (SCM_STRING_BODY(obj)->length)
-#define SCM_STRING_SIZE(obj)    (SCM_STRING_BODY(obj)->size)
+#define SCM_STRING_LENGTH(obj)  (SCM_STRING_RAW_BODY(obj)->length)
+#define SCM_STRING_SIZE(obj)    (SCM_STRING_RAW_BODY(obj)->size)
 #define SCM_STRING_START(obj)   (SCM_STRING_BODY(obj)->start)
 #define SCM_STRING_INCOMPLETE_P(obj)  \
-    (SCM_STRING_BODY_INCOMPLETE_P(SCM_STRING_BODY(obj)))
+    (SCM_STRING_BODY_INCOMPLETE_P(SCM_STRING_RAW_BODY(obj)))
 #define SCM_STRING_SINGLE_BYTE_P(obj) \
     (SCM_STRING_SIZE(obj)==SCM_STRING_LENGTH(obj))
 
@@ -294,7 +319,8 @@ SCM_EXTERN ScmObj  Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end);
 
 #define SCM_STRING_CONST_INITIALIZER(str, len, siz)             \
     { { SCM_CLASS_STATIC_TAG(Scm_StringClass) }, NULL,          \
-      { SCM_STRING_IMMUTABLE|SCM_STRING_TERMINATED, (len), (siz), (str) } }
+      { SCM_STRING_IMMUTABLE|SCM_STRING_TERMINATED, (len), (siz), (str), \
+        { NULL } } }
 
 #define SCM_DEFINE_STRING_CONST(name, str, len, siz)            \
     ScmString name = SCM_STRING_CONST_INITIALIZER(str, len, siz)
@@ -278,6 +278,42 @@ typedef struct ScmHeaderRec ScmSysFdset;
 #define SCM_SYS_FDSET_P(obj)    (FALSE)
 #endif /*!HAVE_SELECT*/
 
+/* poller - scalable readiness notification.
+   Uses epoll if available, poll() otherwise. */
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_POLL_H)
+#define HAVE_SYS_POLLER 1
+
+enum {
+    SCM_SYS_POLL_READ   = (1L<<0),
+    SCM_SYS_POLL_WRITE  = (1L<<1),
+    SCM_SYS_POLL_EXCEPT = (1L<<2),
+    SCM_SYS_POLL_EDGE   = (1L<<3)  /* edge-triggered; epoll only */
+};
+
+typedef struct ScmSysPollerRec {
+    SCM_HEADER;
+    int epfd;                   /* epoll descriptor, or -1 */
+    int closed;
+    ScmObj alwaysReady;         /* ((fd . events) ...) of the descriptors
+                                   epoll refuses, e.g. regular files */
+    /* The following are used by the poll() backend. */
+    int nfds;                   /* # of active entries in pfds */
+    int pfdsize;                /* allocated size of pfds */
+    void *pfds;                 /* struct pollfd[] */
+    int nslots;                 /* size of slots */
+    int *slots;                 /* fd -> index in pfds + 1, or 0 */
+} ScmSysPoller;
+
+SCM_CLASS_DECL(Scm_SysPollerClass);
+#define SCM_CLASS_SYS_POLLER    (&Scm_SysPollerClass)
+#define SCM_SYS_POLLER(obj)     ((ScmSysPoller*)(obj))
+#define SCM_SYS_POLLER_P(obj)   (SCM_XTYPEP(obj, SCM_CLASS_SYS_POLLER))
+
+SCM_EXTERN void   Scm_SysPollerSet(ScmSysPoller *poller, int fd, int events);
+SCM_EXTERN ScmObj Scm_SysPollerWait(ScmSysPoller *poller, ScmObj timeout);
+SCM_EXTERN void   Scm_SysPollerClose(ScmSysPoller *poller);
+#endif /*HAVE_SYS_EPOLL_H || HAVE_POLL_H*/
+
 /*==============================================================
  * Miscellaneous
  */
@@ -678,8 +678,12 @@ enum {
                                            module */
     SCM_COLLECT_VM_STATS     = (1L<<5), /* enable statistics collection
                                            (incurs runtime overhead) */
-    SCM_COLLECT_LOAD_STATS   = (1L<<6)  /* log the stats of file load
+    SCM_COLLECT_LOAD_STATS   = (1L<<6), /* log the stats of file load
                                            timings (incurs runtime overhead) */
+    SCM_NO_JIT               = (1L<<7), /* don't translate hot code into
+                                           native code */
+    SCM_NO_TYPE_FEEDBACK     = (1L<<8)  /* don't specialize arithmetic insns
+                                           by the observed operand types */
 };
 
 #define SCM_VM_RUNTIME_FLAG_IS_SET(vm, flag) ((vm)->runtimeFlags & (flag))
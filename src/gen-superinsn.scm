@@ -0,0 +1,349 @@
+;;;
+;;; gen-superinsn.scm - synthesize combined VM instructions
+;;;
+;;;   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+;;;
+;;;   Redistribution and use in source and binary forms, with or without
+;;;   modification, are permitted provided that the following conditions
+;;;   are met:
+;;;
+;;;   1. Redistributions of source code must retain the above copyright
+;;;      notice, this list of conditions and the following disclaimer.
+;;;
+;;;   2. Redistributions in binary form must reproduce the above copyright
+;;;      notice, this list of conditions and the following disclaimer in the
+;;;      documentation and/or other materials provided with the distribution.
+;;;
+;;;   3. Neither the name of the authors nor the names of its contributors
+;;;      may be used to endorse or promote products derived from this
+;;;      software without specific prior written permission.
+;;;
+;;;   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+;;;   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+;;;   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+;;;   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+;;;   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+;;;   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+;;;   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+;;;   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+;;;   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+;;;   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;;;   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;;;
+
+;; Usage:
+;;   gosh gen-superinsn.scm [-o <output>] [-n <max>] [-t <threshold>]
+;;                          <vminsn.scm> <stat-file> ...
+;;
+;; <stat-file>s contain the instruction statistics dumped by gosh built
+;; with COUNT_INSN_FREQUENCY (see vmstat.c).  'make superinsns' in src/
+;; runs the scripts in INSN_CORPUS to gather them, then calls this script.
+;;
+;; We look for pairs and triples of insns that are frequently executed
+;; in a row, and that geninsn knows how to fuse, and write define-insn
+;; forms of them to <output> (default: vminsn-synth.scm), which vminsn.scm
+;; includes.  Up to <max> insns (default: 16) are added, each of which
+;; should cover at least <threshold> (default: 0.001) of all executed insns.
+;;
+;; Nothing else is needed to make the compiler use the new insns; the
+;; insn emitter (Scm_CompiledCodeEmit) combines insns with the state table
+;; geninsn generates from the define-insn forms.
+;;
+;; Insns already in <output> are kept, even they're no longer frequent,
+;; for they may be used in the precompiled code.  To remove one of them,
+;; you have to rebuild the compiler without using it first; see the
+;; comment about changing ISA in lib/gauche/cgen/precomp.scm.
+
+(use srfi-1)
+(use util.match)
+(use file.util)
+(use gauche.parseopt)
+(use gauche.record)
+
+;; LREF shortcuts.  Must match geninsn.
+(define-constant .lrefx.
+  '(LREF0 LREF1 LREF2 LREF3 LREF10 LREF11 LREF12 LREF20 LREF21 LREF30))
+
+(define-record-type <insn> (make-insn name num-params operand combined body
+                                    flags)
+  insn?
+  (name       insn-name)
+  (num-params insn-num-params)
+  (operand    insn-operand)
+  (combined   insn-combined)
+  (body       insn-body)
+  (flags      insn-flags))
+
+(define (symbol-join syms)
+  ($ string->symbol $ string-join (map x->string syms) "-"))
+
+;;;
+;;; Reading insn definitions
+;;;
+
+;; Returns a list of <insn>s defined in FILE, in order.  We follow what
+;; geninsn's expand-toplevels does, except that we don't follow
+;; include-insns.
+(define (read-insns file)
+  (define (lref-replace form lrefx)
+    (match form
+      [(syms ...) (map (cut lref-replace <> lrefx) syms)]
+      [symbol ($ string->symbol
+                 $ regexp-replace #/\bLREF\b/ (x->string symbol)
+                 $ x->string lrefx)]))
+  (define (lrefx-insns name nparams operand comb)
+    (map (^[lrefx] (make-insn (lref-replace name lrefx) nparams operand
+                              (lref-replace comb lrefx) #f '()))
+         .lrefx.))
+  (append-map
+   (^[form]
+     (match form
+       [('define-insn name nparams operand . opts)
+        (let-optionals* opts ([combined #f] [body #f] . flags)
+          (list (make-insn name (if (pair? nparams) (car nparams) nparams)
+                           operand combined body flags)))]
+       [('define-insn-lref* name _ operand comb)
+        (cons (make-insn name 2 operand comb #f '())
+              (lrefx-insns name 0 operand comb))]
+       [('define-insn-lref+ name nparams operand comb)
+        (lrefx-insns name nparams operand comb)]
+       [_ '()]))
+   (if (file-exists? file) (file->sexp-list file) '())))
+
+;;;
+;;; Reading statistics
+;;;
+
+;; Returns three hashtables, mapping an insn name, a list of two names and
+;; a list of three names to the number of executions, respectively.
+;; A stat file may contain more than one dump; we sum them up.
+(define (read-stats files)
+  (let ([freq1 (make-hash-table 'eq?)]
+        [freq2 (make-hash-table 'equal?)]
+        [freq3 (make-hash-table 'equal?)])
+    (define (add! tab key n)
+      (unless (zero? n) (hash-table-update! tab key (cut + <> n) 0)))
+    (dolist [file files]
+      (dolist [stat (if (file-exists? file) (file->sexp-list file) '())]
+        (let* ([rows  (get-keyword :instruction-frequencies stat '())]
+               [names (map car rows)])
+          (dolist [row rows]
+            (match-let1 (name count . nexts) row
+              (add! freq1 name count)
+              (for-each (^[next n] (add! freq2 (list name next) n))
+                        names nexts)))
+          (dolist [triple (get-keyword :triple-frequencies stat '())]
+            (match-let1 (a b c n) triple
+              (add! freq3 (list a b c) n))))))
+    (values freq1 freq2 freq3)))
+
+;;;
+;;; Checking fusibility
+;;;
+
+(define (tree-any pred tree)
+  (let loop ([tree tree])
+    (or (pred tree)
+        (and (pair? tree)
+             (or (loop (car tree)) (loop (cdr tree)))))))
+
+(define (tree-count sym tree)
+  (cond [(eq? tree sym) 1]
+        [(pair? tree) (+ (tree-count sym (car tree))
+                         (tree-count sym (cdr tree)))]
+        [else 0]))
+
+(define (tree-has? syms tree)
+  (tree-any (cut memq <> syms) tree))
+
+;; geninsn fuses (X PUSH) and (X RET) by switching the expansion of
+;; $result in X's body.  So X must deliver its result only via $result.
+(define (result-fusible? insn)
+  (and-let* ([body (insn-body insn)])
+    (and (tree-has? '($result $result:b $result:i $result:n $result:u
+                      $result:f $lrefNN)
+                    body)
+         (not (tree-has? '(NEXT NEXT1 NEXT_PUSHCHECK RETURN-OP
+                           $branch $branch* $retc $retc* $goto-insn
+                           $values $insn-body $arg-source)
+                         body))
+         (not (tree-any (^x (match x [('set! 'VAL0 . _) #t] [_ #f]))
+                        body)))))
+
+;; geninsn fuses (LREFn X) by letting $w/argr in X's body take the
+;; local variable instead of VAL0.  So X must take VAL0 only via $w/argr.
+;; ($w/argp is also affected, so it must not be used.)
+(define (argr-fusible? insn)
+  (and-let* ([body (insn-body insn)])
+    (and (= (tree-count '$w/argr body) 1)
+         (not (tree-has? '(VAL0 $w/argp $w/numcmp $insn-body $arg-source)
+                         body)))))
+
+(define (lref? name) (or (eq? name 'LREF) (memq name .lrefx.)))
+
+;; Returns a define-insn form that fuses the insns NAMES, or #f if it
+;; can't be done.  LOOKUP maps an insn name to <insn>.
+;; We only produce the combinations that geninsn's do-combined can
+;; render.  Besides, at most one of the ingredients can take parameters,
+;; and at most one can take an operand, since the insn emitter only
+;; keeps the last ones it sees.  For triples, the state table geninsn
+;; generates requires the first two insns are already combined.
+(define (fuse names lookup)
+  (define ingredients (map lookup names))
+  (define (usable? insn)
+    (and insn
+         (not (memq :obsoleted (insn-flags insn)))
+         (not (memq :fold-lref (insn-flags insn)))))
+  (define (lref-foldable? name)       ; we have LREF-name with :fold-lref
+    (and-let* ([insn (lookup (symbol-join `(LREF ,name)))])
+      (memq :fold-lref (insn-flags insn))))
+  (define (renderable?)
+    (match names
+      [(a (or 'PUSH 'RET)) (result-fusible? (lookup a))]
+      [('PUSH b) #t]
+      [((? lref?) b) (and (argr-fusible? (lookup b))
+                          (not (lref-foldable? b)))]
+      [('PUSH b c) (boolean (lookup (symbol-join `(,b ,c))))]
+      [('LREF0 'PUSH c) #t]
+      [((? lref?) b (and (or 'PUSH 'RET) c))
+       (and (argr-fusible? (lookup b))
+            (result-fusible? (lookup b))
+            ;; do-combined renders (b c) with the existing insn if any.
+            (match (lookup (symbol-join `(,b ,c)))
+              [#f #t]
+              [insn (equal? (insn-combined insn) `(,b ,c))]))]
+      [_ #f]))
+  (and (every usable? ingredients)
+       (not (lookup (symbol-join names)))
+       (or (null? (cddr names))
+           (lookup (symbol-join (list (car names) (cadr names)))))
+       (renderable?)
+       (let ([ps (filter (^i (> (insn-num-params i) 0)) ingredients)]
+             [os (remove (^i (eq? (insn-operand i) 'none)) ingredients)])
+         (and (<= (length ps) 1)
+              (<= (length os) 1)
+              `(define-insn ,(symbol-join names)
+                 ,(if (null? ps) 0 (insn-num-params (car ps)))
+                 ,(if (null? os) 'none (insn-operand (car os)))
+                 ,names)))))
+
+;;;
+;;; Selection
+;;;
+
+;; Returns a list of (<define-insn form> . <count>) of selected insns,
+;; in the order they should be defined.
+(define (select-insns insns freq2 freq3 max-insns min-count)
+  (define table (make-hash-table 'eq?))
+  (define (lookup name) (hash-table-get table name #f))
+  (define (add-insn! form)
+    (match-let1 (_ name nparams operand comb) form
+      (hash-table-put! table name
+                       (make-insn name nparams operand comb #f '()))))
+  ;; Fusing (a b) takes b away from the existing combined insns that
+  ;; start with b, e.g. (b c).  Estimate how many of them we lose.
+  (define (overlap a b)
+    (fold (^[insn m]
+            (match (insn-combined insn)
+              [((? (cut eq? b <>)) c . _)
+               (max m (hash-table-get freq3 (list a b c) 0))]
+              [_ m]))
+          0 (hash-table-values table)))
+  (define (score cand)
+    (match cand
+      [(a b) (- (hash-table-get freq2 cand 0) (overlap a b))]
+      [_     (hash-table-get freq3 cand 0)]))
+
+  (define (frequent-keys freq)
+    (filter (^k (>= (hash-table-get freq k) min-count)) (hash-table-keys freq)))
+
+  (dolist [insn insns] (hash-table-put! table (insn-name insn) insn))
+  ;; The score never exceeds the raw count, so we can drop infrequent
+  ;; ones beforehand.
+  (let loop ([cands (append (frequent-keys freq2) (frequent-keys freq3))]
+             [r '()]
+             [n 0])
+    (if (>= n max-insns)
+      (reverse r)
+      ;; Pick the best one that can be fused now.  A triple may become
+      ;; fusible after its prefix is selected, so we rescan every time.
+      (let1 best (fold (^[cand best]
+                         (let1 s (score cand)
+                           (if (and (>= s min-count)
+                                    (or (not best) (> s (cdr best)))
+                                    (fuse cand lookup))
+                             (cons cand s)
+                             best)))
+                       #f cands)
+        (if (not best)
+          (reverse r)
+          (let1 form (fuse (car best) lookup)
+            (add-insn! form)
+            (loop (delete (car best) cands)
+                  (acons form (cdr best) r)
+                  (+ n 1))))))))
+
+;;;
+;;; Output
+;;;
+
+(define (write-synth-file file kept selected freq1 total)
+  (define (pct n) (/ (round (* 10000.0 (/. n total))) 100))
+  (with-output-to-file file
+    (^[]
+      (print ";;;")
+      (print ";;; vminsn-synth.scm - Synthesized combined instructions")
+      (print ";;;")
+      (print ";;; Generated by gen-superinsn.scm from the instruction statistics.")
+      (print ";;; Don't edit this file, except removing insns; see gen-superinsn.scm.")
+      (print ";;; This file is included from vminsn.scm.")
+      (print ";;;")
+      (dolist [insn kept]
+        (print)
+        (format #t ";; ~a% of executed insns in the last statistics\n"
+                (pct (hash-table-get freq1 (insn-name insn) 0)))
+        (write `(define-insn ,(insn-name insn) ,(insn-num-params insn)
+                  ,(insn-operand insn) ,(insn-combined insn)))
+        (print))
+      (dolist [p selected]
+        (print)
+        (format #t ";; saves ~a% of insn dispatches in the statistics\n"
+                (pct (cdr p)))
+        (write (car p))
+        (print)))
+    :if-exists :supersede))
+
+;;;
+;;; Main
+;;;
+
+(define (usage)
+  (exit 1 "Usage: gosh gen-superinsn.scm [-o output] [-n max] [-t threshold]\
+           \n                              vminsn.scm stat-file ..."))
+
+(define (main args)
+  (let-args (cdr args) ([output    "o=s" "vminsn-synth.scm"]
+                        [max-insns "n=i" 16]
+                        [threshold "t=r" 0.001]
+                        [else (opt . _) (usage)]
+                        . rest)
+    (match rest
+      [(vminsn stat-file . more-stat-files)
+       (let* ([kept  (read-insns output)]
+              [insns (append (read-insns vminsn) kept)])
+         (receive (freq1 freq2 freq3) (read-stats (cons stat-file more-stat-files))
+           (let1 total (fold + 0 (hash-table-values freq1))
+             (when (zero? total)
+               (exit 1 "No statistics found.  Is gosh built with \
+                        COUNT_INSN_FREQUENCY?"))
+             (let1 selected (select-insns insns freq2 freq3 max-insns
+                                          (* total threshold))
+               (write-synth-file output kept selected freq1 total)
+               (format #t "~a: ~a insn(s) added, ~a kept\n"
+                       output (length selected) (length kept))))))]
+      [_ (usage)]))
+  0)
+
+;; Local variables:
+;; mode: scheme
+;; end:
@@ -36,6 +36,7 @@
 #include "atomic_ops.h"
 #include "gauche.h"
 #include "gauche/class.h"
+#include "gauche/bits_inline.h"
 
 /*============================================================
  * Internal structures
@@ -643,6 +644,365 @@ static Entry *general_access(ScmHashCore *table, intptr_t key, ScmDictOp op)
     NOTFOUND(table, op, key, hashval, index);
 }
 
+/*============================================================
+ * Open addressing layout
+ */
+
+/* Besides the chained buckets above, ScmHashCore can use open addressing
+ * with a separate array of control bytes (the idea is taken from
+ * Google's "Swiss table").  It is the default for eq?, eqv? and string=?
+ * tables, whose hash functions never call back to Scheme.
+ *
+ * The core's buckets field points to OATable.  Its slots array has
+ * numBuckets OASlots, and ctrl array has one byte per slot,
+ * which is one of:
+ *
+ *   OA_EMPTY    - the slot has never been used.
+ *   OA_DELETED  - the slot had an entry, which is deleted (tombstone).
+ *   0x00-0x7f   - the slot has an entry, and the byte holds 7 bits of
+ *                 its hash value (H2).
+ *
+ * The slots are divided into groups of OA_GROUP_SIZE, and we scan the
+ * control bytes of a group at once, using SIMD instructions if available.
+ * Only the slots whose H2 matches need to be compared with the key,
+ * so we rarely touch the entries that don't match.
+ *
+ * The key, value and hash value are stored inline in the slot, so
+ * a search touches one cache line after the control bytes and we don't
+ * allocate anything per key.  The first two words of a slot are laid
+ * out as ScmDictEntry, and the search returns a pointer to the slot.
+ * Unlike the chained layout, the pointer is valid only until the next
+ * insertion to the table, which may rehash it.  The caller that calls
+ * back to Scheme while holding an entry must search it again (see
+ * hash-table-update! in libdict.scm).  On deletion we return the slot
+ * itself, since the callers look at the value of the deleted entry;
+ * its key and value are left until the next deletion (or insertion
+ * that reuses the slot), and lastDeleted remembers which slot to clear.
+ * We keep the hash value so that rehashing never calls the hash function.
+ *
+ * Rehashing allocates a new OATable and leaves the old one intact.
+ * An iterator keeps walking the slot table it started with, so that
+ * each entry is visited once, and looks up the live entry in the
+ * current table by its saved hash value and key identity.
+ *
+ * The starting group is determined by the hash value (H1), and we probe
+ * the groups in triangular sequence, which visits all groups since the
+ * number of groups is a power of two.  A search ends when we hit a group
+ * that has an empty slot.  It means no key on the probe sequence beyond
+ * that group, so when we delete an entry in such a group, we can mark
+ * it OA_EMPTY instead of OA_DELETED.
+ */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define OA_GROUP_SIZE  16
+#define OA_GROUP_SIZE_LOG2 4
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define OA_GROUP_SIZE  8
+#define OA_GROUP_SIZE_LOG2 3
+#else
+#define OA_GROUP_SIZE  8
+#define OA_GROUP_SIZE_LOG2 3
+#endif
+
+#define OA_EMPTY    0x80
+#define OA_DELETED  0xfe
+#define OA_FULLP(c)  (((c) & 0x80) == 0)
+
+/* Rehash when (entries + tombstones) exceed 7/8 of the capacity */
+#define OA_MAX_LOAD(cap)   ((cap) - (cap)/8)
+
+typedef struct OASlotRec {
+    intptr_t key;               /* must be compatible with ScmDictEntry */
+    intptr_t value;
+    u_long hashval;
+} OASlot;
+
+typedef struct OATableRec {
+    int capacity;               /* # of slots.  same as core's numBuckets,
+                                   but iterator needs it after rehash. */
+    int numDeleted;             /* # of tombstones */
+    int lastDeleted;            /* index of the slot deleted last, whose
+                                   key and value are yet to be cleared,
+                                   or -1. */
+    uint8_t *ctrl;              /* control bytes; atomic */
+    OASlot slots[1];            /* variable length */
+} OATable;
+
+#define OATABLE(hc)   ((OATable*)(hc)->buckets)
+
+#define OA_H2(hashval)  ((uint8_t)(((hashval) >> 7) & 0x7f))
+
+/* Group matching.  Each function returns a bitmask in which the bit
+   (i << OA_MASK_SHIFT) is set iff the i-th byte of the group satisfies
+   the condition. */
+#if defined(__SSE2__)
+#define OA_MASK_SHIFT 0
+static inline u_long oa_match(const uint8_t *g, uint8_t h)
+{
+    __m128i c = _mm_loadu_si128((const __m128i*)g);
+    return (u_long)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8((char)h)));
+}
+static inline u_long oa_match_empty(const uint8_t *g)
+{
+    return oa_match(g, OA_EMPTY);
+}
+static inline u_long oa_match_free(const uint8_t *g) /* empty or deleted */
+{
+    return (u_long)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define OA_MASK_SHIFT 3
+static inline u_long oa_match(const uint8_t *g, uint8_t h)
+{
+    uint8x8_t m = vceq_u8(vld1_u8(g), vdup_n_u8(h));
+    return (u_long)(vget_lane_u64(vreinterpret_u64_u8(m), 0)
+                    & 0x8080808080808080UL);
+}
+static inline u_long oa_match_empty(const uint8_t *g)
+{
+    return oa_match(g, OA_EMPTY);
+}
+static inline u_long oa_match_free(const uint8_t *g)
+{
+    return (u_long)(vget_lane_u64(vreinterpret_u64_u8(vld1_u8(g)), 0)
+                    & 0x8080808080808080UL);
+}
+#else  /* portable version */
+#define OA_MASK_SHIFT 0
+static inline u_long oa_match(const uint8_t *g, uint8_t h)
+{
+    u_long m = 0;
+    for (int i=0; i<OA_GROUP_SIZE; i++) {
+        if (g[i] == h) m |= (1UL << i);
+    }
+    return m;
+}
+static inline u_long oa_match_empty(const uint8_t *g)
+{
+    return oa_match(g, OA_EMPTY);
+}
+static inline u_long oa_match_free(const uint8_t *g)
+{
+    u_long m = 0;
+    for (int i=0; i<OA_GROUP_SIZE; i++) {
+        if (!OA_FULLP(g[i])) m |= (1UL << i);
+    }
+    return m;
+}
+#endif
+
+/* Returns the index of the lowest match in the group, and clears it. */
+static inline int oa_mask_next(u_long *mask)
+{
+    int i = Scm__LowestBitNumber(*mask) >> OA_MASK_SHIFT;
+    *mask &= *mask - 1;
+    return i;
+}
+
+static OATable *oa_make_table(int capacity)
+{
+    OATable *t = SCM_NEW2(OATable*,
+                          sizeof(OATable) + sizeof(OASlot)*(capacity-1));
+    t->capacity = capacity;
+    t->numDeleted = 0;
+    t->lastDeleted = -1;
+    t->ctrl = SCM_NEW_ATOMIC2(uint8_t*, capacity);
+    memset(t->ctrl, OA_EMPTY, capacity);
+    memset(t->slots, 0, sizeof(OASlot)*capacity);
+    return t;
+}
+
+static inline void oa_set_log2(ScmHashCore *table, int capacity)
+{
+    table->numBuckets = capacity;
+    table->numBucketsLog2 = 0;
+    for (int i=capacity; i > 1; i /= 2) table->numBucketsLog2++;
+}
+
+/* Starting group of the probe sequence */
+static inline u_long oa_h1(const ScmHashCore *table, u_long hashval)
+{
+    int ngroups = table->numBuckets / OA_GROUP_SIZE;
+    int gbits = table->numBucketsLog2 - OA_GROUP_SIZE_LOG2;
+    if (ngroups == 1) return 0;
+    return HASH2INDEX(ngroups, gbits, (hashval & PORTABLE_HASHMASK));
+}
+
+/* Place an entry in a freshly created table.  We know the key isn't
+   in the table, and there's no tombstones. */
+static void oa_place(ScmHashCore *table, OATable *t, const OASlot *s)
+{
+    u_long hashval = s->hashval;
+    u_long ngroups = table->numBuckets / OA_GROUP_SIZE;
+    u_long g = oa_h1(table, hashval);
+    for (u_long i = 1; ; i++) {
+        uint8_t *ctrl = t->ctrl + g*OA_GROUP_SIZE;
+        u_long m = oa_match_empty(ctrl);
+        if (m) {
+            int k = oa_mask_next(&m);
+            ctrl[k] = OA_H2(hashval);
+            t->slots[g*OA_GROUP_SIZE + k] = *s;
+            return;
+        }
+        SCM_ASSERT(i < ngroups);
+        g = (g + i) & (ngroups - 1);
+    }
+}
+
+/* Rehash the table into the one with NEWCAP slots.  We use the saved
+   hash values, so this never calls back to Scheme.  The old table is
+   left intact, for an ongoing iterator may still be looking at it. */
+static void oa_rehash(ScmHashCore *table, int newcap)
+{
+    OATable *ot = OATABLE(table);
+    int ocap = table->numBuckets;
+    ScmHashCore tmp = *table;
+    oa_set_log2(&tmp, newcap);
+    OATable *nt = oa_make_table(newcap);
+    for (int i=0; i<ocap; i++) {
+        if (!OA_FULLP(ot->ctrl[i])) continue;
+        oa_place(&tmp, nt, &ot->slots[i]);
+    }
+    table->buckets = (void**)nt;
+    oa_set_log2(table, newcap);
+}
+
+/* Common body of the search in open addressing layout.  CMP is always
+   a constant, so we expect it to be inlined. */
+static inline OASlot *oa_search(ScmHashCore *table, intptr_t key,
+                                 u_long hashval, ScmDictOp op,
+                                 int (*cmp)(const ScmHashCore*,
+                                            intptr_t, intptr_t))
+{
+    OATable *t = OATABLE(table);
+    u_long ngroups = table->numBuckets / OA_GROUP_SIZE;
+    u_long g = oa_h1(table, hashval);
+    uint8_t h2 = OA_H2(hashval);
+    long free_slot = -1;
+
+    for (u_long i = 1; i <= ngroups; i++) {
+        uint8_t *ctrl = t->ctrl + g*OA_GROUP_SIZE;
+        OASlot *slots = t->slots + g*OA_GROUP_SIZE;
+        u_long m = oa_match(ctrl, h2);
+        while (m) {
+            int k = oa_mask_next(&m);
+            OASlot *e = &slots[k];
+            if (e->hashval == hashval && cmp(table, key, e->key)) {
+                if (op == SCM_DICT_DELETE) {
+                    /* Clear the previously deleted slot so that we don't
+                       retain garbage, unless it's been reused. */
+                    int ld = t->lastDeleted;
+                    if (ld >= 0 && !OA_FULLP(t->ctrl[ld])) {
+                        t->slots[ld].key = t->slots[ld].value = 0;
+                    }
+                    ctrl[k] = oa_match_empty(ctrl)? OA_EMPTY : OA_DELETED;
+                    if (ctrl[k] == OA_DELETED) t->numDeleted++;
+                    t->lastDeleted = (int)(g*OA_GROUP_SIZE + k);
+                    table->numEntries--;
+                    SCM_ASSERT(table->numEntries >= 0);
+                    return e;
+                }
+                return e;
+            }
+        }
+        if (op == SCM_DICT_CREATE && free_slot < 0) {
+            u_long f = oa_match_free(ctrl);
+            if (f) free_slot = g*OA_GROUP_SIZE + oa_mask_next(&f);
+        }
+        if (oa_match_empty(ctrl)) break;
+        g = (g + i) & (ngroups - 1);
+    }
+
+    if (op != SCM_DICT_CREATE) return NULL;
+
+    if (table->numEntries + t->numDeleted >= OA_MAX_LOAD(table->numBuckets)
+        && (free_slot < 0 || t->ctrl[free_slot] == OA_EMPTY)) {
+        /* We're about to consume an empty slot, but the table is too
+           crowded.  If it's mostly tombstones, rehash to the same size;
+           otherwise, double it. */
+        int newcap = table->numBuckets;
+        if (table->numEntries >= OA_MAX_LOAD(table->numBuckets)/2) {
+            newcap *= 2;
+        }
+        oa_rehash(table, newcap);
+        t = OATABLE(table);
+        free_slot = -1;
+    }
+    if (free_slot < 0) {
+        /* After rehash, or the table is full of tombstones.  Find the
+           first free slot in the probe sequence. */
+        g = oa_h1(table, hashval);
+        ngroups = table->numBuckets / OA_GROUP_SIZE;
+        for (u_long i = 1; ; i++) {
+            u_long f = oa_match_free(t->ctrl + g*OA_GROUP_SIZE);
+            if (f) {
+                free_slot = g*OA_GROUP_SIZE + oa_mask_next(&f);
+                break;
+            }
+            SCM_ASSERT(i < ngroups);
+            g = (g + i) & (ngroups - 1);
+        }
+    }
+
+    OASlot *e = &t->slots[free_slot];
+    e->key = key;
+    e->value = 0;
+    e->hashval = hashval;
+    if (t->ctrl[free_slot] == OA_DELETED) t->numDeleted--;
+    t->ctrl[free_slot] = h2;
+    table->numEntries++;
+    return e;
+}
+
+static Entry *oa_address_access(ScmHashCore *table, intptr_t key,
+                                  ScmDictOp op)
+{
+    u_long hashval;
+    ADDRESS_HASH(hashval, key);
+    return (Entry*)oa_search(table, key, hashval, op, address_cmp);
+}
+
+static Entry *oa_eqv_access(ScmHashCore *table, intptr_t key,
+                              ScmDictOp op)
+{
+    return (Entry*)oa_search(table, key, Scm_EqvHash(SCM_OBJ(key)), op,
+                             eqv_cmp);
+}
+
+static Entry *oa_string_access(ScmHashCore *table, intptr_t key,
+                                 ScmDictOp op)
+{
+    if (!SCM_STRINGP(SCM_OBJ(key))) {
+        Scm_Error("Got non-string key %S to the string hashtable.",
+                  SCM_OBJ(key));
+    }
+    return (Entry*)oa_search(table, key, Scm_HashString(SCM_STRING(key), 0),
+                             op, string_cmp);
+}
+
+static int oa_general_cmp(const ScmHashCore *table, intptr_t key,
+                          intptr_t k2)
+{
+    return table->cmpfn(table, key, k2);
+}
+
+static Entry *oa_general_access(ScmHashCore *table, intptr_t key,
+                                  ScmDictOp op)
+{
+    return (Entry*)oa_search(table, key, table->hashfn(table, key), op,
+                             oa_general_cmp);
+}
+
+static inline int oa_layout_p(const ScmHashCore *table)
+{
+    return (table->accessfn == (void*)oa_address_access
+            || table->accessfn == (void*)oa_eqv_access
+            || table->accessfn == (void*)oa_string_access
+            || table->accessfn == (void*)oa_general_access);
+}
+
 /*============================================================
  * Hash Core functions
  */
@@ -654,17 +1014,26 @@ static void hash_core_init(ScmHashCore *table,
                            unsigned int initSize,
                            void *data)
 {
+    table->accessfn = (void*)accessfn;
+    table->hashfn = hashfn;
+    table->cmpfn = cmpfn;
+    table->data = data;
+    table->numEntries = 0;
+
+    if (oa_layout_p(table)) {
+        u_int cap = round2up(initSize > OA_GROUP_SIZE? initSize : OA_GROUP_SIZE);
+        if (OA_MAX_LOAD(cap) < initSize) cap *= 2;
+        table->buckets = (void**)oa_make_table(cap);
+        oa_set_log2(table, cap);
+        return;
+    }
+
     if (initSize != 0) initSize = round2up(initSize);
     else initSize = DEFAULT_NUM_BUCKETS;
 
     Entry **b = SCM_NEW_ARRAY(Entry*, initSize);
     table->buckets = (void**)b;
     table->numBuckets = initSize;
-    table->numEntries = 0;
-    table->accessfn = (void*)accessfn;
-    table->hashfn = hashfn;
-    table->cmpfn = cmpfn;
-    table->data = data;
     table->numBucketsLog2 = 0;
     for (u_int i=initSize; i > 1; i /= 2) {
         table->numBucketsLog2++;
@@ -674,29 +1043,36 @@ static void hash_core_init(ScmHashCore *table,
 
 /* choose appropriate procedures for predefined hash types. */
 int  hash_core_predef_procs(ScmHashType type,
+                            ScmHashCoreLayout layout,
                             SearchProc  **accessfn,
                             ScmHashProc **hashfn,
                             ScmHashCompareProc **cmpfn)
 {
+    int open = (layout == SCM_HASH_CORE_OPEN_ADDRESSING);
     switch (type) {
     case SCM_HASH_EQ:
     case SCM_HASH_WORD:
-        *accessfn = address_access;
+        open = open || (layout == SCM_HASH_CORE_DEFAULT);
+        *accessfn = open? oa_address_access : address_access;
         *hashfn = address_hash;
         *cmpfn  = address_cmp;
         return TRUE;
     case SCM_HASH_EQV:
-        *accessfn = general_access;
+        open = open || (layout == SCM_HASH_CORE_DEFAULT);
+        *accessfn = open? oa_eqv_access : general_access;
         *hashfn = eqv_hash;
         *cmpfn  = eqv_cmp;
         return TRUE;
     case SCM_HASH_EQUAL:
-        *accessfn = general_access;
+        /* equal-hash may call back Scheme, so we keep chained buckets
+           unless open addressing is explicitly requested. */
+        *accessfn = open? oa_general_access : general_access;
         *hashfn = equal_hash;
         *cmpfn  = equal_cmp;
         return TRUE;
     case SCM_HASH_STRING:
-        *accessfn = string_access;
+        open = open || (layout == SCM_HASH_CORE_DEFAULT);
+        *accessfn = open? oa_string_access : string_access;
         *hashfn = string_hash;
         *cmpfn  = string_cmp;
         return TRUE;
@@ -709,12 +1085,23 @@ void Scm_HashCoreInitSimple(ScmHashCore *core,
                             ScmHashType type,
                             unsigned int initSize,
                             void *data)
+{
+    Scm_HashCoreInitSimpleWithLayout(core, type, SCM_HASH_CORE_DEFAULT,
+                                     initSize, data);
+}
+
+void Scm_HashCoreInitSimpleWithLayout(ScmHashCore *core,
+                                      ScmHashType type,
+                                      ScmHashCoreLayout layout,
+                                      unsigned int initSize,
+                                      void *data)
 {
     SearchProc  *accessfn = NULL;
     ScmHashProc *hashfn = NULL;
     ScmHashCompareProc *cmpfn = NULL;
 
-    if (hash_core_predef_procs(type, &accessfn, &hashfn, &cmpfn) == FALSE) {
+    if (hash_core_predef_procs(type, layout,
+                               &accessfn, &hashfn, &cmpfn) == FALSE) {
         Scm_Error("[internal error]: wrong TYPE argument passed to Scm_HashCoreInitSimple: %d", type);
     }
     hash_core_init(core, accessfn, hashfn, cmpfn, initSize, data);
@@ -726,8 +1113,23 @@ void Scm_HashCoreInitGeneral(ScmHashCore *core,
                              unsigned int initSize,
                              void *data)
 {
-    hash_core_init(core, general_access, hashfn,
-                   cmpfn, initSize, data);
+    Scm_HashCoreInitGeneralWithLayout(core, hashfn, cmpfn,
+                                      SCM_HASH_CORE_DEFAULT, initSize, data);
+}
+
+/* NB: General hash table defaults to chained buckets, for we can't
+   assume anything about HASHFN and CMPFN. */
+void Scm_HashCoreInitGeneralWithLayout(ScmHashCore *core,
+                                       ScmHashProc *hashfn,
+                                       ScmHashCompareProc *cmpfn,
+                                       ScmHashCoreLayout layout,
+                                       unsigned int initSize,
+                                       void *data)
+{
+    hash_core_init(core,
+                   (layout == SCM_HASH_CORE_OPEN_ADDRESSING
+                    ? oa_general_access : general_access),
+                   hashfn, cmpfn, initSize, data);
 }
 
 int Scm_HashCoreTypeToProcs(ScmHashType type,
@@ -735,11 +1137,45 @@ int Scm_HashCoreTypeToProcs(ScmHashType type,
                             ScmHashCompareProc **cmpfn)
 {
     SearchProc *accessfn;       /* dummy */
-    return hash_core_predef_procs(type, &accessfn, hashfn, cmpfn);
+    return hash_core_predef_procs(type, SCM_HASH_CORE_DEFAULT,
+                                  &accessfn, hashfn, cmpfn);
+}
+
+ScmHashCoreLayout Scm_HashCoreLayout(const ScmHashCore *core)
+{
+    return (oa_layout_p(core)
+            ? SCM_HASH_CORE_OPEN_ADDRESSING
+            : SCM_HASH_CORE_CHAINED);
+}
+
+static void oa_copy(ScmHashCore *dst, const ScmHashCore *src)
+{
+    OATable *st = OATABLE(src);
+    OATable *dt = oa_make_table(src->numBuckets);
+    memcpy(dt->ctrl, st->ctrl, src->numBuckets);
+    memcpy(dt->slots, st->slots, sizeof(OASlot)*src->numBuckets);
+    dt->numDeleted = st->numDeleted;
+    dt->lastDeleted = st->lastDeleted;
+
+    dst->numBuckets = dst->numEntries = 0;
+
+    dst->buckets = (void**)dt;
+    dst->hashfn   = src->hashfn;
+    dst->cmpfn    = src->cmpfn;
+    dst->accessfn = src->accessfn;
+    dst->data     = src->data;
+    dst->numEntries = src->numEntries;
+    dst->numBucketsLog2 = src->numBucketsLog2;
+    dst->numBuckets = src->numBuckets;
 }
 
 void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
 {
+    if (oa_layout_p(src)) {
+        oa_copy(dst, src);
+        return;
+    }
+
     Entry **b = SCM_NEW_ARRAY(Entry*, src->numBuckets);
 
     for (int i=0; i<src->numBuckets; i++) {
@@ -774,6 +1210,15 @@ void Scm_HashCoreCopy(ScmHashCore *dst, const ScmHashCore *src)
 
 void Scm_HashCoreClear(ScmHashCore *table)
 {
+    if (oa_layout_p(table)) {
+        OATable *t = OATABLE(table);
+        memset(t->ctrl, OA_EMPTY, table->numBuckets);
+        memset(t->slots, 0, sizeof(OASlot)*table->numBuckets);
+        t->numDeleted = 0;
+        t->lastDeleted = -1;
+        table->numEntries = 0;
+        return;
+    }
     for (int i=0; i<table->numBuckets; i++) {
         table->buckets[i] = NULL;
     }
@@ -800,6 +1245,12 @@ int Scm_HashCoreNumEntries(ScmHashCore *table)
 void Scm_HashIterInit(ScmHashIter *iter, ScmHashCore *table)
 {
     iter->core = table;
+    if (oa_layout_p(table)) {
+        /* We keep the slot table we walk, for the core may be rehashed. */
+        iter->bucket = 0;
+        iter->next = OATABLE(table);
+        return;
+    }
     for (int i=0; i<table->numBuckets; i++) {
         if (table->buckets[i]) {
             iter->bucket = i;
@@ -810,8 +1261,51 @@ void Scm_HashIterInit(ScmHashIter *iter, ScmHashCore *table)
     iter->next = NULL;
 }
 
+/* Find the entry that has been moved from slot S by rehashing.  We compare
+   the key by identity, so this never calls back to Scheme.  Returns NULL
+   if the entry has been deleted since then. */
+static OASlot *oa_find_moved(ScmHashCore *table, const OASlot *s)
+{
+    OATable *t = OATABLE(table);
+    u_long ngroups = table->numBuckets / OA_GROUP_SIZE;
+    u_long g = oa_h1(table, s->hashval);
+    uint8_t h2 = OA_H2(s->hashval);
+
+    for (u_long i = 1; i <= ngroups; i++) {
+        uint8_t *ctrl = t->ctrl + g*OA_GROUP_SIZE;
+        OASlot *slots = t->slots + g*OA_GROUP_SIZE;
+        u_long m = oa_match(ctrl, h2);
+        while (m) {
+            OASlot *e = &slots[oa_mask_next(&m)];
+            if (e->hashval == s->hashval && e->key == s->key) return e;
+        }
+        if (oa_match_empty(ctrl)) break;
+        g = (g + i) & (ngroups - 1);
+    }
+    return NULL;
+}
+
+static ScmDictEntry *oa_iter_next(ScmHashIter *iter)
+{
+    OATable *t = (OATable*)iter->next;
+    if (t == NULL) return NULL;
+    for (int i = iter->bucket; i < t->capacity; i++) {
+        if (!OA_FULLP(t->ctrl[i])) continue;
+        iter->bucket = i+1;
+        if (t == OATABLE(iter->core)) return (ScmDictEntry*)&t->slots[i];
+        /* The core has been rehashed since we started.  Entries inserted
+           after that aren't visited. */
+        OASlot *e = oa_find_moved(iter->core, &t->slots[i]);
+        if (e) return (ScmDictEntry*)e;
+    }
+    iter->next = NULL;
+    return NULL;
+}
+
 ScmDictEntry *Scm_HashIterNext(ScmHashIter *iter)
 {
+    if (oa_layout_p(iter->core)) return oa_iter_next(iter);
+
     Entry *e = (Entry*)iter->next;
     if (e != NULL) {
         if (e->next) iter->next = e->next;
@@ -946,13 +1440,29 @@ ScmObj Scm_HashTableStat(ScmHashTable *table)
     SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("num-buckets-log2"));
     SCM_APPEND1(h, t, Scm_MakeInteger(c->numBucketsLog2));
 
-    Entry** b = BUCKETS(c);
     ScmVector *v = SCM_VECTOR(Scm_MakeVector(c->numBuckets, SCM_NIL));
     ScmObj *vp = SCM_VECTOR_ELEMENTS(v);
-    for (int i = 0; i<c->numBuckets; i++, vp++) {
-        Entry *e = b[i];
-        for (; e; e = e->next) {
-            *vp = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), *vp);
+    if (oa_layout_p(c)) {
+        OATable *ot = OATABLE(c);
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("layout"));
+        SCM_APPEND1(h, t, SCM_INTERN("open-addressing"));
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("num-deleted"));
+        SCM_APPEND1(h, t, Scm_MakeInteger(ot->numDeleted));
+        for (int i = 0; i<c->numBuckets; i++, vp++) {
+            if (OA_FULLP(ot->ctrl[i])) {
+                OASlot *e = &ot->slots[i];
+                *vp = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), *vp);
+            }
+        }
+    } else {
+        Entry** b = BUCKETS(c);
+        SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("layout"));
+        SCM_APPEND1(h, t, SCM_INTERN("chained"));
+        for (int i = 0; i<c->numBuckets; i++, vp++) {
+            Entry *e = b[i];
+            for (; e; e = e->next) {
+                *vp = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), *vp);
+            }
         }
     }
     SCM_APPEND1(h, t, SCM_MAKE_KEYWORD("contents"));
@@ -961,6 +1471,237 @@ ScmObj Scm_HashTableStat(ScmHashTable *table)
 }
 
 
+/*============================================================
+ * Scheme <concurrent-hash-table> object
+ */
+
+static void concurrent_hash_print(ScmObj obj, ScmPort *port,
+                                  ScmWriteContext *ctx);
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_ConcurrentHashTableClass,
+                         concurrent_hash_print, Scm_ObjectCompare,
+                         NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+
+ScmObj Scm_MakeConcurrentHashTable(ScmHashType type, unsigned int initSize)
+{
+    if (type > SCM_HASH_STRING) {
+        Scm_Error("Scm_MakeConcurrentHashTable: wrong type arg: %d", type);
+    }
+    ScmConcurrentHashTable *z = SCM_NEW(ScmConcurrentHashTable);
+    SCM_SET_CLASS(z, SCM_CLASS_CONCURRENT_HASH_TABLE);
+    z->type = type;
+    unsigned int stripeSize = initSize / SCM_CONCURRENT_HASH_TABLE_STRIPES;
+    for (int i=0; i<SCM_CONCURRENT_HASH_TABLE_STRIPES; i++) {
+        (void)SCM_INTERNAL_MUTEX_INIT(z->stripes[i].mutex);
+        Scm_HashCoreInitSimple(&z->stripes[i].core, type, stripeSize, NULL);
+    }
+    return SCM_OBJ(z);
+}
+
+/* Select a stripe by the hash value of KEY.  We compute the hash outside
+   of the lock, so that equal-hash calling back Scheme code won't block
+   other threads.  The core hashes KEY again, but it uses the lower
+   bits while we use the higher bits of the scrambled value. */
+static ScmConcurrentHashStripe *cht_stripe(ScmConcurrentHashTable *ht,
+                                           ScmObj key)
+{
+    if (ht->type == SCM_HASH_STRING && !SCM_STRINGP(key)) {
+        Scm_Error("Got non-string key %S to the string hashtable.", key);
+    }
+    const ScmHashCore *c = &ht->stripes[0].core;
+    uint32_t h = (uint32_t)c->hashfn(c, (intptr_t)key) * 0x9e3779b1U;
+    return &ht->stripes[(h >> 24) & (SCM_CONCURRENT_HASH_TABLE_STRIPES-1)];
+}
+
+/* Run BODY while holding the lock of stripe S.  For equal? tables,
+   hashing and comparison may call back Scheme code and raise an error,
+   so we make sure to release the lock in that case.  Other table types
+   never call out while holding the lock. */
+#define WITH_STRIPE_LOCK(ht, s, body)                   \
+    do {                                                \
+        (void)SCM_INTERNAL_MUTEX_LOCK((s)->mutex);      \
+        if ((ht)->type == SCM_HASH_EQUAL) {             \
+            SCM_UNWIND_PROTECT { body; }                \
+            SCM_WHEN_ERROR {                            \
+                (void)SCM_INTERNAL_MUTEX_UNLOCK((s)->mutex); \
+                SCM_NEXT_HANDLER;                       \
+            } SCM_END_PROTECT;                          \
+        } else {                                        \
+            body;                                       \
+        }                                               \
+        (void)SCM_INTERNAL_MUTEX_UNLOCK((s)->mutex);    \
+    } while (0)
+
+#define STRIPE_SEARCH(s, key, op) \
+    Scm_HashCoreSearch(&(s)->core, (intptr_t)(key), (op))
+
+ScmObj Scm_ConcurrentHashTableRef(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj fallback)
+{
+    ScmConcurrentHashStripe *s = cht_stripe(ht, key);
+    volatile ScmObj r = fallback;
+    WITH_STRIPE_LOCK(ht, s, {
+            ScmDictEntry *e = STRIPE_SEARCH(s, key, SCM_DICT_GET);
+            if (e) r = SCM_DICT_VALUE(e);
+        });
+    return r;
+}
+
+/* Returns previous value, or SCM_UNBOUND.  See Scm_HashTableSet. */
+ScmObj Scm_ConcurrentHashTableSet(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj value, int flags)
+{
+    ScmConcurrentHashStripe *s = cht_stripe(ht, key);
+    ScmDictOp op = (flags&SCM_DICT_NO_CREATE)? SCM_DICT_GET : SCM_DICT_CREATE;
+    ScmObj r = SCM_UNBOUND;
+    WITH_STRIPE_LOCK(ht, s, {
+            ScmDictEntry *e = STRIPE_SEARCH(s, key, op);
+            if (e) {
+                ScmObj oldval = e->value? SCM_DICT_VALUE(e) : SCM_UNBOUND;
+                if (!(flags&SCM_DICT_NO_OVERWRITE) || SCM_UNBOUNDP(oldval)) {
+                    (void)SCM_DICT_SET_VALUE(e, value);
+                }
+                r = oldval;
+            }
+        });
+    return r;
+}
+
+ScmObj Scm_ConcurrentHashTableDelete(ScmConcurrentHashTable *ht, ScmObj key)
+{
+    ScmConcurrentHashStripe *s = cht_stripe(ht, key);
+    ScmObj r = SCM_UNBOUND;
+    WITH_STRIPE_LOCK(ht, s, {
+            ScmDictEntry *e = STRIPE_SEARCH(s, key, SCM_DICT_DELETE);
+            if (e && e->value) r = SCM_DICT_VALUE(e);
+        });
+    return r;
+}
+
+/* Atomically replaces the value associated to KEY with VALUE, if the
+   current value is EXPECTED (in eq? sense).  EXPECTED being SCM_UNBOUND
+   means KEY must not be in the table; VALUE being SCM_UNBOUND means
+   to remove the entry.  Returns TRUE if replaced. */
+int Scm_ConcurrentHashTableCompareAndSwap(ScmConcurrentHashTable *ht,
+                                          ScmObj key,
+                                          ScmObj expected,
+                                          ScmObj value)
+{
+    ScmConcurrentHashStripe *s = cht_stripe(ht, key);
+    int r = FALSE;
+    WITH_STRIPE_LOCK(ht, s, {
+            ScmDictEntry *e = STRIPE_SEARCH(s, key, SCM_DICT_GET);
+            ScmObj cur = (e && e->value)? SCM_DICT_VALUE(e) : SCM_UNBOUND;
+            if (SCM_EQ(cur, expected)) {
+                if (SCM_UNBOUNDP(value)) {
+                    (void)STRIPE_SEARCH(s, key, SCM_DICT_DELETE);
+                } else {
+                    if (e == NULL) e = STRIPE_SEARCH(s, key, SCM_DICT_CREATE);
+                    (void)SCM_DICT_SET_VALUE(e, value);
+                }
+                r = TRUE;
+            }
+        });
+    return r;
+}
+
+void Scm_ConcurrentHashTablePush(ScmConcurrentHashTable *ht,
+                                 ScmObj key, ScmObj value)
+{
+    ScmConcurrentHashStripe *s = cht_stripe(ht, key);
+    WITH_STRIPE_LOCK(ht, s, {
+            ScmDictEntry *e = STRIPE_SEARCH(s, key, SCM_DICT_CREATE);
+            ScmObj prev = e->value? SCM_DICT_VALUE(e) : SCM_NIL;
+            (void)SCM_DICT_SET_VALUE(e, Scm_Cons(value, prev));
+        });
+}
+
+/* Returns FALLBACK if there's no entry, or the value isn't a pair. */
+ScmObj Scm_ConcurrentHashTablePop(ScmConcurrentHashTable *ht,
+                                  ScmObj key, ScmObj fallback)
+{
+    ScmConcurrentHashStripe *s = cht_stripe(ht, key);
+    volatile ScmObj r = fallback;
+    WITH_STRIPE_LOCK(ht, s, {
+            ScmDictEntry *e = STRIPE_SEARCH(s, key, SCM_DICT_GET);
+            if (e && e->value && SCM_PAIRP(SCM_DICT_VALUE(e))) {
+                r = SCM_CAR(SCM_DICT_VALUE(e));
+                (void)SCM_DICT_SET_VALUE(e, SCM_CDR(SCM_DICT_VALUE(e)));
+            }
+        });
+    return r;
+}
+
+/* The result is just a hint if other threads are modifying the table. */
+long Scm_ConcurrentHashTableNumEntries(ScmConcurrentHashTable *ht)
+{
+    long n = 0;
+    for (int i=0; i<SCM_CONCURRENT_HASH_TABLE_STRIPES; i++) {
+        n += Scm_HashCoreNumEntries(&ht->stripes[i].core);
+    }
+    return n;
+}
+
+void Scm_ConcurrentHashTableClear(ScmConcurrentHashTable *ht)
+{
+    for (int i=0; i<SCM_CONCURRENT_HASH_TABLE_STRIPES; i++) {
+        ScmConcurrentHashStripe *s = &ht->stripes[i];
+        (void)SCM_INTERNAL_MUTEX_LOCK(s->mutex);
+        Scm_HashCoreClear(&s->core);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(s->mutex);
+    }
+}
+
+/* Takes a snapshot of a stripe as an alist.  Iteration of the core
+   doesn't call out, so we don't need WITH_STRIPE_LOCK. */
+static ScmObj stripe_snapshot(ScmConcurrentHashStripe *s)
+{
+    ScmHashIter iter;
+    ScmDictEntry *e;
+    ScmObj r = SCM_NIL;
+    (void)SCM_INTERNAL_MUTEX_LOCK(s->mutex);
+    Scm_HashIterInit(&iter, &s->core);
+    while ((e = Scm_HashIterNext(&iter)) != NULL) {
+        r = Scm_Acons(SCM_DICT_KEY(e), SCM_DICT_VALUE(e), r);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(s->mutex);
+    return r;
+}
+
+ScmObj Scm_ConcurrentHashTableToAlist(ScmConcurrentHashTable *ht)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    for (int i=0; i<SCM_CONCURRENT_HASH_TABLE_STRIPES; i++) {
+        ScmObj a = stripe_snapshot(&ht->stripes[i]);
+        if (!SCM_NULLP(a)) SCM_APPEND(h, t, a);
+    }
+    return h;
+}
+
+void Scm_ConcurrentHashIterInit(ScmConcurrentHashIter *iter,
+                                ScmConcurrentHashTable *ht)
+{
+    iter->table = ht;
+    iter->stripe = 0;
+    iter->pending = SCM_NIL;
+}
+
+/* Returns FALSE when exhausted. */
+int Scm_ConcurrentHashIterNext(ScmConcurrentHashIter *iter,
+                               ScmObj *key, ScmObj *value)
+{
+    while (SCM_NULLP(iter->pending)) {
+        if (iter->stripe >= SCM_CONCURRENT_HASH_TABLE_STRIPES) return FALSE;
+        iter->pending = stripe_snapshot(&iter->table->stripes[iter->stripe++]);
+    }
+    ScmObj p = SCM_CAR(iter->pending);
+    iter->pending = SCM_CDR(iter->pending);
+    *key = SCM_CAR(p);
+    *value = SCM_CDR(p);
+    return TRUE;
+}
+
 /*
  * Utilities
  */
@@ -1000,6 +1741,22 @@ static void hash_print(ScmObj obj, ScmPort *port,
 #endif
 }
 
+static void concurrent_hash_print(ScmObj obj, ScmPort *port,
+                                  ScmWriteContext *ctx SCM_UNUSED)
+{
+    ScmConcurrentHashTable *ht = SCM_CONCURRENT_HASH_TABLE(obj);
+    const char *str = "";
+
+    switch (ht->type) {
+    case SCM_HASH_EQ:      str = "eq?"; break;
+    case SCM_HASH_EQV:     str = "eqv?"; break;
+    case SCM_HASH_EQUAL:   str = "equal?"; break;
+    case SCM_HASH_STRING:  str = "string=?"; break;
+    default: Scm_Panic("something wrong with a concurrent hash table");
+    }
+    Scm_Printf(port, "#<concurrent-hash-table %s %p>", str, ht);
+}
+
 static unsigned int round2up(unsigned int val)
 {
     unsigned int n = 1;
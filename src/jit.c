@@ -0,0 +1,951 @@
+/*
+ * jit.c - baseline native code generator
+ *
+ *   Copyright (c) 2018  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define LIBGAUCHE_BODY
+#include "gauche.h"
+#include "gauche/code.h"
+#include "gauche/vminsn.h"
+#include "gauche/priv/atomicP.h"
+#include "gauche/priv/jitP.h"
+
+#include <stddef.h>
+
+/*
+ * Baseline JIT
+ *
+ *  When a compiled code gets hot (see JIT_ENTRY in vm.c), we translate
+ *  the instructions we know into x86-64 machine code, one template per
+ *  instruction.  VM registers stay in ScmVM during native execution,
+ *  so the interpreter and the native code can hand over the control
+ *  at any instruction boundary; vm->pc is only updated on exit.
+ *
+ *  The templates only cover the common cases: constants, local variable
+ *  references, stack pushes, conditional and unconditional jumps,
+ *  fixnum arithmetic and comparison, and pair access.  Whenever the
+ *  native code meets an instruction without a template, or an operand
+ *  that isn't a fixnum (or a pair) where we expect one, or a fixnum
+ *  overflow, it stores the address of the current instruction to vm->pc
+ *  and returns, and the interpreter carries on from there.  Since none
+ *  of the templates changes VM state before all the checks pass, the
+ *  interpreter sees exactly the state before the instruction, and
+ *  handles the general case (and signals an error if necessary).
+ *
+ *  Register usage: rbx holds vm throughout the native code.  rax, rcx,
+ *  rdx, rsi and rdi are scratch.  All native code is entered via a
+ *  trampoline that saves rbx and jumps to the given entry, so every
+ *  piece of code shares the same frame layout, and the stack is aligned
+ *  at 16 bytes for calling C helpers.
+ *
+ *  The native code of each compiled code gets its own pages, so that
+ *  we can make them executable at once and never write to them again;
+ *  packing the code of several compiled codes in a page would require
+ *  making a page writable while other threads may be running code in it.
+ *  The native code is never freed, even after the compiled code is
+ *  garbage collected, since we don't know if any VM is still running it.
+ *  We cap the total size by SCM_JIT_CODE_LIMIT; once we reach it, the
+ *  code that gets hot afterwards stays interpreted for the rest of the
+ *  process, including the code loaded to replace a collected one.
+ */
+
+#if GAUCHE_JIT
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+static struct {
+    ScmInternalMutex mutex;
+    void (*trampoline)(ScmVM *, void *);
+    size_t total;               /* total bytes of native code */
+} jit;
+
+/* We don't publish an entry whose native code would cover less than
+   this many instructions before falling back; entering and leaving
+   native code costs more than dispatching a couple of instructions. */
+#define JIT_MIN_RUN  3
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7 };
+
+/* condition codes */
+enum {
+    CC_O = 0x0, CC_NO = 0x1, CC_E = 0x4, CC_NE = 0x5,
+    CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf
+};
+#define CC_NEGATE(cc)   ((cc)^1)
+#define CC_ALWAYS       (-1)
+
+/* ALU opcodes (r/m, r) and /digit extensions of 0x81 (r/m, imm32) */
+enum { OP_ADD = 0x01, OP_AND = 0x21, OP_SUB = 0x29, OP_CMP = 0x39 };
+enum { EXT_ADD = 0, EXT_AND = 4, EXT_SUB = 5, EXT_CMP = 7 };
+
+#define REX_W  0x48
+
+#define VMOFF(field)  ((int32_t)offsetof(ScmVM, field))
+
+typedef struct jit_fixup_rec {
+    int pos;                    /* position of rel32 in the buffer */
+    int target;                 /* index of the target insn */
+    int exitp;                  /* TRUE to leave to the interpreter */
+} jit_fixup;
+
+typedef struct jit_builder_rec {
+    ScmCompiledCode *cc;
+    u_char *buf;
+    int len;
+    int cap;
+    int *offs;                  /* native offset of each insn, or -1 */
+    int *stubs;                 /* native offset of exit stubs, or -1 */
+    jit_fixup *fixups;
+    int numFixups;
+    int maxFixups;
+    int cur;                    /* index of the insn we're translating */
+} jit_builder;
+
+/*----------------------------------------------------------------
+ * Encoder
+ */
+
+static void emit1(jit_builder *b, u_int c)
+{
+    if (b->len >= b->cap) {
+        u_char *nbuf = SCM_NEW_ATOMIC2(u_char*, b->cap*2);
+        memcpy(nbuf, b->buf, b->len);
+        b->buf = nbuf;
+        b->cap *= 2;
+    }
+    b->buf[b->len++] = (u_char)c;
+}
+
+static void emit4(jit_builder *b, uint32_t v)
+{
+    for (int i=0; i<4; i++) emit1(b, (v >> (i*8)) & 0xff);
+}
+
+static void emit8(jit_builder *b, uint64_t v)
+{
+    for (int i=0; i<8; i++) emit1(b, (u_int)((v >> (i*8)) & 0xff));
+}
+
+static void patch4(jit_builder *b, int pos, uint32_t v)
+{
+    for (int i=0; i<4; i++) b->buf[pos+i] = (v >> (i*8)) & 0xff;
+}
+
+/* [base+disp32].  base can't be rsp, which requires SIB. */
+static void modrm_mem(jit_builder *b, int reg, int base, int32_t disp)
+{
+    SCM_ASSERT(base != RSP);
+    emit1(b, 0x80 | (reg<<3) | base);
+    emit4(b, (uint32_t)disp);
+}
+
+static void modrm_reg(jit_builder *b, int reg, int rm)
+{
+    emit1(b, 0xc0 | (reg<<3) | rm);
+}
+
+/* mov dst, [base+disp] */
+static void mov_rm(jit_builder *b, int dst, int base, int32_t disp)
+{
+    emit1(b, REX_W); emit1(b, 0x8b); modrm_mem(b, dst, base, disp);
+}
+
+/* mov [base+disp], src */
+static void mov_mr(jit_builder *b, int base, int32_t disp, int src)
+{
+    emit1(b, REX_W); emit1(b, 0x89); modrm_mem(b, src, base, disp);
+}
+
+/* mov dst, src */
+static void mov_rr(jit_builder *b, int dst, int src)
+{
+    emit1(b, REX_W); emit1(b, 0x89); modrm_reg(b, src, dst);
+}
+
+/* mov dst, imm64 */
+static void mov_ri(jit_builder *b, int dst, ScmWord imm)
+{
+    emit1(b, REX_W); emit1(b, 0xb8 + dst); emit8(b, (uint64_t)imm);
+}
+
+/* op dst, src */
+static void alu_rr(jit_builder *b, int op, int dst, int src)
+{
+    emit1(b, REX_W); emit1(b, op); modrm_reg(b, src, dst);
+}
+
+/* op dst, imm32 */
+static void alu_ri(jit_builder *b, int ext, int dst, int32_t imm)
+{
+    emit1(b, REX_W); emit1(b, 0x81); modrm_reg(b, ext, dst);
+    emit4(b, (uint32_t)imm);
+}
+
+/* op qword [base+disp], imm32 */
+static void alu_mi(jit_builder *b, int ext, int base, int32_t disp,
+                   int32_t imm)
+{
+    emit1(b, REX_W); emit1(b, 0x81); modrm_mem(b, ext, base, disp);
+    emit4(b, (uint32_t)imm);
+}
+
+/* mov dword [base+disp], imm32 */
+static void movl_mi(jit_builder *b, int base, int32_t disp, int32_t imm)
+{
+    emit1(b, 0xc7); modrm_mem(b, 0, base, disp); emit4(b, (uint32_t)imm);
+}
+
+/* cmovcc dst, src */
+static void cmov(jit_builder *b, int cc, int dst, int src)
+{
+    emit1(b, REX_W); emit1(b, 0x0f); emit1(b, 0x40 + cc);
+    modrm_reg(b, dst, src);
+}
+
+/* call an absolute address.  Clobbers rax. */
+static void call_abs(jit_builder *b, void *fn)
+{
+    mov_ri(b, RAX, (ScmWord)fn);
+    emit1(b, 0xff); modrm_reg(b, 2, RAX);
+}
+
+/* jmp or jcc to the insn TARGET.  If EXITP, or TARGET doesn't have
+   native code, we leave to the interpreter to run it.  Resolved
+   by resolve_fixups(). */
+static void jump_to(jit_builder *b, int cc, int target, int exitp)
+{
+    if (cc == CC_ALWAYS) {
+        emit1(b, 0xe9);
+    } else {
+        emit1(b, 0x0f); emit1(b, 0x80 + cc);
+    }
+    if (b->numFixups >= b->maxFixups) {
+        jit_fixup *nf = SCM_NEW_ATOMIC_ARRAY(jit_fixup, b->maxFixups*2);
+        memcpy(nf, b->fixups, sizeof(jit_fixup)*b->numFixups);
+        b->fixups = nf;
+        b->maxFixups *= 2;
+    }
+    b->fixups[b->numFixups].pos = b->len;
+    b->fixups[b->numFixups].target = target;
+    b->fixups[b->numFixups].exitp = exitp;
+    b->numFixups++;
+    emit4(b, 0);
+}
+
+/* jcc to a label within the same template.  Returns the position
+   to be given to land(). */
+static int jump_local(jit_builder *b, int cc)
+{
+    emit1(b, 0x0f); emit1(b, 0x80 + cc);
+    int pos = b->len;
+    emit4(b, 0);
+    return pos;
+}
+
+static void land(jit_builder *b, int pos)
+{
+    patch4(b, pos, (uint32_t)(b->len - (pos + 4)));
+}
+
+/*----------------------------------------------------------------
+ * Template components
+ */
+
+/* Leave to the interpreter to run the current insn if CC holds. */
+static void bail(jit_builder *b, int cc)
+{
+    jump_to(b, cc, b->cur, TRUE);
+}
+
+/* Bail out unless R is a fixnum.  Clobbers TMP. */
+static void guard_fixnum(jit_builder *b, int r, int tmp)
+{
+    mov_rr(b, tmp, r);
+    alu_ri(b, EXT_AND, tmp, 3);
+    alu_ri(b, EXT_CMP, tmp, 1);
+    bail(b, CC_NE);
+}
+
+/* Bail out unless R is a pair.  Instances (tag 7), including lazy
+   pairs, are left to the interpreter.  Clobbers TMP. */
+static void guard_pair(jit_builder *b, int r, int tmp)
+{
+    mov_rr(b, tmp, r);
+    alu_ri(b, EXT_AND, tmp, 3);
+    bail(b, CC_NE);
+    mov_rm(b, tmp, r, 0);
+    alu_ri(b, EXT_AND, tmp, 7);
+    alu_ri(b, EXT_CMP, tmp, 7);
+    bail(b, CC_E);
+}
+
+static void load_val0(jit_builder *b, int r)
+{
+    mov_rm(b, r, RBX, VMOFF(val0));
+}
+
+/* LREF(dep,off) into R */
+static void load_lref(jit_builder *b, int r, int dep, int off)
+{
+    mov_rm(b, r, RBX, VMOFF(env));
+    while (dep-- > 0) mov_rm(b, r, r, (int32_t)offsetof(ScmEnvFrame, up));
+    mov_rm(b, r, r, -(int32_t)sizeof(ScmObj)*(off+1));
+}
+
+/* Reads the stack top into R without popping.  Clobbers rdx. */
+static void peek_arg(jit_builder *b, int r)
+{
+    SCM_ASSERT(r != RDX);
+    mov_rm(b, RDX, RBX, VMOFF(sp));
+    mov_rm(b, r, RDX, -(int32_t)sizeof(ScmObj));
+}
+
+/* Discards the stack top.  Changes flags. */
+static void drop_arg(jit_builder *b)
+{
+    alu_mi(b, EXT_SUB, RBX, VMOFF(sp), (int32_t)sizeof(ScmObj));
+}
+
+/* Pushes R.  Clobbers rdx. */
+static void push_arg(jit_builder *b, int r)
+{
+    SCM_ASSERT(r != RDX);
+    mov_rm(b, RDX, RBX, VMOFF(sp));
+    mov_mr(b, RDX, 0, r);
+    alu_ri(b, EXT_ADD, RDX, (int32_t)sizeof(ScmObj));
+    mov_mr(b, RBX, VMOFF(sp), RDX);
+}
+
+/* The equivalent of $result in vminsn.scm; if PUSHP, R is pushed
+   instead of being set to VAL0. */
+static void result(jit_builder *b, int r, int pushp)
+{
+    if (pushp) {
+        push_arg(b, r);
+    } else {
+        mov_mr(b, RBX, VMOFF(val0), r);
+        movl_mi(b, RBX, VMOFF(numVals), 1);
+    }
+}
+
+/* Sets R to #t if CC holds, #f otherwise.  Keeps flags.  Clobbers rsi. */
+static void make_bool(jit_builder *b, int cc, int r)
+{
+    SCM_ASSERT(r != RSI);
+    mov_ri(b, r, SCM_WORD(SCM_FALSE));
+    mov_ri(b, RSI, SCM_WORD(SCM_TRUE));
+    cmov(b, cc, r, RSI);
+}
+
+/* Conditional branch to TARGET if CC holds.  A backward branch goes
+   through the interpreter, so that it checks interrupts. */
+static void branch(jit_builder *b, int cc, int target)
+{
+    jump_to(b, cc, target, target <= b->cur);
+}
+
+/* The equivalent of $branch*: if CC holds, VAL0 <- #f and branch to
+   TARGET; otherwise, VAL0 <- #t. */
+static void branch_bool(jit_builder *b, int cc, int target)
+{
+    mov_ri(b, RAX, SCM_WORD(SCM_TRUE));
+    mov_ri(b, RSI, SCM_WORD(SCM_FALSE));
+    cmov(b, cc, RAX, RSI);
+    mov_mr(b, RBX, VMOFF(val0), RAX);
+    branch(b, cc, target);
+}
+
+/* Unconditional jump.  On a backward jump, we check attentionRequest
+   and leave to the interpreter if it's set. */
+static void jump(jit_builder *b, int target)
+{
+    if (target <= b->cur) {
+        alu_mi(b, EXT_CMP, RBX, VMOFF(attentionRequest), 0);
+        jump_to(b, CC_NE, target, TRUE);
+    }
+    jump_to(b, CC_ALWAYS, target, FALSE);
+}
+
+/* RCX <- x + y, where x is in RCX and y is in RAX, both fixnums.
+   Bails out on overflow. */
+static void fixnum_add(jit_builder *b)
+{
+    alu_ri(b, EXT_SUB, RCX, 1);
+    alu_rr(b, OP_ADD, RCX, RAX);
+    bail(b, CC_O);
+}
+
+/* RCX <- x - y, where x is in RCX and y is in RAX, both fixnums.
+   Bails out on overflow.  Clobbers rsi. */
+static void fixnum_sub(jit_builder *b)
+{
+    mov_rr(b, RSI, RAX);
+    alu_ri(b, EXT_SUB, RSI, 1);
+    alu_rr(b, OP_SUB, RCX, RSI);
+    bail(b, CC_O);
+}
+
+/*----------------------------------------------------------------
+ * Instruction templates
+ */
+
+/* Pseudo insn codes for the fused LREF insns that don't have
+   the generic LREF(dep,off) form. */
+enum {
+    JIT_LREF_CAR = SCM_VM_NUM_INSNS,
+    JIT_LREF_CDR,
+    JIT_LREF_NUMADDI,
+    JIT_LREF_NUMADDI_PUSH
+};
+
+#define LREF_SHORTCUTS(X)                                               \
+    X(0, 0, 0) X(1, 0, 1) X(2, 0, 2) X(3, 0, 3) X(10, 1, 0)             \
+    X(11, 1, 1) X(12, 1, 2) X(20, 2, 0) X(21, 2, 1) X(30, 3, 0)
+
+/* Maps shortcut LREF insns (e.g. LREF21-PUSH) to the generic
+   ones (LREF-PUSH), setting *dep and *off. */
+static u_int lref_shortcut(u_int code, int *dep, int *off)
+{
+    switch (code) {
+#define LREF_SHORTCUT(n, d, o)                                          \
+    case SCM_VM_LREF##n:                                                \
+        *dep = d; *off = o; return SCM_VM_LREF;                         \
+    case SCM_VM_LREF##n##_PUSH:                                         \
+        *dep = d; *off = o; return SCM_VM_LREF_PUSH;                    \
+    case SCM_VM_LREF##n##_CAR:                                          \
+        *dep = d; *off = o; return JIT_LREF_CAR;                        \
+    case SCM_VM_LREF##n##_CDR:                                          \
+        *dep = d; *off = o; return JIT_LREF_CDR;                        \
+    case SCM_VM_LREF##n##_NUMADDI:                                      \
+        *dep = d; *off = o; return JIT_LREF_NUMADDI;                    \
+    case SCM_VM_LREF##n##_NUMADDI_PUSH:                                 \
+        *dep = d; *off = o; return JIT_LREF_NUMADDI_PUSH;
+    LREF_SHORTCUTS(LREF_SHORTCUT)
+#undef LREF_SHORTCUT
+    default: return code;
+    }
+}
+
+/* The VM may rewrite generic arithmetic insns into their specialized
+   versions (see type_feedback() in vm.c).  Our templates check operand
+   types by themselves, so we treat them as the generic ones. */
+static u_int generic_insn(u_int code)
+{
+    switch (code) {
+#define GENERIC_INSN(name)                                              \
+    case name##_FIX: case name##_FLO: return name;
+    GENERIC_INSN(SCM_VM_NUMADD2)
+    GENERIC_INSN(SCM_VM_NUMSUB2)
+    GENERIC_INSN(SCM_VM_NUMMUL2)
+    GENERIC_INSN(SCM_VM_NUMLT2)
+    GENERIC_INSN(SCM_VM_NUMLE2)
+    GENERIC_INSN(SCM_VM_NUMGT2)
+    GENERIC_INSN(SCM_VM_NUMGE2)
+    GENERIC_INSN(SCM_VM_BNLT)
+    GENERIC_INSN(SCM_VM_BNLE)
+    GENERIC_INSN(SCM_VM_BNGT)
+    GENERIC_INSN(SCM_VM_BNGE)
+#undef GENERIC_INSN
+    default: return code;
+    }
+}
+
+static int insn_words(u_int code)
+{
+    switch (Scm_VMInsnOperandType(code)) {
+    case SCM_VM_OPERAND_OBJ:
+    case SCM_VM_OPERAND_CODE:
+    case SCM_VM_OPERAND_CODES:
+    case SCM_VM_OPERAND_ADDR:
+        return 2;
+    case SCM_VM_OPERAND_OBJ_ADDR:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/* Returns the insn index of the jump destination of the insn at PC,
+   or -1 if it doesn't have one. */
+static int jump_target(jit_builder *b, const ScmWord *pc)
+{
+    const ScmWord *dest;
+    switch (Scm_VMInsnOperandType(SCM_VM_INSN_CODE(pc[0]))) {
+    case SCM_VM_OPERAND_ADDR:     dest = (const ScmWord*)pc[1]; break;
+    case SCM_VM_OPERAND_OBJ_ADDR: dest = (const ScmWord*)pc[2]; break;
+    default: return -1;
+    }
+    if (dest < b->cc->code || dest >= b->cc->code + b->cc->codeSize) {
+        return -1;
+    }
+    return (int)(dest - b->cc->code);
+}
+
+/* Emits the template of the insn at PC.  Returns FALSE without
+   emitting anything if we don't have one. */
+static int emit_insn(jit_builder *b, const ScmWord *pc)
+{
+    ScmWord insn = pc[0];
+    int dep = SCM_VM_INSN_ARG0(insn);
+    int off = SCM_VM_INSN_ARG1(insn);
+    u_int code = lref_shortcut(generic_insn(SCM_VM_INSN_CODE(insn)),
+                               &dep, &off);
+    int pushp = FALSE;
+    int target = jump_target(b, pc);
+    int cc;
+
+    switch (code) {
+    case SCM_VM_NOP:
+        break;
+
+    case SCM_VM_CONST_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_CONST:
+        mov_ri(b, RAX, pc[1]);
+        result(b, RAX, pushp);
+        break;
+    case SCM_VM_CONSTI_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_CONSTI:
+        mov_ri(b, RAX, SCM_WORD(SCM_MAKE_INT(SCM_VM_INSN_ARG(insn))));
+        result(b, RAX, pushp);
+        break;
+    case SCM_VM_CONSTN_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_CONSTN:
+        mov_ri(b, RAX, SCM_WORD(SCM_NIL));
+        result(b, RAX, pushp);
+        break;
+    case SCM_VM_CONSTF_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_CONSTF:
+        mov_ri(b, RAX, SCM_WORD(SCM_FALSE));
+        result(b, RAX, pushp);
+        break;
+    case SCM_VM_CONSTU:
+        mov_ri(b, RAX, SCM_WORD(SCM_UNDEFINED));
+        result(b, RAX, FALSE);
+        break;
+
+    case SCM_VM_PUSH:
+        load_val0(b, RAX);
+        push_arg(b, RAX);
+        break;
+
+    case SCM_VM_LREF_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_LREF:
+        load_lref(b, RAX, dep, off);
+        result(b, RAX, pushp);
+        break;
+
+    case SCM_VM_CAR_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_CAR:
+        load_val0(b, RAX);
+        guard_pair(b, RAX, RSI);
+        mov_rm(b, RCX, RAX, (int32_t)offsetof(ScmPair, car));
+        result(b, RCX, pushp);
+        break;
+    case SCM_VM_CDR_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case SCM_VM_CDR:
+        load_val0(b, RAX);
+        guard_pair(b, RAX, RSI);
+        mov_rm(b, RCX, RAX, (int32_t)offsetof(ScmPair, cdr));
+        result(b, RCX, pushp);
+        break;
+    case JIT_LREF_CAR:
+        load_lref(b, RAX, dep, off);
+        guard_pair(b, RAX, RSI);
+        mov_rm(b, RCX, RAX, (int32_t)offsetof(ScmPair, car));
+        result(b, RCX, FALSE);
+        break;
+    case JIT_LREF_CDR:
+        load_lref(b, RAX, dep, off);
+        guard_pair(b, RAX, RSI);
+        mov_rm(b, RCX, RAX, (int32_t)offsetof(ScmPair, cdr));
+        result(b, RCX, FALSE);
+        break;
+
+    case SCM_VM_NOT:
+        load_val0(b, RAX);
+        mov_ri(b, RCX, SCM_WORD(SCM_FALSE));
+        alu_rr(b, OP_CMP, RAX, RCX);
+        make_bool(b, CC_E, RDI);
+        result(b, RDI, FALSE);
+        break;
+    case SCM_VM_NULLP:
+        load_val0(b, RAX);
+        mov_ri(b, RCX, SCM_WORD(SCM_NIL));
+        alu_rr(b, OP_CMP, RAX, RCX);
+        make_bool(b, CC_E, RDI);
+        result(b, RDI, FALSE);
+        break;
+    case SCM_VM_PAIRP: {
+        load_val0(b, RAX);
+        mov_ri(b, RDI, SCM_WORD(SCM_FALSE));
+        mov_rr(b, RSI, RAX);
+        alu_ri(b, EXT_AND, RSI, 3);
+        int notptr = jump_local(b, CC_NE);
+        mov_rm(b, RSI, RAX, 0);
+        alu_ri(b, EXT_AND, RSI, 7);
+        alu_ri(b, EXT_CMP, RSI, 7);
+        bail(b, CC_E);
+        mov_ri(b, RDI, SCM_WORD(SCM_TRUE));
+        land(b, notptr);
+        result(b, RDI, FALSE);
+        break;
+    }
+    case SCM_VM_EQ:
+        peek_arg(b, RCX);
+        load_val0(b, RAX);
+        alu_rr(b, OP_CMP, RCX, RAX);
+        make_bool(b, CC_E, RDI);
+        drop_arg(b);
+        result(b, RDI, FALSE);
+        break;
+
+    case SCM_VM_NUMADD2:
+        peek_arg(b, RCX);
+        load_val0(b, RAX);
+        guard_fixnum(b, RCX, RSI);
+        guard_fixnum(b, RAX, RSI);
+        fixnum_add(b);
+        drop_arg(b);
+        result(b, RCX, FALSE);
+        break;
+    case SCM_VM_NUMSUB2:
+        peek_arg(b, RCX);
+        load_val0(b, RAX);
+        guard_fixnum(b, RCX, RSI);
+        guard_fixnum(b, RAX, RSI);
+        fixnum_sub(b);
+        drop_arg(b);
+        result(b, RCX, FALSE);
+        break;
+    case SCM_VM_LREF_VAL0_NUMADD2:
+        load_lref(b, RCX, dep, off);
+        load_val0(b, RAX);
+        guard_fixnum(b, RCX, RSI);
+        guard_fixnum(b, RAX, RSI);
+        fixnum_add(b);
+        result(b, RCX, FALSE);
+        break;
+    case SCM_VM_NUMADDI:
+        load_val0(b, RAX);
+        guard_fixnum(b, RAX, RSI);
+        alu_ri(b, EXT_ADD, RAX, (int32_t)(SCM_VM_INSN_ARG(insn)*4));
+        bail(b, CC_O);
+        result(b, RAX, FALSE);
+        break;
+    case JIT_LREF_NUMADDI_PUSH: pushp = TRUE; /*FALLTHROUGH*/
+    case JIT_LREF_NUMADDI:
+        load_lref(b, RAX, dep, off);
+        guard_fixnum(b, RAX, RSI);
+        alu_ri(b, EXT_ADD, RAX, (int32_t)(SCM_VM_INSN_ARG(insn)*4));
+        bail(b, CC_O);
+        result(b, RAX, pushp);
+        break;
+    case SCM_VM_NUMSUBI:
+        load_val0(b, RAX);
+        guard_fixnum(b, RAX, RSI);
+        mov_ri(b, RCX, SCM_WORD(SCM_MAKE_INT(SCM_VM_INSN_ARG(insn))) + 1);
+        alu_rr(b, OP_SUB, RCX, RAX);
+        bail(b, CC_O);
+        result(b, RCX, FALSE);
+        break;
+
+    case SCM_VM_NUMEQ2: cc = CC_E;  goto numcmp;
+    case SCM_VM_NUMLT2: cc = CC_L;  goto numcmp;
+    case SCM_VM_NUMLE2: cc = CC_LE; goto numcmp;
+    case SCM_VM_NUMGT2: cc = CC_G;  goto numcmp;
+    case SCM_VM_NUMGE2: cc = CC_GE; goto numcmp;
+    numcmp:
+        /* Tagged fixnums compare in the same order as their values. */
+        peek_arg(b, RCX);
+        load_val0(b, RAX);
+        guard_fixnum(b, RCX, RSI);
+        guard_fixnum(b, RAX, RSI);
+        alu_rr(b, OP_CMP, RCX, RAX);
+        make_bool(b, cc, RDI);
+        drop_arg(b);
+        result(b, RDI, FALSE);
+        break;
+
+    case SCM_VM_BF:
+    case SCM_VM_BT:
+        if (target < 0) return FALSE;
+        load_val0(b, RAX);
+        mov_ri(b, RCX, SCM_WORD(SCM_FALSE));
+        alu_rr(b, OP_CMP, RAX, RCX);
+        branch(b, (code == SCM_VM_BF)? CC_E : CC_NE, target);
+        break;
+    case SCM_VM_BNNULL:
+        if (target < 0) return FALSE;
+        load_val0(b, RAX);
+        mov_ri(b, RCX, SCM_WORD(SCM_NIL));
+        alu_rr(b, OP_CMP, RAX, RCX);
+        branch_bool(b, CC_NE, target);
+        break;
+    case SCM_VM_BNEQ:
+        if (target < 0) return FALSE;
+        peek_arg(b, RCX);
+        drop_arg(b);
+        load_val0(b, RAX);
+        alu_rr(b, OP_CMP, RAX, RCX);
+        branch_bool(b, CC_NE, target);
+        break;
+    case SCM_VM_BNEQC:
+        if (target < 0) return FALSE;
+        load_val0(b, RAX);
+        mov_ri(b, RCX, pc[1]);
+        alu_rr(b, OP_CMP, RAX, RCX);
+        branch_bool(b, CC_NE, target);
+        break;
+    case SCM_VM_BNUMNEI:
+        if (target < 0) return FALSE;
+        load_val0(b, RAX);
+        guard_fixnum(b, RAX, RSI);
+        mov_ri(b, RCX, SCM_WORD(SCM_MAKE_INT(SCM_VM_INSN_ARG(insn))));
+        alu_rr(b, OP_CMP, RAX, RCX);
+        branch_bool(b, CC_NE, target);
+        break;
+
+    /* BNxx branches if the comparison fails */
+    case SCM_VM_BNUMNE: cc = CC_NE; goto bnumcmp;
+    case SCM_VM_BNLT:   cc = CC_GE; goto bnumcmp;
+    case SCM_VM_BNLE:   cc = CC_G;  goto bnumcmp;
+    case SCM_VM_BNGT:   cc = CC_LE; goto bnumcmp;
+    case SCM_VM_BNGE:   cc = CC_L;  goto bnumcmp;
+    bnumcmp:
+        if (target < 0) return FALSE;
+        peek_arg(b, RCX);
+        load_val0(b, RAX);
+        guard_fixnum(b, RCX, RSI);
+        guard_fixnum(b, RAX, RSI);
+        drop_arg(b);
+        alu_rr(b, OP_CMP, RCX, RAX);
+        branch_bool(b, cc, target);
+        break;
+
+    case SCM_VM_LREF_VAL0_BNUMNE: cc = CC_NE; goto lbnumcmp;
+    case SCM_VM_LREF_VAL0_BNLT:   cc = CC_GE; goto lbnumcmp;
+    case SCM_VM_LREF_VAL0_BNLE:   cc = CC_G;  goto lbnumcmp;
+    case SCM_VM_LREF_VAL0_BNGT:   cc = CC_LE; goto lbnumcmp;
+    case SCM_VM_LREF_VAL0_BNGE:   cc = CC_L;  goto lbnumcmp;
+    lbnumcmp:
+        if (target < 0) return FALSE;
+        load_lref(b, RCX, dep, off);
+        load_val0(b, RAX);
+        guard_fixnum(b, RCX, RSI);
+        guard_fixnum(b, RAX, RSI);
+        alu_rr(b, OP_CMP, RCX, RAX);
+        branch_bool(b, cc, target);
+        break;
+
+    case SCM_VM_JUMP:
+        if (target < 0) return FALSE;
+        jump(b, target);
+        break;
+    case SCM_VM_LOCAL_ENV_JUMP:
+        if (target < 0) return FALSE;
+        mov_rr(b, RDI, RBX);
+        mov_ri(b, RSI, (ScmWord)SCM_VM_INSN_ARG(insn));
+        call_abs(b, (void*)Scm__VMLocalEnvShift);
+        jump(b, target);
+        break;
+
+    default:
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*----------------------------------------------------------------
+ * Code generation
+ */
+
+/* Exit stub: vm->pc <- the insn at TARGET, and return. */
+static int emit_exit_stub(jit_builder *b, int target)
+{
+    int pos = b->len;
+    mov_ri(b, RAX, (ScmWord)(b->cc->code + target));
+    mov_mr(b, RBX, VMOFF(pc), RAX);
+    emit1(b, 0x5b);             /* pop rbx */
+    emit1(b, 0xc3);             /* ret */
+    return pos;
+}
+
+static void resolve_fixups(jit_builder *b)
+{
+    for (int i=0; i<b->numFixups; i++) {
+        jit_fixup *f = &b->fixups[i];
+        int dest;
+        if (!f->exitp && b->offs[f->target] >= 0) {
+            dest = b->offs[f->target];
+        } else {
+            if (b->stubs[f->target] < 0) {
+                b->stubs[f->target] = emit_exit_stub(b, f->target);
+            }
+            dest = b->stubs[f->target];
+        }
+        patch4(b, f->pos, (uint32_t)(dest - (f->pos + 4)));
+    }
+}
+
+/* Allocates executable memory and copies the code in.  We map it
+   writable first, then flip it to executable. */
+static void *install_code(const u_char *code, size_t len)
+{
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (len + pagesize - 1) & ~(pagesize - 1);
+    if (jit.total + size > SCM_JIT_CODE_LIMIT) return NULL;
+    void *mem = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+    memcpy(mem, code, len);
+    if (mprotect(mem, size, PROT_READ|PROT_EXEC) < 0) {
+        munmap(mem, size);
+        return NULL;
+    }
+    jit.total += size;
+    return mem;
+}
+
+/* Returns the entry table.  If we can't generate anything useful,
+   all the entries are NULL. */
+static void **jit_compile(ScmCompiledCode *cc)
+{
+    int size = cc->codeSize;
+    void **entries = SCM_NEW_ATOMIC_ARRAY(void*, size);
+    for (int i=0; i<size; i++) entries[i] = NULL;
+    if (jit.trampoline == NULL) return entries;
+
+    jit_builder b;
+    b.cc = cc;
+    b.cap = 256;
+    b.len = 0;
+    b.buf = SCM_NEW_ATOMIC2(u_char*, b.cap);
+    b.offs = SCM_NEW_ATOMIC_ARRAY(int, size);
+    b.stubs = SCM_NEW_ATOMIC_ARRAY(int, size);
+    for (int i=0; i<size; i++) b.offs[i] = b.stubs[i] = -1;
+    b.maxFixups = 32;
+    b.numFixups = 0;
+    b.fixups = SCM_NEW_ATOMIC_ARRAY(jit_fixup, b.maxFixups);
+
+    /* run[i] counts the consecutive insns with native code from i;
+       we record insn indexes in 'insns' to compute it afterwards. */
+    int *insns = SCM_NEW_ATOMIC_ARRAY(int, size);
+    int numInsns = 0;
+    int live = FALSE;           /* TRUE if the last template falls through */
+    for (int i=0; i<size; ) {
+        u_int code = SCM_VM_INSN_CODE(cc->code[i]);
+        int start = b.len;
+        b.cur = i;
+        if (emit_insn(&b, cc->code + i)) {
+            b.offs[i] = start;
+            live = (code != SCM_VM_JUMP && code != SCM_VM_LOCAL_ENV_JUMP);
+        } else if (live) {
+            jump_to(&b, CC_ALWAYS, i, TRUE);
+            live = FALSE;
+        }
+        insns[numInsns++] = i;
+        i += insn_words(code);
+    }
+    /* Code vector always ends with an insn that transfers control, which
+       we don't handle.  Just in case. */
+    if (live) return entries;
+
+    int *run = SCM_NEW_ATOMIC_ARRAY(int, numInsns+1);
+    int published = 0;
+    run[numInsns] = 0;
+    for (int k=numInsns-1; k>=0; k--) {
+        run[k] = (b.offs[insns[k]] >= 0)? run[k+1]+1 : 0;
+        if (run[k] >= JIT_MIN_RUN) published++;
+    }
+    if (published == 0) return entries;
+
+    resolve_fixups(&b);
+    u_char *mem = (u_char*)install_code(b.buf, (size_t)b.len);
+    if (mem == NULL) return entries;
+    for (int k=0; k<numInsns; k++) {
+        if (run[k] >= JIT_MIN_RUN) entries[insns[k]] = mem + b.offs[insns[k]];
+    }
+    return entries;
+}
+
+void **Scm__JitCompile(ScmVM *vm, ScmCompiledCode *cc)
+{
+    if (SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_NO_JIT)) {
+        cc->jitCount = 0;       /* check the flag again later */
+        return NULL;
+    }
+    SCM_INTERNAL_MUTEX_LOCK(jit.mutex);
+    void **entries = cc->jitEntries;
+    if (entries == NULL) {
+        entries = jit_compile(cc);
+        AO_store_full((AO_t*)&cc->jitEntries, (AO_t)entries);
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(jit.mutex);
+    return entries;
+}
+
+void Scm__JitRun(ScmVM *vm, void *entry)
+{
+    jit.trampoline(vm, entry);
+}
+
+int Scm__JitCompiledP(ScmCompiledCode *cc)
+{
+    return AO_load_acquire((AO_t*)&cc->jitEntries) != 0;
+}
+
+/* push rbx; mov rbx, rdi; jmp rsi */
+static const u_char trampoline_code[] = {
+    0x53, REX_W, 0x89, 0xfb, 0xff, 0xe6
+};
+
+void Scm__InitJit(void)
+{
+    SCM_INTERNAL_MUTEX_INIT(jit.mutex);
+    jit.total = 0;
+    jit.trampoline = (void (*)(ScmVM*, void*))
+        install_code(trampoline_code, sizeof(trampoline_code));
+}
+
+#else  /*!GAUCHE_JIT*/
+
+int Scm__JitCompiledP(ScmCompiledCode *cc SCM_UNUSED)
+{
+    return FALSE;
+}
+
+void Scm__InitJit(void)
+{
+}
+
+#endif /*!GAUCHE_JIT*/
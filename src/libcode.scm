@@ -51,7 +51,9 @@
           compiled-code-new-label compiled-code-set-label!
           compiled-code-push-info!
           compiled-code-finish-builder
-          compiled-code-copy!))
+          compiled-code-copy!
+
+          %jit-available? %compiled-code-jit-compiled?))
 (select-module gauche.vm.code)
 
 ;;============================================================
@@ -62,6 +64,7 @@
  (declcode
   (.include <gauche/code.h>
             <gauche/priv/codeP.h>
+            <gauche/priv/jitP.h>
             <gauche/class.h>
             <gauche/vminsn.h>))
 
@@ -159,6 +162,13 @@
  (define-cproc compiled-code-push-info! (cc::<compiled-code> info)
    ::<void> Scm_CompiledCodePushInfo)
 
+ ;; For tests.  %jit-available? tells if this build has the JIT, regardless
+ ;; of -fno-jit.
+ (define-cproc %jit-available? () ::<boolean>
+   (return GAUCHE_JIT))
+ (define-cproc %compiled-code-jit-compiled? (cc::<compiled-code>) ::<boolean>
+   Scm__JitCompiledP)
+
  ;; Kludge: Let gauche.internal import me.  It must be done before the
  ;; compiler runs. This should eventually be done in the gauche.internal side.
  (initcode
@@ -55,7 +55,7 @@
  (define-cise-stmt dict-update!
    [(_ dict searcher xtractor cc) ;; assumes key, proc, and fallback
     `(let* ([e::ScmDictEntry*]
-            [data::(.array void* (1))])
+            [data::(.array void* (3))])
        (cond [(SCM_UNBOUNDP fallback)
               (set! e (,searcher (,xtractor ,dict) (cast intptr_t key)
                                  SCM_DICT_GET))
@@ -65,8 +65,10 @@
                                  SCM_DICT_CREATE))
               (unless (-> e value)
                 (cast void (SCM_DICT_SET_VALUE e fallback)))])
-       (set! (aref data 0) (cast void* e))
-       (Scm_VMPushCC ,cc data 1)
+       (set! (aref data 0) (cast void* e)
+             (aref data 1) (cast void* ,dict)
+             (aref data 2) (cast void* key))
+       (Scm_VMPushCC ,cc data 3)
        (return (Scm_VMApply1 proc (SCM_DICT_VALUE e))))])
 
  (define-cise-stmt dict-push!
@@ -286,9 +288,17 @@
   (return (dict-exists? hash Scm_HashTableRef)))
 
 (inline-stub
+ ;; The entry saved in data[0] may be stale, for the open-addressing
+ ;; layout moves entries when PROC inserts keys and the table is rehashed.
+ ;; If PROC has deleted the key, the result is discarded, as it is with
+ ;; the chained layout, where it goes to the unlinked entry.
  (define-cfn hash-table-update-cc (result (data :: void**)) :static
-   (let* ([e::ScmDictEntry* (cast ScmDictEntry* (aref data 0))])
-     (cast void (SCM_DICT_SET_VALUE e result))
+   (let* ([ht::ScmHashTable* (cast ScmHashTable* (aref data 1))]
+          [e::ScmDictEntry* (Scm_HashCoreSearch (SCM_HASH_TABLE_CORE ht)
+                                                (cast intptr_t (aref data 2))
+                                                SCM_DICT_GET)])
+     (when e
+       (cast void (SCM_DICT_SET_VALUE e result)))
      (return result)))
  )
 
@@ -337,6 +347,148 @@
 (define (hash-table->alist h)
   (hash-table-map h cons))
 
+;;;
+;;; Concurrent hash tables
+;;;
+
+(select-module gauche)
+(inline-stub
+ (define-type <concurrent-hash-table> "ScmConcurrentHashTable*"
+   "concurrent hash table"
+   "SCM_CONCURRENT_HASH_TABLE_P" "SCM_CONCURRENT_HASH_TABLE")
+
+ ;; We don't hold the lock while calling PROC.  Instead, we retry if
+ ;; someone else modified the entry in the mean time.
+ (define-cise-stmt concurrent-hash-table-update-start
+   [(_ ht key proc fallback)
+    `(let* ([old_ (Scm_ConcurrentHashTableRef ,ht ,key SCM_UNBOUND)]
+            [cur_ old_]
+            [data_::(.array void* (5))])
+       (when (SCM_UNBOUNDP old_)
+         (dict-check-entry (SCM_OBJ ,ht) ,key (SCM_UNBOUNDP ,fallback))
+         (set! cur_ ,fallback))
+       (set! (aref data_ 0) (cast void* ,ht)
+             (aref data_ 1) (cast void* ,key)
+             (aref data_ 2) (cast void* ,proc)
+             (aref data_ 3) (cast void* ,fallback)
+             (aref data_ 4) (cast void* old_))
+       (Scm_VMPushCC concurrent-hash-table-update-cc data_ 5)
+       (return (Scm_VMApply1 ,proc cur_)))])
+
+ (define-cfn concurrent-hash-table-update-cc (result data::void**) :static
+   (let* ([ht::ScmConcurrentHashTable*
+           (cast ScmConcurrentHashTable* (aref data 0))]
+          [key (SCM_OBJ (aref data 1))]
+          [proc (SCM_OBJ (aref data 2))]
+          [fallback (SCM_OBJ (aref data 3))])
+     (when (Scm_ConcurrentHashTableCompareAndSwap ht key
+                                                  (SCM_OBJ (aref data 4))
+                                                  result)
+       (return result))
+     (concurrent-hash-table-update-start ht key proc fallback)))
+ )
+
+(define-cproc make-concurrent-hash-table (:optional (type 'eq?)
+                                                    (init-size::<int> 0))
+  (let* ([ctype::ScmHashType SCM_HASH_EQ])
+    (set-hash-type! ctype type)
+    (return (Scm_MakeConcurrentHashTable ctype init-size))))
+
+(define-cproc concurrent-hash-table? (obj) ::<boolean>
+  SCM_CONCURRENT_HASH_TABLE_P)
+
+(define-cproc concurrent-hash-table-type (ht::<concurrent-hash-table>)
+  (get-hash-type (-> ht type)))
+
+(define-cproc concurrent-hash-table-num-entries (ht::<concurrent-hash-table>)
+  ::<long>
+  Scm_ConcurrentHashTableNumEntries)
+
+(define-cproc concurrent-hash-table-clear! (ht::<concurrent-hash-table>)
+  ::<void>
+  Scm_ConcurrentHashTableClear)
+
+(define-cproc concurrent-hash-table-get (ht::<concurrent-hash-table> key
+                                         :optional fallback)
+  (dict-get ht Scm_ConcurrentHashTableRef))
+
+(define-cproc concurrent-hash-table-put! (ht::<concurrent-hash-table>
+                                          key value) ::<void>
+  (Scm_ConcurrentHashTableSet ht key value 0))
+
+(define-cproc concurrent-hash-table-adjoin! (ht::<concurrent-hash-table>
+                                             key value) ::<void>
+  (Scm_ConcurrentHashTableSet ht key value SCM_DICT_NO_OVERWRITE))
+
+(define-cproc concurrent-hash-table-replace! (ht::<concurrent-hash-table>
+                                              key value) ::<void>
+  (Scm_ConcurrentHashTableSet ht key value SCM_DICT_NO_CREATE))
+
+(define-cproc concurrent-hash-table-delete! (ht::<concurrent-hash-table> key)
+  ::<boolean>
+  (return (not (SCM_UNBOUNDP (Scm_ConcurrentHashTableDelete ht key)))))
+
+(define-cproc concurrent-hash-table-exists? (ht::<concurrent-hash-table> key)
+  ::<boolean>
+  (return (dict-exists? ht Scm_ConcurrentHashTableRef)))
+
+(define-cproc concurrent-hash-table-update! (ht::<concurrent-hash-table>
+                                             key proc :optional fallback)
+  (concurrent-hash-table-update-start ht key proc fallback))
+
+(define-cproc concurrent-hash-table-push! (ht::<concurrent-hash-table>
+                                           key value) ::<void>
+  Scm_ConcurrentHashTablePush)
+
+(define-cproc concurrent-hash-table-pop! (ht::<concurrent-hash-table> key
+                                          :optional fallback)
+  (let* ([r (Scm_ConcurrentHashTablePop ht key fallback)])
+    (when (SCM_UNBOUNDP r)
+      (Scm_Error "%S doesn't have a list for key %S" ht key))
+    (return r)))
+
+(define-cproc concurrent-hash-table->alist (ht::<concurrent-hash-table>)
+  Scm_ConcurrentHashTableToAlist)
+
+(inline-stub
+ (define-cfn concurrent-hash-table-iter (args::ScmObj* nargs::int data::void*)
+   :static
+   (cast void nargs) ; suppress unused var warning
+   (let* ([iter::ScmConcurrentHashIter* (cast ScmConcurrentHashIter* data)]
+          [k] [v])
+     (if (Scm_ConcurrentHashIterNext iter (& k) (& v))
+       (return (values k v))
+       (return (values (aref args 0) (aref args 0))))))
+ )
+
+(select-module gauche.internal)
+(define-cproc %concurrent-hash-table-iter (ht::<concurrent-hash-table>)
+  (let* ([iter::ScmConcurrentHashIter* (SCM_NEW ScmConcurrentHashIter)])
+    (Scm_ConcurrentHashIterInit iter ht)
+    (return (Scm_MakeSubr concurrent_hash_table_iter iter 1 0
+                          '"concurrent-hash-table-iterator"))))
+
+(select-module gauche)
+;; Iteration is weakly consistent; see hash.h.
+(define (concurrent-hash-table-fold ht kons knil)
+  (let ([i ((with-module gauche.internal %concurrent-hash-table-iter) ht)]
+        [eof (cons #f #f)])
+    (let loop ([r knil])
+      (receive [k v] (i eof)
+        (if (eq? k eof)
+          r
+          (loop (kons k v r)))))))
+
+(define (concurrent-hash-table-for-each ht proc)
+  (concurrent-hash-table-fold ht (^[k v _] (proc k v)) #f)
+  (undefined))
+
+(define (concurrent-hash-table-keys ht)
+  (concurrent-hash-table-fold ht (^[k v r] (cons k r)) '()))
+
+(define (concurrent-hash-table-values ht)
+  (concurrent-hash-table-fold ht (^[k v r] (cons v r)) '()))
+
 ;;;
 ;;; TreeMap
 ;;;
@@ -219,6 +219,7 @@
 
 (select-module gauche.internal)
 (define-cproc %loaded-dlobjs () Scm_DLObjs) ; for internal use; name may change
+(define-cproc %provided-features () Scm_ProvidedFeatures) ; ditto
 
 (select-module gauche.internal)
 ;; NB: 'require' is recognized by the compiler, which calls
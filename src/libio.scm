@@ -185,7 +185,8 @@
 (define-cproc %open-input-file (path::<string>
                                 :key (if-does-not-exist :error)
                                 (buffering #f)
-                                (element-type :binary))
+                                (element-type :binary)
+                                (mmap #f))
   (let* ([ignerr::int FALSE]
          [flags::int O_RDONLY])
     (cond [(SCM_FALSEP if-does-not-exist) (set! ignerr TRUE)]
@@ -202,8 +203,11 @@
            (logior= flags O_BINARY)))
     (let* ([bufmode::int (Scm_BufferingMode buffering SCM_PORT_INPUT
                                             SCM_PORT_BUFFER_FULL)]
-           [o (Scm_OpenFilePort (Scm_GetStringConst path)
-                                flags bufmode 0)])
+           [o (?: (SCM_FALSEP mmap)
+                  (Scm_OpenFilePort (Scm_GetStringConst path)
+                                    flags bufmode 0)
+                  (Scm_OpenMappedFilePort (Scm_GetStringConst path)
+                                          bufmode))])
       (when (and (SCM_FALSEP o) (not (%open/allow-noexist? ignerr)))
         (Scm_SysError "couldn't open input file: %S" path))
       (return o))))
@@ -381,6 +385,13 @@
 (define-cproc get-remaining-input-string (iport::<input-port>)
   (return (Scm_GetRemainingInputString iport 0)))
 
+;; Returns a u8vector sharing the content of a port opened with :mmap #t,
+;; or #f for other ports.
+(define-cproc port-mapped-u8vector (iport::<input-port>
+                                    :optional (start::<fixnum> 0)
+                                              (end::<fixnum> -1))
+  (return (Scm_PortMappedBytes iport start end)))
+
 ;; Coding aware port
 (select-module gauche)
 
@@ -548,17 +559,9 @@
       (Scm_ReadError port "read-line: encountered illegal byte sequence: %S" r))
     (return r)))
 
-(define (read-string n :optional (port (current-input-port)))
-  (define o (open-output-string :private? #t))
-  (let loop ([i 0])
-    (if (>= i n)
-      (get-output-string o)
-      (let1 c (read-char port)
-        (if (eof-object? c)
-          (if (= i 0)
-            (eof-object)
-            (get-output-string o))
-          (begin (write-char c o) (loop (+ i 1))))))))
+(define-cproc read-string (n::<fixnum>
+                           :optional (port::<input-port> (current-input-port)))
+  (return (Scm_ReadString port n)))
 
 (define (write-string string :optional (port (current-output-port))
                                        (start 0)
@@ -626,8 +629,16 @@
 (select-module gauche.internal)
 (define-cproc %port-ungotten-chars (port::<input-port>)
   Scm_UngottenChars)
+;; Used by text.csv
+(define-cproc %read-string-until (port::<input-port> delims::<string>)
+  Scm_ReadStringUntil)
 (define-cproc %port-ungotten-bytes (port::<input-port>)
   Scm_UngottenBytes)
+;; Used by copy-port.  The caller must lock both ports.
+(define-cproc %port-copy-fd (src::<input-port> dst::<output-port>
+                             limit::<fixnum>)
+  (let* ([r::ScmSize (Scm_PortCopyFd src dst limit)])
+    (return (?: (< r 0) SCM_FALSE (Scm_MakeInteger r)))))
 
 ;; Read time constructor (srfi-10)
 (select-module gauche)
@@ -256,11 +256,11 @@
 
 ;;
 ;; Turn on generic dispatcher on selected gfs.
-;; Eventually, we automate attaching dispacher whenever gf meets certain
-;; criteria.  The dispatcher is so effective, (e.g. ref <vector>
-;; gets 8x speedup) so we manually turn it on for soem gfs.
-;; In case if bug is found in dispatcher mechanism, use -fno-generic-dispatcher
-;; option to turn off dispatchers.
+;; Gfs get dispatchers automatically once they're called often enough
+;; (see priv/dispatchP.h), but these are so popular that we attach
+;; them from the beginning (e.g. ref <vector> gets 8x speedup).
+;; In case if bug is found in dispatcher mechanism, set the environment
+;; variable GAUCHE_DISABLE_GENERIC_DISPATCHER to turn off dispatchers.
 ;;
 (with-module gauche.object
   (generic-build-dispatcher! ref 0)
@@ -211,7 +211,20 @@
 ;;;
 
 (select-module gauche)
-(define-cproc profiler-start () ::<void> Scm_ProfilerStart)
+;; sampling-rate is the number of samples per second.
+;; stack-depth is the max number of callers recorded per sample.
+(define-cproc profiler-start (:key (sampling-rate::<int> 0)
+                                   (stack-depth::<int> -1)
+                                   (all-threads::<boolean> #f))
+  ::<void>
+  (when (< sampling-rate 0)
+    (Scm_Error "sampling-rate must be a positive integer, but got: %d"
+               sampling-rate))
+  (Scm_ProfilerConfigure (?: (> sampling-rate 0) (/ 1000000 sampling-rate) -1)
+                         stack-depth)
+  (if all-threads
+    (Scm_ProfilerStartAll)
+    (Scm_ProfilerStart)))
 (define-cproc profiler-stop  () ::<int>  Scm_ProfilerStop)
 (define-cproc profiler-reset () ::<void> Scm_ProfilerReset)
 
@@ -219,6 +232,9 @@
 ;; Autoloaded profiler-get-result will use this.
 ;; See lib/gauche/vm/profiler.scm
 (define-cproc profiler-raw-result () Scm_ProfilerRawResult)
+(define-cproc profiler-raw-stack-result () Scm_ProfilerRawStackResult)
+(define-cproc profiler-raw-thread-results () Scm_ProfilerRawThreadResults)
+(define-cproc profiler-sampling-period () ::<int> Scm_ProfilerSamplingPeriod)
 
 ;;;
 ;;; Introspection
@@ -96,7 +96,7 @@
 
 (select-module scheme)
 (define-cproc string-length (str::<string>) ::<fixnum> :constant
-  (return (SCM_STRING_BODY_LENGTH (SCM_STRING_BODY str))))
+  (return (SCM_STRING_BODY_LENGTH (SCM_STRING_RAW_BODY str))))
 (define-cproc string-ref (str::<string> k::<fixnum> :optional fallback)
   :constant
   (let* ([r::ScmChar (Scm_StringRef str k (SCM_UNBOUNDP fallback))])
@@ -106,7 +106,7 @@
 
 (select-module gauche)
 (define-cproc string-size (str::<string>) ::<fixnum> :constant
-  (return (SCM_STRING_BODY_SIZE (SCM_STRING_BODY str))))
+  (return (SCM_STRING_BODY_SIZE (SCM_STRING_RAW_BODY str))))
 
 (select-module gauche.internal)
 ;; see lib/gauche/stringutil.scm for generic string-split
@@ -1308,6 +1308,37 @@
    ) ;; when defined(HAVE_SELECT)
  )
 
+;;---------------------------------------------------------------------
+;; poller
+
+(inline-stub
+ (define-type <sys-poller> "ScmSysPoller*")
+
+ (when "defined(HAVE_SYS_POLLER)"
+   (define-constant SYS_POLL_READ   (c "SCM_MAKE_INT(SCM_SYS_POLL_READ)"))
+   (define-constant SYS_POLL_WRITE  (c "SCM_MAKE_INT(SCM_SYS_POLL_WRITE)"))
+   (define-constant SYS_POLL_EXCEPT (c "SCM_MAKE_INT(SCM_SYS_POLL_EXCEPT)"))
+   (define-constant SYS_POLL_EDGE   (c "SCM_MAKE_INT(SCM_SYS_POLL_EDGE)"))
+
+   ;; Registers PF with EVENTS, replacing the previous registration.
+   ;; EVENTS 0 unregisters it.
+   (define-cproc sys-poller-set! (poller::<sys-poller> pf events::<fixnum>)
+     ::<void>
+     (Scm_SysPollerSet poller (Scm_GetPortFd pf TRUE) events))
+
+   ;; Returns a list of (fd . events)
+   (define-cproc sys-poller-wait (poller::<sys-poller> :optional (timeout #f))
+     Scm_SysPollerWait)
+
+   (define-cproc sys-poller-close (poller::<sys-poller>) ::<void>
+     Scm_SysPollerClose)
+
+   (initcode (Scm_AddFeature "gauche.sys.poller" NULL))
+   (when "defined(HAVE_SYS_EPOLL_H)"
+     (initcode (Scm_AddFeature "gauche.sys.epoll" NULL)))
+   ) ;; when defined(HAVE_SYS_POLLER)
+ )
+
 ;;---------------------------------------------------------------------
 ;; miscellaneous
 
@@ -934,6 +934,16 @@ int Scm_ProvidedP(ScmObj feature)
     return r;
 }
 
+/* Returns a fresh list of the provided features, in the order they were
+   provided. */
+ScmObj Scm_ProvidedFeatures(void)
+{
+    (void)SCM_INTERNAL_MUTEX_LOCK(ldinfo.prov_mutex);
+    ScmObj r = Scm_Reverse(ldinfo.provided);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(ldinfo.prov_mutex);
+    return r;
+}
+
 /*------------------------------------------------------------------
  * Autoload
  */
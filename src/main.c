@@ -62,6 +62,8 @@ int interactive_mode = FALSE;   /* force interactive mode */
 int test_mode = FALSE;          /* add . and ../lib implicitly  */
 int profiling_mode = FALSE;     /* profile the script? */
 int stats_mode = FALSE;         /* collect stats (EXPERIMENTAL) */
+const char *dump_image = NULL;  /* if given, dump an image to this file
+                                   instead of running script or repl. */
 
 ScmObj pre_cmds = SCM_NIL;      /* assoc list of commands that needs to be
                                    processed before entering repl.
@@ -91,7 +93,7 @@ ScmModule *default_toplevel_module = NULL;
 void usage(void)
 {
     fprintf(stderr,
-            "Usage: gosh [-biqV][-I<path>][-A<path>][-u<module>][-m<module>][-l<file>][-L<file>][-e<expr>][-E<expr>][-p<type>][-F<feature>][-r<standard>][-f<flag>][--] [file]\n"
+            "Usage: gosh [-biqV][-I<path>][-A<path>][-u<module>][-m<module>][-l<file>][-L<file>][-e<expr>][-E<expr>][-P<image>][-D<image>][-p<type>][-F<feature>][-r<standard>][-f<flag>][--] [file]\n"
             "Options:\n"
             "  -V       Prints version and exits.\n"
             "  -b       Batch mode.  Doesn't print prompts.  Supersedes -i.\n"
@@ -107,6 +109,11 @@ void usage(void)
             "           the script file or entering repl.\n"
             "  -E<expr> Similar to -e, but reads <expr> as if it is surrounded\n"
             "           by parenthesis.\n"
+            "  -P<image> Loads the libraries precompiled in <image>, instead of\n"
+            "           their sources.  See -D.\n"
+            "  -D<image> After processing other options, precompiles the Scheme\n"
+            "           libraries loaded so far into <image> and exits, without\n"
+            "           executing the script file or entering repl.\n"
             "  -m<module> When the script file is given, this option specifies the\n"
             "           name of the module in which the 'main' procedure is defined.\n"
             "           By default, the 'main' procedure in the user module is called\n"
@@ -142,6 +149,9 @@ void usage(void)
             "                      don't run lambda lifting pass.\n"
             "      no-post-inline-pass\n"
             "                      don't run post-inline optimization pass.\n"
+            "      no-jit          don't translate hot code into native code\n"
+            "      no-type-feedback\n"
+            "                      don't specialize arithmetic by observed types.\n"
             "      no-source-info  don't preserve source information for debugging\n"
             "      test            test mode, to run gosh inside the build tree\n"
             "Environment variables:\n"
@@ -250,6 +260,12 @@ void further_options(const char *optarg)
     else if (strcmp(optarg, "no-source-info") == 0) {
         SCM_VM_COMPILER_FLAG_SET(vm, SCM_COMPILE_NOSOURCE);
     }
+    else if (strcmp(optarg, "no-jit") == 0) {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_NO_JIT);
+    }
+    else if (strcmp(optarg, "no-type-feedback") == 0) {
+        SCM_VM_RUNTIME_FLAG_SET(vm, SCM_NO_TYPE_FEEDBACK);
+    }
     else if (strcmp(optarg, "load-verbose") == 0) {
         SCM_VM_RUNTIME_FLAG_SET(vm, SCM_LOAD_VERBOSE);
     }
@@ -288,7 +304,7 @@ void further_options(const char *optarg)
     }
     else {
         fprintf(stderr, "unknown -f option: %s\n", optarg);
-        fprintf(stderr, "supported options are: -fcase-fold, -fload-verbose, -finclude-verbose, -fno-inline, -fno-inline-globals, -fno-inline-locals, -fno-inline-constants, -fno-inline-setters, -fno-source-info, -fno-post-inline-pass, -fno-lambda-lifting-pass, -fwarn-legacy-syntax, or -ftest\n");
+        fprintf(stderr, "supported options are: -fcase-fold, -fload-verbose, -finclude-verbose, -fno-inline, -fno-inline-globals, -fno-inline-locals, -fno-inline-constants, -fno-inline-setters, -fno-source-info, -fno-post-inline-pass, -fno-lambda-lifting-pass, -fno-jit, -fno-type-feedback, -fwarn-legacy-syntax, or -ftest\n");
         exit(1);
     }
 }
@@ -317,7 +333,7 @@ void feature_options(const char *optarg)
 int parse_options(int argc, char *argv[])
 {
     int c;
-    while ((c = getopt(argc, argv, "+be:E:ip:ql:L:m:u:Vv:r:F:f:I:A:-")) >= 0) {
+    while ((c = getopt(argc, argv, "+be:E:ip:ql:L:m:u:Vv:r:F:f:I:A:P:D:-")) >= 0) {
         switch (c) {
         case 'b': batch_mode = TRUE; break;
         case 'i': interactive_mode = TRUE; break;
@@ -329,6 +345,7 @@ int parse_options(int argc, char *argv[])
         case 'm':
             main_module = Scm_Intern(SCM_STRING(SCM_MAKE_STR_COPYING(optarg)));
             break;
+        case 'D': dump_image = optarg; break;
         case 'r': /*FALLTHROUGH*/;
         case 'u': /*FALLTHROUGH*/;
         case 'l': /*FALLTHROUGH*/;
@@ -337,6 +354,7 @@ int parse_options(int argc, char *argv[])
         case 'A': /*FALLTHROUGH*/;
         case 'e': /*FALLTHROUGH*/;
         case 'E': /*FALLTHROUGH*/;
+        case 'P': /*FALLTHROUGH*/;
             pre_cmds = Scm_Acons(SCM_MAKE_CHAR(c),
                                  SCM_MAKE_STR_COPYING(optarg), pre_cmds);
             break;
@@ -474,6 +492,22 @@ static int init_console(void)
 extern void Scm__SetupPortsForWindows(int);
 #endif /*defined(GAUCHE_WINDOWS)*/
 
+/* Calls load-image or dump-image in gauche.image with FILE. */
+static void image_command(const char *name, ScmObj file)
+{
+    ScmLoadPacket lpak;
+    ScmEvalPacket epak;
+
+    if (Scm_Require(SCM_MAKE_STR("gauche/image"), 0, &lpak) < 0) {
+        error_exit(lpak.exception);
+    }
+    ScmObj proc = Scm_GlobalVariableRef(SCM_FIND_MODULE("gauche.image", 0),
+                                        SCM_SYMBOL(SCM_INTERN(name)), 0);
+    if (Scm_Apply(proc, SCM_LIST1(file), &epak) < 0) {
+        error_exit(epak.exception);
+    }
+}
+
 /* Process command-line options that needs to run after Scheme runtime
    is initialized.  CMD_ARGS is an list of (OPTION-CHAR . OPTION-ARG) */
 static void process_command_args(ScmObj cmd_args)
@@ -502,6 +536,9 @@ static void process_command_args(ScmObj cmd_args)
             if (Scm_Load(Scm_GetStringConst(SCM_STRING(v)), SCM_LOAD_QUIET_NOFILE, &lpak) < 0)
                 error_exit(lpak.exception);
             break;
+        case 'P':
+            image_command("load-image", v);
+            break;
         case 'u':
             if (Scm_Require(Scm_StringJoin(Scm_StringSplitByChar(SCM_STRING(v),
                                                                  '.'),
@@ -737,6 +774,11 @@ int main(int ac, char **av)
 
     process_command_args(Scm_Reverse(pre_cmds));
 
+    if (dump_image != NULL) {
+        image_command("dump-image", SCM_MAKE_STR_COPYING(dump_image));
+        Scm_Exit(0);
+    }
+
     /* Set up instruments. */
     ScmLoadPacket lpak;
     if (profiling_mode) {
@@ -121,9 +121,11 @@
 
 /* Global module table */
 static struct {
-    ScmHashTable *table;    /* Maps name -> module. */
-    ScmInternalMutex mutex; /* Lock for table.  Only register_module and
-                               lookup_module may hold the lock. */
+    ScmConcurrentHashTable *table; /* Maps name -> module.  It is
+                                      concurrent, so looking up modules
+                                      doesn't need to hold mutex. */
+    ScmInternalMutex mutex; /* Lock for module operations.  See the note
+                               above. */
 } modules;
 
 /* Predefined modules - slots will be initialized by Scm__InitModule */
@@ -176,28 +178,32 @@ static ScmObj make_module(ScmObj name, ScmHashTable *internal)
 /* Internal.  Lookup module with name N from the table. */
 static ScmModule *lookup_module(ScmSymbol *name)
 {
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
-    ScmObj v = Scm_HashTableRef(modules.table, SCM_OBJ(name), SCM_UNBOUND);
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    ScmObj v = Scm_ConcurrentHashTableRef(modules.table, SCM_OBJ(name),
+                                          SCM_UNBOUND);
     if (SCM_UNBOUNDP(v)) return NULL;
     else return SCM_MODULE(v);
 }
 
-/* Internal.  Lookup module, and if there's none, create one. */
+/* Internal.  Lookup module, and if there's none, create one.
+   If another thread registers the same name first, the module we've
+   created is just discarded. */
 static ScmModule *lookup_module_create(ScmSymbol *name, int *created)
 {
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
-    ScmDictEntry *e = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(modules.table),
-                                         (intptr_t)name,
-                                         SCM_DICT_CREATE);
-    if (e->value == 0) {
-        (void)SCM_DICT_SET_VALUE(e, make_module(SCM_OBJ(name), NULL));
+    ScmModule *m = lookup_module(name);
+    if (m != NULL) {
+        *created = FALSE;
+        return m;
+    }
+    ScmObj z = make_module(SCM_OBJ(name), NULL);
+    ScmObj v = Scm_ConcurrentHashTableSet(modules.table, SCM_OBJ(name), z,
+                                          SCM_DICT_NO_OVERWRITE);
+    if (SCM_UNBOUNDP(v)) {
         *created = TRUE;
+        return SCM_MODULE(z);
     } else {
         *created = FALSE;
+        return SCM_MODULE(v);
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
-    return SCM_MODULE(e->value);
 }
 
 ScmObj Scm_MakeModule(ScmSymbol *name, int error_if_exists)
@@ -822,15 +828,13 @@ ScmModule *Scm_FindModule(ScmSymbol *name, int flags)
 ScmObj Scm_AllModules(void)
 {
     ScmObj h = SCM_NIL, t = SCM_NIL;
-    ScmHashIter iter;
-    ScmDictEntry *e;
+    ScmConcurrentHashIter iter;
+    ScmObj k, v;
 
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
-    Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(modules.table));
-    while ((e = Scm_HashIterNext(&iter)) != NULL) {
-        SCM_APPEND1(h, t, SCM_DICT_VALUE(e));
+    Scm_ConcurrentHashIterInit(&iter, modules.table);
+    while (Scm_ConcurrentHashIterNext(&iter, &k, &v)) {
+        SCM_APPEND1(h, t, v);
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
     return h;
 }
 
@@ -914,7 +918,7 @@ ScmModule *Scm_CurrentModule(void)
     do {                                                                    \
       SCM_SET_CLASS(&mod, SCM_CLASS_MODULE);                                \
       init_module(&mod, mname,  inttab);                                    \
-      Scm_HashTableSet(modules.table, (mod).name, SCM_OBJ(&mod), 0);        \
+      Scm_ConcurrentHashTableSet(modules.table, (mod).name, SCM_OBJ(&mod), 0);\
       mod.parents = (SCM_NULLP(mpl)? SCM_NIL : SCM_LIST1(SCM_CAR(mpl)));    \
       mpl = mod.mpl = Scm_Cons(SCM_OBJ(&mod), mpl);                         \
     } while (0)
@@ -936,7 +940,8 @@ void Scm__InitModule(void)
     const char **modname;
 
     (void)SCM_INTERNAL_MUTEX_INIT(modules.mutex);
-    modules.table = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 64));
+    modules.table = SCM_CONCURRENT_HASH_TABLE(
+        Scm_MakeConcurrentHashTable(SCM_HASH_EQ, 64));
 
     /* standard module chain */
     ScmObj mpl = SCM_NIL;
@@ -41,6 +41,25 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#if defined(HAVE_SYS_MMAN_H) && !defined(GAUCHE_WINDOWS)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAVE_MAPPED_PORT 1
+#endif
+#if defined(HAVE_POLL_H) && !defined(GAUCHE_WINDOWS)
+#include <poll.h>
+#endif
+#if defined(HAVE_SYS_UIO_H) && !defined(GAUCHE_WINDOWS)
+#include <sys/uio.h>
+#include <limits.h>
+#define HAVE_VECTORED_WRITE 1
+#endif
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE) \
+    && !defined(GAUCHE_WINDOWS)
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#define HAVE_KERNEL_COPY 1
+#endif
 
 #undef MAX
 #undef MIN
@@ -68,6 +87,8 @@ static void bufport_flush(ScmPort*, ScmSize, int);
 static void file_closer(ScmPort *p);
 static int  file_buffered_port_p(ScmPort *p);       /* for Scm_PortFdDup */
 static void file_buffered_port_set_fd(ScmPort *p, int fd); /* ditto */
+static ScmSize file_flusher(ScmPort *p, ScmSize cnt, int forcep);
+static int  file_filenum(ScmPort *p);
 
 static ScmObj get_port_name(ScmPort *port)
 {
@@ -337,7 +358,29 @@ void Scm_PortFdDup(ScmPort *dst, ScmPort *src)
    SCM_FD_UNKNOWN. */
 int Scm_FdReady(int fd, int dir)
 {
-#if defined(HAVE_SELECT) && !defined(GAUCHE_WINDOWS)
+#if defined(HAVE_POLL_H) && !defined(GAUCHE_WINDOWS)
+    /* poll() isn't limited by FD_SETSIZE. */
+    struct pollfd pfd;
+    int r;
+
+    /* In case if this is called on non-file ports.*/
+    if (fd < 0) return SCM_FD_READY;
+    pfd.fd = fd;
+    pfd.events = (dir == SCM_PORT_OUTPUT)? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    SCM_SYSCALL(r, poll(&pfd, 1, 0));
+    if (r < 0) Scm_SysError("poll failed");
+    /* select() fails with EBADF on a closed fd; poll() reports it
+       in revents instead. */
+    if (pfd.revents & POLLNVAL) {
+        errno = EBADF;
+        Scm_SysError("poll failed on %d", fd);
+    }
+    /* An error or hangup condition counts as ready, since the next
+       read or write won't block. */
+    if (r > 0) return SCM_FD_READY;
+    else       return SCM_FD_WOULDBLOCK;
+#elif defined(HAVE_SELECT) && !defined(GAUCHE_WINDOWS)
     fd_set fds;
     int r;
     struct timeval tm;
@@ -729,10 +772,88 @@ static void bufport_flush(ScmPort *p, ScmSize cnt, int forcep)
     }
 }
 
+#if defined(HAVE_VECTORED_WRITE)
+/* Write-through for a port directly connected to a file descriptor.
+   When the data doesn't fit in the buffer, we don't copy it into the
+   buffer piecewise; instead we pass the buffered data and the caller's
+   chunks to a single writev() (or a few, if there are more chunks than
+   IOV_MAX), and empty the buffer.  Won't return until everything is
+   written. */
+
+#if !defined(IOV_MAX)
+#define IOV_MAX 16
+#endif
+#define WRITEV_NIOV MIN(IOV_MAX, 64)
+
+static void file_writev(ScmPort *p, struct iovec *iov, int iovcnt)
+{
+    int fd = file_filenum(p);
+    SCM_ASSERT(fd >= 0);
+    while (iovcnt > 0) {
+        ScmSize r;
+        errno = 0;
+        SCM_SYSCALL(r, writev(fd, iov, iovcnt));
+        if (r < 0) {
+            /* See file_flusher for SIGPIPE handling. */
+            if (SCM_PORT_BUFFER_SIGPIPE_SENSITIVE_P(p)) Scm_Exit(1);
+            p->error = TRUE;
+            Scm_SysError("write failed on %S", p);
+        }
+        /* Skip the chunks fully written, and adjust the partial one. */
+        while (iovcnt > 0 && r >= (ScmSize)iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+}
+
+static void bufport_write_through(ScmPort *p, const char **srcs,
+                                  const ScmSize *sizs, int n)
+{
+    struct iovec iov[WRITEV_NIOV];
+    int k = 0;
+    ScmSize cursiz = SCM_PORT_BUFFER_AVAIL(p);
+    if (cursiz > 0) {
+        iov[k].iov_base = p->src.buf.buffer;
+        iov[k].iov_len = cursiz;
+        k++;
+    }
+    /* The buffered data is handed to writev; if it fails halfway,
+       we don't want to write it again when the port is closed. */
+    p->src.buf.current = p->src.buf.buffer;
+    for (int i = 0; i < n; i++) {
+        if (sizs[i] == 0) continue;
+        iov[k].iov_base = (void*)srcs[i];
+        iov[k].iov_len = sizs[i];
+        if (++k == WRITEV_NIOV) {
+            file_writev(p, iov, k);
+            k = 0;
+        }
+    }
+    if (k > 0) file_writev(p, iov, k);
+}
+
+/* Returns TRUE if P's output can bypass the buffer. */
+#define BUFPORT_WRITE_THROUGH_P(p) \
+    ((p)->src.buf.flusher == file_flusher && file_buffered_port_p(p))
+#endif /*HAVE_VECTORED_WRITE*/
+
 /* Writes siz bytes in src to the buffered port.  siz may be larger than
    the port's buffer.  Won't return until entire siz bytes are written. */
 static void bufport_write(ScmPort *p, const char *src, ScmSize siz)
 {
+#if defined(HAVE_VECTORED_WRITE)
+    if (siz > p->src.buf.end - p->src.buf.current
+        && BUFPORT_WRITE_THROUGH_P(p)) {
+        bufport_write_through(p, &src, &siz, 1);
+        return;
+    }
+#endif /*HAVE_VECTORED_WRITE*/
     do {
         ScmSize room = p->src.buf.end - p->src.buf.current;
         if (room >= siz) {
@@ -749,6 +870,24 @@ static void bufport_write(ScmPort *p, const char *src, ScmSize siz)
     } while (siz != 0);
 }
 
+/* Writes N chunks to the buffered port, in order.  If they don't fit in
+   the buffer and the port is connected to a file descriptor, it takes
+   one writev() call in total. */
+static void bufport_writev(ScmPort *p, const char **srcs,
+                           const ScmSize *sizs, int n)
+{
+#if defined(HAVE_VECTORED_WRITE)
+    ScmSize total = 0;
+    for (int i = 0; i < n; i++) total += sizs[i];
+    if (total > p->src.buf.end - p->src.buf.current
+        && BUFPORT_WRITE_THROUGH_P(p)) {
+        bufport_write_through(p, srcs, sizs, n);
+        return;
+    }
+#endif /*HAVE_VECTORED_WRITE*/
+    for (int i = 0; i < n; i++) bufport_write(p, srcs[i], sizs[i]);
+}
+
 /* Fills the buffer.  Reads at least MIN bytes (unless it reaches EOF).
  * If ALLOW_LESS is true, however, we allow to return before the full
  * data is read.
@@ -839,7 +978,7 @@ static ScmSize bufport_read(ScmPort *p, char *dst, ScmSize siz)
  *
  *   The OS doesn't automatically flush the buffered output port,
  *   as it does on FILE* structure.  So Gauche keeps track of active
- *   output buffered ports, in a weak vector.
+ *   output buffered ports, in weak vectors.
  *   When the port is no longer used, it is collected by GC and removed
  *   from the vector.   Scm_FlushAllPorts() flushes the active ports.
  *
@@ -849,129 +988,137 @@ static ScmSize bufport_read(ScmPort *p, char *dst, ScmSize siz)
  *   and at that moment GC has already cleared the vector entry.  So we
  *   can rather let GC remove the entries.
  *
- *   When we find the weak vector is full, we trigger a global GC once.
- *   It may collect garbaged ports and make some room in the vector,
- *   even though the ports are not finalized (GC_gcollect doesn't call
- *   finalizers; they are called at the next checkpoint in VM).
+ *   The registry is split into PORT_SHARDS shards by the hash value of
+ *   the port, each of which has its own mutex and an open-addressing
+ *   weak vector, so that threads opening and closing ports rarely
+ *   contend.  Since entries can be cleared by GC behind us, we can't
+ *   tell exactly how many of them are in use; 'count' is the number of
+ *   entries we've filled since the last rehash, which is an upper bound.
+ *   When it reaches 3/4 of the vector, we rehash the live entries into
+ *   a new vector, doubling its size if more than half of them are alive.
+ *   So registering a port never needs to run GC.
  */
 
-/*TODO: allow to extend the port vector. */
+#define PORT_SHARDS              16     /* need to be 2^n */
+#define PORT_SHARD_INITIAL_SIZE  16     /* need to be 2^n */
 
-#define PORT_VECTOR_SIZE 256    /* need to be 2^n */
-
-static struct {
+static struct port_shard {
     ScmWeakVector   *ports;
+    ScmSmallInt      size;              /* size of ports */
+    ScmSmallInt      count;             /* # of filled entries (see above) */
     ScmInternalMutex mutex;
-} active_buffered_ports;
+} active_buffered_ports[PORT_SHARDS];
 
 #define PORT_HASH(port)  \
-    ((((SCM_WORD(port)>>3) * 2654435761UL)>>16) % PORT_VECTOR_SIZE)
+    (((SCM_WORD(port)>>3) * 2654435761UL)>>16)
+#define PORT_SHARD(port) \
+    (&active_buffered_ports[PORT_HASH(port) & (PORT_SHARDS-1)])
+
+/* Search an empty entry by quadratic probing.  The probe sequence visits
+   all entries, since the size is 2^n.  The caller must hold the lock and
+   make sure there's an empty entry. */
+static void shard_insert(struct port_shard *s, ScmPort *port)
+{
+    ScmSmallInt mask = s->size - 1;
+    ScmSmallInt i = (PORT_HASH(port) / PORT_SHARDS) & mask;
+    ScmSmallInt c = 0;
+    while (!SCM_FALSEP(Scm_WeakVectorRef(s->ports, i, SCM_FALSE))) {
+        i = (i - ++c) & mask;
+    }
+    Scm_WeakVectorSet(s->ports, i, SCM_OBJ(port));
+    s->count++;
+}
 
-static void register_buffered_port(ScmPort *port)
+/* Rehash live entries into a new vector.  The caller must hold the lock. */
+static void shard_rehash(struct port_shard *s)
 {
-    int i, h, c;
-    int tried_gc = FALSE;
-    int need_gc  = FALSE;
-
-  retry:
-    h = i = (int)PORT_HASH(port);
-    c = 0;
-    /* search an available entry by quadratic hash
-       used entry may have #<port> or #t.  #t is for transient state
-       during Scm_FlushAllPorts()---see below. */
-    (void)SCM_INTERNAL_MUTEX_LOCK(active_buffered_ports.mutex);
-    while (!SCM_FALSEP(Scm_WeakVectorRef(active_buffered_ports.ports,
-                                         i, SCM_FALSE))) {
-        i -= ++c; while (i<0) i+=PORT_VECTOR_SIZE;
-        if (i == h) {
-            /* Vector entry is full.  We run global GC to try to collect
-               unused entry. */
-            need_gc = TRUE;
-            break;
-        }
+    ScmWeakVector *old = s->ports;
+    ScmSmallInt oldsize = s->size, live = 0;
+    /* Keep live ports in a strong array, so that GC won't clear them
+       while we're moving them. */
+    ScmObj *save = SCM_NEW_ARRAY(ScmObj, oldsize);
+
+    for (ScmSmallInt i=0; i<oldsize; i++) {
+        ScmObj p = Scm_WeakVectorRef(old, i, SCM_FALSE);
+        if (SCM_PORTP(p)) save[live++] = p;
     }
-    if (!need_gc) {
-        Scm_WeakVectorSet(active_buffered_ports.ports, i, SCM_OBJ(port));
+    if (live*2 > oldsize) s->size = oldsize*2;
+    s->ports = SCM_WEAK_VECTOR(Scm_MakeWeakVector(s->size));
+    s->count = 0;
+    for (ScmSmallInt i=0; i<live; i++) {
+        shard_insert(s, SCM_PORT(save[i]));
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(active_buffered_ports.mutex);
+}
 
-    if (need_gc) {
-        if (tried_gc) {
-            /* We should probably try to extend the weak vector.
-               But for the time being... */
-            Scm_Panic("active buffered port table overflow");
-        } else {
-            GC_gcollect();
-            tried_gc = TRUE;
-            need_gc = FALSE;
-            goto retry;
-        }
-    }
+static void register_buffered_port(ScmPort *port)
+{
+    struct port_shard *s = PORT_SHARD(port);
+    (void)SCM_INTERNAL_MUTEX_LOCK(s->mutex);
+    if ((s->count + 1) * 4 > s->size * 3) shard_rehash(s);
+    shard_insert(s, port);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(s->mutex);
 }
 
 /* This should be called when the output buffered port is explicitly closed.
    The ports collected by GC are automatically unregistered. */
 static void unregister_buffered_port(ScmPort *port)
 {
-    int h = (int)PORT_HASH(port);
-    int i = h;
-    int c = 0;
-    (void)SCM_INTERNAL_MUTEX_LOCK(active_buffered_ports.mutex);
+    struct port_shard *s = PORT_SHARD(port);
+    (void)SCM_INTERNAL_MUTEX_LOCK(s->mutex);
+    ScmSmallInt mask = s->size - 1;
+    ScmSmallInt h = (PORT_HASH(port) / PORT_SHARDS) & mask;
+    ScmSmallInt i = h, c = 0;
     do {
-        ScmObj p = Scm_WeakVectorRef(active_buffered_ports.ports, i, SCM_FALSE);
-        if (!SCM_FALSEP(p) && SCM_EQ(SCM_OBJ(port), p)) {
-            Scm_WeakVectorSet(active_buffered_ports.ports, i, SCM_FALSE);
+        ScmObj p = Scm_WeakVectorRef(s->ports, i, SCM_FALSE);
+        if (SCM_EQ(SCM_OBJ(port), p)) {
+            Scm_WeakVectorSet(s->ports, i, SCM_FALSE);
             break;
         }
-        i -= ++c; while (i<0) i+=PORT_VECTOR_SIZE;
+        i = (i - ++c) & mask;
     } while (i != h);
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(active_buffered_ports.mutex);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(s->mutex);
 }
 
 /* Flush all ports.  Note that it is possible that this routine can be
    called recursively if one of the flushing routine calls Scm_Exit.
-   In order to avoid infinite loop, I have to delete the entries of already
-   flushed port before calling flush, then recover them before return
+   In order to avoid infinite loop, we take the ports out of the shard
+   before calling flush, then register them again before return
    (unless exitting is true, in that case we know nobody cares the active
-   port vector anymore).
+   ports anymore).
    Even if more than one thread calls Scm_FlushAllPorts simultaneously,
-   the flush method is called only once for each vector.
+   the flush method is called only once for each port.
  */
 void Scm_FlushAllPorts(int exitting)
 {
-    ScmObj p = SCM_FALSE;
-    int saved = 0;
-
-    ScmVector *save = SCM_VECTOR(Scm_MakeVector(PORT_VECTOR_SIZE, SCM_FALSE));
-    ScmWeakVector *ports = active_buffered_ports.ports;
+    for (int k=0; k<PORT_SHARDS; k++) {
+        struct port_shard *s = &active_buffered_ports[k];
+        ScmSmallInt saved = 0;
 
-    for (int i=0; i<PORT_VECTOR_SIZE;) {
-        (void)SCM_INTERNAL_MUTEX_LOCK(active_buffered_ports.mutex);
-        for (; i<PORT_VECTOR_SIZE; i++) {
-            p = Scm_WeakVectorRef(ports, i, SCM_FALSE);
+        (void)SCM_INTERNAL_MUTEX_LOCK(s->mutex);
+        ScmObj *save = SCM_NEW_ARRAY(ScmObj, s->size);
+        for (ScmSmallInt i=0; i<s->size; i++) {
+            ScmObj p = Scm_WeakVectorRef(s->ports, i, SCM_FALSE);
             if (SCM_PORTP(p)) {
-                Scm_VectorSet(save, i, p);
-                /* Set #t so that the slot won't be reused. */
-                Scm_WeakVectorSet(ports, i, SCM_TRUE);
-                saved++;
-                break;
+                save[saved++] = p;
+                Scm_WeakVectorSet(s->ports, i, SCM_FALSE);
             }
         }
-        (void)SCM_INTERNAL_MUTEX_UNLOCK(active_buffered_ports.mutex);
-        if (SCM_PORTP(p)) {
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(s->mutex);
+
+        for (ScmSmallInt i=0; i<saved; i++) {
+            ScmPort *p = SCM_PORT(save[i]);
             SCM_ASSERT(SCM_PORT_TYPE(p)==SCM_PORT_FILE);
-            if (!SCM_PORT_ERROR_OCCURRED_P(SCM_PORT(p))) {
-                bufport_flush(SCM_PORT(p), 0, TRUE);
+            if (!SCM_PORT_ERROR_OCCURRED_P(p) && !SCM_PORT_CLOSED_P(p)) {
+                bufport_flush(p, 0, TRUE);
             }
         }
-    }
-    if (!exitting && saved) {
-        (void)SCM_INTERNAL_MUTEX_LOCK(active_buffered_ports.mutex);
-        for (int i=0; i<PORT_VECTOR_SIZE; i++) {
-            p = Scm_VectorRef(save, i, SCM_FALSE);
-            if (SCM_PORTP(p)) Scm_WeakVectorSet(ports, i, p);
+
+        if (!exitting && saved) {
+            for (ScmSmallInt i=0; i<saved; i++) {
+                ScmPort *p = SCM_PORT(save[i]);
+                if (!SCM_PORT_CLOSED_P(p)) register_buffered_port(p);
+            }
         }
-        (void)SCM_INTERNAL_MUTEX_UNLOCK(active_buffered_ports.mutex);
     }
 }
 
@@ -1231,6 +1378,224 @@ ScmObj Scm_MakePortWithFd(ScmObj name, int direction,
     return p;
 }
 
+/*===============================================================
+ * Kernel-side copy
+ *
+ *   When copy-port copies from a port reading a regular file to
+ *   a port connected to a file descriptor, we let the kernel move
+ *   the data with sendfile(), so it never comes up to the user space.
+ *   Whatever SRC has already read into its buffer (or has ungotten)
+ *   is written to DST first, and DST's buffer is flushed, so the order
+ *   of the data is kept.
+ *
+ *   Returns the number of bytes copied, or -1 if the ports aren't
+ *   eligible, in which case nothing has been done and the caller
+ *   should use the ordinary buffered copy.  If LIMIT is not negative,
+ *   at most LIMIT bytes are copied.
+ *   The caller must hold the locks of both ports.
+ */
+
+#if defined(HAVE_KERNEL_COPY)
+#define KERNEL_COPY_CHUNK (64*1024*1024)
+
+static int kernel_copy_port_p(ScmPort *p, int dir)
+{
+    return (SCM_PORT_TYPE(p) == SCM_PORT_FILE
+            && SCM_PORT_DIR(p) == dir
+            && !SCM_PORT_CLOSED_P(p)
+            && file_buffered_port_p(p)
+            && (dir == SCM_PORT_INPUT
+                ? p->src.buf.filler == file_filler
+                : p->src.buf.flusher == file_flusher)
+            && FILE_PORT_DATA(p)->fd >= 0);
+}
+
+/* Some filesystems don't support sendfile.  We copy through DST's
+   buffer in that case. */
+static ScmSize kernel_copy_fallback(ScmPort *src, ScmPort *dst, ScmSize limit)
+{
+    int ifd = FILE_PORT_DATA(src)->fd;
+    ScmSize count = 0;
+    while (limit < 0 || count < limit) {
+        ScmSize req = dst->src.buf.size;
+        if (limit >= 0 && limit - count < req) req = limit - count;
+        ScmSize r;
+        SCM_SYSCALL(r, read(ifd, dst->src.buf.buffer, req));
+        if (r < 0) {
+            src->error = TRUE;
+            Scm_SysError("read failed on %S", src);
+        }
+        if (r == 0) break;
+        dst->src.buf.current = dst->src.buf.buffer + r;
+        bufport_flush(dst, 0, TRUE);
+        count += r;
+    }
+    return count;
+}
+#endif /*HAVE_KERNEL_COPY*/
+
+ScmSize Scm_PortCopyFd(ScmPort *src, ScmPort *dst, ScmSize limit)
+{
+#if defined(HAVE_KERNEL_COPY)
+    if (!kernel_copy_port_p(src, SCM_PORT_INPUT)
+        || !kernel_copy_port_p(dst, SCM_PORT_OUTPUT)) return -1;
+    struct stat st;
+    if (fstat(FILE_PORT_DATA(src)->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+
+    ScmSize count = 0, n;
+    /* Pass on the data already read into SRC. */
+    if (src->ungotten != SCM_CHAR_INVALID) {
+        SCM_CHAR_PUT(src->scratch, src->ungotten);
+        src->scrcnt = SCM_CHAR_NBYTES(src->ungotten);
+        src->ungotten = SCM_CHAR_INVALID;
+    }
+    n = src->scrcnt;
+    if (limit >= 0 && n > limit) n = limit;
+    if (n > 0) {
+        bufport_write(dst, src->scratch, n);
+        src->scrcnt -= n;
+        shift_scratch(src, n);
+        count += n;
+    }
+    n = src->src.buf.end - src->src.buf.current;
+    if (limit >= 0 && n > limit - count) n = limit - count;
+    if (n > 0) {
+        bufport_write(dst, src->src.buf.current, n);
+        src->src.buf.current += n;
+        src->bytes += n;
+        count += n;
+    }
+    bufport_flush(dst, 0, TRUE);
+
+    int ifd = FILE_PORT_DATA(src)->fd;
+    int ofd = FILE_PORT_DATA(dst)->fd;
+    while (limit < 0 || count < limit) {
+        size_t req = KERNEL_COPY_CHUNK;
+        if (limit >= 0 && (size_t)(limit - count) < req) req = limit - count;
+        ScmSize r;
+        errno = 0;
+        SCM_SYSCALL(r, sendfile(ofd, ifd, NULL, req));
+        if (r < 0) {
+            if (errno == EINVAL || errno == ENOSYS) {
+                ScmSize m = kernel_copy_fallback(src, dst,
+                                                 limit < 0 ? -1 : limit-count);
+                src->bytes += m;
+                count += m;
+                break;
+            }
+            /* See file_flusher for SIGPIPE handling. */
+            if (SCM_PORT_BUFFER_SIGPIPE_SENSITIVE_P(dst)) Scm_Exit(1);
+            dst->error = TRUE;
+            Scm_SysError("sendfile failed from %S to %S", src, dst);
+        }
+        if (r == 0) break;
+        src->bytes += r;
+        count += r;
+    }
+    return count;
+#else  /*!HAVE_KERNEL_COPY*/
+    return -1;
+#endif /*!HAVE_KERNEL_COPY*/
+}
+
+/*===============================================================
+ * Mapped file port
+ *
+ *   An input port whose content is a read-only memory map of a file.
+ *   It is an input string port over the mapped region, so reading
+ *   never fills a buffer or copies the data into one; bulk readers
+ *   (read-line, read-string, read-uvector, etc.) copy directly from
+ *   the mapping.
+ *
+ *   The mapping is owned by an immutable u8vector, which unmaps it when
+ *   collected.  The port keeps it in src.istr.owner, and
+ *   Scm_PortMappedBytes creates u8vectors that share the mapped memory
+ *   and have it as the owner.  So closing the port doesn't unmap the
+ *   file; the mapping lives as long as any of them is alive.
+ *
+ *   Since it is a string port, it doesn't behave exactly like a file
+ *   port: port-type returns string, port-file-number returns #f, the
+ *   buffering mode can't be queried or changed, and port-seek can't
+ *   move past the end of the file.
+ *
+ *   If the file can't be mapped (e.g. it isn't a regular file), we
+ *   return an ordinary file port with the BUFFERING mode.
+ *   NB: Truncating the file while it's mapped causes SIGBUS on
+ *   accessing the lost pages.
+ */
+
+#if defined(HAVE_MAPPED_PORT)
+static void mapping_finalize(ScmObj obj, void *data SCM_UNUSED)
+{
+    ScmUVector *v = SCM_UVECTOR(obj);
+    (void)munmap(SCM_UVECTOR_ELEMENTS(v), (size_t)SCM_UVECTOR_SIZE(v));
+}
+#endif /*HAVE_MAPPED_PORT*/
+
+ScmObj Scm_OpenMappedFilePort(const char *path, int buffering)
+{
+#if defined(HAVE_MAPPED_PORT)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return SCM_FALSE;
+
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0 && st.st_size <= SCM_SMALL_INT_MAX) {
+        m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (m == MAP_FAILED) {
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0) {
+            /* An empty file can't be mapped.  Just give an empty port. */
+            close(fd);
+            ScmPort *p = make_port(SCM_CLASS_PORT, SCM_PORT_INPUT,
+                                   SCM_PORT_ISTR);
+            p->src.istr.start = p->src.istr.current = p->src.istr.end = "";
+            p->src.istr.owner = SCM_FALSE;
+            p->name = SCM_MAKE_STR_COPYING(path);
+            return SCM_OBJ(p);
+        }
+        return Scm_MakePortWithFd(SCM_MAKE_STR_COPYING(path), SCM_PORT_INPUT,
+                                  fd, buffering, TRUE);
+    }
+    close(fd);                  /* the mapping stays */
+#if defined(MADV_SEQUENTIAL)
+    (void)madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    ScmObj owner = Scm_MakeUVectorFull(SCM_CLASS_U8VECTOR,
+                                       (ScmSmallInt)st.st_size, m, TRUE, NULL);
+    Scm_RegisterFinalizer(owner, mapping_finalize, NULL);
+
+    ScmPort *p = make_port(SCM_CLASS_PORT, SCM_PORT_INPUT, SCM_PORT_ISTR);
+    p->src.istr.start = (const char*)m;
+    p->src.istr.current = (const char*)m;
+    p->src.istr.end = (const char*)m + st.st_size;
+    p->src.istr.owner = owner;
+    p->name = SCM_MAKE_STR_COPYING(path);
+    return SCM_OBJ(p);
+#else  /*!HAVE_MAPPED_PORT*/
+    return Scm_OpenFilePort(path, O_RDONLY, buffering, 0);
+#endif /*!HAVE_MAPPED_PORT*/
+}
+
+/* Returns an immutable u8vector that shares the bytes [start, end) of
+   the file mapped to PORT, or #f if PORT isn't a mapped file port. */
+ScmObj Scm_PortMappedBytes(ScmPort *port, ScmSmallInt start, ScmSmallInt end)
+{
+    if (SCM_PORT_TYPE(port) != SCM_PORT_ISTR
+        || !SCM_U8VECTORP(port->src.istr.owner)) {
+        return SCM_FALSE;
+    }
+    ScmUVector *m = SCM_UVECTOR(port->src.istr.owner);
+    SCM_CHECK_START_END(start, end, SCM_UVECTOR_SIZE(m));
+    return Scm_MakeUVectorFull(SCM_CLASS_U8VECTOR, end - start,
+                               (char*)SCM_UVECTOR_ELEMENTS(m) + start,
+                               TRUE, m);
+}
+
 /*===============================================================
  * String port
  */
@@ -1243,6 +1608,7 @@ ScmObj Scm_MakeInputStringPort(ScmString *str, int privatep)
     p->src.istr.start = s;
     p->src.istr.current = s;
     p->src.istr.end = s + size;
+    p->src.istr.owner = SCM_FALSE;
     SCM_PORT(p)->name = SCM_MAKE_STR("(input string port)");
     if (privatep) PORT_PRELOCK(p, Scm_VM());
     return SCM_OBJ(p);
@@ -1302,6 +1668,9 @@ ScmObj Scm_GetRemainingInputString(ScmPort *port, int flags)
        the port is pointing won't be changed. */
     const char *ep = port->src.istr.end;
     const char *cp = port->src.istr.current;
+    /* The content of a mapped file port goes away when the mapping
+       is collected, so the result must not share it. */
+    if (!SCM_FALSEP(port->src.istr.owner)) flags |= SCM_STRING_COPYING;
     /* Things gets complicated if there's an ungotten char or bytes.
        We want to share the string body whenever possible, so we
        first check the ungotten stuff matches the content of the
@@ -1725,8 +2094,13 @@ ScmObj Scm_SetCurrentErrorPort(ScmPort *port)
 
 void Scm__InitPort(void)
 {
-    (void)SCM_INTERNAL_MUTEX_INIT(active_buffered_ports.mutex);
-    active_buffered_ports.ports = SCM_WEAK_VECTOR(Scm_MakeWeakVector(PORT_VECTOR_SIZE));
+    for (int i=0; i<PORT_SHARDS; i++) {
+        struct port_shard *s = &active_buffered_ports[i];
+        (void)SCM_INTERNAL_MUTEX_INIT(s->mutex);
+        s->size = PORT_SHARD_INITIAL_SIZE;
+        s->count = 0;
+        s->ports = SCM_WEAK_VECTOR(Scm_MakeWeakVector(s->size));
+    }
 
     Scm_InitStaticClass(&Scm_PortClass, "<port>",
                         Scm_GaucheModule(), port_slots, 0);
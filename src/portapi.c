@@ -290,6 +290,59 @@ void Scm_PutzUnsafe(const char *s, volatile ScmSize siz, ScmPort *p)
     }
 }
 
+/*=================================================================
+ * Putzv - write multiple chunks at once
+ *   For a port connected to a file descriptor, the chunks that don't
+ *   fit in the buffer are written, together with the buffered data,
+ *   by a single writev() without being copied into the buffer.
+ */
+
+#ifdef SAFE_PORT_OP
+void Scm_Putzv(const char **ss, const ScmSize *sizs, int n, ScmPort *p)
+#else
+void Scm_PutzvUnsafe(const char **ss, const ScmSize *sizs, int n, ScmPort *p)
+#endif
+{
+    VMDECL;
+    SHORTCUT(p, Scm_PutzvUnsafe(ss, sizs, n, p); return);
+    WALKER_CHECK(p);
+    LOCK(p);
+    CLOSE_CHECK(p);
+    switch (SCM_PORT_TYPE(p)) {
+    case SCM_PORT_FILE:
+        SAFE_CALL(p, bufport_writev(p, ss, sizs, n));
+        if (SCM_PORT_BUFFER_MODE(p) == SCM_PORT_BUFFER_LINE) {
+            const char *cp = p->src.buf.current;
+            while (cp-- > p->src.buf.buffer) {
+                if (*cp == '\n') {
+                    SAFE_CALL(p, bufport_flush(p, (cp - p->src.buf.current), FALSE));
+                    break;
+                }
+            }
+        } else if (SCM_PORT_BUFFER_MODE(p) == SCM_PORT_BUFFER_NONE) {
+            SAFE_CALL(p, bufport_flush(p, 0, TRUE));
+        }
+        UNLOCK(p);
+        break;
+    case SCM_PORT_OSTR:
+        for (int i = 0; i < n; i++) {
+            Scm_DStringPutz(&p->src.ostr, ss[i], sizs[i]);
+        }
+        UNLOCK(p);
+        break;
+    case SCM_PORT_PROC:
+        for (volatile int i = 0; i < n; i++) {
+            SAFE_CALL(p, p->src.vt.Putz(ss[i], sizs[i], p));
+        }
+        UNLOCK(p);
+        break;
+    default:
+        UNLOCK(p);
+        Scm_PortError(p, SCM_PORT_ERROR_OUTPUT,
+                      "bad port type for output: %S", p);
+    }
+}
+
 /*=================================================================
  * Flush
  */
@@ -709,6 +762,102 @@ int Scm_GetcUnsafe(ScmPort *p)
 
 #undef GETC_SCRATCH
 
+/*=================================================================
+ * Cursor - bulk input
+ *   Scm_PortCursorView returns a borrowed view of the input that is
+ *   immediately available, without copying it.  The caller scans it,
+ *   then tells how many bytes it has consumed by Scm_PortCursorAdvance.
+ *   The view is valid until the next operation on the port.
+ *
+ *   The caller must hold the port lock, as with *Unsafe APIs, and it
+ *   must use PORT_SAFE_CALL if it's called from within a locked region,
+ *   since filling the buffer may raise an error.
+ *
+ *   If there's a pending character in the scratch buffer or the ungotten
+ *   char, the view only contains it; the next view shows the port's
+ *   buffer.  So the view may end in the middle of a multibyte character;
+ *   the caller should read such character by Scm_GetcUnsafe.
+ *
+ *   Scm_PortCursorView returns the number of bytes in the view, 0 if
+ *   the port reached EOF, or -1 if the port doesn't have a buffer to
+ *   view (procedural ports).  In the last case the caller should use
+ *   Scm_Get[bc]Unsafe.
+ */
+
+#ifndef PORT_CURSOR             /* common part */
+#define PORT_CURSOR
+
+ScmSize Scm_PortCursorView(ScmPort *p, const char **start)
+{
+    /* NB: We can't use CLOSE_CHECK, for the lock is the caller's. */
+    if (SCM_PORT_CLOSED_P(p)) {
+        Scm_PortError(p, SCM_PORT_ERROR_CLOSED,
+                      "I/O attempted on closed port: %S", p);
+    }
+    if (p->ungotten != SCM_CHAR_INVALID) {
+        SCM_CHAR_PUT(p->scratch, p->ungotten);
+        p->scrcnt = SCM_CHAR_NBYTES(p->ungotten);
+        p->ungotten = SCM_CHAR_INVALID;
+    }
+    if (p->scrcnt > 0) {
+        *start = p->scratch;
+        return p->scrcnt;
+    }
+
+    switch (SCM_PORT_TYPE(p)) {
+    case SCM_PORT_FILE:
+        if (p->src.buf.current >= p->src.buf.end) {
+            if (bufport_fill(p, 1, FALSE) == 0) return 0;
+        }
+        *start = p->src.buf.current;
+        return p->src.buf.end - p->src.buf.current;
+    case SCM_PORT_ISTR:
+        *start = p->src.istr.current;
+        return p->src.istr.end - p->src.istr.current;
+    default:
+        return -1;
+    }
+}
+
+/* Consumes NBYTES bytes of the last view.  If COUNT_LINES is true,
+   newlines in the consumed bytes are counted.  (Those in the scratch
+   buffer aren't, since they've been counted when they were read.) */
+void Scm_PortCursorAdvance(ScmPort *p, ScmSize nbytes, int count_lines)
+{
+    if (p->scrcnt > 0) {
+        SCM_ASSERT(nbytes <= (ScmSize)p->scrcnt);
+        p->scrcnt -= nbytes;
+        shift_scratch(p, nbytes);
+        return;
+    }
+
+    const char *s;
+    switch (SCM_PORT_TYPE(p)) {
+    case SCM_PORT_FILE:
+        s = p->src.buf.current;
+        p->src.buf.current += nbytes;
+        break;
+    case SCM_PORT_ISTR:
+        s = p->src.istr.current;
+        p->src.istr.current += nbytes;
+        break;
+    default:
+        Scm_PortError(p, SCM_PORT_ERROR_INPUT,
+                      "port doesn't have a cursor: %S", p);
+        return;                 /* dummy */
+    }
+    p->bytes += nbytes;
+    if (count_lines) {
+        const char *e = s + nbytes;
+        while ((s = memchr(s, '\n', e - s)) != NULL) {
+            p->line++;
+            s++;
+        }
+    }
+}
+
+#endif /*PORT_CURSOR*/
+
 /*=================================================================
  * Getz - block read.
  *   If the buffering mode is BUFFER_FULL, this reads BUFLEN bytes
@@ -820,13 +969,6 @@ ScmSize Scm_GetzUnsafe(char *buf, ScmSize buflen, ScmPort *p)
 
 /* Auxiliary procedures */
 
-/* NB: it may be further optimized by scanning the contents of buffer
-   when the port is a buffered port or an input string, which allows
-   us to avoid mb->wc->mb conversion.   See port.c, v 1.69 for some
-   attempt to do so.  The problem there is that if I have to take
-   into account the cases of the ungotten char and the scratch buffer,
-   code becomes ugly.  There might be some better approach. */
-
 #ifndef READLINE_AUX
 #define READLINE_AUX
 /* Assumes the port is locked, and the caller takes care of unlocking
@@ -834,15 +976,10 @@ ScmSize Scm_GetzUnsafe(char *buf, ScmSize buflen, ScmPort *p)
 /* NB: this routine reads bytes, not chars.  It allows to readline
    from a port in unknown character encoding (e.g. reading the first
    line of xml doc to find out charset parameter). */
-ScmObj readline_body(ScmPort *p)
+static ScmObj readline_body_bytewise(ScmPort *p, ScmDString *ds, int b1)
 {
-    ScmDString ds;
-
-    Scm_DStringInit(&ds);
-    int b1 = Scm_GetbUnsafe(p);
-    if (b1 == EOF) return SCM_EOF;
     for (;;) {
-        if (b1 == EOF) return Scm_DStringGet(&ds, 0);
+        if (b1 == EOF) return Scm_DStringGet(ds, 0);
         if (b1 == '\n') break;
         if (b1 == '\r') {
             int b2 = Scm_GetbUnsafe(p);
@@ -850,11 +987,54 @@ ScmObj readline_body(ScmPort *p)
             Scm_UngetbUnsafe(b2, p);
             break;
         }
-        SCM_DSTRING_PUTB(&ds, b1);
+        SCM_DSTRING_PUTB(ds, b1);
         b1 = Scm_GetbUnsafe(p);
     }
     p->line++;
-    return Scm_DStringGet(&ds, 0);
+    return Scm_DStringGet(ds, 0);
+}
+
+/* Buffered ports and input string ports are scanned through the
+   cursor, so that we can find the end of line by a bulk search and
+   copy the line in chunks. */
+ScmObj readline_body(ScmPort *p)
+{
+    ScmDString ds;
+    const char *v;
+    int seen = FALSE;
+
+    Scm_DStringInit(&ds);
+    for (;;) {
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n < 0) {
+            int b1 = Scm_GetbUnsafe(p);
+            if (b1 == EOF && !seen) return SCM_EOF;
+            return readline_body_bytewise(p, &ds, b1);
+        }
+        if (n == 0) {
+            if (!seen) return SCM_EOF;
+            return Scm_DStringGet(&ds, 0);
+        }
+        seen = TRUE;
+        const char *e = v + n;
+        const char *q = memchr(v, '\n', n);
+        if (q == NULL) q = e;
+        const char *cr = memchr(v, '\r', q - v);
+        if (cr) q = cr;
+        Scm_DStringPutz(&ds, v, q - v);
+        if (q == e) {
+            Scm_PortCursorAdvance(p, n, FALSE);
+            continue;
+        }
+        int eol = *q;
+        Scm_PortCursorAdvance(p, q - v + 1, FALSE);
+        if (eol == '\r') {
+            int b2 = Scm_GetbUnsafe(p);
+            if (b2 != EOF && b2 != '\n') Scm_UngetbUnsafe(b2, p);
+        }
+        p->line++;
+        return Scm_DStringGet(&ds, 0);
+    }
 }
 #endif /* READLINE_AUX */
 
@@ -874,6 +1054,175 @@ ScmObj Scm_ReadLineUnsafe(ScmPort *p)
     return r;
 }
 
+/*=================================================================
+ * ReadString
+ *   Reads up to NCHARS characters.  Returns EOF if no character
+ *   is available before EOF.
+ */
+
+#ifndef READSTRING_AUX
+#define READSTRING_AUX
+/* Assumes the port is locked, and the caller takes care of unlocking
+   even if an error is signalled within this body */
+static ScmObj readstring_body(ScmPort *p, ScmSize nchars)
+{
+    ScmDString ds;
+    ScmSize count = 0;
+    const char *v;
+
+    Scm_DStringInit(&ds);
+    while (count < nchars) {
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n == 0) break;      /* EOF */
+        if (n > 0) {
+            /* Take as many complete characters as we can from the view. */
+            const char *q = v, *e = v + n;
+            ScmSize k = 0;
+            while (k < nchars - count && q < e) {
+                int nf = SCM_CHAR_NFOLLOWS((unsigned char)*q);
+                if (q + nf + 1 > e) break;
+                q += nf + 1;
+                k++;
+            }
+            if (k > 0) {
+                Scm_DStringPutz(&ds, v, q - v);
+                Scm_PortCursorAdvance(p, q - v, TRUE);
+                count += k;
+                continue;
+            }
+        }
+        /* The port doesn't have a view, or the next character straddles
+           the end of the view. */
+        int c = Scm_GetcUnsafe(p);
+        if (c == EOF) break;
+        SCM_DSTRING_PUTC(&ds, c);
+        count++;
+    }
+    if (count == 0 && nchars > 0) return SCM_EOF;
+    return Scm_DStringGet(&ds, 0);
+}
+#endif /* READSTRING_AUX */
+
+#ifdef SAFE_PORT_OP
+ScmObj Scm_ReadString(ScmPort *p, ScmSize nchars)
+#else
+ScmObj Scm_ReadStringUnsafe(ScmPort *p, ScmSize nchars)
+#endif
+{
+    ScmObj r = SCM_UNDEFINED;
+    VMDECL;
+    SHORTCUT(p, return Scm_ReadStringUnsafe(p, nchars));
+
+    LOCK(p);
+    SAFE_CALL(p, r = readstring_body(p, nchars));
+    UNLOCK(p);
+    return r;
+}
+
+/*=================================================================
+ * ReadStringUntil
+ *   Reads characters up to (but not including) one of the characters
+ *   in DELIMS, or EOF.  Returns EOF if the port is already at EOF.
+ */
+
+#ifndef READUNTIL_AUX
+#define READUNTIL_AUX
+/* Assumes the port is locked, and the caller takes care of unlocking
+   even if an error is signalled within this body */
+static ScmObj readuntil_body(ScmPort *p, ScmString *delims)
+{
+    const ScmStringBody *db = SCM_STRING_BODY(delims);
+    const char *dp = SCM_STRING_BODY_START(db);
+    ScmSmallInt dlen = SCM_STRING_BODY_LENGTH(db);
+    char ascii[128];            /* ASCII delimiters */
+    ScmChar *others = SCM_NEW_ATOMIC_ARRAY(ScmChar, dlen+1);
+    int nothers = 0;
+
+    memset(ascii, 0, sizeof(ascii));
+    for (ScmSmallInt i=0; i<dlen; i++) {
+        ScmChar ch;
+        SCM_CHAR_GET(dp, ch);
+        dp += SCM_CHAR_NBYTES(ch);
+        if (ch == SCM_CHAR_INVALID) break;
+        if (ch < 0x80) ascii[ch] = TRUE;
+        else others[nothers++] = ch;
+    }
+
+#define DELIMITER_P(ch, result)                                 \
+    do {                                                        \
+        if ((ch) < 0x80) { result = ascii[ch]; }                \
+        else {                                                  \
+            result = FALSE;                                     \
+            for (int k_=0; k_<nothers; k_++) {                  \
+                if (others[k_] == (ch)) { result = TRUE; break; } \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+    ScmDString ds;
+    const char *v;
+    int seen = FALSE, stop = FALSE;
+
+    Scm_DStringInit(&ds);
+    while (!stop) {
+        ScmSize n = Scm_PortCursorView(p, &v);
+        if (n == 0) break;      /* EOF */
+        if (n > 0) {
+            ScmSize i = 0;
+            while (i < n) {
+                unsigned char b = (unsigned char)v[i];
+                int nf = SCM_CHAR_NFOLLOWS(b);
+                if (i + nf + 1 > n) break;
+                if (b < 0x80) {
+                    if (ascii[b]) { stop = TRUE; break; }
+                } else if (nothers > 0) {
+                    ScmChar ch;
+                    int d;
+                    SCM_CHAR_GET(v+i, ch);
+                    DELIMITER_P(ch, d);
+                    if (d) { stop = TRUE; break; }
+                }
+                i += nf + 1;
+            }
+            if (i > 0) {
+                Scm_DStringPutz(&ds, v, i);
+                Scm_PortCursorAdvance(p, i, TRUE);
+                seen = TRUE;
+            }
+            if (stop) { seen = TRUE; break; }
+            if (i > 0) continue;
+        }
+        /* The port doesn't have a view, or the next character straddles
+           the end of the view. */
+        int c = Scm_GetcUnsafe(p);
+        if (c == EOF) break;
+        seen = TRUE;
+        DELIMITER_P(c, stop);
+        if (stop) Scm_UngetcUnsafe(c, p);
+        else SCM_DSTRING_PUTC(&ds, c);
+    }
+#undef DELIMITER_P
+    if (!seen) return SCM_EOF;
+    return Scm_DStringGet(&ds, 0);
+}
+#endif /* READUNTIL_AUX */
+
+#ifdef SAFE_PORT_OP
+ScmObj Scm_ReadStringUntil(ScmPort *p, ScmString *delims)
+#else
+ScmObj Scm_ReadStringUntilUnsafe(ScmPort *p, ScmString *delims)
+#endif
+{
+    ScmObj r = SCM_UNDEFINED;
+    VMDECL;
+    SHORTCUT(p, return Scm_ReadStringUntilUnsafe(p, delims));
+
+    LOCK(p);
+    SAFE_CALL(p, r = readuntil_body(p, delims));
+    UNLOCK(p);
+    return r;
+}
+
 /*=================================================================
  * ByteReady
  */
@@ -37,6 +37,8 @@
 #include "gauche/code.h"
 #include "gauche/vminsn.h"
 #include "gauche/prof.h"
+#include "gauche/priv/vmP.h"
+#include "gauche/priv/atomicP.h"
 
 #ifdef GAUCHE_PROFILE
 
@@ -51,8 +53,6 @@
  * Interval timer operation
  */
 
-#define SAMPLING_PERIOD 10000
-
 #if defined(GAUCHE_WINDOWS)
 
 static void sampler_sample(ScmVM*);
@@ -67,7 +67,7 @@ static unsigned __stdcall observer_thread(void *arg)
     /* NB: We can't use Scm_SysError in this thread. */
     /* NB: GetThreadContext might be required to make the target thread
            certainly suspended. */
-    sleep_time = SAMPLING_PERIOD / 1000;
+    sleep_time = vm->prof->samplingPeriod / 1000;
     if (sleep_time <= 0) sleep_time = 1;
     do {
         if (!suspend_flag &&
@@ -86,10 +86,8 @@ static unsigned __stdcall observer_thread(void *arg)
     return 0;
 }
 
-static void ITIMER_START(void)
+static void ITIMER_START(ScmVM *vm)
 {
-    ScmVM *vm = Scm_VM();
-
     vm->prof->hTimerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
     if (vm->prof->hTimerEvent == NULL) {
         Scm_SysError("CreateEvent failed");
@@ -113,10 +111,8 @@ static void ITIMER_START(void)
     }
 }
 
-static void ITIMER_STOP(void)
+static void ITIMER_STOP(ScmVM *vm)
 {
-    ScmVM *vm = Scm_VM();
-
     if (vm->prof->hTimerEvent != NULL && vm->prof->hObserverThread !=NULL) {
         SetEvent(vm->prof->hTimerEvent);
         WaitForSingleObject(vm->prof->hObserverThread, INFINITE);
@@ -133,17 +129,17 @@ static void ITIMER_STOP(void)
 
 #else  /* !GAUCHE_WINDOWS */
 
-#define ITIMER_START()                                  \
-    do {                                                \
-        struct itimerval tval, oval;                    \
-        tval.it_interval.tv_sec = 0;                    \
-        tval.it_interval.tv_usec = SAMPLING_PERIOD;     \
-        tval.it_value.tv_sec = 0;                       \
-        tval.it_value.tv_usec = SAMPLING_PERIOD;        \
-        setitimer(ITIMER_PROF, &tval, &oval);           \
+#define ITIMER_START(vm)                                        \
+    do {                                                        \
+        struct itimerval tval, oval;                            \
+        int period_ = (vm)->prof->samplingPeriod;               \
+        tval.it_interval.tv_sec = period_ / 1000000;            \
+        tval.it_interval.tv_usec = period_ % 1000000;           \
+        tval.it_value = tval.it_interval;                       \
+        setitimer(ITIMER_PROF, &tval, &oval);                   \
     } while (0)
 
-#define ITIMER_STOP()                           \
+#define ITIMER_STOP(vm)                         \
     do {                                        \
         struct itimerval tval, oval;            \
         tval.it_interval.tv_sec = 0;            \
@@ -155,6 +151,61 @@ static void ITIMER_STOP(void)
 
 #endif /* !GAUCHE_WINDOWS */
 
+#if defined(SCM_PROF_THREAD_TIMER)
+/* Per-thread CPU-time timer, used when all threads are profiled.
+   ITIMER_PROF counts the CPU time of the whole process and the signal
+   goes to an arbitrary thread, so it can't be used for that purpose. */
+
+#include <sys/syscall.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* Must be called on the thread that runs VM.  Returns -1 on error,
+   leaving errno. */
+static int thread_timer_arm(ScmVM *vm)
+{
+    ScmVMProfiler *prof = vm->prof;
+    if (prof->cpuTimerArmed) return 0;
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &prof->cpuTimer) < 0) {
+        return -1;
+    }
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = prof->samplingPeriod / 1000000;
+    spec.it_interval.tv_nsec = (prof->samplingPeriod % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(prof->cpuTimer, 0, &spec, NULL) < 0) {
+        int e = errno;
+        timer_delete(prof->cpuTimer);
+        errno = e;
+        return -1;
+    }
+    prof->cpuTimerArmed = TRUE;
+
+    /* Threads created by gauche.threads block all signals by default. */
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    SIGPROCMASK(SIG_UNBLOCK, &set, NULL);
+    return 0;
+}
+
+/* May be called from any thread. */
+static void thread_timer_disarm(ScmVMProfiler *prof)
+{
+    if (!prof->cpuTimerArmed) return;
+    timer_delete(prof->cpuTimer);
+    prof->cpuTimerArmed = FALSE;
+}
+#endif /* SCM_PROF_THREAD_TIMER */
+
 /*=============================================================
  * Statistic sampler
  */
@@ -171,9 +222,9 @@ static void sampler_flush(ScmVM *vm)
     if (vm->prof == NULL) return; /* for safety */
     if (vm->prof->samplerFd < 0 || vm->prof->currentSample == 0) return;
 
-    int nsamples = vm->prof->currentSample;
+    int nwords = vm->prof->currentSample;
     ssize_t r = write(vm->prof->samplerFd, vm->prof->samples,
-                      nsamples * sizeof(ScmProfSample[1]));
+                      nwords * sizeof(ScmWord));
     if (r == (ssize_t)-1) {
         vm->prof->errorOccurred++;
     }
@@ -192,52 +243,105 @@ static void sampler_sample(int sig SCM_UNUSED)
     ScmVM *vm = Scm_VM();
 #endif /* !GAUCHE_WINDOWS */
     if (vm == NULL || vm->prof == NULL) return;
-    if (vm->prof->state != SCM_PROFILER_RUNNING) return;
 
-    if (vm->prof->currentSample >= SCM_PROF_SAMPLES_IN_BUFFER) {
+    /* Handshake with stop_all(), which may run on another thread: it
+       sets the state and then waits for the sampling flag to be cleared.
+       Each side's store must be visible before it reads the other's
+       flag, hence the full barriers. */
+    ScmVMProfiler *prof = vm->prof;
+    AO_store((AO_t*)&prof->sampling, TRUE);
+    AO_nop_full();
+    if (prof->state != SCM_PROFILER_RUNNING) {
+        AO_store_release((AO_t*)&prof->sampling, FALSE);
+        return;
+    }
+
+    if (prof->currentSample + (int)SCM_PROF_SAMPLE_HEADER_WORDS
+        + prof->stackDepth > SCM_PROF_SAMPLE_BUFFER_WORDS) {
 #if !defined(GAUCHE_WINDOWS)
-        ITIMER_STOP();
+        /* The per-thread timer only counts our own CPU time, so we don't
+           need to stop it during flushing. */
+        if (!prof->allThreads) ITIMER_STOP(vm);
 #endif /* !GAUCHE_WINDOWS */
         sampler_flush(vm);
 #if !defined(GAUCHE_WINDOWS)
-        ITIMER_START();
+        if (!prof->allThreads) ITIMER_START(vm);
 #endif /* !GAUCHE_WINDOWS */
     }
 
-    int i = vm->prof->currentSample++;
+    ScmProfSample *sample = (ScmProfSample*)(prof->samples + prof->currentSample);
+    ScmWord *callers = prof->samples + prof->currentSample
+        + SCM_PROF_SAMPLE_HEADER_WORDS;
     if (vm->base) {
         /* If vm->pc is RET and val0 is a subr, it is pretty likely that
            we're actually executing that subr. */
         if (vm->pc && SCM_VM_INSN_CODE(*vm->pc) == SCM_VM_RET
             && SCM_SUBRP(vm->val0)) {
-            vm->prof->samples[i].func = vm->val0;
-            vm->prof->samples[i].pc = NULL;
+            sample->func = vm->val0;
+            sample->pc = NULL;
         } else {
-            vm->prof->samples[i].func = SCM_OBJ(vm->base);
-            vm->prof->samples[i].pc = vm->pc;
+            sample->func = SCM_OBJ(vm->base);
+            sample->pc = vm->pc;
         }
     } else {
-        vm->prof->samples[i].func = SCM_FALSE;
-        vm->prof->samples[i].pc = NULL;
+        sample->func = SCM_FALSE;
+        sample->pc = NULL;
     }
-    vm->prof->totalSamples++;
+    sample->depth = Scm__VMRecordStack(vm, callers, prof->stackDepth);
+    prof->currentSample += SCM_PROF_SAMPLE_HEADER_WORDS + sample->depth;
+    prof->totalSamples++;
+    AO_store_release((AO_t*)&prof->sampling, FALSE);
 }
 
-/* register samples into the stat table.  Called from Scm_ProfilerResult */
-void collect_samples(ScmVMProfiler *prof)
+/* Add a sample to the stack trie. */
+static void collect_stack(ScmVMProfiler *prof, ScmProfSample *sample)
 {
-    for (int i=0; i<prof->currentSample; i++) {
+    ScmWord *callers = (ScmWord*)sample + SCM_PROF_SAMPLE_HEADER_WORDS;
+    ScmHashTable *tab = prof->stackTrie;
+    ScmObj node = SCM_FALSE;
+
+    /* Walk from the outermost caller to the sampled function. */
+    for (int i=(int)sample->depth; i>=0; i--) {
+        ScmObj func = (i > 0)? SCM_OBJ(callers[i-1]) : sample->func;
+        if (tab == NULL) {
+            tab = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+            SCM_SET_CDR(node, SCM_OBJ(tab));
+        }
+        node = Scm_HashTableRef(tab, func, SCM_UNBOUND);
+        if (SCM_UNBOUNDP(node)) {
+            node = Scm_Cons(SCM_MAKE_INT(0), SCM_FALSE);
+            Scm_HashTableSet(tab, func, node, 0);
+        }
+        tab = SCM_HASH_TABLE_P(SCM_CDR(node))? SCM_HASH_TABLE(SCM_CDR(node)) : NULL;
+    }
+    SCM_SET_CAR(node, Scm_Add(SCM_CAR(node), SCM_MAKE_INT(1)));
+}
+
+/* register samples in prof->samples[0..nwords) into the stat table.
+   Returns the number of words consumed; a partial record at the end
+   is left unconsumed.  Called from Scm_ProfilerRawResult */
+static int collect_samples(ScmVMProfiler *prof, int nwords)
+{
+    int i = 0;
+    while (i + (int)SCM_PROF_SAMPLE_HEADER_WORDS <= nwords) {
+        ScmProfSample *sample = (ScmProfSample*)(prof->samples + i);
+        int size = SCM_PROF_SAMPLE_HEADER_WORDS + (int)sample->depth;
+        if (i + size > nwords) break;
+
         ScmObj e = Scm_HashTableRef(prof->statHash,
-                                    prof->samples[i].func, SCM_UNBOUND);
+                                    sample->func, SCM_UNBOUND);
         if (SCM_UNBOUNDP(e)) {
             /* NB: just for now */
             Scm_Warn("profiler: uncounted object appeared in a sample: %p (%S)",
-                     prof->samples[i].func, prof->samples[i].func);
+                     sample->func, sample->func);
         } else {
             SCM_ASSERT(SCM_PAIRP(e));
             SCM_SET_CDR(e, Scm_Add(SCM_CDR(e), SCM_MAKE_INT(1)));
         }
+        collect_stack(prof, sample);
+        i += size;
     }
+    return i;
 }
 
 /*=============================================================
@@ -291,45 +395,302 @@ void Scm_ProfilerCountBufferFlush(ScmVM *vm)
 /*=============================================================
  * External API
  */
-void Scm_ProfilerStart(void)
+
+static ScmVMProfiler *make_profiler(void)
 {
-    ScmVM *vm = Scm_VM();
+    ScmVMProfiler *prof = SCM_NEW(ScmVMProfiler);
+    prof->state = SCM_PROFILER_INACTIVE;
+    prof->samplerFd = -1;
+    prof->currentSample = 0;
+    prof->totalSamples = 0;
+    prof->errorOccurred = 0;
+    prof->currentCount = 0;
+    prof->samplingPeriod = SCM_PROF_DEFAULT_SAMPLING_PERIOD;
+    prof->stackDepth = SCM_PROF_DEFAULT_STACK_DEPTH;
+    prof->allThreads = FALSE;
+    prof->timerRequest = FALSE;
+    prof->sampling = FALSE;
+    prof->statHash =
+        SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    prof->stackTrie =
+        SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+#if defined(GAUCHE_WINDOWS)
+    prof->hTargetThread = NULL;
+    prof->hObserverThread = NULL;
+    prof->hTimerEvent = NULL;
+    prof->samplerFileName = NULL;
+#endif /* GAUCHE_WINDOWS */
+#if defined(SCM_PROF_THREAD_TIMER)
+    prof->cpuTimerArmed = FALSE;
+#endif /* SCM_PROF_THREAD_TIMER */
+    return prof;
+}
+
+/* Opens the temporary file to save samples, if we haven't. */
+static void prepare_sampler_file(ScmVMProfiler *prof)
+{
+    if (prof->samplerFd >= 0) return;
+
     ScmObj templat = Scm_StringAppendC(SCM_STRING(Scm_TmpDir()),
                                        "/gauche-profXXXXXX", -1, -1);
     char *templat_buf = Scm_GetString(SCM_STRING(templat)); /*mutable copy*/
-
-    if (!vm->prof) {
-        vm->prof = SCM_NEW(ScmVMProfiler);
-        vm->prof->state = SCM_PROFILER_INACTIVE;
-        vm->prof->samplerFd = Scm_Mkstemp(templat_buf);
-        vm->prof->currentSample = 0;
-        vm->prof->totalSamples = 0;
-        vm->prof->errorOccurred = 0;
-        vm->prof->currentCount = 0;
-        vm->prof->statHash =
-            SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    prof->samplerFd = Scm_Mkstemp(templat_buf);
 #if defined(GAUCHE_WINDOWS)
-        vm->prof->hTargetThread = NULL;
-        vm->prof->hObserverThread = NULL;
-        vm->prof->hTimerEvent = NULL;
-        vm->prof->samplerFileName = templat_buf;
+    prof->samplerFileName = templat_buf;
 #else  /* !GAUCHE_WINDOWS */
-        unlink(templat_buf);       /* keep anonymous tmpfile */
+    unlink(templat_buf);
 #endif /* !GAUCHE_WINDOWS */
-    } else if (vm->prof->samplerFd < 0) {
-        vm->prof->samplerFd = Scm_Mkstemp(templat_buf);
-#if defined(GAUCHE_WINDOWS)
-        vm->prof->samplerFileName = templat_buf;
-#else  /* !GAUCHE_WINDOWS */
-        unlink(templat_buf);
+}
+
+#if !defined(GAUCHE_WINDOWS)
+static void install_sampler_handler(void)
+{
+    struct sigaction act;
+    act.sa_handler = sampler_sample;
+    sigfillset(&act.sa_mask);
+    act.sa_flags = SA_RESTART;
+    if (sigaction(SIGPROF, &act, NULL) < 0) {
+        Scm_SysError("sigaction failed");
+    }
+}
 #endif /* !GAUCHE_WINDOWS */
+
+/* Sets the sampling period (in microseconds) and the max stack depth
+   to be recorded.  A negative value leaves the setting unchanged.
+   Takes effect at the next Scm_ProfilerStart. */
+void Scm_ProfilerConfigure(int samplingPeriod, int stackDepth)
+{
+    ScmVM *vm = Scm_VM();
+    if (!vm->prof) vm->prof = make_profiler();
+    if (samplingPeriod == 0) {
+        Scm_Error("profiler: sampling period must be positive");
+    }
+    if (samplingPeriod > 0) vm->prof->samplingPeriod = samplingPeriod;
+    if (stackDepth >= 0) {
+        if (stackDepth > SCM_PROF_MAX_STACK_DEPTH) {
+            stackDepth = SCM_PROF_MAX_STACK_DEPTH;
+        }
+        vm->prof->stackDepth = stackDepth;
+    }
+}
+
+int Scm_ProfilerSamplingPeriod(void)
+{
+    ScmVM *vm = Scm_VM();
+    if (vm->prof) return vm->prof->samplingPeriod;
+    else return SCM_PROF_DEFAULT_SAMPLING_PERIOD;
+}
+
+/*
+ * Profiling all threads
+ *
+ *  Every VM participating in the process-wide profiling is kept in
+ *  allprof.vms, even after its thread terminates, so that its result
+ *  can be retrieved later.  Each VM arms its own timer on its own
+ *  thread; when profiling is started by other thread, we set the
+ *  timerRequest flag and let the VM do it at the next safe point
+ *  (see process_queued_requests() in vm.c).
+ *
+ *  The per-VM buffers are only touched by the VM's thread while it is
+ *  profiled.  The results should be collected after the profiling is
+ *  stopped; call counts of threads that are still running at that
+ *  moment may be slightly off.
+ */
+
+static struct {
+    ScmInternalMutex mutex;
+    int running;
+    int samplingPeriod;
+    int stackDepth;
+    ScmObj vms;                 /* participating VMs */
+} allprof = { SCM_INTERNAL_MUTEX_INITIALIZER, FALSE, 0, 0, SCM_NIL };
+
+/* Make VM join the current profiling.  allprof.mutex must be held. */
+static void join_profiling(ScmVM *vm)
+{
+    ScmVMProfiler *prof = vm->prof;
+    prof->samplingPeriod = allprof.samplingPeriod;
+    prof->stackDepth = allprof.stackDepth;
+    prof->allThreads = TRUE;
+    prof->state = SCM_PROFILER_RUNNING;
+    vm->profilerRunning = TRUE;
+    if (SCM_FALSEP(Scm_Memq(SCM_OBJ(vm), allprof.vms))) {
+        allprof.vms = Scm_Cons(SCM_OBJ(vm), allprof.vms);
+    }
+}
+
+/* Stop sampling on all participating VMs.  Returns the total number
+   of samples. */
+static int stop_all(void)
+{
+    int total = 0;
+    ScmObj cp;
+
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    allprof.running = FALSE;
+    SCM_FOR_EACH(cp, allprof.vms) {
+        ScmVM *vm = SCM_VM(SCM_CAR(cp));
+        ScmVMProfiler *prof = vm->prof;
+        prof->timerRequest = FALSE;
+#if defined(SCM_PROF_THREAD_TIMER)
+        thread_timer_disarm(prof);
+#endif /* SCM_PROF_THREAD_TIMER */
+        if (prof->state == SCM_PROFILER_RUNNING) {
+            prof->state = SCM_PROFILER_PAUSING;
+        }
+        vm->profilerRunning = FALSE;
+        /* A signal may have already been delivered to the thread.
+           See sampler_sample() for the handshake. */
+        AO_nop_full();
+        while (AO_load_acquire((AO_t*)&prof->sampling)) ;
+        total += prof->totalSamples;
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+    return total;
+}
+
+void Scm_ProfilerStartAll(void)
+{
+#if defined(SCM_PROF_THREAD_TIMER)
+    ScmVM *self = Scm_VM();
+    if (allprof.running) return;
+    if (!self->prof) self->prof = make_profiler();
+    if (self->prof->state == SCM_PROFILER_RUNNING) Scm_ProfilerStop();
+    install_sampler_handler();
+
+    /* We prepare the buffers before locking, for it may raise an error. */
+    ScmObj vms = Scm__VMRegisteredVMs(), cp;
+    SCM_FOR_EACH(cp, vms) {
+        ScmVM *vm = SCM_VM(SCM_CAR(cp));
+        if (vm->state == SCM_VM_TERMINATED) continue;
+        if (!vm->prof) vm->prof = make_profiler();
+        prepare_sampler_file(vm->prof);
+    }
+
+    int r = 0;
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    allprof.running = TRUE;
+    allprof.samplingPeriod = self->prof->samplingPeriod;
+    allprof.stackDepth = self->prof->stackDepth;
+    SCM_FOR_EACH(cp, vms) {
+        ScmVM *vm = SCM_VM(SCM_CAR(cp));
+        if (vm->state == SCM_VM_TERMINATED || vm->prof == NULL) continue;
+        join_profiling(vm);
+        if (vm == self) {
+            r = thread_timer_arm(vm);
+        } else {
+            vm->prof->timerRequest = TRUE;
+            vm->attentionRequest = TRUE;
+        }
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+    if (r < 0) {
+        int e = errno;
+        stop_all();
+        errno = e;
+        Scm_SysError("profiler: failed to set up a timer");
+    }
+#else  /* !SCM_PROF_THREAD_TIMER */
+    Scm_Error("profiler: profiling all threads is not supported on this platform.");
+#endif /* !SCM_PROF_THREAD_TIMER */
+}
+
+#if defined(SCM_PROF_THREAD_TIMER)
+/* Like prepare_sampler_file, but returns -1 instead of raising an error. */
+static int try_prepare_sampler_file(ScmVMProfiler *prof)
+{
+    if (prof->samplerFd >= 0) return 0;
+
+    char templat[PATH_MAX];
+    int n = snprintf(templat, sizeof(templat), "%s/gauche-profXXXXXX",
+                     Scm_GetStringConst(SCM_STRING(Scm_TmpDir())));
+    if (n < 0 || n >= (int)sizeof(templat)) return -1;
+    int fd;
+    SCM_SYSCALL(fd, mkstemp(templat));
+    if (fd < 0) return -1;
+    unlink(templat);
+    prof->samplerFd = fd;
+    return 0;
+}
+#endif /* SCM_PROF_THREAD_TIMER */
+
+/* Called on the VM's thread when it is attached.  This is called
+   outside of the VM loop, so it must not raise an error.  If we can't
+   profile the thread, we just leave it out; if the timer can't be set,
+   the collected result warns that it may not be accurate. */
+void Scm__ProfilerAttachVM(ScmVM *vm)
+{
+#if defined(SCM_PROF_THREAD_TIMER)
+    if (!allprof.running) return;
+    if (!vm->prof) vm->prof = make_profiler();
+    if (try_prepare_sampler_file(vm->prof) < 0) return;
+
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    if (allprof.running) {
+        join_profiling(vm);
+        if (thread_timer_arm(vm) < 0) vm->prof->errorOccurred++;
     }
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+#endif /* SCM_PROF_THREAD_TIMER */
+}
+
+/* Called on the VM's thread when it is detached.  We keep the VM in
+   allprof.vms so that its result can be examined later. */
+void Scm__ProfilerDetachVM(ScmVM *vm)
+{
+    if (vm->prof == NULL || !vm->prof->allThreads) return;
+
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    vm->prof->timerRequest = FALSE;
+#if defined(SCM_PROF_THREAD_TIMER)
+    thread_timer_disarm(vm->prof);
+#endif /* SCM_PROF_THREAD_TIMER */
+    if (vm->prof->state == SCM_PROFILER_RUNNING) {
+        vm->prof->state = SCM_PROFILER_PAUSING;
+    }
+    vm->profilerRunning = FALSE;
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+    Scm_ProfilerCountBufferFlush(vm);
+}
+
+/* Called on the VM's thread when timerRequest is set. */
+void Scm__ProfilerProcessRequest(ScmVM *vm)
+{
+#if defined(SCM_PROF_THREAD_TIMER)
+    int r = 0;
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    if (vm->prof->timerRequest) {
+        vm->prof->timerRequest = FALSE;
+        if (allprof.running) r = thread_timer_arm(vm);
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+    if (r < 0) {
+        Scm_Warn("profiler: failed to set up a timer for thread %S: %s",
+                 vm->name, strerror(errno));
+    }
+#else  /* !SCM_PROF_THREAD_TIMER */
+    vm->prof->timerRequest = FALSE;
+#endif /* !SCM_PROF_THREAD_TIMER */
+}
 
+/*
+ * Profiling the current thread
+ */
+
+void Scm_ProfilerStart(void)
+{
+    ScmVM *vm = Scm_VM();
+
+    if (!vm->prof) vm->prof = make_profiler();
+    prepare_sampler_file(vm->prof);
+
+    if (allprof.running) return;
     if (vm->prof->state == SCM_PROFILER_RUNNING) return;
     vm->prof->state = SCM_PROFILER_RUNNING;
+    vm->prof->allThreads = FALSE;
     vm->profilerRunning = TRUE;
 
-    /* NB: this should be done globally!!! */
+    /* NB: For profiling all threads, see Scm_ProfilerStartAll. */
 #if defined(GAUCHE_WINDOWS)
     if (!DuplicateHandle(GetCurrentProcess(),
                          GetCurrentThread(),
@@ -340,24 +701,22 @@ void Scm_ProfilerStart(void)
         Scm_SysError("DuplicateHandle failed");
     }
 #else  /* !GAUCHE_WINDOWS */
-    struct sigaction act;
-    act.sa_handler = sampler_sample;
-    sigfillset(&act.sa_mask);
-    act.sa_flags = SA_RESTART;
-    if (sigaction(SIGPROF, &act, NULL) < 0) {
-        Scm_SysError("sigaction failed");
-    }
+    install_sampler_handler();
 #endif /* !GAUCHE_WINDOWS */
 
-    ITIMER_START();
+    ITIMER_START(vm);
 }
 
 int Scm_ProfilerStop(void)
 {
     ScmVM *vm = Scm_VM();
     if (vm->prof == NULL) return 0;
+    if (vm->prof->allThreads) {
+        if (allprof.running) return stop_all();
+        return 0;
+    }
     if (vm->prof->state != SCM_PROFILER_RUNNING) return 0;
-    ITIMER_STOP();
+    ITIMER_STOP(vm);
 #if defined(GAUCHE_WINDOWS)
     if (vm->prof->hTargetThread != NULL) {
         CloseHandle(vm->prof->hTargetThread);
@@ -369,13 +728,12 @@ int Scm_ProfilerStop(void)
     return vm->prof->totalSamples;
 }
 
-void Scm_ProfilerReset(void)
+/* Discard the profiling data of VM.  The profiler of VM must not be
+   running. */
+static void reset_profiler(ScmVM *vm)
 {
-    ScmVM *vm = Scm_VM();
-
     if (vm->prof == NULL) return;
     if (vm->prof->state == SCM_PROFILER_INACTIVE) return;
-    if (vm->prof->state == SCM_PROFILER_RUNNING) Scm_ProfilerStop();
 
     if (vm->prof->samplerFd >= 0) {
         close(vm->prof->samplerFd);
@@ -388,57 +746,127 @@ void Scm_ProfilerReset(void)
     vm->prof->currentSample = 0;
     vm->prof->errorOccurred = 0;
     vm->prof->currentCount = 0;
+    vm->prof->allThreads = FALSE;
     vm->prof->statHash =
         SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
+    vm->prof->stackTrie =
+        SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
     vm->prof->state = SCM_PROFILER_INACTIVE;
 }
 
-/* Returns the statHash */
-ScmObj Scm_ProfilerRawResult(void)
+void Scm_ProfilerReset(void)
 {
     ScmVM *vm = Scm_VM();
 
-    if (vm->prof == NULL) return SCM_FALSE;
-    if (vm->prof->state == SCM_PROFILER_INACTIVE) return SCM_FALSE;
-    if (vm->prof->state == SCM_PROFILER_RUNNING) Scm_ProfilerStop();
+    if (allprof.running) stop_all();
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    ScmObj vms = allprof.vms;
+    allprof.vms = SCM_NIL;
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+
+    ScmObj cp;
+    SCM_FOR_EACH(cp, vms) reset_profiler(SCM_VM(SCM_CAR(cp)));
+
+    if (vm->prof && vm->prof->state == SCM_PROFILER_RUNNING) {
+        Scm_ProfilerStop();
+    }
+    reset_profiler(vm);
+}
+
+/* Collect the samples of VM into its statHash and stackTrie.
+   Returns the statHash, or #f if VM hasn't been profiled.
+   The profiler of VM must not be running. */
+static ScmObj collect_profiler(ScmVM *vm)
+{
+    ScmVMProfiler *prof = vm->prof;
+
+    if (prof == NULL) return SCM_FALSE;
+    if (prof->state == SCM_PROFILER_INACTIVE) return SCM_FALSE;
 
-    if (vm->prof->errorOccurred > 0) {
+    if (prof->errorOccurred > 0) {
         Scm_Warn("profiler: An error has been occurred during saving profiling samples.  The result may not be accurate");
     }
 
     Scm_ProfilerCountBufferFlush(vm);
 
     /* collect samples in the current buffer */
-    collect_samples(vm->prof);
+    collect_samples(prof, prof->currentSample);
 
     /* collect samples in the saved file */
     off_t off;
-    SCM_SYSCALL(off, lseek(vm->prof->samplerFd, 0, SEEK_SET));
+    SCM_SYSCALL(off, lseek(prof->samplerFd, 0, SEEK_SET));
     if (off == (off_t)-1) {
-        Scm_ProfilerReset();
+        reset_profiler(vm);
         Scm_Error("profiler: seek failed in retrieving sample data");
     }
+    /* A record may straddle the chunks we read; we carry over the
+       unconsumed words to the beginning of the buffer. */
+    int carry = 0;
     for (;;) {
-        ssize_t r = read(vm->prof->samplerFd, vm->prof->samples,
-                         sizeof(ScmProfSample[1]) * SCM_PROF_SAMPLES_IN_BUFFER);
+        ssize_t r = read(prof->samplerFd, prof->samples + carry,
+                         sizeof(ScmWord)*(SCM_PROF_SAMPLE_BUFFER_WORDS-carry));
         if (r <= 0) break;
-        vm->prof->currentSample = r / sizeof(ScmProfSample[1]);
-        collect_samples(vm->prof);
+        int nwords = carry + (int)(r / sizeof(ScmWord));
+        int used = collect_samples(prof, nwords);
+        carry = nwords - used;
+        memmove(prof->samples, prof->samples + used,
+                carry * sizeof(ScmWord));
     }
-    vm->prof->currentSample = 0;
+    prof->currentSample = 0;
 #if defined(GAUCHE_WINDOWS)
-    if (vm->prof->samplerFd >= 0) {
-        close(vm->prof->samplerFd);
-        vm->prof->samplerFd = -1;
-        unlink(vm->prof->samplerFileName);
+    if (prof->samplerFd >= 0) {
+        close(prof->samplerFd);
+        prof->samplerFd = -1;
+        unlink(prof->samplerFileName);
     }
 #else  /* !GAUCHE_WINDOWS */
-    if (ftruncate(vm->prof->samplerFd, 0) < 0) {
+    if (ftruncate(prof->samplerFd, 0) < 0) {
         Scm_SysError("profiler: failed to truncate temporary file");
     }
 #endif /* !GAUCHE_WINDOWS */
 
-    return SCM_OBJ(vm->prof->statHash);
+    return SCM_OBJ(prof->statHash);
+}
+
+/* Returns the statHash */
+ScmObj Scm_ProfilerRawResult(void)
+{
+    ScmVM *vm = Scm_VM();
+
+    if (vm->prof == NULL) return SCM_FALSE;
+    if (vm->prof->state == SCM_PROFILER_INACTIVE) return SCM_FALSE;
+    if (vm->prof->state == SCM_PROFILER_RUNNING) Scm_ProfilerStop();
+    return collect_profiler(vm);
+}
+
+/* Returns the stackTrie.  See prof.h for the structure. */
+ScmObj Scm_ProfilerRawStackResult(void)
+{
+    ScmVM *vm = Scm_VM();
+    if (SCM_FALSEP(Scm_ProfilerRawResult())) return SCM_FALSE;
+    return SCM_OBJ(vm->prof->stackTrie);
+}
+
+/* Returns a list of (<vm> <statHash> . <stackTrie>) for each VM that
+   participated in profiling all threads.  Stops the profiling if it's
+   running. */
+ScmObj Scm_ProfilerRawThreadResults(void)
+{
+    if (allprof.running) stop_all();
+    SCM_INTERNAL_MUTEX_LOCK(allprof.mutex);
+    ScmObj vms = Scm_Reverse(allprof.vms);
+    SCM_INTERNAL_MUTEX_UNLOCK(allprof.mutex);
+
+    ScmObj h = SCM_NIL, t = SCM_NIL, cp;
+    SCM_FOR_EACH(cp, vms) {
+        ScmVM *vm = SCM_VM(SCM_CAR(cp));
+        ScmObj stat = collect_profiler(vm);
+        if (SCM_FALSEP(stat)) continue;
+        SCM_APPEND1(h, t, Scm_Cons(SCM_OBJ(vm),
+                                   Scm_Cons(stat,
+                                            SCM_OBJ(vm->prof->stackTrie))));
+    }
+    return h;
 }
 
 #else  /* !GAUCHE_PROFILE */
@@ -463,4 +891,45 @@ ScmObj Scm_ProfilerRawResult(void)
     Scm_Error("profiler is not supported.");
     return SCM_FALSE;
 }
+
+ScmObj Scm_ProfilerRawStackResult(void)
+{
+    Scm_Error("profiler is not supported.");
+    return SCM_FALSE;
+}
+
+void Scm_ProfilerConfigure(int samplingPeriod SCM_UNUSED,
+                           int stackDepth SCM_UNUSED)
+{
+    Scm_Error("profiler is not supported.");
+}
+
+int Scm_ProfilerSamplingPeriod(void)
+{
+    Scm_Error("profiler is not supported.");
+    return 0;
+}
+
+void Scm_ProfilerStartAll(void)
+{
+    Scm_Error("profiler is not supported.");
+}
+
+ScmObj Scm_ProfilerRawThreadResults(void)
+{
+    Scm_Error("profiler is not supported.");
+    return SCM_FALSE;
+}
+
+void Scm__ProfilerAttachVM(ScmVM *vm SCM_UNUSED)
+{
+}
+
+void Scm__ProfilerDetachVM(ScmVM *vm SCM_UNUSED)
+{
+}
+
+void Scm__ProfilerProcessRequest(ScmVM *vm SCM_UNUSED)
+{
+}
 #endif /* !GAUCHE_PROFILE */
@@ -452,7 +452,21 @@ static void read_comment(ScmPort *port) /* leading semicolon is already read */
 {
     for (;;) {
         /* NB: comment may contain unexpected character code.
-           for the safety, we read bytes here. */
+           for the safety, we read bytes here.  If the port has a buffer,
+           we search the end of line in it directly. */
+        const char *v;
+        ScmSize n = Scm_PortCursorView(port, &v);
+        if (n == 0) break;
+        if (n > 0) {
+            const char *nl = memchr(v, '\n', n);
+            if (nl == NULL) {
+                Scm_PortCursorAdvance(port, n, FALSE);
+                continue;
+            }
+            Scm_PortCursorAdvance(port, nl - v + 1, FALSE);
+            port->line++;
+            break;
+        }
         int c = Scm_GetbUnsafe(port);
         if (c == '\n') {
             /* oops.  ugly. */
@@ -1063,6 +1077,25 @@ static ScmObj read_string(ScmPort *port, int incompletep,
     ((var)==' ' || (var)=='\t' || SCM_CHAR_EXTRA_WHITESPACE_INTRALINE(var))
 
     for (;;) {
+        /* Fast path: copy the run of ordinary characters in the buffer.
+           We only look at the first byte of each character, since the
+           following bytes may look like '"' or '\\' in some encodings. */
+        const char *v;
+        ScmSize n = Scm_PortCursorView(port, &v);
+        if (n > 0) {
+            ScmSize i = 0;
+            while (i < n && v[i] != '"' && v[i] != '\\') {
+                int nf = incompletep? 0 : SCM_CHAR_NFOLLOWS((unsigned char)v[i]);
+                if (i + nf + 1 > n) break;
+                i += nf + 1;
+            }
+            if (i > 0) {
+                Scm_DStringPutz(&ds, v, i);
+                Scm_PortCursorAdvance(port, i, !incompletep);
+                continue;
+            }
+        }
+
         FETCH(c);
         switch (c) {
         case EOF: goto eof_exit;
@@ -1286,6 +1319,25 @@ static ScmObj read_word(ScmPort *port, ScmChar initial,
     }
 
     for (;;) {
+        /* Fast path: take the run of ASCII constituents in the buffer. */
+        const char *v;
+        ScmSize n = Scm_PortCursorView(port, &v);
+        if (n > 0) {
+            ScmSize i = 0;
+            for (; i < n; i++) {
+                int c = (unsigned char)v[i];
+                if (c >= 0x80 || !char_word_constituent(c, include_hash_sign)) {
+                    break;
+                }
+                if (case_fold && char_word_case_fold(c)) break;
+            }
+            if (i > 0) {
+                Scm_DStringPutz(&ds, v, i);
+                Scm_PortCursorAdvance(port, i, FALSE);
+                continue;
+            }
+        }
+
         int c = Scm_GetcUnsafe(port);
         if (c == EOF || !char_word_constituent(c, include_hash_sign)) {
             Scm_UngetcUnsafe(c, port);
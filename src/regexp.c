@@ -39,6 +39,7 @@
 #include "gauche/regexp.h"
 #include "gauche/class.h"
 #include "gauche/priv/builtin-syms.h"
+#include "gauche/priv/atomicP.h"
 
 /* I don't like to reinvent wheels, so I looked for a regexp implementation
  * that can handle multibyte encodings and not bound to Unicode.
@@ -78,6 +79,11 @@
  * A possible fix is to check if recursion level exceeds some limit,
  * then save the C stack into heap (as in the C-stack-copying continuation
  * does) and reuse the stack area.
+ *
+ * If the regexp doesn't use features that require backtracking, such as
+ * backreferences and lookaround assertions, we also compile it into a
+ * Thompson NFA and match it in linear time instead.  See "Linear-time
+ * matcher" below.
  */
 
 /* Instructions.  `RL' suffix indicates that the instruction moves the
@@ -227,9 +233,19 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_RegexpClass,
                          SCM_CLASS_DEFAULT_CPL);
 SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_RegMatchClass, NULL);
 
+/* Each regexp is allocated with a private part that follows ScmRegexp,
+   so that we don't change the public struct.  NFA is the program for
+   the linear-time matcher, or NULL if the regexp needs backtracking. */
+typedef struct regexp_private_rec {
+    ScmRegexp rx;
+    struct ScmRegNFARec *nfa;
+} regexp_private;
+
+#define REGEXP_NFA(rx)  (((regexp_private*)(rx))->nfa)
+
 static ScmRegexp *make_regexp(void)
 {
-    ScmRegexp *rx = SCM_NEW(ScmRegexp);
+    ScmRegexp *rx = &SCM_NEW(regexp_private)->rx;
     SCM_SET_CLASS(rx, SCM_CLASS_REGEXP);
     rx->code = NULL;
     rx->numCodes = 0;
@@ -241,6 +257,7 @@ static ScmRegexp *make_regexp(void)
     rx->flags = 0;
     rx->pattern = SCM_FALSE;
     rx->ast = SCM_FALSE;
+    REGEXP_NFA(rx) = NULL;
     return rx;
 }
 
@@ -1880,6 +1897,313 @@ static ScmObj calculate_lasetn(ScmObj ast)
     else return calculate_laset(SCM_CAR(ast), SCM_CDR(ast));
 }
 
+/*-------------------------------------------------------------
+ * pass 3b - NFA generation
+ *          If the regexp doesn't need backtracking, i.e. it doesn't
+ *          use backreferences, lookahead/lookbehind assertions,
+ *          conditional patterns or standalone patterns, we also
+ *          compile the AST into a Thompson-style NFA program.  It is
+ *          run by the linear-time matcher (see "Linear-time matcher"
+ *          below) instead of rex_rec.
+ *
+ *          The program begins with the search loop, equivalent to
+ *          a leading non-greedy `.*', so that a single pass finds
+ *          the leftmost match:
+ *
+ *             0: SPLIT 3, 1
+ *             1: ANY
+ *             2: JUMP 0
+ *             3: <regexp>
+ *                MATCH
+ *
+ *          SPLIT prefers the first branch, so the threads are ordered
+ *          by the same priority as the backtracking matcher tries the
+ *          choices.  That gives the same submatches as rex_rec.
+ */
+
+enum {
+    /* These consume a character */
+    NFA_CHAR,                   /* match ch */
+    NFA_CHAR_CI,                /* match ch case-insensitively */
+    NFA_ANY,                    /* match any char */
+    NFA_SET,                    /* match any char in cs */
+    NFA_NSET,                   /* match any char not in cs */
+    /* These don't */
+    NFA_MATCH,                  /* success */
+    NFA_SPLIT,                  /* go to x and y, preferring x */
+    NFA_JUMP,                   /* go to x */
+    NFA_SAVE,                   /* record the position in the slot x */
+    NFA_BOL,                    /* beginning of line assertion */
+    NFA_EOL,                    /* end of line assertion */
+    NFA_WB,                     /* word boundary assertion */
+    NFA_NWB,                    /* negative word boundary assertion */
+    NFA_FAIL                    /* fail */
+};
+
+#define NFA_CONSUMING_P(op)  ((op) <= NFA_NSET)
+
+/* If the program gets bigger than this, e.g. by nested {n,m}, we give up
+   and leave the regexp to the backtracking matcher. */
+#define NFA_MAX_INSNS     10000
+
+/* The first insn of <regexp> in the above layout */
+#define NFA_REGEXP_START  3
+
+typedef struct nfa_insn_rec {
+    int op;
+    int x, y;
+    ScmChar ch;
+    ScmCharSet *cs;
+} nfa_insn;
+
+struct dfa_rec;
+
+struct ScmRegNFARec {
+    nfa_insn *insns;
+    int numInsns;
+    int numSlots;               /* 2 * numGroups */
+    int dfap;                   /* TRUE if the program can be run as DFA,
+                                   i.e. it doesn't have word boundary
+                                   assertions. */
+    AO_t dfa;                   /* struct dfa_rec*; created lazily. */
+    AO_t scratch;               /* struct pike_scratch_rec*; work area of
+                                   the last pike_exec, kept for reuse. */
+};
+
+typedef struct nfa_builder_rec {
+    nfa_insn *insns;
+    int numInsns;
+    int maxInsns;
+    int casefoldp;
+    int repwhilep;              /* TRUE if rep-while can be treated as rep */
+    int wbp;                    /* TRUE if we've emitted WB or NWB */
+} nfa_builder;
+
+static int nfa_emit(nfa_builder *b, int op, int x, int y)
+{
+    if (b->numInsns == b->maxInsns) {
+        int newmax = b->maxInsns * 2;
+        nfa_insn *newinsns = SCM_NEW_ARRAY(nfa_insn, newmax);
+        memcpy(newinsns, b->insns, sizeof(nfa_insn)*b->numInsns);
+        b->insns = newinsns;
+        b->maxInsns = newmax;
+    }
+    nfa_insn *i = &b->insns[b->numInsns];
+    i->op = op;
+    i->x = x;
+    i->y = y;
+    i->ch = SCM_CHAR_INVALID;
+    i->cs = NULL;
+    return b->numInsns++;
+}
+
+static int nfa_rec(nfa_builder *b, ScmObj ast, int lastp);
+
+/* Like rc3_seq, only the last item gets LASTP. */
+static int nfa_seq(nfa_builder *b, ScmObj seq, int lastp)
+{
+    ScmObj cp;
+    SCM_FOR_EACH(cp, seq) {
+        if (!nfa_rec(b, SCM_CAR(cp), lastp && SCM_NULLP(SCM_CDR(cp)))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Returns FALSE if AST can't be handled by NFA.  The treatment of
+   LASTP follows rc3_rec exactly, for it changes the meaning of `$'. */
+static int nfa_rec(nfa_builder *b, ScmObj ast, int lastp)
+{
+    if (b->numInsns > NFA_MAX_INSNS) return FALSE;
+
+    if (!SCM_PAIRP(ast)) {
+        if (SCM_CHARP(ast)) {
+            int k = nfa_emit(b, b->casefoldp? NFA_CHAR_CI : NFA_CHAR, 0, 0);
+            b->insns[k].ch = SCM_CHAR_VALUE(ast);
+            return TRUE;
+        }
+        if (SCM_CHAR_SET_P(ast)) {
+            int k = nfa_emit(b, NFA_SET, 0, 0);
+            b->insns[k].cs = SCM_CHAR_SET(ast);
+            return TRUE;
+        }
+        if (SCM_EQ(ast, SCM_SYM_ANY)) {
+            nfa_emit(b, NFA_ANY, 0, 0);
+            return TRUE;
+        }
+        if (SCM_EQ(ast, SCM_SYM_BOL)) {
+            nfa_emit(b, NFA_BOL, 0, 0);
+            return TRUE;
+        }
+        if (SCM_EQ(ast, SCM_SYM_EOL)) {
+            if (lastp) {
+                nfa_emit(b, NFA_EOL, 0, 0);
+            } else {
+                int k = nfa_emit(b, NFA_CHAR, 0, 0);
+                b->insns[k].ch = '$';
+            }
+            return TRUE;
+        }
+        if (SCM_EQ(ast, SCM_SYM_WB) || SCM_EQ(ast, SCM_SYM_NWB)) {
+            nfa_emit(b, SCM_EQ(ast, SCM_SYM_WB)? NFA_WB : NFA_NWB, 0, 0);
+            b->wbp = TRUE;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    ScmObj type = SCM_CAR(ast);
+    if (SCM_EQ(type, SCM_SYM_COMP)) {
+        int k = nfa_emit(b, NFA_NSET, 0, 0);
+        b->insns[k].cs = SCM_CHAR_SET(SCM_CDR(ast));
+        return TRUE;
+    }
+    if (SCM_EQ(type, SCM_SYM_SEQ)) {
+        return nfa_seq(b, SCM_CDR(ast), lastp);
+    }
+    if (SCM_INTP(type)) {
+        int grpno = SCM_INT_VALUE(type);
+        nfa_emit(b, NFA_SAVE, grpno*2, 0);
+        if (!nfa_seq(b, SCM_CDDR(ast), lastp)) return FALSE;
+        nfa_emit(b, NFA_SAVE, grpno*2+1, 0);
+        return TRUE;
+    }
+    if (SCM_EQ(type, SCM_SYM_SEQ_UNCASE) || SCM_EQ(type, SCM_SYM_SEQ_CASE)) {
+        int oldcase = b->casefoldp;
+        b->casefoldp = SCM_EQ(type, SCM_SYM_SEQ_UNCASE);
+        int r = nfa_seq(b, SCM_CDR(ast), lastp);
+        b->casefoldp = oldcase;
+        return r;
+    }
+    if (SCM_EQ(type, SCM_SYM_ALT)) {
+        /*     SPLIT L1, #1
+           L1: <alt0>
+               JUMP next
+           #1: SPLIT L2, #2
+           L2: <alt1>
+               JUMP next
+                 :
+               <altN>
+           next:
+        */
+        if (!SCM_PAIRP(SCM_CDR(ast))) {
+            nfa_emit(b, NFA_FAIL, 0, 0);
+            return TRUE;
+        }
+        ScmObj clause, jumps = SCM_NIL;
+        for (clause = SCM_CDR(ast);
+             SCM_PAIRP(SCM_CDR(clause));
+             clause = SCM_CDR(clause)) {
+            int split = nfa_emit(b, NFA_SPLIT, b->numInsns+1, 0);
+            if (!nfa_rec(b, SCM_CAR(clause), lastp)) return FALSE;
+            jumps = Scm_Cons(SCM_MAKE_INT(nfa_emit(b, NFA_JUMP, 0, 0)), jumps);
+            b->insns[split].y = b->numInsns;
+        }
+        if (!nfa_rec(b, SCM_CAR(clause), lastp)) return FALSE;
+        SCM_FOR_EACH(jumps, jumps) {
+            b->insns[SCM_INT_VALUE(SCM_CAR(jumps))].x = b->numInsns;
+        }
+        return TRUE;
+    }
+    if (SCM_EQ(type, SCM_SYM_REP_WHILE)) {
+        /* Rep-while made by rc2_optimize matches the same strings as rep.
+           The one given in AST by the user may not. */
+        if (!b->repwhilep) return FALSE;
+        type = SCM_SYM_REP;
+    }
+    if (SCM_EQ(type, SCM_SYM_REP) || SCM_EQ(type, SCM_SYM_REP_MIN)) {
+        ScmObj min = SCM_CADR(ast), max = SCM_CAR(SCM_CDDR(ast));
+        ScmObj item = SCM_CDR(SCM_CDDR(ast));
+        int greedy = SCM_EQ(type, SCM_SYM_REP);
+        int multip = (SCM_FALSEP(max) || SCM_INT_VALUE(max) > 1);
+        int m = SCM_INT_VALUE(min);
+
+        /* mandatory part.  see rc3_seq_rep for LASTP. */
+        for (int i = 0; i < m; i++) {
+            if (!nfa_seq(b, item, multip && i == m-1)) return FALSE;
+        }
+        if (SCM_EQ(min, max)) return TRUE;
+
+        if (!SCM_FALSEP(max)) {
+            /* optional part.  each SPLIT skips the rest.
+                   SPLIT L1, next    (SPLIT next, L1 if not greedy)
+               L1: <x>
+                   SPLIT L2, next
+               L2: <x>
+                     :
+               next:
+               rc3_minmax tries the number of repetitions first, then
+               the choices inside <x>.  These orders agree only if <x>
+               has no choices by itself, so we leave other cases to
+               the backtracking matcher.
+            */
+            int count = SCM_INT_VALUE(max) - m;
+            ScmObj splits = SCM_NIL;
+            for (int i = 0; i < count; i++) {
+                int split = nfa_emit(b, NFA_SPLIT, 0, 0);
+                splits = Scm_Cons(SCM_MAKE_INT(split), splits);
+                if (!nfa_seq(b, item, FALSE)) return FALSE;
+                if (i == 0 && count > 1) {
+                    for (int k = split+1; k < b->numInsns; k++) {
+                        if (b->insns[k].op == NFA_SPLIT) return FALSE;
+                    }
+                }
+            }
+            SCM_FOR_EACH(splits, splits) {
+                nfa_insn *i = &b->insns[SCM_INT_VALUE(SCM_CAR(splits))];
+                int body = SCM_INT_VALUE(SCM_CAR(splits)) + 1;
+                i->x = greedy? body : b->numInsns;
+                i->y = greedy? b->numInsns : body;
+            }
+            return TRUE;
+        }
+
+        /*  rep: SPLIT L1, next     (SPLIT next, L1 if not greedy)
+            L1:  <x>
+                 JUMP rep
+            next:
+        */
+        int split = nfa_emit(b, NFA_SPLIT, 0, 0);
+        if (!nfa_seq(b, item, FALSE)) return FALSE;
+        nfa_emit(b, NFA_JUMP, split, 0);
+        b->insns[split].x = greedy? split+1 : b->numInsns;
+        b->insns[split].y = greedy? b->numInsns : split+1;
+        return TRUE;
+    }
+    /* backref, cpat, once, assert, nassert and lookbehind need
+       backtracking. */
+    return FALSE;
+}
+
+static struct ScmRegNFARec *rc3_nfa(regcomp_ctx *ctx, ScmObj ast)
+{
+    nfa_builder b;
+    b.maxInsns = 32;
+    b.insns = SCM_NEW_ARRAY(nfa_insn, b.maxInsns);
+    b.numInsns = 0;
+    b.casefoldp = ctx->casefoldp;
+    /* AST given by Scm_RegCompFromAST isn't from rc2_optimize */
+    b.repwhilep = (ctx->ipat != NULL);
+    b.wbp = FALSE;
+
+    nfa_emit(&b, NFA_SPLIT, NFA_REGEXP_START, 1);
+    nfa_emit(&b, NFA_ANY, 0, 0);
+    nfa_emit(&b, NFA_JUMP, 0, 0);
+    if (!nfa_rec(&b, ast, TRUE)) return NULL;
+    nfa_emit(&b, NFA_MATCH, 0, 0);
+    if (b.numInsns > NFA_MAX_INSNS) return NULL;
+
+    struct ScmRegNFARec *nfa = SCM_NEW(struct ScmRegNFARec);
+    nfa->insns = b.insns;
+    nfa->numInsns = b.numInsns;
+    nfa->numSlots = ctx->rx->numGroups * 2;
+    nfa->dfap = !b.wbp;
+    nfa->dfa = (AO_t)0;
+    nfa->scratch = (AO_t)0;
+    return nfa;
+}
+
 /* pass 3 */
 static ScmObj rc3(regcomp_ctx *ctx, ScmObj ast)
 {
@@ -1901,6 +2225,9 @@ static ScmObj rc3(regcomp_ctx *ctx, ScmObj ast)
     ctx->rx->code = ctx->code;
     ctx->rx->numCodes = ctx->codep;
 
+    /* pass 3b : NFA for the linear-time matcher, if possible */
+    REGEXP_NFA(ctx->rx) = rc3_nfa(ctx, ast);
+
     ctx->rx->ast = ast;
     return SCM_OBJ(ctx->rx);
 }
@@ -1921,6 +2248,13 @@ void Scm_RegDump(ScmRegexp *rx)
     } else {
         Scm_Printf(SCM_CUROUT, "(none)\n");
     }
+    if (REGEXP_NFA(rx)) {
+        Scm_Printf(SCM_CUROUT, "   nfa = %d insns%s\n",
+                   REGEXP_NFA(rx)->numInsns,
+                   REGEXP_NFA(rx)->dfap? "" : " (no dfa)");
+    } else {
+        Scm_Printf(SCM_CUROUT, "   nfa = (none)\n");
+    }
 
     int end = rx->numCodes;
     for (int codep = 0; codep < end; codep++) {
@@ -2341,13 +2675,14 @@ static int is_word_constituent(unsigned char b)
     return FALSE;
 }
 
-static int is_word_boundary(struct match_ctx *ctx, const char *input)
+static int word_boundary_p(const char *start, const char *stop,
+                           const char *input)
 {
     const char *prevp;
 
-    if (input == ctx->input || input == ctx->stop) return TRUE;
+    if (input == start || input == stop) return TRUE;
     unsigned char nextb = (unsigned char)*input;
-    SCM_CHAR_BACKWARD(input, ctx->input, prevp);
+    SCM_CHAR_BACKWARD(input, start, prevp);
     SCM_ASSERT(prevp != NULL);
     unsigned char prevb = (unsigned char)*prevp;
     if ((is_word_constituent(nextb) && !is_word_constituent(prevb))
@@ -2357,6 +2692,11 @@ static int is_word_boundary(struct match_ctx *ctx, const char *input)
     return FALSE;
 }
 
+static int is_word_boundary(struct match_ctx *ctx, const char *input)
+{
+    return word_boundary_p(ctx->input, ctx->stop, input);
+}
+
 static void rex_rec(const unsigned char *code,
                     const char *input,
                     struct match_ctx *ctx)
@@ -2772,7 +3112,7 @@ static void rex_rec(const unsigned char *code,
 }
 
 static ScmObj make_match(ScmRegexp *rx, ScmString *orig,
-                         struct match_ctx *ctx)
+                         struct ScmRegMatchSub **matches)
 {
     ScmRegMatch *rm = SCM_NEW(ScmRegMatch);
     SCM_SET_CLASS(rm, SCM_CLASS_REGMATCH);
@@ -2785,7 +3125,7 @@ static ScmObj make_match(ScmRegexp *rx, ScmString *orig,
     rm->input = SCM_STRING_BODY_START(origb);
     rm->inputLen = SCM_STRING_BODY_LENGTH(origb);
     rm->inputSize = SCM_STRING_BODY_SIZE(origb);
-    rm->matches = ctx->matches;
+    rm->matches = matches;
     return SCM_OBJ(rm);
 }
 
@@ -2816,7 +3156,7 @@ static ScmObj rex(ScmRegexp *rx, ScmString *orig,
         rex_rec(ctx.codehead, start, &ctx);
         return SCM_FALSE;
     }
-    return make_match(rx, orig, &ctx);
+    return make_match(rx, orig, ctx.matches);
 }
 
 /* advance start pointer while the character matches (skip_match=TRUE) or does
@@ -2837,6 +3177,524 @@ static inline const char *skip_input(const char *start, const char *limit,
     return limit;
 }
 
+/*----------------------------------------------------------------------
+ * Linear-time matcher
+ *
+ *   The backtracking matcher above may take exponential time for
+ *   patterns such as #/(a|aa)*b/ on a long run of a's.  If the regexp
+ *   is compiled into an NFA program (see pass 3b), we run it instead
+ *   in two phases.
+ *
+ *   First, a lazily constructed DFA scans the input to see if there's
+ *   a match at all, and where the match ends.  Each DFA state is an
+ *   ordered list of NFA threads, so we can find the end of the match
+ *   that the backtracking matcher would have found.  States and
+ *   transitions are created on demand and cached in the NFA, so that
+ *   the subsequent matches with the same regexp become a simple
+ *   table lookup per character.
+ *
+ *   Then, if it's a match, a Pike VM runs the NFA up to that end
+ *   to find the start of the match and submatches.  It keeps at most
+ *   one thread per NFA instruction, so it runs in O(n*m) time for
+ *   input length n and program size m.
+ *
+ *   If the DFA gets too big, we give up and just run the Pike VM.
+ *   The DFA can't handle word boundary assertions either; regexps
+ *   with them are always matched by the Pike VM.
+ */
+
+/* Flags for closure computation */
+#define NFA_AT_START   1        /* we're at the beginning of the input */
+#define NFA_AT_END     2        /* we're at the end of the input */
+
+#define DFA_MAX_STATES    1024
+#define DFA_NUM_BUCKETS   256
+#define DFA_MBCACHE_SIZE  16    /* must be power of 2 */
+
+typedef struct dfa_state_rec {
+    int *pcs;                   /* NFA threads, in priority order.  Either
+                                   character-consuming insns or pending
+                                   EOL assertions. */
+    int numPcs;
+    int matchp;                 /* TRUE if we have a match here */
+    int eolMatchp;              /* TRUE if we have a match here when
+                                   this is the end of input */
+    u_long hashval;
+    struct dfa_state_rec *chain;
+    AO_t next[128];             /* transitions by ASCII chars */
+    AO_t mbnext[DFA_MBCACHE_SIZE]; /* transitions by other chars; each
+                                      one is dfa_mbnext*. */
+} dfa_state;
+
+typedef struct dfa_mbnext_rec {
+    ScmChar ch;
+    dfa_state *next;
+} dfa_mbnext;
+
+/* All the fields but start are only accessed while holding dfa_mutex. */
+struct dfa_rec {
+    struct ScmRegNFARec *nfa;
+    dfa_state *start;
+    dfa_state *buckets[DFA_NUM_BUCKETS];
+    int numStates;
+    /* work area */
+    int *stack;
+    int *pcs;
+    u_int *marks;
+    u_int gen;
+};
+
+/* A global lock to build DFA states.  Lookups don't need it. */
+static ScmInternalMutex dfa_mutex;
+
+static inline int nfa_char_match(const nfa_insn *insn, ScmChar ch)
+{
+    switch (insn->op) {
+    case NFA_CHAR:    return insn->ch == ch;
+    case NFA_CHAR_CI: return insn->ch == Scm_CharDowncase(ch);
+    case NFA_ANY:     return TRUE;
+    case NFA_SET:     return Scm_CharSetContains(insn->cs, ch);
+    case NFA_NSET:    return !Scm_CharSetContains(insn->cs, ch);
+    default:          return FALSE;
+    }
+}
+
+/* Add the threads reachable from PC to d->pcs, in priority order.
+   Returns TRUE if we reach MATCH; in which case the lower priority
+   threads are never run, so the caller should stop adding. */
+static int dfa_closure(struct dfa_rec *d, int pc, int flags, int *npcs)
+{
+    const nfa_insn *insns = d->nfa->insns;
+    int sp = 0;
+
+    d->stack[sp++] = pc;
+    while (sp > 0) {
+        pc = d->stack[--sp];
+        for (;;) {
+            if (d->marks[pc] == d->gen) break;
+            d->marks[pc] = d->gen;
+            const nfa_insn *insn = &insns[pc];
+            if (NFA_CONSUMING_P(insn->op)) {
+                d->pcs[(*npcs)++] = pc;
+                break;
+            }
+            switch (insn->op) {
+            case NFA_MATCH:
+                return TRUE;
+            case NFA_SPLIT:
+                d->stack[sp++] = insn->y;
+                pc = insn->x;
+                continue;
+            case NFA_JUMP:
+                pc = insn->x;
+                continue;
+            case NFA_SAVE:
+                pc++;
+                continue;
+            case NFA_BOL:
+                if (!(flags & NFA_AT_START)) break;
+                pc++;
+                continue;
+            case NFA_EOL:
+                if (flags & NFA_AT_END) { pc++; continue; }
+                /* We don't know yet; keep it to check at the end. */
+                d->pcs[(*npcs)++] = pc;
+                break;
+            default:
+                /* NFA_FAIL.  NB: The DFA doesn't run a program with
+                   WB or NWB. */
+                break;
+            }
+            break;
+        }
+    }
+    return FALSE;
+}
+
+/* Returns the state consists of d->pcs[0..npcs-1], creating it
+   if necessary.  Returns NULL if we have too many states. */
+static dfa_state *dfa_intern(struct dfa_rec *d, int npcs, int matchp)
+{
+    u_long h = (u_long)matchp;
+    for (int i = 0; i < npcs; i++) h = h*31 + (u_long)d->pcs[i];
+
+    dfa_state *s = d->buckets[h % DFA_NUM_BUCKETS];
+    for (; s; s = s->chain) {
+        if (s->hashval == h && s->numPcs == npcs && s->matchp == matchp
+            && memcmp(s->pcs, d->pcs, npcs*sizeof(int)) == 0) {
+            return s;
+        }
+    }
+    if (d->numStates >= DFA_MAX_STATES) return NULL;
+
+    s = SCM_NEW(dfa_state);
+    s->pcs = SCM_NEW_ATOMIC2(int*, (npcs+1)*sizeof(int));
+    memcpy(s->pcs, d->pcs, npcs*sizeof(int));
+    s->numPcs = npcs;
+    s->matchp = matchp;
+    s->hashval = h;
+    for (int i = 0; i < 128; i++) s->next[i] = (AO_t)0;
+    for (int i = 0; i < DFA_MBCACHE_SIZE; i++) s->mbnext[i] = (AO_t)0;
+
+    /* See if pending EOL assertions lead to a match. */
+    s->eolMatchp = FALSE;
+    for (int i = 0; i < npcs && !s->eolMatchp; i++) {
+        if (d->nfa->insns[s->pcs[i]].op != NFA_EOL) continue;
+        int dummy = 0;
+        d->gen++;
+        s->eolMatchp = dfa_closure(d, s->pcs[i]+1, NFA_AT_END, &dummy);
+    }
+    /* The above may have clobbered d->pcs, but we no longer need it. */
+
+    s->chain = d->buckets[h % DFA_NUM_BUCKETS];
+    d->buckets[h % DFA_NUM_BUCKETS] = s;
+    d->numStates++;
+    return s;
+}
+
+static struct dfa_rec *dfa_make(struct ScmRegNFARec *nfa, int anchored)
+{
+    struct dfa_rec *d = SCM_NEW(struct dfa_rec);
+    int n = nfa->numInsns;
+    d->nfa = nfa;
+    d->numStates = 0;
+    for (int i = 0; i < DFA_NUM_BUCKETS; i++) d->buckets[i] = NULL;
+    d->stack = SCM_NEW_ATOMIC2(int*, (n+1)*sizeof(int));
+    d->pcs   = SCM_NEW_ATOMIC2(int*, (n+1)*sizeof(int));
+    d->marks = SCM_NEW_ATOMIC2(u_int*, n*sizeof(u_int));
+    for (int i = 0; i < n; i++) d->marks[i] = 0;
+    d->gen = 1;
+
+    int npcs = 0;
+    int matchp = dfa_closure(d, anchored? NFA_REGEXP_START : 0,
+                             NFA_AT_START, &npcs);
+    d->start = dfa_intern(d, npcs, matchp);
+    return d;
+}
+
+/* Computes the transition from S by CH.  Returns NULL if we give up. */
+static dfa_state *dfa_transition(struct dfa_rec *d, dfa_state *s, ScmChar ch)
+{
+    dfa_state *next = NULL;
+    SCM_INTERNAL_MUTEX_LOCK(dfa_mutex);
+    if (ch < 128) {
+        next = (dfa_state*)AO_load(&s->next[ch]);
+    } else {
+        dfa_mbnext *e =
+            (dfa_mbnext*)AO_load(&s->mbnext[ch & (DFA_MBCACHE_SIZE-1)]);
+        if (e && e->ch == ch) next = e->next;
+    }
+    if (next == NULL) {
+        int npcs = 0, matchp = FALSE;
+        d->gen++;
+        for (int i = 0; i < s->numPcs && !matchp; i++) {
+            const nfa_insn *insn = &d->nfa->insns[s->pcs[i]];
+            if (nfa_char_match(insn, ch)) {
+                matchp = dfa_closure(d, s->pcs[i]+1, 0, &npcs);
+            }
+        }
+        next = dfa_intern(d, npcs, matchp);
+        if (next) {
+            if (ch < 128) {
+                AO_store_full(&s->next[ch], (AO_t)next);
+            } else {
+                dfa_mbnext *e = SCM_NEW(dfa_mbnext);
+                e->ch = ch;
+                e->next = next;
+                AO_store_full(&s->mbnext[ch & (DFA_MBCACHE_SIZE-1)], (AO_t)e);
+            }
+        }
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(dfa_mutex);
+    return next;
+}
+
+/* Scans [start, stop) and returns 1 and sets *mend if there's a match,
+   0 if there's none, or -1 if we give up. */
+static int dfa_scan(ScmRegexp *rx, const char *start, const char *stop,
+                    const char **mend)
+{
+    struct ScmRegNFARec *nfa = REGEXP_NFA(rx);
+    struct dfa_rec *d = (struct dfa_rec*)AO_load(&nfa->dfa);
+
+    if (d == NULL) {
+        SCM_INTERNAL_MUTEX_LOCK(dfa_mutex);
+        d = (struct dfa_rec*)AO_load(&nfa->dfa);
+        if (d == NULL) {
+            d = dfa_make(nfa, rx->flags & SCM_REGEXP_BOL_ANCHORED);
+            AO_store_full(&nfa->dfa, (AO_t)d);
+        }
+        SCM_INTERNAL_MUTEX_UNLOCK(dfa_mutex);
+    }
+
+    dfa_state *s = d->start;
+    const char *p = start, *last = NULL;
+    if (s == NULL) return -1;
+    if (s->matchp) last = p;
+
+    while (p < stop && s->numPcs > 0) {
+        unsigned char b = (unsigned char)*p;
+        dfa_state *next;
+        if (b < 128) {
+            next = (dfa_state*)AO_load(&s->next[b]);
+            if (next == NULL) next = dfa_transition(d, s, b);
+            p++;
+        } else {
+            ScmChar ch;
+            SCM_CHAR_GET(p, ch);
+            dfa_mbnext *e =
+                (dfa_mbnext*)AO_load(&s->mbnext[ch & (DFA_MBCACHE_SIZE-1)]);
+            if (e && e->ch == ch) next = e->next;
+            else next = dfa_transition(d, s, ch);
+            p += SCM_CHAR_NFOLLOWS(b) + 1;
+        }
+        if (next == NULL) return -1;
+        s = next;
+        if (s->matchp) last = p;
+    }
+    if (p == stop && s->eolMatchp) last = stop;
+    if (last == NULL) return 0;
+    *mend = last;
+    return 1;
+}
+
+/* Pike VM */
+
+typedef struct pike_list_rec {
+    int n;
+    int *pcs;                   /* threads in priority order */
+    const char **caps;          /* caps[i*numSlots ...] for pcs[i] */
+} pike_list;
+
+typedef struct pike_vm_rec {
+    const nfa_insn *insns;
+    int numSlots;
+    const char *start;          /* start of the input */
+    const char *stop;           /* end of the input */
+    u_int *marks;
+    u_int gen;
+    int *stack;                 /* pc, or -(slot+1) followed by the
+                                   index of saved value in savedcaps */
+    const char **savedcaps;
+} pike_vm;
+
+/* Work area of pike_exec.  Its size only depends on the NFA, so we keep
+   one in the NFA after use and take it in the next run.  A run that
+   finds it taken by another thread allocates its own. */
+typedef struct pike_scratch_rec {
+    u_int *marks;
+    int *stack;
+    const char **savedcaps;
+    int *pcs[2];
+    const char **caps[2];
+    const char **tcaps;
+} pike_scratch;
+
+static pike_scratch *pike_scratch_take(struct ScmRegNFARec *nfa)
+{
+    pike_scratch *w = (pike_scratch*)AO_load_acquire(&nfa->scratch);
+    if (w && AO_compare_and_swap_full(&nfa->scratch, (AO_t)w, 0)) return w;
+
+    int ni = nfa->numInsns, ns = nfa->numSlots;
+    w = SCM_NEW(pike_scratch);
+    w->marks = SCM_NEW_ATOMIC2(u_int*, ni*sizeof(u_int));
+    w->stack = SCM_NEW_ATOMIC2(int*, (ni*2+1)*sizeof(int));
+    w->savedcaps = SCM_NEW_ATOMIC2(const char**, (ni+1)*sizeof(const char*));
+    for (int i = 0; i < 2; i++) {
+        w->pcs[i] = SCM_NEW_ATOMIC2(int*, ni*sizeof(int));
+        w->caps[i] = SCM_NEW_ATOMIC2(const char**,
+                                     (ni*ns+1)*sizeof(const char*));
+    }
+    w->tcaps = SCM_NEW_ATOMIC2(const char**, (ns+1)*sizeof(const char*));
+    return w;
+}
+
+static void pike_scratch_release(struct ScmRegNFARec *nfa, pike_scratch *w)
+{
+    AO_store_release(&nfa->scratch, (AO_t)w);
+}
+
+/* Add the threads reachable from PC at input position P to the list L,
+   with the captures CAPS.  CAPS is restored on return. */
+static void pike_add(pike_vm *vm, pike_list *l, int pc, const char *p,
+                     const char **caps)
+{
+    int sp = 0, nsaved = 0;
+
+    vm->stack[sp++] = pc;
+    while (sp > 0) {
+        pc = vm->stack[--sp];
+        if (pc < 0) {
+            caps[-pc-1] = vm->savedcaps[--nsaved];
+            continue;
+        }
+        for (;;) {
+            if (vm->marks[pc] == vm->gen) break;
+            vm->marks[pc] = vm->gen;
+            const nfa_insn *insn = &vm->insns[pc];
+            if (NFA_CONSUMING_P(insn->op) || insn->op == NFA_MATCH) {
+                l->pcs[l->n] = pc;
+                memcpy(l->caps + l->n*vm->numSlots, caps,
+                       vm->numSlots*sizeof(const char*));
+                l->n++;
+                break;
+            }
+            switch (insn->op) {
+            case NFA_SPLIT:
+                vm->stack[sp++] = insn->y;
+                pc = insn->x;
+                continue;
+            case NFA_JUMP:
+                pc = insn->x;
+                continue;
+            case NFA_SAVE:
+                vm->savedcaps[nsaved++] = caps[insn->x];
+                vm->stack[sp++] = -insn->x-1;
+                caps[insn->x] = p;
+                pc++;
+                continue;
+            case NFA_BOL:
+                if (p != vm->start) break;
+                pc++;
+                continue;
+            case NFA_EOL:
+                if (p != vm->stop) break;
+                pc++;
+                continue;
+            case NFA_WB:
+                if (!word_boundary_p(vm->start, vm->stop, p)) break;
+                pc++;
+                continue;
+            case NFA_NWB:
+                if (word_boundary_p(vm->start, vm->stop, p)) break;
+                pc++;
+                continue;
+            default:
+                /* NFA_FAIL */
+                break;
+            }
+            break;
+        }
+    }
+}
+
+/* Runs the NFA of RX on the string ORIG, whose content is [start, stop).
+   LIMIT is the end of the match if we know it, or STOP. */
+static ScmObj pike_exec(ScmRegexp *rx, ScmString *orig,
+                        const char *start, const char *stop,
+                        const char *limit)
+{
+    struct ScmRegNFARec *nfa = REGEXP_NFA(rx);
+    int ni = nfa->numInsns, ns = nfa->numSlots;
+    int anchored = rx->flags & SCM_REGEXP_BOL_ANCHORED;
+    pike_vm vm;
+    pike_list l0, l1, *clist = &l0, *nlist = &l1;
+    pike_scratch *w = pike_scratch_take(nfa);
+
+    vm.insns = nfa->insns;
+    vm.numSlots = ns;
+    vm.start = start;
+    vm.stop = stop;
+    vm.marks = w->marks;
+    for (int i = 0; i < ni; i++) vm.marks[i] = 0;
+    vm.gen = 1;
+    vm.stack = w->stack;
+    vm.savedcaps = w->savedcaps;
+    l0.n = l1.n = 0;
+    l0.pcs  = w->pcs[0];
+    l1.pcs  = w->pcs[1];
+    l0.caps = w->caps[0];
+    l1.caps = w->caps[1];
+    const char **caps = w->tcaps;
+    const char **mcaps = NULL;
+
+    const char *p = start;
+    for (;;) {
+        if (mcaps == NULL && (p == start || !anchored)) {
+            if (clist->n == 0 && !anchored && !SCM_FALSEP(rx->laset)) {
+                /* No thread is running; we can skip to the position where
+                   a match can begin. */
+                while (p < limit) {
+                    ScmChar ch;
+                    SCM_CHAR_GET(p, ch);
+                    if (Scm_CharSetContains(SCM_CHAR_SET(rx->laset), ch)) break;
+                    p += SCM_CHAR_NFOLLOWS(*p) + 1;
+                }
+                if (p == limit) break;
+                vm.gen++;
+            }
+            /* The new thread has the least priority. */
+            for (int i = 0; i < ns; i++) caps[i] = NULL;
+            pike_add(&vm, clist, NFA_REGEXP_START, p, caps);
+        }
+        if (clist->n == 0) {
+            /* No thread is running.  Unless we already have a match,
+               we retry from the next position. */
+            if (mcaps != NULL || anchored || p >= limit) break;
+            p += SCM_CHAR_NFOLLOWS(*p) + 1;
+            vm.gen++;
+            continue;
+        }
+
+        ScmChar ch = SCM_CHAR_INVALID;
+        const char *np = p;
+        if (p < limit) {
+            SCM_CHAR_GET(p, ch);
+            np = p + SCM_CHAR_NFOLLOWS(*p) + 1;
+        }
+        vm.gen++;
+        nlist->n = 0;
+        for (int i = 0; i < clist->n; i++) {
+            const nfa_insn *insn = &nfa->insns[clist->pcs[i]];
+            const char **tcaps = clist->caps + i*ns;
+            if (insn->op == NFA_MATCH) {
+                /* Threads after this have lower priority; cut them. */
+                if (mcaps == NULL) {
+                    mcaps = SCM_NEW_ATOMIC2(const char**,
+                                            (ns+1)*sizeof(const char*));
+                }
+                memcpy(mcaps, tcaps, ns*sizeof(const char*));
+                break;
+            }
+            if (p < limit && nfa_char_match(insn, ch)) {
+                memcpy(caps, tcaps, ns*sizeof(const char*));
+                pike_add(&vm, nlist, clist->pcs[i]+1, np, caps);
+            }
+        }
+        if (p >= limit) break;
+        pike_list *t = clist; clist = nlist; nlist = t;
+        p = np;
+    }
+    pike_scratch_release(nfa, w);
+    if (mcaps == NULL) return SCM_FALSE;
+
+    struct ScmRegMatchSub **matches =
+        SCM_NEW_ARRAY(struct ScmRegMatchSub *, rx->numGroups);
+    for (int i = 0; i < rx->numGroups; i++) {
+        matches[i] = SCM_NEW(struct ScmRegMatchSub);
+        matches[i]->start = -1;
+        matches[i]->length = -1;
+        matches[i]->after = -1;
+        matches[i]->startp = mcaps[i*2];
+        matches[i]->endp = mcaps[i*2+1];
+    }
+    return make_match(rx, orig, matches);
+}
+
+static ScmObj rex_nfa(ScmRegexp *rx, ScmString *orig,
+                      const char *start, const char *stop)
+{
+    const char *limit = stop;
+    if (REGEXP_NFA(rx)->dfap && start < stop) {
+        switch (dfa_scan(rx, start, stop, &limit)) {
+        case 0: return SCM_FALSE;
+        case 1: break;
+        default: limit = stop; break;
+        }
+    }
+    return pike_exec(rx, orig, start, stop, limit);
+}
+
 /*----------------------------------------------------------------------
  * entry point
  */
@@ -2852,6 +3710,10 @@ ScmObj Scm_RegExec(ScmRegexp *rx, ScmString *str)
     if (SCM_STRING_INCOMPLETE_P(str)) {
         Scm_Error("incomplete string is not allowed: %S", str);
     }
+    /* If we have an NFA, we use the linear-time matcher. */
+    if (REGEXP_NFA(rx)) {
+        return rex_nfa(rx, str, start, end);
+    }
 #if 0
     /* Disabled for now; we need to use more heuristics to determine
        when we should apply mustMatch.  For example, if the regexp
@@ -3092,4 +3954,5 @@ void Scm_RegMatchDump(ScmRegMatch *rm)
 
 void Scm__InitRegexp(void)
 {
+    SCM_INTERNAL_MUTEX_INIT(dfa_mutex);
 }
@@ -33,6 +33,7 @@
 
 #define LIBGAUCHE_BODY
 #include "gauche.h"
+#include "gauche/priv/atomicP.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -72,6 +73,7 @@ static ScmString *make_str(ScmSmallInt len, ScmSmallInt siz,
     s->initialBody.length = len;
     s->initialBody.size = siz;
     s->initialBody.start = p;
+    s->initialBody.aux.index = NULL;
     return s;
 }
 
@@ -115,6 +117,201 @@ char *Scm_StrdupPartial(const char *src, size_t size)
 
 /* We have multiple similar functions, due to performance reasons. */
 
+/*
+ * Vectorized UTF-8 kernels
+ *
+ *  utf8_scan() validates and counts characters of the longest prefix
+ *  of the given string that can be processed by blocks.  It accepts
+ *  the same byte sequences as SCM_CHAR_GET does for 1 to 4 byte
+ *  characters; that is, it rejects overlong forms and stray or missing
+ *  continuation bytes, but it doesn't reject surrogates or code points
+ *  beyond U+10FFFF.  When it sees a byte that begins 5 or 6 byte
+ *  sequence, or an invalid sequence, it stops at the last character
+ *  boundary before the block and leaves the rest to the scalar loop,
+ *  which knows the exact semantics.
+ *
+ *  The return value is the number of bytes processed, which is always
+ *  at a character boundary, and the number of characters in it is
+ *  added to *count.
+ *
+ *  The SSE2 version is used on x86_64 (SSE2 is always available there).
+ *  If the compiler can generate AVX2 code, the AVX2 version is also
+ *  compiled and chosen at runtime if the CPU supports it.
+ */
+#if defined(GAUCHE_CHAR_ENCODING_UTF_8) && defined(__GNUC__) \
+    && defined(__x86_64__)
+#define UTF8_SIMD 1
+#include <immintrin.h>
+#if defined(__clang__) || (__GNUC__ >= 5)
+#define UTF8_AVX2 1
+#endif
+#endif
+
+#if defined(UTF8_SIMD)
+
+#define UTF8_SIMD_MIN_SIZE  32
+
+/* Called when the blocks up to P are validated.  If the last character
+   in them continues past P, its continuation bytes haven't been checked,
+   so we back up to the beginning of the character and uncount it. */
+static ScmSmallInt utf8_scan_finish(const unsigned char *str,
+                                    const unsigned char *p,
+                                    ScmSmallInt count, ScmSmallInt *pcount)
+{
+    if (p > str) {
+        const unsigned char *q = p - 1;
+        while ((*q & 0xc0) == 0x80) q--;
+        if (q + SCM_CHAR_NFOLLOWS(*q) + 1 != p) {
+            p = q;
+            count--;
+        }
+    }
+    *pcount += count;
+    return (ScmSmallInt)(p - str);
+}
+
+/* x >= y as unsigned bytes */
+#define GE_EPU8(x, y)  _mm_cmpeq_epi8(_mm_max_epu8((x), (y)), (x))
+
+static ScmSmallInt utf8_scan_sse2(const unsigned char *str, ScmSmallInt size,
+                                  ScmSmallInt *pcount)
+{
+    const unsigned char *p = str, *end = str + size;
+    const __m128i k80 = _mm_set1_epi8((char)0x80);
+    const __m128i kc0 = _mm_set1_epi8((char)0xc0);
+    const __m128i ke0 = _mm_set1_epi8((char)0xe0);
+    const __m128i kf0 = _mm_set1_epi8((char)0xf0);
+    const __m128i kf8 = _mm_set1_epi8((char)0xf8);
+    const __m128i kfe = _mm_set1_epi8((char)0xfe);
+    const __m128i ka0 = _mm_set1_epi8((char)0xa0);
+    const __m128i k90 = _mm_set1_epi8((char)0x90);
+    __m128i prev = _mm_setzero_si128();
+    ScmSmallInt count = 0;
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        if (_mm_movemask_epi8(_mm_or_si128(v, prev)) == 0) {
+            /* All ASCII, and no pending continuation. */
+            count += 16;
+            prev = v;
+            p += 16;
+            continue;
+        }
+        __m128i prev1 = _mm_or_si128(_mm_slli_si128(v, 1),
+                                     _mm_srli_si128(prev, 15));
+        __m128i prev2 = _mm_or_si128(_mm_slli_si128(v, 2),
+                                     _mm_srli_si128(prev, 14));
+        __m128i prev3 = _mm_or_si128(_mm_slli_si128(v, 3),
+                                     _mm_srli_si128(prev, 13));
+        __m128i cont = _mm_cmpeq_epi8(_mm_and_si128(v, kc0), k80);
+        __m128i req = _mm_or_si128(GE_EPU8(prev1, kc0),
+                                   _mm_or_si128(GE_EPU8(prev2, ke0),
+                                                GE_EPU8(prev3, kf0)));
+        __m128i err = _mm_xor_si128(cont, req);
+        /* 5 or 6 byte sequence, or invalid byte */
+        err = _mm_or_si128(err, GE_EPU8(v, kf8));
+        /* overlong 2 byte sequence (c0, c1) */
+        err = _mm_or_si128(err, _mm_cmpeq_epi8(_mm_and_si128(v, kfe), kc0));
+        /* overlong 3 and 4 byte sequences */
+        err = _mm_or_si128(err,
+                           _mm_andnot_si128(GE_EPU8(v, ka0),
+                                            _mm_cmpeq_epi8(prev1, ke0)));
+        err = _mm_or_si128(err,
+                           _mm_andnot_si128(GE_EPU8(v, k90),
+                                            _mm_cmpeq_epi8(prev1, kf0)));
+        if (_mm_movemask_epi8(err)) break;
+        count += 16 - __builtin_popcount(_mm_movemask_epi8(cont));
+        prev = v;
+        p += 16;
+    }
+    return utf8_scan_finish(str, p, count, pcount);
+}
+
+#undef GE_EPU8
+
+#if defined(UTF8_AVX2)
+
+#define GE_EPU8(x, y)  _mm256_cmpeq_epi8(_mm256_max_epu8((x), (y)), (x))
+#define PREV_N(v, prev, n) \
+    _mm256_alignr_epi8((v), _mm256_permute2x128_si256((prev), (v), 0x21), \
+                       16-(n))
+
+__attribute__((target("avx2")))
+static ScmSmallInt utf8_scan_avx2(const unsigned char *str, ScmSmallInt size,
+                                  ScmSmallInt *pcount)
+{
+    const unsigned char *p = str, *end = str + size;
+    const __m256i k80 = _mm256_set1_epi8((char)0x80);
+    const __m256i kc0 = _mm256_set1_epi8((char)0xc0);
+    const __m256i ke0 = _mm256_set1_epi8((char)0xe0);
+    const __m256i kf0 = _mm256_set1_epi8((char)0xf0);
+    const __m256i kf8 = _mm256_set1_epi8((char)0xf8);
+    const __m256i kfe = _mm256_set1_epi8((char)0xfe);
+    const __m256i ka0 = _mm256_set1_epi8((char)0xa0);
+    const __m256i k90 = _mm256_set1_epi8((char)0x90);
+    __m256i prev = _mm256_setzero_si256();
+    ScmSmallInt count = 0;
+
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        if (_mm256_movemask_epi8(_mm256_or_si256(v, prev)) == 0) {
+            count += 32;
+            prev = v;
+            p += 32;
+            continue;
+        }
+        __m256i prev1 = PREV_N(v, prev, 1);
+        __m256i prev2 = PREV_N(v, prev, 2);
+        __m256i prev3 = PREV_N(v, prev, 3);
+        __m256i cont = _mm256_cmpeq_epi8(_mm256_and_si256(v, kc0), k80);
+        __m256i req = _mm256_or_si256(GE_EPU8(prev1, kc0),
+                                      _mm256_or_si256(GE_EPU8(prev2, ke0),
+                                                      GE_EPU8(prev3, kf0)));
+        __m256i err = _mm256_xor_si256(cont, req);
+        err = _mm256_or_si256(err, GE_EPU8(v, kf8));
+        err = _mm256_or_si256(err,
+                              _mm256_cmpeq_epi8(_mm256_and_si256(v, kfe), kc0));
+        err = _mm256_or_si256(err,
+                              _mm256_andnot_si256(GE_EPU8(v, ka0),
+                                                  _mm256_cmpeq_epi8(prev1, ke0)));
+        err = _mm256_or_si256(err,
+                              _mm256_andnot_si256(GE_EPU8(v, k90),
+                                                  _mm256_cmpeq_epi8(prev1, kf0)));
+        if (_mm256_movemask_epi8(err)) break;
+        count += 32 - __builtin_popcount((unsigned)_mm256_movemask_epi8(cont));
+        prev = v;
+        p += 32;
+    }
+    /* The rest may still be processed by 16-byte blocks, but we need
+       to restart from a character boundary. */
+    ScmSmallInt n = utf8_scan_finish(str, p, count, pcount);
+    if (p == end || end - p >= 32) return n; /* finished or stopped by error */
+    return n + utf8_scan_sse2(str + n, size - n, pcount);
+}
+
+#undef PREV_N
+#undef GE_EPU8
+#endif /* UTF8_AVX2 */
+
+static ScmSmallInt utf8_scan(const char *str, ScmSmallInt size,
+                             ScmSmallInt *pcount)
+{
+    if (size < UTF8_SIMD_MIN_SIZE) return 0;
+#if defined(UTF8_AVX2)
+    static int use_avx2 = -1;
+    if (use_avx2 < 0) {
+        __builtin_cpu_init();
+        use_avx2 = __builtin_cpu_supports("avx2")? 1 : 0;
+    }
+    if (use_avx2) {
+        return utf8_scan_avx2((const unsigned char*)str, size, pcount);
+    }
+#endif /* UTF8_AVX2 */
+    return utf8_scan_sse2((const unsigned char*)str, size, pcount);
+}
+
+#endif /* UTF8_SIMD */
+
 /* Calculate both length and size of C-string str.
    If str is incomplete, *plen gets -1. */
 static inline ScmSmallInt count_size_and_length(const char *str,
@@ -124,6 +321,11 @@ static inline ScmSmallInt count_size_and_length(const char *str,
     char c;
     const char *p = str;
     ScmSmallInt size = 0, len = 0;
+#if defined(UTF8_SIMD)
+    /* strlen is fast enough; the valid prefix is counted by blocks. */
+    size = utf8_scan(str, (ScmSmallInt)strlen(str), &len);
+    p += size;
+#endif
     while ((c = *p++) != 0) {
         int i = SCM_CHAR_NFOLLOWS(c);
         len++;
@@ -143,16 +345,22 @@ static inline ScmSmallInt count_size_and_length(const char *str,
 static inline ScmSmallInt count_length(const char *str, ScmSmallInt size)
 {
     ScmSmallInt count = 0;
-    while (size-- > 0) {
+    while (size > 0) {
+#if defined(UTF8_SIMD)
+        ScmSmallInt n = utf8_scan(str, size, &count);
+        str += n;
+        size -= n;
+        if (size == 0) break;
+#endif
         unsigned char c = (unsigned char)*str;
         int i = SCM_CHAR_NFOLLOWS(c);
-        if (i < 0 || i > size) return -1;
+        if (i < 0 || i >= size) return -1;
         ScmChar ch;
         SCM_CHAR_GET(str, ch);
         if (ch == SCM_CHAR_INVALID) return -1;
         count++;
         str += i+1;
-        size -= i;
+        size -= i+1;
     }
     return count;
 }
@@ -468,6 +676,110 @@ static const char *forward_pos(const char *current, ScmSmallInt offset)
     return current;
 }
 
+/*
+ * Character index
+ *
+ *  Finding the N-th character of a multibyte string requires to scan
+ *  the string from the beginning, which makes a loop of string-ref
+ *  quadratic.  So we build a sparse index that records the byte offset
+ *  of every STRING_INDEX_INTERVAL-th character on the first random
+ *  access, and attach it to the string body.  The body is immutable,
+ *  so the index never gets stale.
+ *
+ *  A substring shares the content of the original string.  If the
+ *  original body has an index, the substring's body gets a view of it
+ *  that only adjusts the starting position.  Note that the body's start
+ *  pointer may be replaced by a copy (see get_string_from_body), so
+ *  the index only keeps offsets relative to the start.
+ *
+ *  The index is set by CAS without locking.  If more than one thread
+ *  build the index of the same body simultaneously, one of them wins,
+ *  which is harmless.
+ *
+ *  We only attach the index to the bodies in the heap.  Static string
+ *  literals may be placed in read-only memory, so we don't cache the
+ *  index of them and just scan from the beginning.
+ */
+
+#define STRING_INDEX_INTERVAL  64
+
+typedef struct ScmStringIndexRec {
+    ScmSmallInt charOffset;     /* char position of the body start, */
+    ScmSmallInt byteOffset;     /*   and its byte offset, in the indexed
+                                     string.  Both are 0 unless the index
+                                     is shared from the original string. */
+    const ScmSmallInt *offsets; /* offsets[i] is the byte offset of
+                                   (i*STRING_INDEX_INTERVAL)-th char
+                                   of the indexed string */
+} ScmStringIndex;
+
+static inline const ScmStringIndex *body_index(const ScmStringBody *b)
+{
+    return (const ScmStringIndex*)AO_load_acquire((AO_t*)&b->aux.index);
+}
+
+/* Returns the index of B, building it if necessary.  Returns NULL if
+   B is not in the heap. */
+static const ScmStringIndex *string_index(const ScmStringBody *b)
+{
+    const ScmStringIndex *xidx = body_index(b);
+    if (xidx) return xidx;
+    if (GC_base((void*)b) == NULL) return NULL;
+
+    ScmSmallInt n = SCM_STRING_BODY_LENGTH(b)/STRING_INDEX_INTERVAL + 1;
+    const char *start = SCM_STRING_BODY_START(b), *p = start;
+    ScmSmallInt *offsets = SCM_NEW_ATOMIC_ARRAY(ScmSmallInt, n);
+    for (ScmSmallInt i=0; i<n; i++) {
+        if (i > 0) p = forward_pos(p, STRING_INDEX_INTERVAL);
+        offsets[i] = (ScmSmallInt)(p - start);
+    }
+    ScmStringIndex *idx = SCM_NEW(ScmStringIndex);
+    idx->charOffset = 0;
+    idx->byteOffset = 0;
+    idx->offsets = offsets;
+    if (!AO_compare_and_swap_full((AO_t*)&b->aux.index, 0, (AO_t)idx)) {
+        /* Another thread won. */
+        return body_index(b);
+    }
+    return idx;
+}
+
+/* Returns the pointer to the POS-th character of a multibyte string body.
+   POS may be equal to the length.  The index is only consulted if POS is
+   far enough from the beginning. */
+static const char *index_pos(const ScmStringBody *b, ScmSmallInt pos)
+{
+    const char *start = SCM_STRING_BODY_START(b);
+    if (pos < STRING_INDEX_INTERVAL && b->aux.index == NULL) {
+        return forward_pos(start, pos);
+    }
+    const ScmStringIndex *idx = string_index(b);
+    if (idx == NULL) return forward_pos(start, pos);
+    ScmSmallInt q = pos + idx->charOffset;
+    ScmSmallInt k = q/STRING_INDEX_INTERVAL;
+    if (k*STRING_INDEX_INTERVAL <= idx->charOffset) {
+        /* The nearest mark is before the start; then POS is small. */
+        return forward_pos(start, pos);
+    }
+    return forward_pos(start + (idx->offsets[k] - idx->byteOffset),
+                       q - k*STRING_INDEX_INTERVAL);
+}
+
+/* Let the body of substring S, whose start is at START-th character of XB,
+   share the index of XB. */
+static void share_index(ScmString *s, const ScmStringBody *xb,
+                        ScmSmallInt start)
+{
+    const ScmStringIndex *xidx = body_index(xb);
+    if (xidx == NULL) return;
+    ScmStringIndex *idx = SCM_NEW(ScmStringIndex);
+    idx->charOffset = xidx->charOffset + start;
+    idx->byteOffset = xidx->byteOffset
+        + (SCM_STRING_BODY_START(&s->initialBody) - SCM_STRING_BODY_START(xb));
+    idx->offsets = xidx->offsets;
+    s->initialBody.aux.index = idx;
+}
+
 /* string-ref.
  * If POS is out of range,
  *   - returns SCM_CHAR_INVALID if range_error is FALSE
@@ -496,7 +808,7 @@ ScmChar Scm_StringRef(ScmString *str, ScmSmallInt pos, int range_error)
     if (SCM_STRING_BODY_SINGLE_BYTE_P(b)) {
         return (ScmChar)(((unsigned char *)SCM_STRING_BODY_START(b))[pos]);
     } else {
-        const char *p = forward_pos(SCM_STRING_BODY_START(b), pos);
+        const char *p = index_pos(b, pos);
         ScmChar c;
         SCM_CHAR_GET(p, c);
         return c;
@@ -534,7 +846,7 @@ const char *Scm_StringBodyPosition(const ScmStringBody *b, ScmSmallInt offset)
     if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
         return (SCM_STRING_BODY_START(b)+offset);
     } else {
-        return (forward_pos(SCM_STRING_BODY_START(b), offset));
+        return (index_pos(b, offset));
     }
 }
 
@@ -546,20 +858,265 @@ const char *Scm_StringPosition(ScmString *str, ScmSmallInt offset)
     return Scm_StringBodyPosition(SCM_STRING_BODY(str), offset);
 }
 
+/*----------------------------------------------------------------
+ * Rope
+ *
+ *  Repeated concatenation, e.g. (set! s (string-append s piece)) in a
+ *  loop, is quadratic if each step copies the whole content.  So if the
+ *  result is large enough, string-append and friends create a rope
+ *  body instead; it is a balanced binary tree whose leaves are flat
+ *  string bodies.  Leaves share the bodies of the original strings, which
+ *  is safe since a string body is never altered once created (mutation
+ *  replaces the body of ScmString).  Small adjacent leaves are merged
+ *  to keep the tree from degenerating into a tree of single characters.
+ *
+ *  The tree is kept balanced in the same way as AVL tree; the depths of
+ *  the children of a node differ at most by 2 (rotations are done on
+ *  the way up from join), so the depth is O(log n) and both
+ *  concatenation and substring take O(log n) nodes.
+ *
+ *  Most string operations need a contiguous content.  They get it through
+ *  SCM_STRING_BODY, which calls Scm__StringFlatten for a rope.  It
+ *  copies the leaves into a fresh flat body and replaces the string's
+ *  body with it, so the conversion happens at most once per string.
+ *  If more than one thread flatten the same string simultaneously,
+ *  one of them wins, which is harmless since the contents are the same.
+ */
+
+typedef struct ScmStringRopeRec {
+    const ScmStringBody *leaf;  /* flat body if this is a leaf, or NULL */
+    const struct ScmStringRopeRec *left;
+    const struct ScmStringRopeRec *right;
+    ScmSmallInt length;         /* # of characters (== size if incomplete) */
+    ScmSmallInt size;           /* # of bytes */
+    int depth;                  /* 0 for leaves */
+} ScmStringRope;
+
+/* Results of concatenation smaller than this are created flat. */
+#define ROPE_MIN_SIZE     1024
+/* Adjacent leaves are merged if the total size doesn't exceed this. */
+#define ROPE_LEAF_SIZE    256
+
+static ScmObj substring(const ScmStringBody *xb,
+                        ScmSmallInt start, ScmSmallInt end,
+                        int byterange);
+
+#define ROPE_DEPTH(r)  ((r)->depth)
+
+static const ScmStringRope *rope_leaf(const ScmStringBody *b)
+{
+    SCM_ASSERT(!SCM_STRING_BODY_HAS_FLAG(b, SCM_STRING_ROPE));
+    ScmStringRope *r = SCM_NEW(ScmStringRope);
+    r->leaf = b;
+    r->left = r->right = NULL;
+    r->length = SCM_STRING_BODY_LENGTH(b);
+    r->size = SCM_STRING_BODY_SIZE(b);
+    r->depth = 0;
+    return r;
+}
+
+/* Returns the rope of the string body B. */
+static const ScmStringRope *body_rope(const ScmStringBody *b)
+{
+    if (SCM_STRING_BODY_HAS_FLAG(b, SCM_STRING_ROPE)) return b->aux.rope;
+    return rope_leaf(b);
+}
+
+static const ScmStringRope *rope_node(const ScmStringRope *l,
+                                      const ScmStringRope *r)
+{
+    ScmStringRope *n = SCM_NEW(ScmStringRope);
+    n->leaf = NULL;
+    n->left = l;
+    n->right = r;
+    n->length = l->length + r->length;
+    n->size = l->size + r->size;
+    n->depth = (ROPE_DEPTH(l) > ROPE_DEPTH(r)? ROPE_DEPTH(l):ROPE_DEPTH(r)) + 1;
+    return n;
+}
+
+/* Copies the content of rope R into BUF, which must have enough room. */
+static char *rope_copy(const ScmStringRope *r, char *buf)
+{
+    while (r->leaf == NULL) {
+        buf = rope_copy(r->left, buf);
+        r = r->right;
+    }
+    memcpy(buf, SCM_STRING_BODY_START(r->leaf), r->size);
+    return buf + r->size;
+}
+
+/* Copies the content of body B, which may be a rope, into BUF. */
+static char *body_copy(const ScmStringBody *b, char *buf)
+{
+    if (SCM_STRING_BODY_HAS_FLAG(b, SCM_STRING_ROPE)) {
+        return rope_copy(b->aux.rope, buf);
+    }
+    memcpy(buf, SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b));
+    return buf + SCM_STRING_BODY_SIZE(b);
+}
+
+/* Merge two small leaves into one. */
+static const ScmStringRope *rope_merge_leaves(const ScmStringRope *l,
+                                              const ScmStringRope *r)
+{
+    ScmSmallInt size = l->size + r->size;
+    char *p = SCM_NEW_ATOMIC2(char *, size + 1);
+    memcpy(p, SCM_STRING_BODY_START(l->leaf), l->size);
+    memcpy(p + l->size, SCM_STRING_BODY_START(r->leaf), r->size);
+    p[size] = '\0';
+    u_long flags = SCM_STRING_TERMINATED;
+    if (SCM_STRING_BODY_INCOMPLETE_P(l->leaf)
+        || SCM_STRING_BODY_INCOMPLETE_P(r->leaf)) {
+        flags |= SCM_STRING_INCOMPLETE;
+    }
+    ScmString *s = make_str(l->length + r->length, size, p, flags);
+    return rope_leaf(&s->initialBody);
+}
+
+/* Creates a node of L and R, whose depths may differ by 2 at most. */
+static const ScmStringRope *rope_balance(const ScmStringRope *l,
+                                         const ScmStringRope *r)
+{
+    if (ROPE_DEPTH(l) > ROPE_DEPTH(r) + 1) {
+        if (ROPE_DEPTH(l->left) >= ROPE_DEPTH(l->right)) {
+            return rope_node(l->left, rope_node(l->right, r));
+        } else {
+            return rope_node(rope_node(l->left, l->right->left),
+                             rope_node(l->right->right, r));
+        }
+    }
+    if (ROPE_DEPTH(r) > ROPE_DEPTH(l) + 1) {
+        if (ROPE_DEPTH(r->right) >= ROPE_DEPTH(r->left)) {
+            return rope_node(rope_node(l, r->left), r->right);
+        } else {
+            return rope_node(rope_node(l, r->left->left),
+                             rope_node(r->left->right, r->right));
+        }
+    }
+    return rope_node(l, r);
+}
+
+/* Concatenates two ropes. */
+static const ScmStringRope *rope_join(const ScmStringRope *l,
+                                      const ScmStringRope *r)
+{
+    if (l->size == 0) return r;
+    if (r->size == 0) return l;
+    if (l->leaf && r->leaf) {
+        if (l->size + r->size <= ROPE_LEAF_SIZE) {
+            return rope_merge_leaves(l, r);
+        }
+        return rope_node(l, r);
+    }
+    /* If we're appending or prepending a small leaf, we go down to
+       the edge so that it can be merged with the adjacent leaf. */
+    if (ROPE_DEPTH(l) > ROPE_DEPTH(r) + 1
+        || (r->leaf && r->size <= ROPE_LEAF_SIZE)) {
+        return rope_balance(l->left, rope_join(l->right, r));
+    }
+    if (ROPE_DEPTH(r) > ROPE_DEPTH(l) + 1
+        || (l->leaf && l->size <= ROPE_LEAF_SIZE)) {
+        return rope_balance(rope_join(l, r->left), r->right);
+    }
+    return rope_node(l, r);
+}
+
+/* Returns a rope of characters [start, end) of R.  R must be complete. */
+static const ScmStringRope *rope_substring(const ScmStringRope *r,
+                                           ScmSmallInt start,
+                                           ScmSmallInt end)
+{
+    if (start == 0 && end == r->length) return r;
+    if (r->leaf) {
+        ScmObj s = substring(r->leaf, start, end, FALSE);
+        return rope_leaf(SCM_STRING_RAW_BODY(s));
+    }
+    ScmSmallInt llen = r->left->length;
+    if (end <= llen) return rope_substring(r->left, start, end);
+    if (start >= llen) return rope_substring(r->right, start-llen, end-llen);
+    return rope_join(rope_substring(r->left, start, llen),
+                     rope_substring(r->right, 0, end-llen));
+}
+
+/* Creates a string from rope R.  FLAGS may have SCM_STRING_INCOMPLETE. */
+static ScmObj make_rope_str(const ScmStringRope *r, u_long flags)
+{
+    if (r->leaf) {
+        const ScmStringBody *b = r->leaf;
+        flags |= SCM_STRING_BODY_FLAGS(b)
+            & (SCM_STRING_TERMINATED|SCM_STRING_INCOMPLETE);
+        return SCM_OBJ(make_str(SCM_STRING_BODY_LENGTH(b),
+                                SCM_STRING_BODY_SIZE(b),
+                                SCM_STRING_BODY_START(b), flags));
+    }
+    if (r->size < ROPE_MIN_SIZE) {
+        char *p = SCM_NEW_ATOMIC2(char *, r->size + 1);
+        rope_copy(r, p);
+        p[r->size] = '\0';
+        return SCM_OBJ(make_str(r->length, r->size, p,
+                                flags|SCM_STRING_TERMINATED));
+    }
+    /* The rope body is allocated separately from the string, so that
+       the tree can be GC-ed once the string is flattened. */
+    ScmString *s = make_str(0, 0, "", SCM_STRING_TERMINATED);
+    ScmStringBody *b = SCM_NEW(ScmStringBody);
+    b->flags = (flags & SCM_STRING_INCOMPLETE) | SCM_STRING_ROPE;
+    b->length = (flags & SCM_STRING_INCOMPLETE)? r->size : r->length;
+    b->size = r->size;
+    b->start = NULL;
+    b->aux.rope = r;
+    s->body = b;
+    return SCM_OBJ(s);
+}
+
+const ScmStringBody *Scm__StringFlatten(ScmString *str)
+{
+    const ScmStringBody *b = SCM_STRING_RAW_BODY(str);
+    if (!SCM_STRING_BODY_HAS_FLAG(b, SCM_STRING_ROPE)) return b;
+
+    const ScmStringRope *r = b->aux.rope;
+    char *p = SCM_NEW_ATOMIC2(char *, r->size + 1);
+    rope_copy(r, p);
+    p[r->size] = '\0';
+
+    ScmStringBody *nb = SCM_NEW(ScmStringBody);
+    nb->flags = (SCM_STRING_BODY_FLAGS(b) & ~SCM_STRING_ROPE)
+        | SCM_STRING_TERMINATED;
+    nb->length = SCM_STRING_BODY_LENGTH(b);
+    nb->size = SCM_STRING_BODY_SIZE(b);
+    nb->start = p;
+    nb->aux.index = NULL;
+    /* Another thread may pick up the new body as soon as it sees the
+       pointer, so the contents must be visible before it.  If two threads
+       flatten the same rope, either result will do. */
+    AO_store_release((AO_t*)&str->body, (AO_t)nb);
+    return nb;
+}
+
 /*----------------------------------------------------------------
  * Concatenation
  */
 
 ScmObj Scm_StringAppend2(ScmString *x, ScmString *y)
 {
-    const ScmStringBody *xb = SCM_STRING_BODY(x);
-    const ScmStringBody *yb = SCM_STRING_BODY(y);
+    const ScmStringBody *xb = SCM_STRING_RAW_BODY(x);
+    const ScmStringBody *yb = SCM_STRING_RAW_BODY(y);
     ScmSmallInt sizex = SCM_STRING_BODY_SIZE(xb);
-    ScmSmallInt lenx = SCM_STRING_BODY_LENGTH(xb);
     ScmSmallInt sizey = SCM_STRING_BODY_SIZE(yb);
-    ScmSmallInt leny = SCM_STRING_BODY_LENGTH(yb);
     CHECK_SIZE(sizex+sizey);
     u_long flags = 0;
+
+    if (sizex + sizey >= ROPE_MIN_SIZE) {
+        if (SCM_STRING_BODY_INCOMPLETE_P(xb) || SCM_STRING_BODY_INCOMPLETE_P(yb)) {
+            flags |= SCM_STRING_INCOMPLETE;
+        }
+        return make_rope_str(rope_join(body_rope(xb), body_rope(yb)), flags);
+    }
+
+    /* Ropes are never this small, so XB and YB are flat. */
+    ScmSmallInt lenx = SCM_STRING_BODY_LENGTH(xb);
+    ScmSmallInt leny = SCM_STRING_BODY_LENGTH(yb);
     char *p = SCM_NEW_ATOMIC2(char *,sizex + sizey + 1);
 
     memcpy(p, xb->start, sizex);
@@ -576,7 +1133,7 @@ ScmObj Scm_StringAppend2(ScmString *x, ScmString *y)
 ScmObj Scm_StringAppendC(ScmString *x, const char *str,
                          ScmSmallInt sizey, ScmSmallInt leny)
 {
-    const ScmStringBody *xb = SCM_STRING_BODY(x);
+    const ScmStringBody *xb = SCM_STRING_RAW_BODY(x);
     ScmSmallInt sizex = SCM_STRING_BODY_SIZE(xb);
     ScmSmallInt lenx = SCM_STRING_BODY_LENGTH(xb);
     u_long flags = 0;
@@ -585,6 +1142,17 @@ ScmObj Scm_StringAppendC(ScmString *x, const char *str,
     else if (leny < 0) leny = count_length(str, sizey);
     CHECK_SIZE(sizex+sizey);
 
+    if (sizex + sizey >= ROPE_MIN_SIZE) {
+        ScmString *y = make_str(leny, sizey, Scm_StrdupPartial(str, sizey),
+                                SCM_STRING_TERMINATED);
+        if (SCM_STRING_BODY_INCOMPLETE_P(xb) || leny < 0) {
+            flags |= SCM_STRING_INCOMPLETE;
+        }
+        return make_rope_str(rope_join(body_rope(xb),
+                                       rope_leaf(&y->initialBody)),
+                             flags);
+    }
+
     char *p = SCM_NEW_ATOMIC2(char *, sizex + sizey + 1);
     memcpy(p, xb->start, sizex);
     memcpy(p+sizex, str, sizey);
@@ -623,7 +1191,7 @@ ScmObj Scm_StringAppend(ScmObj strs)
         if (!SCM_STRINGP(SCM_CAR(cp))) {
             Scm_Error("string required, but got %S", SCM_CAR(cp));
         }
-        b = SCM_STRING_BODY(SCM_CAR(cp));
+        b = SCM_STRING_RAW_BODY(SCM_CAR(cp));
         size += SCM_STRING_BODY_SIZE(b);
         len += SCM_STRING_BODY_LENGTH(b);
         CHECK_SIZE(size);
@@ -633,6 +1201,16 @@ ScmObj Scm_StringAppend(ScmObj strs)
         bodies[i++] = b;
     }
 
+    if (size >= ROPE_MIN_SIZE) {
+        const ScmStringRope *r = body_rope(bodies[0]);
+        for (i=1; i<numstrs; i++) {
+            r = rope_join(r, body_rope(bodies[i]));
+        }
+        bodies = NULL;          /* to help GC */
+        return make_rope_str(r, flags);
+    }
+
+    /* Ropes are never this small, so all bodies are flat. */
     char *buf = SCM_NEW_ATOMIC2(char *, size+1);
     char *bufp = buf;
     for (i=0; i<numstrs; i++) {
@@ -683,7 +1261,7 @@ ScmObj Scm_StringJoin(ScmObj strs, ScmString *delim, int grammer)
         if (!SCM_STRINGP(SCM_CAR(cp))) {
             Scm_Error("string required, but got %S", SCM_CAR(cp));
         }
-        b = SCM_STRING_BODY(SCM_CAR(cp));
+        b = SCM_STRING_RAW_BODY(SCM_CAR(cp));
         size += SCM_STRING_BODY_SIZE(b);
         len  += SCM_STRING_BODY_LENGTH(b);
         CHECK_SIZE(size);
@@ -709,9 +1287,7 @@ ScmObj Scm_StringJoin(ScmObj strs, ScmString *delim, int grammer)
         bufp += dsize;
     }
     for (i=0; i<nstrs; i++) {
-        const ScmStringBody *b = bodies[i];
-        memcpy(bufp, SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b));
-        bufp += SCM_STRING_BODY_SIZE(b);
+        bufp = body_copy(bodies[i], bufp);
         if (i < nstrs-1) {
             memcpy(bufp, SCM_STRING_BODY_START(dbody), dsize);
             bufp += dsize;
@@ -745,8 +1321,9 @@ ScmObj Scm_StringReplaceBody(ScmString *str, const ScmStringBody *newbody)
         Scm_Error("attempted to modify an immutable string: %S", str);
     }
 
-    /* Atomically replaces the str's body (no MT hazard) */
-    str->body = newbody;
+    /* Atomically replaces the str's body (no MT hazard).  The release
+       store makes the contents of newbody visible before the pointer. */
+    AO_store_release((AO_t*)&str->body, (AO_t)newbody);
 
     /* TODO: If the initialBody of str isn't shared,
        nullify str->initialBody.start so that the original string is
@@ -776,22 +1353,44 @@ static ScmObj substring(const ScmStringBody *xb,
                                 flags));
     } else {
         const char *s, *e;
-        if (start) s = forward_pos(SCM_STRING_BODY_START(xb), start);
+        if (start) s = index_pos(xb, start);
         else s = SCM_STRING_BODY_START(xb);
         if (len == end) {
             e = SCM_STRING_BODY_START(xb) + SCM_STRING_BODY_SIZE(xb);
         } else {
-            e = forward_pos(s, end - start);
+            if (end - start < STRING_INDEX_INTERVAL) {
+                e = forward_pos(s, end - start);
+            } else {
+                e = index_pos(xb, end);
+            }
             flags &= ~SCM_STRING_TERMINATED;
         }
-        return SCM_OBJ(make_str((ScmSmallInt)(end - start),
-                                (ScmSmallInt)(e - s), s, flags));
+        ScmString *r = make_str((ScmSmallInt)(end - start),
+                                (ScmSmallInt)(e - s), s, flags);
+        share_index(r, xb, start);
+        return SCM_OBJ(r);
     }
 }
 
+/* Substring of a complete rope is taken without flattening it. */
+static ScmObj rope_substring_str(const ScmStringBody *xb,
+                                 ScmSmallInt start, ScmSmallInt end)
+{
+    SCM_CHECK_START_END(start, end, SCM_STRING_BODY_LENGTH(xb));
+    return make_rope_str(rope_substring(xb->aux.rope, start, end), 0);
+}
+
+#define ROPE_SUBSTRING_P(xb, byterange)                 \
+    (SCM_STRING_BODY_HAS_FLAG(xb, SCM_STRING_ROPE)      \
+     && !SCM_STRING_BODY_INCOMPLETE_P(xb) && !(byterange))
+
 ScmObj Scm_Substring(ScmString *x, ScmSmallInt start, ScmSmallInt end,
                      int byterangep)
 {
+    const ScmStringBody *xb = SCM_STRING_RAW_BODY(x);
+    if (ROPE_SUBSTRING_P(xb, byterangep)) {
+        return rope_substring_str(xb, start, end);
+    }
     return substring(SCM_STRING_BODY(x), start, end, byterangep);
 }
 
@@ -801,7 +1400,7 @@ ScmObj Scm_Substring(ScmString *x, ScmSmallInt start, ScmSmallInt end,
 ScmObj Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end)
 {
     ScmSmallInt istart, iend;
-    const ScmStringBody *xb = SCM_STRING_BODY(x);
+    const ScmStringBody *xb = SCM_STRING_RAW_BODY(x);
     if (SCM_UNBOUNDP(start) || SCM_UNDEFINEDP(start) || SCM_FALSEP(start)) {
         istart = 0;
     } else {
@@ -818,7 +1417,10 @@ ScmObj Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end)
             Scm_Error("exact integer required for start, but got %S", end);
         iend = SCM_INT_VALUE(end);
     }
-    return substring(xb, istart, iend, FALSE);
+    if (ROPE_SUBSTRING_P(xb, FALSE)) {
+        return rope_substring_str(xb, istart, iend);
+    }
+    return substring(SCM_STRING_BODY(x), istart, iend, FALSE);
 }
 
 /*----------------------------------------------------------------
@@ -935,11 +1537,15 @@ static int string_search(const char *s1, ScmSmallInt siz1,
             /* Shortcut for single-byte strings */
             if (siz1 < siz2) return NOT_FOUND;
             if (siz1 < 256 || siz2 >= 256) {
-                /* brute-force search */
-                for (i=0; i<=siz1-siz2; i++) {
-                    if (memcmp(s2, s1+i, siz2) == 0) break;
+                /* brute-force search, skipping to the candidates by memchr */
+                const char *p = s1, *last = s1 + siz1 - siz2;
+                for (;;) {
+                    p = memchr(p, s2[0], last - p + 1);
+                    if (p == NULL) return NOT_FOUND;
+                    if (memcmp(s2+1, p+1, siz2-1) == 0) break;
+                    if (p++ == last) return NOT_FOUND;
                 }
-                if (i == siz1-siz2+1) return NOT_FOUND;
+                i = p - s1;
             } else {
                 i = boyer_moore(s1, siz1, s2, siz2);
                 if (i < 0) return NOT_FOUND;
@@ -1176,6 +1782,23 @@ ScmObj Scm_StringScanCharRight(ScmString *s1, ScmChar ch, int retmode)
    calculated every time we call string_scan, which is a waste.  Some
    mechanism to cache the skip table would be nice.
 */
+#if defined(GAUCHE_CHAR_ENCODING_UTF_8)
+/* Returns the first occurrence of byte sequence NEEDLE in HAYSTACK,
+   or NULL. */
+static const char *find_bytes(const char *haystack, ScmSmallInt size,
+                              const char *needle, int nb)
+{
+    const char *p = haystack, *last = haystack + size - nb;
+    while (p <= last) {
+        p = memchr(p, needle[0], last - p + 1);
+        if (p == NULL) return NULL;
+        if (memcmp(p+1, needle+1, nb-1) == 0) return p;
+        p++;
+    }
+    return NULL;
+}
+#endif /*GAUCHE_CHAR_ENCODING_UTF_8*/
+
 ScmObj Scm_StringSplitByCharWithLimit(ScmString *str, ScmChar ch, int limit)
 {
     char buf[SCM_CHAR_MAX_BYTES];
@@ -1186,6 +1809,35 @@ ScmObj Scm_StringSplitByCharWithLimit(ScmString *str, ScmChar ch, int limit)
 
     SCM_CHAR_PUT(buf, ch);
 
+#if defined(GAUCHE_CHAR_ENCODING_UTF_8)
+    /* A complete UTF-8 string can be searched bytewise.  We scan the
+       string directly, without making intermediate substrings, and
+       we only need to count the length of each piece but the last. */
+    const ScmStringBody *b = SCM_STRING_BODY(str);
+    if (!SCM_STRING_BODY_INCOMPLETE_P(b)) {
+        const char *s = SCM_STRING_BODY_START(b);
+        const char *end = s + SCM_STRING_BODY_SIZE(b);
+        ScmSmallInt rest = SCM_STRING_BODY_LENGTH(b);
+        for (;;) {
+            const char *q = find_bytes(s, end - s, buf, nb);
+            if (q == NULL) {
+                if (SCM_NULLP(head)) return SCM_LIST1(SCM_OBJ(str));
+                SCM_APPEND1(head, tail, Scm_MakeString(s, end - s, rest, 0));
+                break;
+            }
+            ScmSmallInt n = count_length(s, q - s);
+            SCM_APPEND1(head, tail, Scm_MakeString(s, q - s, n, 0));
+            rest -= n + 1;
+            s = q + nb;
+            if (--limit == 0) {
+                SCM_APPEND1(head, tail, Scm_MakeString(s, end - s, rest, 0));
+                break;
+            }
+        }
+        return head;
+    }
+#endif /*GAUCHE_CHAR_ENCODING_UTF_8*/
+
     for (;;) {
         ScmObj v1, v2;
         v1 = string_scan(str, buf, nb, 1, FALSE, SCM_STRING_SCAN_BOTH,
@@ -1401,12 +2053,12 @@ ScmObj Scm_MakeStringPointer(ScmString *src, ScmSmallInt index,
         ptr = sptr + index;
         effective_size = end - start;
     } else {
-        sptr = forward_pos(SCM_STRING_BODY_START(srcb), start);
-        ptr = forward_pos(sptr, index);
+        sptr = index_pos(srcb, start);
+        ptr = index_pos(srcb, start + index);
         if (end == len) {
             eptr = SCM_STRING_BODY_START(srcb) + SCM_STRING_BODY_SIZE(srcb);
         } else {
-            eptr = forward_pos(sptr, end - start);
+            eptr = index_pos(srcb, end);
         }
         effective_size = eptr - ptr;
     }
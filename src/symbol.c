@@ -55,9 +55,9 @@ static ScmClass *keyword_cpl[] = {
 SCM_DEFINE_BUILTIN_CLASS(Scm_KeywordClass, symbol_print, symbol_compare,
                          NULL, NULL, keyword_cpl);
 
-/* name -> symbol mapper */
-static ScmInternalMutex obtable_mutex = SCM_INTERNAL_MUTEX_INITIALIZER;
-static ScmHashTable *obtable = NULL;
+/* name -> symbol mapper.  It's a concurrent hash table, so that threads
+   interning symbols in parallel (e.g. loading code) won't serialize. */
+static ScmConcurrentHashTable *obtable = NULL;
 
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
 /* Global keyword table. */
@@ -74,9 +74,8 @@ static ScmSymbol *make_sym(ScmClass *klass, ScmString *name, int interned)
 {
     if (interned) {
         /* fast path */
-        SCM_INTERNAL_MUTEX_LOCK(obtable_mutex);
-        ScmObj e = Scm_HashTableRef(obtable, SCM_OBJ(name), SCM_FALSE);
-        SCM_INTERNAL_MUTEX_UNLOCK(obtable_mutex);
+        ScmObj e = Scm_ConcurrentHashTableRef(obtable, SCM_OBJ(name),
+                                              SCM_FALSE);
         if (!SCM_FALSEP(e)) return SCM_SYMBOL(e);
     }
 
@@ -89,12 +88,11 @@ static ScmSymbol *make_sym(ScmClass *klass, ScmString *name, int interned)
         return sym;
     } else {
         /* Using SCM_DICT_NO_OVERWRITE ensures that if another thread interns
-           the same name symbol between above HashTableRef and here, we'll
+           the same name symbol between above lookup and here, we'll
            get the already interned symbol. */
-        SCM_INTERNAL_MUTEX_LOCK(obtable_mutex);
-        ScmObj r = Scm_HashTableSet(obtable, SCM_OBJ(name), SCM_OBJ(sym),
-                                    SCM_DICT_NO_OVERWRITE);
-        SCM_INTERNAL_MUTEX_UNLOCK(obtable_mutex);
+        ScmObj r = Scm_ConcurrentHashTableSet(obtable, SCM_OBJ(name),
+                                              SCM_OBJ(sym),
+                                              SCM_DICT_NO_OVERWRITE);
         return SCM_UNBOUNDP(r)? sym : SCM_SYMBOL(r);
     }
 }
@@ -471,8 +469,8 @@ ScmObj Scm_ExtractKeywords(ScmObj kv_list,
 
 void Scm__InitSymbol(void)
 {
-    SCM_INTERNAL_MUTEX_INIT(obtable_mutex);
-    obtable = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_STRING, 4096));
+    obtable = SCM_CONCURRENT_HASH_TABLE(
+        Scm_MakeConcurrentHashTable(SCM_HASH_STRING, 4096));
     init_builtin_syms();
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
     (void)SCM_INTERNAL_MUTEX_INIT(keywords.mutex);
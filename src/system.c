@@ -46,6 +46,12 @@
 #include <fcntl.h>
 #include <math.h>
 #include <dirent.h>
+#include <limits.h>
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#elif defined(HAVE_POLL_H)
+#include <poll.h>
+#endif
 
 #if !defined(GAUCHE_WINDOWS)
 #include <grp.h>
@@ -2205,35 +2211,9 @@ static int win_wait_for_handles(HANDLE *handles, int nhandles, int options,
  * select
  */
 
-#ifdef HAVE_SELECT
-static ScmObj fdset_allocate(ScmClass *klass, ScmObj initargs SCM_UNUSED)
-{
-    ScmSysFdset *set = SCM_NEW_INSTANCE(ScmSysFdset, klass);
-    set->maxfd = -1;
-    FD_ZERO(&set->fdset);
-    return SCM_OBJ(set);
-}
-
-static ScmSysFdset *fdset_copy(ScmSysFdset *fdset)
-{
-    ScmSysFdset *set = SCM_NEW(ScmSysFdset);
-    SCM_SET_CLASS(set, SCM_CLASS_SYS_FDSET);
-    set->maxfd = fdset->maxfd;
-    set->fdset = fdset->fdset;
-    return set;
-}
-
-SCM_DEFINE_BUILTIN_CLASS(Scm_SysFdsetClass, NULL, NULL, NULL,
-                         fdset_allocate, SCM_CLASS_DEFAULT_CPL);
-
-static ScmSysFdset *select_checkfd(ScmObj fds)
-{
-    if (SCM_FALSEP(fds)) return NULL;
-    if (!SCM_SYS_FDSET_P(fds))
-        Scm_Error("sys-fdset object or #f is required, but got %S", fds);
-    return SCM_SYS_FDSET(fds);
-}
-
+#if defined(HAVE_SELECT) || defined(HAVE_SYS_POLLER)
+/* Converts the timeout argument of sys-select and sys-poller-wait.
+   #f means no timeout. */
 static struct timeval *select_timeval(ScmObj timeout, struct timeval *tm)
 {
     if (SCM_FALSEP(timeout)) return NULL;
@@ -2273,6 +2253,36 @@ static struct timeval *select_timeval(ScmObj timeout, struct timeval *tm)
     Scm_Error("timeval needs to be a real number (in microseconds) or a list of two integers (seconds and microseconds), but got %S", timeout);
     return NULL;                /* dummy */
 }
+#endif /*HAVE_SELECT || HAVE_SYS_POLLER*/
+
+#ifdef HAVE_SELECT
+static ScmObj fdset_allocate(ScmClass *klass, ScmObj initargs SCM_UNUSED)
+{
+    ScmSysFdset *set = SCM_NEW_INSTANCE(ScmSysFdset, klass);
+    set->maxfd = -1;
+    FD_ZERO(&set->fdset);
+    return SCM_OBJ(set);
+}
+
+static ScmSysFdset *fdset_copy(ScmSysFdset *fdset)
+{
+    ScmSysFdset *set = SCM_NEW(ScmSysFdset);
+    SCM_SET_CLASS(set, SCM_CLASS_SYS_FDSET);
+    set->maxfd = fdset->maxfd;
+    set->fdset = fdset->fdset;
+    return set;
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_SysFdsetClass, NULL, NULL, NULL,
+                         fdset_allocate, SCM_CLASS_DEFAULT_CPL);
+
+static ScmSysFdset *select_checkfd(ScmObj fds)
+{
+    if (SCM_FALSEP(fds)) return NULL;
+    if (!SCM_SYS_FDSET_P(fds))
+        Scm_Error("sys-fdset object or #f is required, but got %S", fds);
+    return SCM_SYS_FDSET(fds);
+}
 
 static ScmObj select_int(ScmSysFdset *rfds, ScmSysFdset *wfds,
                          ScmSysFdset *efds, ScmObj timeout)
@@ -2317,6 +2327,236 @@ ScmObj Scm_SysSelectX(ScmObj rfds, ScmObj wfds, ScmObj efds, ScmObj timeout)
 
 #endif /* HAVE_SELECT */
 
+/*===============================================================
+ * poller
+ *
+ *   A set of file descriptors to watch, with the cost of waiting
+ *   independent of the number of descriptors.  We use epoll if
+ *   available; otherwise we keep an array of struct pollfd and use
+ *   poll(), which at least isn't limited by FD_SETSIZE.
+ *
+ *   Events are a bitmask of SCM_SYS_POLL_READ, _WRITE and _EXCEPT.
+ *   SCM_SYS_POLL_EDGE makes the registration edge-triggered with epoll;
+ *   it's ignored by the poll() backend.  Error or hangup conditions
+ *   are reported as all of the read/write events registered for
+ *   the descriptor, so that the handler notices them by the
+ *   subsequent I/O.
+ *
+ *   epoll refuses descriptors that poll() always reports ready, such as
+ *   regular files, with EPERM.  We keep them in alwaysReady and report
+ *   them on every wait, as poll() would.
+ */
+
+#if defined(HAVE_SYS_POLLER)
+
+#define POLLER_MAX_EVENTS 256
+
+static void poller_finalize(ScmObj obj, void *data SCM_UNUSED)
+{
+    Scm_SysPollerClose(SCM_SYS_POLLER(obj));
+}
+
+static ScmObj poller_allocate(ScmClass *klass, ScmObj initargs SCM_UNUSED)
+{
+    ScmSysPoller *poller = SCM_NEW_INSTANCE(ScmSysPoller, klass);
+    poller->epfd = -1;
+    poller->closed = FALSE;
+    poller->alwaysReady = SCM_NIL;
+    poller->nfds = poller->pfdsize = poller->nslots = 0;
+    poller->pfds = NULL;
+    poller->slots = NULL;
+#if defined(HAVE_SYS_EPOLL_H)
+    SCM_SYSCALL(poller->epfd, epoll_create1(EPOLL_CLOEXEC));
+    if (poller->epfd < 0) Scm_SysError("epoll_create1 failed");
+    Scm_RegisterFinalizer(SCM_OBJ(poller), poller_finalize, NULL);
+#endif
+    return SCM_OBJ(poller);
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_SysPollerClass, NULL, NULL, NULL,
+                         poller_allocate, SCM_CLASS_DEFAULT_CPL);
+
+static int poller_timeout_ms(ScmObj timeout)
+{
+    struct timeval tm;
+    if (select_timeval(timeout, &tm) == NULL) return -1;
+    if (tm.tv_sec >= INT_MAX/1000 - 1) return INT_MAX;
+    return (int)(tm.tv_sec*1000 + (tm.tv_usec + 999)/1000);
+}
+
+static ScmObj poller_result(ScmObj tail, int fd, int events)
+{
+    return Scm_Cons(Scm_Cons(SCM_MAKE_INT(fd), SCM_MAKE_INT(events)), tail);
+}
+
+#if defined(HAVE_SYS_EPOLL_H)
+
+void Scm_SysPollerSet(ScmSysPoller *poller, int fd, int events)
+{
+    if (poller->closed) Scm_Error("poller already closed: %S", poller);
+    if (fd < 0) Scm_Error("invalid file descriptor: %d", fd);
+    int r;
+    ScmObj p = Scm_Assv(SCM_MAKE_INT(fd), poller->alwaysReady);
+    if (SCM_PAIRP(p)) {
+        poller->alwaysReady = Scm_DeleteX(p, poller->alwaysReady, SCM_CMP_EQ);
+    }
+    if ((events & ~SCM_SYS_POLL_EDGE) == 0) {
+        SCM_SYSCALL(r, epoll_ctl(poller->epfd, EPOLL_CTL_DEL, fd, NULL));
+        if (r < 0 && errno != ENOENT && errno != EBADF) {
+            Scm_SysError("epoll_ctl failed on %d", fd);
+        }
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = 0;
+    if (events & SCM_SYS_POLL_READ)   ev.events |= EPOLLIN;
+    if (events & SCM_SYS_POLL_WRITE)  ev.events |= EPOLLOUT;
+    if (events & SCM_SYS_POLL_EXCEPT) ev.events |= EPOLLPRI;
+    if (events & SCM_SYS_POLL_EDGE)   ev.events |= EPOLLET;
+    /* We keep the registered events to report error conditions. */
+    ev.data.u64 = (uint64_t)(unsigned int)fd | ((uint64_t)events << 32);
+    SCM_SYSCALL(r, epoll_ctl(poller->epfd, EPOLL_CTL_MOD, fd, &ev));
+    if (r < 0 && errno == ENOENT) {
+        SCM_SYSCALL(r, epoll_ctl(poller->epfd, EPOLL_CTL_ADD, fd, &ev));
+    }
+    if (r < 0 && errno == EPERM) {
+        poller->alwaysReady =
+            Scm_Acons(SCM_MAKE_INT(fd), SCM_MAKE_INT(events),
+                      poller->alwaysReady);
+        return;
+    }
+    if (r < 0) Scm_SysError("epoll_ctl failed on %d", fd);
+}
+
+ScmObj Scm_SysPollerWait(ScmSysPoller *poller, ScmObj timeout)
+{
+    if (poller->closed) Scm_Error("poller already closed: %S", poller);
+    struct epoll_event evs[POLLER_MAX_EVENTS];
+    int n;
+    int ms = SCM_NULLP(poller->alwaysReady)? poller_timeout_ms(timeout) : 0;
+    SCM_SYSCALL(n, epoll_wait(poller->epfd, evs, POLLER_MAX_EVENTS, ms));
+    if (n < 0) Scm_SysError("epoll_wait failed");
+    ScmObj r = SCM_NIL;
+    ScmObj cp;
+    SCM_FOR_EACH(cp, poller->alwaysReady) {
+        int events = SCM_INT_VALUE(SCM_CDAR(cp))
+            & (SCM_SYS_POLL_READ|SCM_SYS_POLL_WRITE);
+        if (events) r = poller_result(r, SCM_INT_VALUE(SCM_CAAR(cp)), events);
+    }
+    for (int i = n-1; i >= 0; i--) {
+        int fd = (int)(evs[i].data.u64 & 0xffffffffUL);
+        int registered = (int)(evs[i].data.u64 >> 32);
+        int events = 0;
+        if (evs[i].events & EPOLLIN)  events |= SCM_SYS_POLL_READ;
+        if (evs[i].events & EPOLLOUT) events |= SCM_SYS_POLL_WRITE;
+        if (evs[i].events & EPOLLPRI) events |= SCM_SYS_POLL_EXCEPT;
+        if (evs[i].events & (EPOLLERR|EPOLLHUP)) {
+            events |= registered & (SCM_SYS_POLL_READ|SCM_SYS_POLL_WRITE);
+        }
+        if (events) r = poller_result(r, fd, events);
+    }
+    return r;
+}
+
+void Scm_SysPollerClose(ScmSysPoller *poller)
+{
+    if (poller->closed) return;
+    poller->closed = TRUE;
+    poller->alwaysReady = SCM_NIL;
+    if (poller->epfd >= 0) {
+        close(poller->epfd);
+        poller->epfd = -1;
+    }
+}
+
+#else  /*!HAVE_SYS_EPOLL_H*/
+
+#define POLLER_PFDS(poller)  ((struct pollfd*)(poller)->pfds)
+
+void Scm_SysPollerSet(ScmSysPoller *poller, int fd, int events)
+{
+    if (poller->closed) Scm_Error("poller already closed: %S", poller);
+    if (fd < 0) Scm_Error("invalid file descriptor: %d", fd);
+    int slot = (fd < poller->nslots)? poller->slots[fd] - 1 : -1;
+    short pevents = 0;
+    if (events & SCM_SYS_POLL_READ)   pevents |= POLLIN;
+    if (events & SCM_SYS_POLL_WRITE)  pevents |= POLLOUT;
+    if (events & SCM_SYS_POLL_EXCEPT) pevents |= POLLPRI;
+
+    if (pevents == 0) {
+        if (slot < 0) return;
+        /* Move the last entry to the hole. */
+        struct pollfd *last = &POLLER_PFDS(poller)[--poller->nfds];
+        if (slot != poller->nfds) {
+            POLLER_PFDS(poller)[slot] = *last;
+            poller->slots[last->fd] = slot + 1;
+        }
+        poller->slots[fd] = 0;
+        return;
+    }
+    if (slot < 0) {
+        if (fd >= poller->nslots) {
+            int newsize = (poller->nslots == 0)? 64 : poller->nslots;
+            while (newsize <= fd) newsize *= 2;
+            int *slots = SCM_NEW_ATOMIC_ARRAY(int, newsize);
+            memset(slots, 0, newsize*sizeof(int));
+            if (poller->nslots > 0) {
+                memcpy(slots, poller->slots, poller->nslots*sizeof(int));
+            }
+            poller->slots = slots;
+            poller->nslots = newsize;
+        }
+        if (poller->nfds == poller->pfdsize) {
+            int newsize = (poller->pfdsize == 0)? 16 : poller->pfdsize*2;
+            struct pollfd *pfds = SCM_NEW_ATOMIC_ARRAY(struct pollfd, newsize);
+            if (poller->nfds > 0) {
+                memcpy(pfds, poller->pfds, poller->nfds*sizeof(struct pollfd));
+            }
+            poller->pfds = pfds;
+            poller->pfdsize = newsize;
+        }
+        slot = poller->nfds++;
+        poller->slots[fd] = slot + 1;
+        POLLER_PFDS(poller)[slot].fd = fd;
+    }
+    POLLER_PFDS(poller)[slot].events = pevents;
+    POLLER_PFDS(poller)[slot].revents = 0;
+}
+
+ScmObj Scm_SysPollerWait(ScmSysPoller *poller, ScmObj timeout)
+{
+    if (poller->closed) Scm_Error("poller already closed: %S", poller);
+    struct pollfd *pfds = POLLER_PFDS(poller);
+    int n;
+    SCM_SYSCALL(n, poll(pfds, poller->nfds, poller_timeout_ms(timeout)));
+    if (n < 0) Scm_SysError("poll failed");
+    ScmObj r = SCM_NIL;
+    for (int i = poller->nfds-1; i >= 0 && n > 0; i--) {
+        short rev = pfds[i].revents;
+        if (rev == 0) continue;
+        n--;
+        int events = 0;
+        if (rev & POLLIN)  events |= SCM_SYS_POLL_READ;
+        if (rev & POLLOUT) events |= SCM_SYS_POLL_WRITE;
+        if (rev & POLLPRI) events |= SCM_SYS_POLL_EXCEPT;
+        if (rev & (POLLERR|POLLHUP|POLLNVAL)) {
+            if (pfds[i].events & POLLIN)  events |= SCM_SYS_POLL_READ;
+            if (pfds[i].events & POLLOUT) events |= SCM_SYS_POLL_WRITE;
+        }
+        if (events) r = poller_result(r, pfds[i].fd, events);
+    }
+    return r;
+}
+
+void Scm_SysPollerClose(ScmSysPoller *poller)
+{
+    poller->closed = TRUE;
+    poller->nfds = 0;
+}
+
+#endif /*!HAVE_SYS_EPOLL_H*/
+#endif /*HAVE_SYS_POLLER*/
+
 /*===============================================================
  * Environment
  */
@@ -3226,6 +3466,9 @@ void Scm__InitSystem(void)
     Scm_InitStaticClass(&Scm_SysPasswdClass, "<sys-passwd>", mod, pwd_slots, 0);
 #ifdef HAVE_SELECT
     Scm_InitStaticClass(&Scm_SysFdsetClass, "<sys-fdset>", mod, NULL, 0);
+#endif
+#ifdef HAVE_SYS_POLLER
+    Scm_InitStaticClass(&Scm_SysPollerClass, "<sys-poller>", mod, NULL, 0);
 #endif
     SCM_INTERNAL_MUTEX_INIT(env_mutex);
     Scm_HashCoreInitSimple(&env_strings, SCM_HASH_STRING, 0, NULL);
@@ -2,9 +2,11 @@
  * Test the lowest-level numeric routines.
  */
 
+#include <time.h>
 #include "gauche.h"
 #include "gauche/priv/arith.h"
 #include "gauche/scmconst.h"
+#include "gauche/bignum.h"
 
 #define UMAX SCM_ULONG_MAX
 #define SMAX LONG_MAX
@@ -789,15 +791,200 @@ void test_f16(void)
               Scm_DoubleToHalf(2.9802322387695312e-8));
 }
 
+/*=============================================================
+ * Testing bignum multiplication and radix conversion
+ */
+
+/* Deterministic pseudo-random bignum of the given number of words.
+   The top word is nonzero. */
+static ScmObj random_bignum(int size, u_long *seed)
+{
+    u_long *v = SCM_NEW_ATOMIC_ARRAY(u_long, size);
+    for (int i=0; i<size; i++) {
+        u_long w = 0;
+        for (int j=0; j<(int)sizeof(u_long); j++) {
+            *seed = *seed * 1103515245 + 12345;
+            w = (w << 8) | ((*seed >> 16) & 0xff);
+        }
+        v[i] = w;
+    }
+    if (v[size-1] == 0) v[size-1] = 1;
+    return Scm_MakeBignumFromUIArray(1, v, size);
+}
+
+/* All ones; maximizes carries. */
+static ScmObj ones_bignum(int size)
+{
+    u_long *v = SCM_NEW_ATOMIC_ARRAY(u_long, size);
+    for (int i=0; i<size; i++) v[i] = SCM_ULONG_MAX;
+    return Scm_MakeBignumFromUIArray(1, v, size);
+}
+
+enum { MUL_BASECASE, MUL_KARATSUBA, MUL_TOOM3, MUL_NTT, MUL_DEFAULT };
+static const char *mul_names[] = {
+    "basecase", "karatsuba", "toom3", "ntt", "default"
+};
+static int default_thresholds[SCM_BIGNUM_NUM_THRESHOLDS];
+
+static void save_default_thresholds(void)
+{
+    for (int i=0; i<SCM_BIGNUM_NUM_THRESHOLDS; i++) {
+        default_thresholds[i] = Scm_BignumThreshold(i);
+    }
+}
+
+/* Force multiplication algorithm. */
+static void set_mul_algorithm(int algo)
+{
+    for (int i=0; i<SCM_BIGNUM_NUM_THRESHOLDS; i++) {
+        Scm_BignumSetThreshold(i, default_thresholds[i]);
+    }
+    switch (algo) {
+    case MUL_BASECASE:
+        Scm_BignumSetThreshold(SCM_BIGNUM_KARATSUBA_THRESHOLD, INT_MAX);
+        Scm_BignumSetThreshold(SCM_BIGNUM_TOOM3_THRESHOLD, INT_MAX);
+        Scm_BignumSetThreshold(SCM_BIGNUM_NTT_THRESHOLD, INT_MAX);
+        break;
+    case MUL_KARATSUBA:
+        Scm_BignumSetThreshold(SCM_BIGNUM_KARATSUBA_THRESHOLD, 1);
+        Scm_BignumSetThreshold(SCM_BIGNUM_TOOM3_THRESHOLD, INT_MAX);
+        Scm_BignumSetThreshold(SCM_BIGNUM_NTT_THRESHOLD, INT_MAX);
+        break;
+    case MUL_TOOM3:
+        Scm_BignumSetThreshold(SCM_BIGNUM_TOOM3_THRESHOLD, 1);
+        Scm_BignumSetThreshold(SCM_BIGNUM_NTT_THRESHOLD, INT_MAX);
+        break;
+    case MUL_NTT:
+        Scm_BignumSetThreshold(SCM_BIGNUM_NTT_THRESHOLD, 1);
+        break;
+    }
+}
+
+static void test_bignum_mul_1(int xsize, int ysize, u_long *seed)
+{
+    ScmObj x = random_bignum(xsize, seed);
+    ScmObj y = random_bignum(ysize, seed);
+    char msg[100];
+
+    set_mul_algorithm(MUL_BASECASE);
+    ScmObj expect = Scm_Mul(x, y);
+    ScmObj expect_ones = Scm_Mul(ones_bignum(xsize), ones_bignum(ysize));
+    for (int algo=MUL_KARATSUBA; algo<=MUL_DEFAULT; algo++) {
+        set_mul_algorithm(algo);
+        snprintf(msg, sizeof(msg), "%s %dx%d words",
+                 mul_names[algo], xsize, ysize);
+        test_true(msg, Scm_NumEq(expect, Scm_Mul(x, y))
+                  && Scm_NumEq(expect_ones,
+                               Scm_Mul(ones_bignum(xsize),
+                                       ones_bignum(ysize))));
+    }
+}
+
+static void test_bignum_radix_1(int size, int radix, u_long *seed)
+{
+    ScmObj x = Scm_Negate(random_bignum(size, seed));
+    char msg[100];
+
+    Scm_BignumSetThreshold(SCM_BIGNUM_DC_RADIX_THRESHOLD, INT_MAX);
+    ScmObj expect = Scm_NumberToString(x, radix, 0);
+    Scm_BignumSetThreshold(SCM_BIGNUM_DC_RADIX_THRESHOLD, 2);
+    ScmObj s = Scm_NumberToString(x, radix, 0);
+    Scm_BignumSetThreshold(SCM_BIGNUM_DC_RADIX_THRESHOLD,
+                           default_thresholds[SCM_BIGNUM_DC_RADIX_THRESHOLD]);
+    snprintf(msg, sizeof(msg), "number->string %d words radix %d",
+             size, radix);
+    test_true(msg, Scm_StringEqual(SCM_STRING(expect), SCM_STRING(s))
+              && Scm_NumEq(x, Scm_StringToNumber(SCM_STRING(s), radix, 0)));
+}
+
+void test_bignum(void)
+{
+    static const int sizes[] = { 1, 2, 3, 5, 8, 9, 13, 31, 32, 33,
+                                 64, 100, 129, 257, 500 };
+    static const int radices[] = { 2, 3, 8, 10, 16, 36 };
+    int nsizes = (int)(sizeof(sizes)/sizeof(sizes[0]));
+    u_long seed = 42;
+
+    save_default_thresholds();
+
+    TEST_SECTION("bignum multiplication");
+    for (int i=0; i<nsizes; i++) {
+        test_bignum_mul_1(sizes[i], sizes[i], &seed);
+        for (int j=0; j<i; j++) {
+            test_bignum_mul_1(sizes[i], sizes[j], &seed);
+        }
+    }
+    set_mul_algorithm(MUL_DEFAULT);
+
+    TEST_SECTION("bignum radix conversion");
+    for (int i=0; i<nsizes; i++) {
+        for (int j=0; j<(int)(sizeof(radices)/sizeof(radices[0])); j++) {
+            test_bignum_radix_1(sizes[i], radices[j], &seed);
+        }
+    }
+}
+
+/* Run with --bench to see the crossover points of the algorithms.
+   Times are in microseconds per operation. */
+static double bench_mul_1(int algo, ScmObj x, ScmObj y)
+{
+    set_mul_algorithm(algo);
+    int reps = 0;
+    clock_t start = clock(), end;
+    do {
+        Scm_Mul(x, y);
+        reps++;
+        end = clock();
+    } while (end - start < CLOCKS_PER_SEC/10);
+    return (double)(end - start) * 1e6 / CLOCKS_PER_SEC / reps;
+}
+
+void bench_bignum(void)
+{
+    u_long seed = 1;
+    printf("%8s", "words");
+    for (int algo=MUL_BASECASE; algo<=MUL_DEFAULT; algo++) {
+        printf(" %12s", mul_names[algo]);
+    }
+    printf(" %12s %12s\n", "->string", "->string-dc");
+    for (int size=8; size<=8192; size*=2) {
+        ScmObj x = random_bignum(size, &seed);
+        ScmObj y = random_bignum(size, &seed);
+        printf("%8d", size);
+        for (int algo=MUL_BASECASE; algo<=MUL_DEFAULT; algo++) {
+            if (algo == MUL_BASECASE && size > 2048) printf(" %12s", "-");
+            else printf(" %12.1f", bench_mul_1(algo, x, y));
+        }
+        set_mul_algorithm(MUL_DEFAULT);
+        for (int dc=0; dc<2; dc++) {
+            Scm_BignumSetThreshold(SCM_BIGNUM_DC_RADIX_THRESHOLD,
+                                   dc? 2 : INT_MAX);
+            clock_t start = clock();
+            Scm_NumberToString(x, 10, 0);
+            printf(" %12.1f",
+                   (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC);
+        }
+        set_mul_algorithm(MUL_DEFAULT);
+        printf("\n");
+        fflush(stdout);
+    }
+}
+
 /*=============================================================
  * main
  */
-int main(int argc SCM_UNUSED, char **argv SCM_UNUSED)
+int main(int argc, char **argv)
 {
     const char *testmsg = "Testing integer arithmetic macros ... ";
 
     Scm_Init(GAUCHE_SIGNATURE);
 
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        save_default_thresholds();
+        bench_bignum();
+        return 0;
+    }
+
     fprintf(stderr, "%-65s", testmsg);
     message(stdout, testmsg, '=');
 
@@ -817,6 +1004,8 @@ int main(int argc SCM_UNUSED, char **argv SCM_UNUSED)
 
     test_f16();
 
+    test_bignum();
+
     if (errcount) {
         fprintf(stderr, "failed.\n");
         fprintf(stdout, "failed.\n");
@@ -39,6 +39,10 @@
 #include "gauche/priv/vmP.h"
 #include "gauche/priv/identifierP.h"
 #include "gauche/priv/parameterP.h"
+#include "gauche/priv/dispatchP.h"
+#include "gauche/priv/jitP.h"
+#include "gauche/priv/arith.h"
+#include "gauche/priv/atomicP.h"
 #include "gauche/code.h"
 #include "gauche/vminsn.h"
 #include "gauche/prof.h"
@@ -146,6 +150,8 @@ static ScmEnvFrame *get_env(ScmVM *vm);
 
 static void   call_error_reporter(ScmObj e);
 
+/* Define this (e.g. with CFLAGS=-DCOUNT_INSN_FREQUENCY) to gather
+   instruction statistics.  See vmstat.c. */
 /*#define COUNT_INSN_FREQUENCY*/
 #ifdef COUNT_INSN_FREQUENCY
 #include "vmstat.c"
@@ -406,15 +412,41 @@ static void vm_register(ScmVM *vm)
                                          SCM_DICT_CREATE);
     (void)SCM_DICT_SET_VALUE(e, SCM_TRUE);
     SCM_INTERNAL_MUTEX_UNLOCK(vm_table_mutex);
+#ifdef GAUCHE_PROFILE
+    Scm__ProfilerAttachVM(vm);
+#endif
 }
 
 static void vm_unregister(ScmVM *vm)
 {
+#ifdef GAUCHE_PROFILE
+    Scm__ProfilerDetachVM(vm);
+#endif
     SCM_INTERNAL_MUTEX_LOCK(vm_table_mutex);
     (void)Scm_HashCoreSearch(&vm_table, (intptr_t)vm, SCM_DICT_DELETE);
     SCM_INTERNAL_MUTEX_UNLOCK(vm_table_mutex);
 }
 
+/* Returns a list of all VMs, including the primordial one.  Used by
+   the profiler to sample all threads. */
+ScmObj Scm__VMRegisteredVMs(void)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    ScmHashIter iter;
+    ScmDictEntry *e;
+
+    if (rootVM) SCM_APPEND1(h, t, SCM_OBJ(rootVM));
+    SCM_INTERNAL_MUTEX_LOCK(vm_table_mutex);
+    Scm_HashIterInit(&iter, &vm_table);
+    while ((e = Scm_HashIterNext(&iter)) != NULL) {
+        if (SCM_OBJ(e->key) != SCM_OBJ(rootVM)) {
+            SCM_APPEND1(h, t, SCM_OBJ(e->key));
+        }
+    }
+    SCM_INTERNAL_MUTEX_UNLOCK(vm_table_mutex);
+    return h;
+}
+
 /*====================================================================
  * VM interpreter
  *
@@ -498,6 +530,12 @@ static void vm_unregister(ScmVM *vm)
         }                                                       \
     } while (0)
 
+/* The profiler's signal handler walks the continuation frames from
+   vm->cont (see Scm__VMRecordStack), so a frame must be filled before
+   it is linked to the chain.  The handler runs on the thread of the VM,
+   so we only need to keep the compiler from reordering the stores. */
+#define CONT_FRAME_BARRIER()  AO_compiler_barrier()
+
 /* Push a continuation frame.  next_pc is the PC from where execution
    will be resumed.  */
 #define PUSH_CONT(next_pc)                              \
@@ -509,6 +547,7 @@ static void vm_unregister(ScmVM *vm)
         newcont->cpc = PC;                              \
         newcont->pc = next_pc;                          \
         newcont->base = BASE;                           \
+        CONT_FRAME_BARRIER();                           \
         CONT = newcont;                                 \
         SP += CONT_FRAME_SIZE;                          \
         ARGP = SP;                                      \
@@ -773,6 +812,34 @@ static void vm_unregister(ScmVM *vm)
 #define CHECK_INTR \
     do { if (vm->attentionRequest) goto process_queue; } while (0)
 
+/* Baseline JIT (see jit.c).  JIT_ENTRY is placed where the control
+   enters a code vector---the start of a closure body and the
+   destination of JUMP and LOCAL-ENV-JUMP.  It counts the entries,
+   translates BASE when it gets hot, and if PC has native code, runs it
+   until it reaches an instruction it doesn't handle.  The entry table
+   is filled before it is published, so we don't need a barrier here
+   (we only have the JIT on x86-64).
+   COUNT_INSN_FREQUENCY needs to see every instruction, so we turn off
+   the JIT with it. */
+#if GAUCHE_JIT && !defined(COUNT_INSN_FREQUENCY)
+#define JIT_ENTRY                                                       \
+    do {                                                                \
+        void **e__ = BASE->jitEntries;                                  \
+        if (e__ == NULL) {                                              \
+            if (++BASE->jitCount < SCM_JIT_THRESHOLD) break;            \
+            e__ = Scm__JitCompile(vm, BASE);                            \
+            if (e__ == NULL) break;                                     \
+        }                                                               \
+        void *n__ = e__[PC - BASE->code];                               \
+        if (n__ != NULL) {                                              \
+            Scm__JitRun(vm, n__);                                       \
+            CHECK_INTR;                                                 \
+        }                                                               \
+    } while (0)
+#else
+#define JIT_ENTRY  /*empty*/
+#endif
+
 /* WNA - "Wrong Number of Arguments" handler.  The actual call is in vmcall.c.
    We handle the autocurrying magic here.
 
@@ -863,6 +930,139 @@ static void local_env_shift(ScmVM *vm, int env_depth)
     else           { ENV = tenv; }
 }
 
+#if GAUCHE_JIT
+void Scm__VMLocalEnvShift(ScmVM *vm, int env_depth)
+{
+    local_env_shift(vm, env_depth);
+}
+#endif /*GAUCHE_JIT*/
+
+/* type_feedback, type_deoptimize
+   Called from the generic arithmetic insns and their specialized versions
+   (see $type-feedback in vminsn.scm).
+
+   A generic insn such as NUMADD2 doesn't use its parameter field, so we
+   keep the profile of the site there: the number of consecutive executions
+   that have seen the same class of operands (both fixnums or both flonums),
+   the class, and how many times the site has been deoptimized.  Once the
+   count reaches FEEDBACK_THRESHOLD, type_feedback rewrites the insn word
+   to the specialized insn (e.g. NUMADD2-FIX), whose parameter field keeps
+   the deoptimization count.  When the specialized insn sees unexpected
+   operands, type_deoptimize rewrites it back to the generic insn.  If
+   the site sees other operands, changes the class, or is deoptimized too
+   many times, we set FEEDBACK_DONE to the profile and leave the site
+   generic.
+
+   The insn words may be rewritten by multiple threads concurrently, but
+   it doesn't matter---the update may be lost, but every possible word is
+   a valid insn for the site.
+ */
+#define FEEDBACK_THRESHOLD    32
+#define FEEDBACK_COUNT_MASK   0x3f
+#define FEEDBACK_FIX          (1L<<6)
+#define FEEDBACK_FLO          (2L<<6)
+#define FEEDBACK_CLASS_MASK   (3L<<6)
+#define FEEDBACK_DEOPT_SHIFT  8
+#define FEEDBACK_DEOPT_MAX    3
+#define FEEDBACK_DONE         (1L<<10)
+
+static void type_feedback(ScmVM *vm, ScmWord *pc, ScmObj x, ScmObj y,
+                          u_int fixcode, u_int flocode)
+{
+    u_int code = SCM_VM_INSN_CODE(*pc);
+    long prof = SCM_VM_INSN_ARG(*pc);
+    long klass = 0;
+
+    if (SCM_INTP(x) && SCM_INTP(y))            klass = FEEDBACK_FIX;
+    else if (SCM_FLONUMP(x) && SCM_FLONUMP(y)) klass = FEEDBACK_FLO;
+
+    if (klass == 0
+        || ((prof & FEEDBACK_CLASS_MASK) != 0
+            && (prof & FEEDBACK_CLASS_MASK) != klass)
+        || SCM_VM_RUNTIME_FLAG_IS_SET(vm, SCM_NO_TYPE_FEEDBACK)) {
+        *pc = SCM_VM_INSN1(code, FEEDBACK_DONE);
+    } else if ((prof & FEEDBACK_COUNT_MASK) + 1 >= FEEDBACK_THRESHOLD) {
+        *pc = SCM_VM_INSN1((klass == FEEDBACK_FIX)? fixcode : flocode,
+                           prof >> FEEDBACK_DEOPT_SHIFT);
+    } else {
+        *pc = SCM_VM_INSN1(code, (prof | klass) + 1);
+    }
+}
+
+static void type_deoptimize(ScmWord *pc, u_int generic)
+{
+    long ndeopt = SCM_VM_INSN_ARG(*pc) + 1;
+    if (ndeopt > FEEDBACK_DEOPT_MAX) {
+        *pc = SCM_VM_INSN1(generic, FEEDBACK_DONE);
+    } else {
+        *pc = SCM_VM_INSN1(generic, ndeopt << FEEDBACK_DEOPT_SHIFT);
+    }
+}
+
+/* fpstack_mark, fpstack_reset
+   Called from FPSTACK-MARK and FPSTACK-RESET insns, so that a flonum loop
+   (see pass5/embed-call in compile-5.scm) can reuse the same flonum
+   registers throughout the iterations.
+
+   fpstack_mark reserves N registers for the loop arguments, and returns
+   the mark, which is kept in the env frame as a hidden loop argument.
+
+   fpstack_reset is called at the back edge of the loop, where the stack
+   has the mark followed by the new loop arguments.  At this point, the
+   flonum registers allocated since the mark can only be referred from
+   those arguments and VAL0; the env and continuation frames made in the
+   iteration are about to be discarded, and the flonums that could
+   survive them are already moved to the heap.  So we copy the arguments
+   into the reserved registers and rewind fpsp just after them.
+   If fpstack has been flushed during the iteration, the mark doesn't
+   correspond to the current fpstack contents, but it is still safe:
+   all the registers allocated after the flush are either below fpsp
+   we set or the ones we move.
+ */
+#define FPSTACK_RESET_MAX  32
+
+static ScmObj fpstack_mark(ScmVM *vm, int n)
+{
+#if GAUCHE_FFX
+    if (vm->fpsp + n > vm->fpstackEnd) Scm_VMFlushFPStack(vm);
+    ScmObj mark = SCM_MAKE_INT(vm->fpsp - vm->fpstack);
+    vm->fpsp += n;
+    return mark;
+#else  /*!GAUCHE_FFX*/
+    return SCM_MAKE_INT(0);
+#endif /*!GAUCHE_FFX*/
+}
+
+static void fpstack_reset(ScmVM *vm)
+{
+#if GAUCHE_FFX
+    int nargs = (int)(SP - ARGP) - 1;
+    SCM_ASSERT(nargs >= 0 && SCM_INTP(*ARGP));
+    if (nargs > FPSTACK_RESET_MAX) return;
+
+    ScmFlonum *base = vm->fpstack + SCM_INT_VALUE(*ARGP);
+    ScmObj *args = ARGP + 1;
+    double vals[FPSTACK_RESET_MAX];
+
+    /* Read all values first, for the arguments may be swapped. */
+    for (int i=0; i<nargs; i++) {
+        if (SCM_FLONUM_REG_P(args[i]) && SCM_FLONUM(args[i]) >= base) {
+            vals[i] = SCM_FLONUM_VALUE(args[i]);
+        }
+    }
+    for (int i=0; i<nargs; i++) {
+        if (SCM_FLONUM_REG_P(args[i]) && SCM_FLONUM(args[i]) >= base) {
+            SCM_FLONUM_VALUE(base+i) = vals[i];
+            args[i] = SCM_MAKE_FLONUM_REG(base+i);
+        }
+    }
+    if (SCM_FLONUM_REG_P(VAL0) && SCM_FLONUM(VAL0) >= base) {
+        VAL0 = SCM_UNDEFINED;
+    }
+    vm->fpsp = base + nargs;
+#endif /*GAUCHE_FFX*/
+}
+
 
 /*===================================================================
  * Main loop of VM
@@ -1041,6 +1241,7 @@ static void save_cont(ScmVM *vm)
         }
 
         /* make the orig frame forwarded */
+        CONT_FRAME_BARRIER();
         if (prev) prev->prev = csave;
         prev = csave;
 
@@ -1436,6 +1637,7 @@ void Scm_VMPushCC(ScmCContinuationProc *after,
     cc->pc = (ScmWord*)after;
     cc->base = BASE;
     cc->env = &ccEnvMark;
+    CONT_FRAME_BARRIER();
     CONT = cc;
     ARGP = SP = s;
 }
@@ -2705,6 +2907,10 @@ static void process_queued_requests(ScmVM *vm)
        VM level. */
     if (vm->signalPending)   Scm_SigCheck(vm);
     if (vm->finalizerPending) Scm_VMFinalizerRun(vm);
+#ifdef GAUCHE_PROFILE
+    /* Profiler started by other thread wants us to arm our timer. */
+    if (vm->prof && vm->prof->timerRequest) Scm__ProfilerProcessRequest(vm);
+#endif
 
     /* VM STOP is required from other thread.
        See Scm_ThreadStop() in ext/threads/threads.c */
@@ -2769,6 +2975,26 @@ ScmObj Scm_VMGetStackLite(ScmVM *vm)
     return stack;
 }
 
+/* Records the code bases of the continuation frames to BUF, innermost
+   first, up to MAX entries, and returns the number of entries.
+   This is called from the profiler's signal handler, so it must not
+   allocate.
+   A C continuation frame and a boundary frame inherit the base of the
+   frame below, when the Scheme code calls a subr non-tail; we omit them
+   in that case so that the caller won't appear twice. */
+int Scm__VMRecordStack(ScmVM *vm, ScmWord *buf, int max)
+{
+    int n = 0;
+    for (ScmContFrame *c = vm->cont; c && n < max; c = c->prev) {
+        ScmCompiledCode *b = c->base;
+        if (b == NULL || b == &internal_apply_compiled_code) continue;
+        if ((C_CONTINUATION_P(c) || BOUNDARY_FRAME_P(c))
+            && c->prev && c->prev->base == b) continue;
+        buf[n++] = SCM_WORD(b);
+    }
+    return n;
+}
+
 /*
  * Call trace
  */
@@ -210,6 +210,7 @@
         CHECK_STACK(vm->base->maxstack);
         SCM_PROF_COUNT_CALL(vm, SCM_OBJ(vm->base));
         VAL0 = SCM_MAKE_INT(argc); /* keep argc to VAL0. */
+        JIT_ENTRY;
         NEXT;
     }
 
@@ -254,7 +255,28 @@
         }
       GENERIC_ENTRY:
         /* pure generic application.  we implement MOP in C. */
+#if !defined(APPLY_CALL)
+        {
+            /* See if we've seen the same call from here.  The cached
+               list is already sorted. */
+            u_long gen;
+            mm = Scm__CallSiteCacheLookup(vm->base, PC, SCM_GENERIC(VAL0),
+                                          ARGP, argc, &gen);
+            if (SCM_FALSEP(mm)) {
+                mm = Scm_ComputeApplicableMethods(SCM_GENERIC(VAL0),
+                                                  ARGP, argc, APP);
+                if (SCM_PAIRP(mm)) {
+                    if (SCM_PAIRP(SCM_CDR(mm))) {
+                        mm = Scm_SortMethods(mm, ARGP, argc);
+                    }
+                    Scm__CallSiteCacheStore(vm->base, PC, SCM_GENERIC(VAL0),
+                                            ARGP, argc, mm, gen);
+                }
+            }
+        }
+#else  /*APPLY_CALL*/
         mm = Scm_ComputeApplicableMethods(SCM_GENERIC(VAL0), ARGP, argc, APP);
+#endif /*APPLY_CALL*/
         if (!SCM_NULLP(mm)) {
             /* sort methods.  we only need as many args as
                gf->maxReqargs to order methods, so we only unfold that
@@ -280,9 +302,11 @@
                 for (int i=0;i<argc; i++, ap++) SCM_FLONUM_ENSURE_MEM(*ap);
             }
 #endif /*GAUCHE_FFX*/
+#if defined(APPLY_CALL)
             if (SCM_PAIRP(SCM_CDR(mm))) {
                 mm = Scm_SortMethods(mm, ARGP, argc);
             }
+#endif /*APPLY_CALL*/
             if (SCM_METHOD_LEAF_P(SCM_CAR(mm))) {
                 nm = SCM_TRUE;  /* Dummy */
             } else {
@@ -0,0 +1,7 @@
+;;;
+;;; vminsn-synth.scm - Synthesized combined instructions
+;;;
+;;; Generated by gen-superinsn.scm from the instruction statistics.
+;;; Don't edit this file, except removing insns; see gen-superinsn.scm.
+;;; This file is included from vminsn.scm.
+;;;
@@ -82,6 +82,12 @@
 ;;;                         of having LREF0-SOMETHING or LREF21-SOMETHING
 ;;;                         separately, we'll have LREF-SOMETHING(0,0) and
 ;;;                         LREF-SOMETHING(2,1), respectively.
+;;;
+;;; (include-insns <file>)
+;;;
+;;;   Reads the insn definitions in <file>, relative to this file.
+;;;   It is used to include vminsn-synth.scm, which is generated by
+;;;   gen-superinsn.scm.
 
 ;;;==============================================================
 ;;; Common Cise macros
@@ -292,6 +298,55 @@
                  (set! ,r (,cmp ,x ,y))])
           ,@body)))])
 
+;;
+;; ($type-feedback insn)
+;;   Type feedback of a generic arithmetic insn INSN, which takes operands
+;;   from the stack top and VAL0.  Records the operand types in the
+;;   parameter field of the insn word, and eventually rewrites it to
+;;   INSN-FIX or INSN-FLO.  See type_feedback() in vm.c.
+;;   The profile is only kept when INSN itself is executed, so we emit
+;;   nothing for the variations that take operands from elsewhere, and
+;;   check the insn code at runtime to exclude the combined insns.
+(define-cise-stmt $type-feedback
+  [(_ insn)
+   (if (arg-source)
+     '(begin)
+     (let1 c-name (^[suffix] (string->symbol (c-insn-name #"~|insn|~|suffix|")))
+       `(when (and (== (SCM_VM_INSN_CODE code) ,(c-name ""))
+                   (< (SCM_VM_INSN_ARG code) FEEDBACK_DONE))
+          (type_feedback vm (- PC 1) (* (- SP 1)) VAL0
+                         ,(c-name "-FIX") ,(c-name "-FLO")))))])
+
+;;
+;; ($w/specialized insn pred x . body)
+;;   Common part of the specialized versions of a generic insn INSN.
+;;   If both operands, the stack top and VAL0, satisfy PRED, pops the
+;;   stack top to X and executes BODY.  Otherwise, rewrites the insn back
+;;   to INSN and jumps to it.
+(define-cise-stmt $w/specialized
+  [(_ insn pred x . body)
+   `(let* ([,x (* (- SP 1))])
+      (cond [(and (,pred ,x) (,pred VAL0))
+             (set! SP (- SP 1))
+             ,@body]
+            [else
+             (type_deoptimize (- PC 1) ,(string->symbol (c-insn-name insn)))
+             ($goto-insn ,insn)]))])
+
+;;
+;; ($w/specialized-numcmp insn pred r op . body)
+;;   Specialized version of $w/numcmp.
+(define-cise-stmt $w/specialized-numcmp
+  [(_ insn pred r op . body)
+   (let1 x (gensym)
+     `($w/specialized ,insn ,pred ,x
+        (let* ([,r :: int
+                   ,(if (eq? pred 'SCM_INTP)
+                      `(,op (cast (signed long) (cast intptr_t ,x))
+                            (cast (signed long) (cast intptr_t VAL0)))
+                      `(,op (SCM_FLONUM_VALUE ,x) (SCM_FLONUM_VALUE VAL0)))])
+          ,@body)))])
+
 ;;
 ;; ($undef var)
 ;; ($define var)
@@ -426,7 +481,7 @@
 ;;  Jump to <addr>.
 ;;
 (define-insn JUMP      0 addr #f
-  (begin (FETCH-LOCATION PC) CHECK-INTR NEXT))
+  (begin (FETCH-LOCATION PC) CHECK-INTR JIT-ENTRY NEXT))
 
 ;; RET
 ;;  Pop the continuation stack.
@@ -527,6 +582,7 @@
     (local_env_shift vm (SCM_VM_INSN_ARG code))
     (FETCH-LOCATION PC)
     CHECK-INTR
+    JIT-ENTRY
     NEXT))
 
 ;; LOCAL-ENV-CALL(depth)
@@ -554,6 +610,7 @@
     (CHECK-STACK (-> vm base maxstack))
     CHECK-INTR
     (SCM_PROF_COUNT_CALL vm (SCM_OBJ (-> vm base)))
+    JIT-ENTRY
     NEXT))
 
 (define-insn LOCAL-ENV-TAIL-CALL 1 none #f
@@ -591,10 +648,14 @@
 
 (define-insn BNUMNE  0 addr #f (let* ((y VAL0))
                                  ($w/argp x ($branch* (not (Scm_NumEq x y))))))
-(define-insn BNLT    0 addr #f ($w/numcmp r <  ($branch* (not r))))
-(define-insn BNLE    0 addr #f ($w/numcmp r <= ($branch* (not r))))
-(define-insn BNGT    0 addr #f ($w/numcmp r >  ($branch* (not r))))
-(define-insn BNGE    0 addr #f ($w/numcmp r >= ($branch* (not r))))
+(define-insn BNLT    0 addr #f
+  (begin ($type-feedback BNLT) ($w/numcmp r <  ($branch* (not r)))))
+(define-insn BNLE    0 addr #f
+  (begin ($type-feedback BNLE) ($w/numcmp r <= ($branch* (not r)))))
+(define-insn BNGT    0 addr #f
+  (begin ($type-feedback BNGT) ($w/numcmp r >  ($branch* (not r)))))
+(define-insn BNGE    0 addr #f
+  (begin ($type-feedback BNGE) ($w/numcmp r >= ($branch* (not r)))))
 
 ;; Compare LREF(n,m) and VAL0 and branch.  This is not a simple combination
 ;; of LREF + BNLT etc. (which would compare stack top and LREF).  These insns
@@ -1171,38 +1232,48 @@
       ($result:b (== (SCM_FLONUM_VALUE VAL0) (SCM_FLONUM_VALUE arg)))]
      [else ($result:b (Scm_NumEq arg VAL0))])))
 
-(define-insn NUMLT2  0 none #f ($w/numcmp r <  ($result:b r)))
-(define-insn NUMLE2  0 none #f ($w/numcmp r <= ($result:b r)))
-(define-insn NUMGT2  0 none #f ($w/numcmp r >  ($result:b r)))
-(define-insn NUMGE2  0 none #f ($w/numcmp r >= ($result:b r)))
+(define-insn NUMLT2  0 none #f
+  (begin ($type-feedback NUMLT2) ($w/numcmp r <  ($result:b r))))
+(define-insn NUMLE2  0 none #f
+  (begin ($type-feedback NUMLE2) ($w/numcmp r <= ($result:b r))))
+(define-insn NUMGT2  0 none #f
+  (begin ($type-feedback NUMGT2) ($w/numcmp r >  ($result:b r))))
+(define-insn NUMGE2  0 none #f
+  (begin ($type-feedback NUMGE2) ($w/numcmp r >= ($result:b r))))
 
 (define-insn NUMADD2 0 none #f          ; +
-  ($w/argp arg
-    (cond
-     [(and (SCM_INTP arg) (SCM_INTP VAL0))
-      ($result:n (+ (SCM_INT_VALUE arg) (SCM_INT_VALUE VAL0)))]
-     [(and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
-      ($result:f (+ (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))]
-     [else ($result (Scm_Add arg VAL0))])))
+  (begin
+    ($type-feedback NUMADD2)
+    ($w/argp arg
+      (cond
+       [(and (SCM_INTP arg) (SCM_INTP VAL0))
+        ($result:n (+ (SCM_INT_VALUE arg) (SCM_INT_VALUE VAL0)))]
+       [(and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
+        ($result:f (+ (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))]
+       [else ($result (Scm_Add arg VAL0))]))))
 
 (define-insn NUMSUB2 0 none #f          ; -  (binary)
-  ($w/argp arg
-    (cond
-     [(and (SCM_INTP arg) (SCM_INTP VAL0))
-      ($result:n (- (SCM_INT_VALUE arg) (SCM_INT_VALUE VAL0)))]
-     [(and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
-      ($result:f (- (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))]
-     [else ($result (Scm_Sub arg VAL0))])))
+  (begin
+    ($type-feedback NUMSUB2)
+    ($w/argp arg
+      (cond
+       [(and (SCM_INTP arg) (SCM_INTP VAL0))
+        ($result:n (- (SCM_INT_VALUE arg) (SCM_INT_VALUE VAL0)))]
+       [(and (SCM_FLONUMP arg) (SCM_FLONUMP VAL0))
+        ($result:f (- (SCM_FLONUM_VALUE arg) (SCM_FLONUM_VALUE VAL0)))]
+       [else ($result (Scm_Sub arg VAL0))]))))
 
 (define-insn NUMMUL2 0 none #f          ; *
-  ($w/argp arg
-    ;; we take a shortcut if either one is flonum and the
-    ;; other is real.  (if both are integers, the overflow check
-    ;; would be cumbersome so we just call Scm_Mul).
-    (if (or (and (SCM_FLONUMP arg) (SCM_REALP VAL0))
-            (and (SCM_FLONUMP VAL0) (SCM_REALP arg)))
-      ($result:f (* (Scm_GetDouble arg) (Scm_GetDouble VAL0)))
-      ($result (Scm_Mul arg VAL0)))))
+  (begin
+    ($type-feedback NUMMUL2)
+    ($w/argp arg
+      ;; we take a shortcut if either one is flonum and the
+      ;; other is real.  (if both are integers, the overflow check
+      ;; would be cumbersome so we just call Scm_Mul).
+      (if (or (and (SCM_FLONUMP arg) (SCM_REALP VAL0))
+              (and (SCM_FLONUMP VAL0) (SCM_REALP arg)))
+        ($result:f (* (Scm_GetDouble arg) (Scm_GetDouble VAL0)))
+        ($result (Scm_Mul arg VAL0))))))
 
 (define-insn NUMDIV2 0 none #f          ; / (binary)
   ($w/argp arg
@@ -1438,3 +1509,94 @@
     (local_env_shift vm (SCM_VM_INSN_ARG code))
     NEXT))
 
+;; FPSTACK-MARK(nargs)
+;;  Appears at the entry of a flonum loop (see pass5/embed-call), and
+;;  at its non-tail jump calls.  Reserves NARGS flonum registers for
+;;  the loop arguments, and pushes the mark, which becomes the hidden
+;;  first argument of the loop.
+(define-insn FPSTACK-MARK 1 none #f
+  (let* ([mark (fpstack_mark vm (SCM_VM_INSN_ARG code))])
+    (CHECK-STACK-PARANOIA 1)
+    (PUSH-ARG mark)
+    NEXT))
+
+;; FPSTACK-RESET
+;;  Appears before LOCAL-ENV-JUMP at the back edge of a flonum loop.
+;;  The stack has the mark and the new loop arguments.  Moves the
+;;  flonum arguments to the registers reserved by FPSTACK-MARK, and
+;;  discards the flonum registers allocated during the iteration.
+(define-insn FPSTACK-RESET 0 none #f
+  (begin (fpstack_reset vm) NEXT))
+;; NUMADD2-FIX, NUMADD2-FLO, NUMSUB2-FIX, ...
+;;  Specialized versions of the generic arithmetic insns.  The compiler
+;;  never emits them; the VM rewrites a generic insn to one of them when
+;;  the insn has seen only fixnums (-FIX) or flonums (-FLO) as operands
+;;  for a while (see $type-feedback).  If the operands don't match,
+;;  the insn is rewritten back to the generic one (see $w/specialized).
+(define-insn NUMADD2-FIX 0 none #f
+  ($w/specialized NUMADD2 SCM_INTP x
+    ($result:n (+ (SCM_INT_VALUE x) (SCM_INT_VALUE VAL0)))))
+(define-insn NUMADD2-FLO 0 none #f
+  ($w/specialized NUMADD2 SCM_FLONUMP x
+    ($result:f (+ (SCM_FLONUM_VALUE x) (SCM_FLONUM_VALUE VAL0)))))
+(define-insn NUMSUB2-FIX 0 none #f
+  ($w/specialized NUMSUB2 SCM_INTP x
+    ($result:n (- (SCM_INT_VALUE x) (SCM_INT_VALUE VAL0)))))
+(define-insn NUMSUB2-FLO 0 none #f
+  ($w/specialized NUMSUB2 SCM_FLONUMP x
+    ($result:f (- (SCM_FLONUM_VALUE x) (SCM_FLONUM_VALUE VAL0)))))
+(define-insn NUMMUL2-FIX 0 none #f
+  ($w/specialized NUMMUL2 SCM_INTP x
+    (let* ([v0::long (SCM_INT_VALUE x)] [v1::long (SCM_INT_VALUE VAL0)]
+           [k::long 0] [ov::int 0])
+      (SMULOV k ov v0 v1)
+      (if (or ov (not (SCM_SMALL_INT_FITS k)))
+        ($result (Scm_Mul x VAL0))
+        ($result (SCM_MAKE_INT k))))))
+(define-insn NUMMUL2-FLO 0 none #f
+  ($w/specialized NUMMUL2 SCM_FLONUMP x
+    ($result:f (* (SCM_FLONUM_VALUE x) (SCM_FLONUM_VALUE VAL0)))))
+
+(define-insn NUMLT2-FIX 0 none #f
+  ($w/specialized-numcmp NUMLT2 SCM_INTP r <  ($result:b r)))
+(define-insn NUMLT2-FLO 0 none #f
+  ($w/specialized-numcmp NUMLT2 SCM_FLONUMP r <  ($result:b r)))
+(define-insn NUMLE2-FIX 0 none #f
+  ($w/specialized-numcmp NUMLE2 SCM_INTP r <= ($result:b r)))
+(define-insn NUMLE2-FLO 0 none #f
+  ($w/specialized-numcmp NUMLE2 SCM_FLONUMP r <= ($result:b r)))
+(define-insn NUMGT2-FIX 0 none #f
+  ($w/specialized-numcmp NUMGT2 SCM_INTP r >  ($result:b r)))
+(define-insn NUMGT2-FLO 0 none #f
+  ($w/specialized-numcmp NUMGT2 SCM_FLONUMP r >  ($result:b r)))
+(define-insn NUMGE2-FIX 0 none #f
+  ($w/specialized-numcmp NUMGE2 SCM_INTP r >= ($result:b r)))
+(define-insn NUMGE2-FLO 0 none #f
+  ($w/specialized-numcmp NUMGE2 SCM_FLONUMP r >= ($result:b r)))
+
+(define-insn BNLT-FIX 0 addr #f
+  ($w/specialized-numcmp BNLT SCM_INTP r <  ($branch* (not r))))
+(define-insn BNLT-FLO 0 addr #f
+  ($w/specialized-numcmp BNLT SCM_FLONUMP r <  ($branch* (not r))))
+(define-insn BNLE-FIX 0 addr #f
+  ($w/specialized-numcmp BNLE SCM_INTP r <= ($branch* (not r))))
+(define-insn BNLE-FLO 0 addr #f
+  ($w/specialized-numcmp BNLE SCM_FLONUMP r <= ($branch* (not r))))
+(define-insn BNGT-FIX 0 addr #f
+  ($w/specialized-numcmp BNGT SCM_INTP r >  ($branch* (not r))))
+(define-insn BNGT-FLO 0 addr #f
+  ($w/specialized-numcmp BNGT SCM_FLONUMP r >  ($branch* (not r))))
+(define-insn BNGE-FIX 0 addr #f
+  ($w/specialized-numcmp BNGE SCM_INTP r >= ($branch* (not r))))
+(define-insn BNGE-FLO 0 addr #f
+  ($w/specialized-numcmp BNGE SCM_FLONUMP r >= ($branch* (not r))))
+
+
+;;;==============================================================
+;;; Synthesized insns
+;;;
+
+;; Combined insns selected from the instruction statistics by
+;; gen-superinsn.scm.  They must come after all the other insns, so that
+;; adding them doesn't change the existing insn codes.
+(include-insns "vminsn-synth.scm")
@@ -34,32 +34,98 @@
 /* This file is included from vm.c */
 
 #ifdef COUNT_INSN_FREQUENCY
+#include <fcntl.h>             /* for O_APPEND etc. */
+
 /* for statistics */
+
+/* insn2_freq and insn3_freq only count sequences of instructions
+   where the control falls through from one to the next, that is, the
+   ones that are adjacent in the same code vector.  Those are the
+   candidates for combined instructions; see gen-superinsn.scm. */
 static u_long insn1_freq[SCM_VM_NUM_INSNS];
 static u_long insn2_freq[SCM_VM_NUM_INSNS][SCM_VM_NUM_INSNS];
 
+/* Triples are sparse, so we keep them in a fixed-size open addressing
+   table.  Once it fills up we count the misses in insn3_dropped. */
+#define INSN3_TABLE_SIZE 65536  /* must be a power of 2 */
+static struct {
+    u_long key;                 /* 0 for an empty entry */
+    u_long count;
+} insn3_freq[INSN3_TABLE_SIZE];
+static u_long insn3_dropped;
+
+/* The last instruction executed, and the one before it if the control
+   fell through from it (-1 otherwise).  We don't bother to make them
+   thread-local; the statistics are approximate anyway. */
+static ScmCompiledCode *prev_base = NULL;
+static ScmWord *prev_pc = NULL;
+static int prev_code = -1;
+static int prev2_code = -1;
+
 #define LREF_FREQ_COUNT_MAX 10
 static u_long lref_freq[LREF_FREQ_COUNT_MAX][LREF_FREQ_COUNT_MAX];
 static u_long lset_freq[LREF_FREQ_COUNT_MAX][LREF_FREQ_COUNT_MAX];
 
-static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
+/* Number of words an instruction occupies in the code vector. */
+static int insn_words(int code)
 {
-    if (vm->base && vm->pc != vm->base->code) {
-        insn2_freq[SCM_VM_INSN_CODE(code)][SCM_VM_INSN_CODE(*vm->pc)]++;
+    switch (Scm_VMInsnOperandType(code)) {
+    case SCM_VM_OPERAND_NONE:     return 1;
+    case SCM_VM_OPERAND_OBJ_ADDR: return 3;
+    default:                      return 2;
+    }
+}
+
+static void count_insn3(int c0, int c1, int c2)
+{
+    u_long key = ((u_long)c0*SCM_VM_NUM_INSNS + c1)*SCM_VM_NUM_INSNS + c2 + 1;
+    u_long h = (key * 2654435761UL) & (INSN3_TABLE_SIZE-1);
+
+    for (int i=0; i<INSN3_TABLE_SIZE; i++) {
+        if (insn3_freq[h].key == key) {
+            insn3_freq[h].count++;
+            return;
+        }
+        if (insn3_freq[h].key == 0) {
+            insn3_freq[h].key = key;
+            insn3_freq[h].count = 1;
+            return;
+        }
+        h = (h+1) & (INSN3_TABLE_SIZE-1);
     }
+    insn3_dropped++;
+}
+
+static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
+{
+    ScmWord *pc = vm->pc;
     code = *vm->pc++;
-    insn1_freq[SCM_VM_INSN_CODE(code)]++;
-    switch (SCM_VM_INSN_CODE(code)) {
-    case SCM_VM_LREF0: lref_freq[0][0]++; break;
-    case SCM_VM_LREF1: lref_freq[0][1]++; break;
-    case SCM_VM_LREF2: lref_freq[0][2]++; break;
-    case SCM_VM_LREF3: lref_freq[0][3]++; break;
-    case SCM_VM_LREF4: lref_freq[0][4]++; break;
+
+    int c = SCM_VM_INSN_CODE(code);
+    insn1_freq[c]++;
+    if (prev_code >= 0 && vm->base == prev_base
+        && pc == prev_pc + insn_words(prev_code)) {
+        insn2_freq[prev_code][c]++;
+        if (prev2_code >= 0) count_insn3(prev2_code, prev_code, c);
+        prev2_code = prev_code;
+    } else {
+        prev2_code = -1;
+    }
+    prev_base = vm->base;
+    prev_pc = pc;
+    prev_code = c;
+
+    switch (c) {
+    case SCM_VM_LREF0:  lref_freq[0][0]++; break;
+    case SCM_VM_LREF1:  lref_freq[0][1]++; break;
+    case SCM_VM_LREF2:  lref_freq[0][2]++; break;
+    case SCM_VM_LREF3:  lref_freq[0][3]++; break;
     case SCM_VM_LREF10: lref_freq[1][0]++; break;
     case SCM_VM_LREF11: lref_freq[1][1]++; break;
     case SCM_VM_LREF12: lref_freq[1][2]++; break;
-    case SCM_VM_LREF13: lref_freq[1][3]++; break;
-    case SCM_VM_LREF14: lref_freq[1][4]++; break;
+    case SCM_VM_LREF20: lref_freq[2][0]++; break;
+    case SCM_VM_LREF21: lref_freq[2][1]++; break;
+    case SCM_VM_LREF30: lref_freq[3][0]++; break;
     case SCM_VM_LREF:
     {
         int dep = SCM_VM_INSN_ARG0(code);
@@ -69,11 +135,6 @@ static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
         lref_freq[dep][off]++;
         break;
     }
-    case SCM_VM_LSET0: lset_freq[0][0]++; break;
-    case SCM_VM_LSET1: lset_freq[0][1]++; break;
-    case SCM_VM_LSET2: lset_freq[0][2]++; break;
-    case SCM_VM_LSET3: lset_freq[0][3]++; break;
-    case SCM_VM_LSET4: lset_freq[0][4]++; break;
     case SCM_VM_LSET:
     {
         int dep = SCM_VM_INSN_ARG0(code);
@@ -87,34 +148,59 @@ static ScmWord fetch_insn_counting(ScmVM *vm, ScmWord code)
     return code;
 }
 
-static void dump_insn_frequency(void *data)
+/* The statistics are written to the current output port, or appended
+   to the file named by the environment variable
+   GAUCHE_INSN_FREQUENCY_FILE if it is set.  The latter is used to
+   accumulate the statistics over a benchmark corpus. */
+static void dump_insn_frequency(void *data SCM_UNUSED)
 {
-    Scm_Printf(SCM_CUROUT, "(:instruction-frequencies (");
+    ScmObj out = SCM_OBJ(SCM_CUROUT);
+    const char *file = Scm_GetEnv("GAUCHE_INSN_FREQUENCY_FILE");
+    if (file != NULL) {
+        out = Scm_OpenFilePort(file, O_WRONLY|O_CREAT|O_APPEND,
+                               SCM_PORT_BUFFER_FULL, 0666);
+        if (SCM_FALSEP(out)) return;
+    }
+
+    Scm_Printf(SCM_PORT(out), "(:instruction-frequencies (");
     for (int i=0; i<SCM_VM_NUM_INSNS; i++) {
-        Scm_Printf(SCM_CUROUT, "(%s %d", Scm_VMInsnName(i), insn1_freq[i]);
+        Scm_Printf(SCM_PORT(out), "(%s %lu", Scm_VMInsnName(i), insn1_freq[i]);
         for (int j=0; j<SCM_VM_NUM_INSNS; j++) {
-            Scm_Printf(SCM_CUROUT, " %d", insn2_freq[i][j]);
+            Scm_Printf(SCM_PORT(out), " %lu", insn2_freq[i][j]);
         }
-        Scm_Printf(SCM_CUROUT, ")\n");
+        Scm_Printf(SCM_PORT(out), ")\n");
+    }
+    Scm_Printf(SCM_PORT(out), ")\n :triple-frequencies (");
+    for (int i=0; i<INSN3_TABLE_SIZE; i++) {
+        u_long key = insn3_freq[i].key;
+        if (key == 0) continue;
+        key--;
+        Scm_Printf(SCM_PORT(out), "(%s %s %s %lu)\n",
+                   Scm_VMInsnName(key/(SCM_VM_NUM_INSNS*SCM_VM_NUM_INSNS)),
+                   Scm_VMInsnName((key/SCM_VM_NUM_INSNS)%SCM_VM_NUM_INSNS),
+                   Scm_VMInsnName(key%SCM_VM_NUM_INSNS),
+                   insn3_freq[i].count);
     }
-    Scm_Printf(SCM_CUROUT, ")\n :lref-frequencies (");
+    Scm_Printf(SCM_PORT(out), ")\n :triple-dropped %lu", insn3_dropped);
+    Scm_Printf(SCM_PORT(out), "\n :lref-frequencies (");
     for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
-        Scm_Printf(SCM_CUROUT, "(");
+        Scm_Printf(SCM_PORT(out), "(");
         for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
-            Scm_Printf(SCM_CUROUT, "%d ", lref_freq[i][j]);
+            Scm_Printf(SCM_PORT(out), "%lu ", lref_freq[i][j]);
         }
-        Scm_Printf(SCM_CUROUT, ")\n");
+        Scm_Printf(SCM_PORT(out), ")\n");
     }
-    Scm_Printf(SCM_CUROUT, ")\n :lset-frequencies (");
+    Scm_Printf(SCM_PORT(out), ")\n :lset-frequencies (");
     for (int i=0; i<LREF_FREQ_COUNT_MAX; i++) {
-        Scm_Printf(SCM_CUROUT, "(");
+        Scm_Printf(SCM_PORT(out), "(");
         for (int j=0; j<LREF_FREQ_COUNT_MAX; j++) {
-            Scm_Printf(SCM_CUROUT, "%d ", lset_freq[i][j]);
+            Scm_Printf(SCM_PORT(out), "%lu ", lset_freq[i][j]);
         }
-        Scm_Printf(SCM_CUROUT, ")\n");
+        Scm_Printf(SCM_PORT(out), ")\n");
     }
-    Scm_Printf(SCM_CUROUT, ")\n");
-    Scm_Printf(SCM_CUROUT, ")\n");
+    Scm_Printf(SCM_PORT(out), ")\n");
+    Scm_Printf(SCM_PORT(out), ")\n");
+    if (file != NULL) Scm_ClosePort(SCM_PORT(out));
 }
 
 #endif /*COUNT_INSN_FREQUENCY*/
@@ -36,6 +36,18 @@
 
 (test-basics (make-hash-table 'eq?))
 
+(test-section "concurrent-hash-table as dictionary")
+
+(test-basics (make-concurrent-hash-table 'eq?))
+
+(let1 h (make-concurrent-hash-table 'eqv?)
+  (test* "update!/push!" '(1 (x))
+         (begin (dict-update! h 1 (cut + <> 1) 0)
+                (dict-push! h 2 'x)
+                (list (dict-get h 1) (dict-get h 2))))
+  (test* "keys" '(1 2) (sort (dict-keys h)))
+  (test* "clear!" '() (begin (dict-clear! h) (dict->alist h))))
+
 (test-section "tree-map as dictionary")
 
 (test-basics
@@ -3,7 +3,8 @@
 ;;
 
 
-;; As of 0.9.7, dispatcher is on for 'ref' and 'object-apply'.
+;; As of 0.9.7, dispatcher is on for 'ref' and 'object-apply', and
+;; other gfs get one automatically once they're called often enough.
 ;; It can be turned off by setting GAUCHE_DISABLE_GENERIC_DISPATCHER env var
 ;; at the initialization.  Run this script with and without it 
 
@@ -68,12 +69,12 @@
   )
 
 (define (main args)
-  (print "With dispatcher")
-  (bench)
-  ((with-module gauche.object generic-invalidate-dispatcher!) ref)
-  ((with-module gauche.object generic-invalidate-dispatcher!) object-apply)
-  (print "Without dispatcher")
+  (print (if (sys-getenv "GAUCHE_DISABLE_GENERIC_DISPATCHER")
+           "Without dispatcher"
+           "With dispatcher"))
   (bench)
+  (print "ref dispatcher: "
+         ((with-module gauche.object generic-dispatcher-info) ref))
   )
 
 #|
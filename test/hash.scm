@@ -403,6 +403,55 @@
                 (iota 20))
     (every (cut hash-table-contains? h <> ) (iota 20))))
 
+;; Exercise growth and tombstones of open-addressing tables
+(let ()
+  (define (churn type keygen)
+    (let1 h (make-hash-table type)
+      (dotimes [i 2000] (hash-table-put! h (keygen i) i))
+      (dotimes [i 2000] (when (odd? i) (hash-table-delete! h (keygen i))))
+      (dotimes [i 1000] (hash-table-put! h (keygen (+ i 2000)) i))
+      (and (= (hash-table-num-entries h) 2000)
+           (every (^i (eqv? (hash-table-get h (keygen i) #f)
+                            (cond [(>= i 2000) (- i 2000)]
+                                  [(odd? i) #f]
+                                  [else i])))
+                  (iota 3000))
+           (= (length (hash-table-keys h)) 2000))))
+  (test* "insert/delete churn (eq?)" #t
+         (let1 syms (list->vector (map (^i (string->symbol #"k~i")) (iota 3000)))
+           (churn 'eq? (cut vector-ref syms <>))))
+  (test* "insert/delete churn (eqv?)" #t
+         (churn 'eqv? (^i (* i 1.5))))
+  (test* "insert/delete churn (string=?)" #t
+         (churn 'string=? number->string))
+  (test* "delete during iteration" '()
+         (let1 h (make-hash-table 'eqv?)
+           (dotimes [i 100] (hash-table-put! h i i))
+           (hash-table-for-each h (^[k v] (hash-table-delete! h k)))
+           (hash-table-keys h)))
+  (test* "insertion during iteration" '((0 1 2 3 4 5 6 7 8 9) 20)
+         (let ([h (make-hash-table 'eqv?)]
+               [seen '()])
+           (dotimes [i 10] (hash-table-put! h i i))
+           (hash-table-for-each h (^[k v]
+                                    (when (< k 1000)
+                                      (push! seen k)
+                                      (hash-table-put! h (+ k 1000) v))))
+           (list (sort seen) (hash-table-num-entries h))))
+  (test* "update! with rehash in proc" '(0 100)
+         (let1 h (make-hash-table 'eqv?)
+           (hash-table-update! h 'x (^v (dotimes [i 100]
+                                          (hash-table-put! h i i))
+                                        (+ v 100))
+                               0)
+           (list (hash-table-get h 0) (hash-table-get h 'x))))
+  (test* "update! with deletion in proc" #f
+         (let1 h (make-hash-table 'eqv?)
+           (hash-table-put! h 'x 1)
+           (hash-table-update! h 'x (^v (hash-table-delete! h 'x) (+ v 1)))
+           (hash-table-exists? h 'x)))
+  )
+
 ;;------------------------------------------------------------------
 (test-section "iterators")
 
@@ -498,7 +547,63 @@
          (hash-table=? (make-comparator number? (^[a b] (= (abs a) (abs b)))
                                         #f #f)
                        c d)))
-              
+
+;;------------------------------------------------------------------
+(test-section "concurrent hash table")
+
+(let1 h (make-concurrent-hash-table 'equal?)
+  (test* "concurrent-hash-table?" '(#t #f)
+         (list (concurrent-hash-table? h)
+               (concurrent-hash-table? (make-hash-table))))
+  (test* "type" 'equal? (concurrent-hash-table-type h))
+  (test* "put!/get" '(1 2 none)
+         (begin
+           (concurrent-hash-table-put! h '(a) 1)
+           (concurrent-hash-table-put! h "b" 2)
+           (list (concurrent-hash-table-get h '(a))
+                 (concurrent-hash-table-get h "b")
+                 (concurrent-hash-table-get h 'c 'none))))
+  (test* "get w/o fallback" (test-error)
+         (concurrent-hash-table-get h 'c))
+  (test* "adjoin!/replace!" '(1 #f)
+         (begin
+           (concurrent-hash-table-adjoin! h '(a) 10)
+           (concurrent-hash-table-replace! h 'c 3)
+           (list (concurrent-hash-table-get h '(a))
+                 (concurrent-hash-table-exists? h 'c))))
+  (test* "update!" '(11 5)
+         (begin
+           (concurrent-hash-table-update! h '(a) (cut + <> 10))
+           (concurrent-hash-table-update! h 'c (cut + <> 5) 0)
+           (list (concurrent-hash-table-get h '(a))
+                 (concurrent-hash-table-get h 'c))))
+  (test* "push!/pop!" '(y x none)
+         (begin
+           (concurrent-hash-table-push! h 'l 'x)
+           (concurrent-hash-table-push! h 'l 'y)
+           (list (concurrent-hash-table-pop! h 'l)
+                 (concurrent-hash-table-pop! h 'l)
+                 (concurrent-hash-table-pop! h 'l 'none))))
+  (test* "delete!" '(#t #f 4)
+         (list (concurrent-hash-table-delete! h 'c)
+               (concurrent-hash-table-delete! h 'c)
+               (concurrent-hash-table-num-entries h)))
+  (test* "->alist" '(("b" . 2) ((a) . 11) (l))
+         (concurrent-hash-table->alist h)
+         (cut lset= equal? <> <>))
+  (test* "fold" 13
+         (concurrent-hash-table-fold h (^[k v s] (if (number? v) (+ v s) s))
+                                     0))
+  (test* "clear!" '(0 ())
+         (begin
+           (concurrent-hash-table-clear! h)
+           (list (concurrent-hash-table-num-entries h)
+                 (concurrent-hash-table-keys h)))))
+
+(test* "concurrent string table rejects non-string key" (test-error)
+       (concurrent-hash-table-put! (make-concurrent-hash-table 'string=?)
+                                   'a 1))
+
 (test-module 'gauche.hashutil) ; autoloaded module
 
 (test-end)
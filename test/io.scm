@@ -103,6 +103,19 @@
              :if-exists #f)
            (call-with-input-file "tmp2.o" read)))
 
+;; The registry of active buffered output ports grows as needed.
+(test* "flush-all-ports with many open ports" (* 300 6)
+       (begin
+         (sys-unlink "tmp2.o")
+         (let1 ps (list-tabulate 300
+                                 (^_ (open-output-file "tmp2.o"
+                                                       :if-exists :append
+                                                       :buffering :full)))
+           (for-each (^p (display "abcdef" p)) ps)
+           (flush-all-ports)
+           (begin0 (string-size (call-with-input-file "tmp2.o" port->string))
+             (for-each close-output-port ps)))))
+
 ;;-------------------------------------------------------------------
 (test-section "port-attributes")
 
@@ -291,6 +304,44 @@
                (and (eof-object? s3)
                     (list (string-size s1) (string-size s2)))))))
 
+(with-output-to-file "tmp1.o" (cut display "a\u3042b\nc\u3044"))
+(test* "read-string" '("a\u3042" "b\nc" "\u3044" #t)
+       (call-with-input-file "tmp1.o"
+         (^p (let* ([s1 (read-string 2 p)]
+                    [s2 (read-string 3 p)]
+                    [s3 (read-string 5 p)]
+                    [s4 (read-string 1 p)])
+               (list s1 s2 s3 (eof-object? s4))))))
+(test* "read-string (ungotten)" '(#\a "a\u3042b" 2)
+       (call-with-input-file "tmp1.o"
+         (^p (let* ([c (peek-char p)]
+                    [s (read-string 3 p)]
+                    [_ (read-string 2 p)])
+               (list c s (port-current-line p))))))
+(test* "read-string (zero)" ""
+       (call-with-input-string "abc" (cut read-string 0 <>)))
+
+;; Long multibyte lines cross the buffer boundary at various positions.
+(let1 lines (list-tabulate 50 (^i (make-string (* i 211) (integer->char (+ #x3041 i)))))
+  (with-output-to-file "tmp1.o" (^() (for-each (^l (display l) (newline)) lines)))
+  (test* "read-line (long multibyte lines)" lines
+         (call-with-input-file "tmp1.o" port->string-list :buffering :full))
+  (test* "read-string (long multibyte lines)" (apply string-append
+                                                     (map (cut string-append <> "\n") lines))
+         (call-with-input-file "tmp1.o"
+           (^p (let loop ([r '()])
+                 (let1 s (read-string 997 p)
+                   (if (eof-object? s)
+                     (apply string-append (reverse r))
+                     (loop (cons s r))))))))
+  (test* "port-current-line after read-string" 51
+         (call-with-input-file "tmp1.o"
+           (^p (read-string 1000000 p) (port-current-line p))))
+  (test* "read (long string literal)" lines
+         (begin
+           (with-output-to-file "tmp1.o" (cut write lines))
+           (call-with-input-file "tmp1.o" read))))
+
 (with-output-to-file "tmp1.o"
   (cut display "a b c \"d e\" f g\n(0 1 2\n3 4 5)\n"))
 
@@ -634,6 +685,57 @@
 
 (sys-unlink "test.o")
 
+;;-------------------------------------------------------------------
+(test-section "mapped file ports")
+
+(with-output-to-file "test.o"
+  (cut display "abc\ndef\u3042\nghi"))
+
+(test* "mmap port read-line" '("abc" "def\u3042" "ghi" #t)
+       (call-with-input-file "test.o"
+         (^p (let* ([a (read-line p)]
+                    [b (read-line p)]
+                    [c (read-line p)])
+               (list a b c (eof-object? (read-line p)))))
+         :mmap #t))
+
+(test* "mmap port read-string, seek and tell" '("ab" 2 "def" 10 "ghi")
+       (call-with-input-file "test.o"
+         (^p (let* ([a (read-string 2 p)]
+                    [pos (port-tell p)]
+                    [_ (port-seek p 4)]
+                    [b (read-string 3 p)]
+                    [_ (read-char p)]
+                    [pos2 (port-tell p)]
+                    [_ (read-char p)])
+               (list a pos b pos2 (port->string p))))
+         :mmap #t))
+
+(test* "mmap port get-remaining-input-string" "def\u3042\nghi"
+       (call-with-input-file "test.o"
+         (^p (read-line p) (get-remaining-input-string p))
+         :mmap #t))
+
+(test* "port-mapped-u8vector" '(#u8(97 98 99) #u8(103 104 105) #t)
+       (let* ([p (open-input-file "test.o" :mmap #t)]
+              [v1 (port-mapped-u8vector p 0 3)]
+              [v2 (port-mapped-u8vector p 11)])
+         (close-port p)
+         (list v1 v2 (not (port-mapped-u8vector (open-input-string "abc"))))))
+
+(test* "mmap port (empty file)" '(#t #f)
+       (begin
+         (with-output-to-file "test.o" (cut display ""))
+         (call-with-input-file "test.o"
+           (^p (list (eof-object? (read-char p))
+                     (port-mapped-u8vector p)))
+           :mmap #t)))
+
+(test* "mmap port (nonexistent file)" #f
+       (open-input-file "test.o.nonexistent" :mmap #t :if-does-not-exist #f))
+
+(sys-unlink "test.o")
+
 ;;-------------------------------------------------------------------
 (test-section "format")
 
@@ -491,6 +491,18 @@
         "-340282366920938463463374607431768211457")
       (i-tester2 (exp2 127)))
 
+;; Large numbers are converted by divide and conquer.
+(test* "10^50000" 50001 (string-length (number->string (expt 10 50000))))
+(test* "10^3000-1" (make-string 3000 #\9)
+       (number->string (- (expt 10 3000) 1)))
+(test* "-2^20000 in binary" (string-append "-1" (make-string 20000 #\0))
+       (number->string (- (expt 2 20000)) 2))
+(let1 x (- (expt 37 12345) (expt 11 4321))
+  (test* "large number roundtrip" x
+         (string->number (number->string x 10)))
+  (test* "large number roundtrip (radix 36)" x
+         (string->number (number->string x 36) 36)))
+
 ;;------------------------------------------------------------------
 (test-section "number->string customization")
 
@@ -1328,6 +1340,18 @@
            173462447179147555430258970864309778377421844723664084649347019061363579192879108857591038330408837177983810868451546421940712978306134189864280826014542758708589243873685563973118948869399158545506611147420216132557017260564139394366945793220968665108959685482705388072645828554151936401912464931182546092879815733057795573358504982279280090942872567591518912118622751714319229788100979251036035496917279912663527358783236647193154777091427745377038294584918917590325110939381322486044298573971650711059244462177542540706913047034664643603491382441723306598834177
            ))
 
+;; These are large enough to exercise Karatsuba, Toom-3 and NTT
+;; multiplication, respectively.
+(dolist [k '(5000 20000 200000)]
+  (test* (format "(2^~a-1)(2^~a+1)" k k) (- (expt 2 (* k 2)) 1)
+         (* (- (expt 2 k) 1) (+ (expt 2 k) 1)))
+  (let ([x (- (expt 3 (quotient k 2)) 1)]
+        [y (+ (expt 7 (quotient k 3)) 12345)])
+    (test* (format "quotient&remainder of product (~a)" k) (list x 0)
+           (receive (q r) (quotient&remainder (* x y) y) (list q r)))
+    (test* (format "(x+y)^2-(x-y)^2 = 4xy (~a)" k) (* 4 x y)
+           (- (* (+ x y) (+ x y)) (* (- x y) (- x y))))))
+
 ;;------------------------------------------------------------------
 (test-section "multiplication short cuts")
 
@@ -420,6 +420,60 @@
        (cons (acc-dis-1 (make <acc-dis-1>) #f)
              (acc-dis-1 (make <acc-dis-1>) 2)))
 
+(define-generic acc-dis-3)
+(define-method acc-dis-3 ((a <acc-dis-0>)) 0)
+(define-method acc-dis-3 ((a <acc-dis-1>)) 1)
+(define-method acc-dis-3 ((a <acc-dis-1>) (b <integer>)) 'int)
+(define-method acc-dis-3 ((a <top>) b) 'top)
+
+(let ([info (with-module gauche.object generic-dispatcher-info)])
+  (test* "automatic build (before)" #f (info acc-dis-3))
+  (test* "automatic build (after)" '(0 1 int top)
+         (let loop ([n 0] [r '()])
+           (if (= n 100)
+             r
+             (loop (+ n 1)
+                   (list (acc-dis-3 (make <acc-dis-0>))
+                         (acc-dis-3 (make <acc-dis-1>))
+                         (acc-dis-3 (make <acc-dis-1>) 3)
+                         (acc-dis-3 (make <acc-dis-1>) 'x))))))
+  (test* "automatic build (info)" '(0 #t #t)
+         (let1 i (info acc-dis-3)
+           (list (get-keyword :axis i)
+                 (> (get-keyword :hits i) 0)
+                 (> (get-keyword :misses i) 0)))))
+
+(define-generic acc-dis-4)
+(define-macro (gen-acc-dis-4-methods)
+  `(begin
+     ,@(map (^n `(define-method acc-dis-4 ((a ,(symbol-append '<acc-dis- n '>)))
+                   ,n))
+            (iota 10))))
+(gen-acc-dis-4-methods)
+(test* "automatic build (many methods)" '(#t 9)
+       (list (boolean ((with-module gauche.object generic-dispatcher-info)
+                       acc-dis-4))
+             (acc-dis-4 (make <acc-dis-9>))))
+
+;; call site cache
+(define-generic cs-cache)
+(define-method cs-cache ((a <top>)) 'top)
+(define (cs-cache-caller x) (cs-cache x))
+
+(test* "call site cache" '(top top top)
+       (map cs-cache-caller '(1 "a" #\b)))
+(define-method cs-cache ((a <integer>)) 'int)
+(test* "call site cache (method added)" '(int top top)
+       (map cs-cache-caller '(1 "a" #\b)))
+(define-method cs-cache ((a <string>)) (list 'str (next-method)))
+(test* "call site cache (next-method)" '(int (str top) top)
+       (map cs-cache-caller '(1 "a" #\b)))
+(test* "call site cache (megamorphic)" '(int (str top) top top top top)
+       (map cs-cache-caller '(1 "a" #\b a 1.0 (x))))
+(define cs-cache (lambda (x) 'redefined))
+(test* "call site cache (redefined)" '(redefined redefined)
+       (map cs-cache-caller '(1 "a")))
+
 
 ;;----------------------------------------------------------------
 (test-section "module and accessor")
@@ -159,5 +159,152 @@
          (foo)))
 
 
+;;----------------------------------------------------------------
+(test-section "native code")
+
+;; The following loops run long enough to be translated into native
+;; code, if the JIT is available.  The native code handles only the
+;; common cases, so these also check the fallback to the interpreter
+;; in the middle of a loop.
+
+(define (jit-sum n)
+  (let loop ([i 0] [s 0])
+    (if (< i n) (loop (+ i 1) (+ s i)) s)))
+
+(define (jit-fib n)
+  (if (< n 2) n (+ (jit-fib (- n 1)) (jit-fib (- n 2)))))
+
+(test* "fixnum loop" 49995000 (jit-sum 10000))
+(test* "fixnum loop, after warmup" '(0 0 1 4950) (map jit-sum '(0 1 2 100)))
+(test* "recursion" 6765 (jit-fib 20))
+;; The Makefile runs this file again with -fno-jit, defining *no-jit*,
+;; so that the above and below also run in the interpreter.
+(test* "hot code is translated" (and ((with-module gauche.internal
+                                        %jit-available?))
+                                      (not (global-variable-bound?
+                                            'user '*no-jit*)))
+       ((with-module gauche.internal %compiled-code-jit-compiled?)
+        (closure-code jit-fib)))
+(test* "overflow to bignum" (+ (greatest-fixnum) 1000)
+       (let loop ([i 0] [x (- (greatest-fixnum) 1000)])
+         (if (< i 2000) (loop (+ i 1) (+ x 1)) x)))
+(test* "underflow to bignum" (- (least-fixnum) 1000)
+       (let loop ([i 2000] [x (+ (least-fixnum) 1000)])
+         (if (> i 0) (loop (- i 1) (- x 1)) x)))
+(test* "flonum operands" 5000.0
+       (let loop ([i 0] [x 0.0])
+         (if (< i 10000) (loop (+ i 1) (+ x 0.5)) x)))
+(test* "fixnum and flonum" 1001
+       (let loop ([i 0])
+         (if (< i 1000.5) (loop (+ i 1)) i)))
+(test* "list walk" 500500
+       (let loop ([l (iota 1001)] [s 0])
+         (if (null? l) s (loop (cdr l) (+ s (car l))))))
+(test* "list walk, lazy" 500500
+       (let loop ([l (liota 1001)] [s 0])
+         (if (null? l) s (loop (cdr l) (+ s (car l))))))
+(test* "list walk, improper" (test-error)
+       (let loop ([l (append (iota 1000) 'x)] [s 0])
+         (if (null? l) s (loop (cdr l) (+ s (car l))))))
+(test* "type error after loop" (test-error)
+       (let loop ([i 0])
+         (if (< i 1000) (loop (+ i 1)) (+ i 'a))))
+
+;;----------------------------------------------------------------
+(test-section "flonum loop")
+
+;; A loop carrying flonums reuses the same flonum registers across
+;; iterations.  The registers are recycled at each back edge, so make
+;; sure the flonums that escape from the loop keep their values.
+
+(define (flo-sum n)
+  (let loop ([i 0] [x 0.0])
+    (if (< i n) (loop (+ i 1) (+ x 0.5)) x)))
+
+(test* "flonum loop detection" '(#t #t #f)
+       (list (pair? (filter-insn flo-sum 'FPSTACK-MARK))
+             (pair? (filter-insn flo-sum 'FPSTACK-RESET))
+             (pair? (filter-insn jit-sum 'FPSTACK-MARK))))
+(test* "flonum loop" 50000.0 (flo-sum 100000))
+(test* "flonum loop, swapping" '(2.0 1.0)
+       (let loop ([i 0] [x 1.0] [y 2.0])
+         (if (< i 1001) (loop (+ i 1) y x) (list x y))))
+(test* "flonum loop, fibonacci" 12586269025.0
+       (let loop ([i 0] [a 0.0] [b 1.0])
+         (if (< i 50) (loop (+ i 1) b (+ a b)) a)))
+(test* "flonum loop, escaping values" '(0.0 1.5 3.0 4.5 6.0)
+       (let loop ([i 0] [x 0.0] [r '()])
+         (if (= i 5) (reverse r) (loop (+ i 1) (+ x 1.5) (cons x r)))))
+(test* "flonum loop, closed values" '(2.0 1.0 0.0)
+       (map (^f (f))
+            (let loop ([i 0] [x 0.0] [fs '()])
+              (if (= i 3) fs (loop (+ i 1) (+ x 1.0) (cons (^[] x) fs))))))
+(test* "flonum loop, local binding" 2.0
+       (let loop ([i 0] [x 0.0])
+         (if (< i 100000)
+           (let ([y (* x 0.5)]) (loop (+ i 1) (+ y 1.0)))
+           x)))
+(test* "flonum loop, nested" 250.0
+       (let outer ([i 0] [s 0.0])
+         (if (= i 100)
+           s
+           (outer (+ i 1)
+                  (let inner ([j 0] [t s])
+                    (if (= j 10) t (inner (+ j 1) (+ t 0.25))))))))
+
+(define *flo* 1.5)
+(test* "flonum loop, outer flonums" '(3.0 50000.0 4.5)
+       (let* ([a (* *flo* 2.0)]
+              [b (flo-sum 100000)]
+              [c (+ a *flo*)])
+         (list a b c)))
+
+;;----------------------------------------------------------------
+(test-section "type feedback")
+
+;; Generic arithmetic insns are rewritten to the specialized ones after
+;; they see the same operand types for a while, and rewritten back
+;; when they see other types.
+
+(define (tf-add a b) (+ (car a) (car b)))
+(define (tf-sub a b) (- (car a) (car b)))
+(define (tf-mul a b) (* (car a) (car b)))
+(define (tf-lt a b) (if (< (car a) (car b)) 'yes 'no))
+
+(define (tf-insns proc) (map car (proc->insn/split proc)))
+
+(define (tf-repeat proc a b)
+  (dotimes [i 100] (proc a b))
+  (proc a b))
+
+(test* "fixnum add" 5 (tf-repeat tf-add '(2) '(3)))
+(test* "specialized to fixnum" #t (boolean (memq 'NUMADD2-FIX (tf-insns tf-add))))
+(test* "deoptimize" 5.5 (tf-add '(2.5) '(3)))
+(test* "deoptimized" #t (boolean (memq 'NUMADD2 (tf-insns tf-add))))
+(test* "flonum add" 6.0 (tf-repeat tf-add '(2.5) '(3.5)))
+(test* "specialized to flonum" #t (boolean (memq 'NUMADD2-FLO (tf-insns tf-add))))
+(test* "deoptimize" (+ (greatest-fixnum) 1) (tf-add `(,(greatest-fixnum)) '(1)))
+(test* "deoptimize" 1/2 (tf-add '(1/4) '(1/4)))
+
+(test* "polymorphic site" '(-1 -1.0 -1 -1.0)
+       (list (tf-sub '(1) '(2)) (tf-sub '(1.0) '(2.0))
+             (tf-sub '(1) '(2)) (tf-sub '(1.0) '(2.0))))
+(test* "polymorphic site stays generic" '(-1 #f #f)
+       (list (tf-repeat tf-sub '(1) '(2))
+             (boolean (memq 'NUMSUB2-FIX (tf-insns tf-sub)))
+             (boolean (memq 'NUMSUB2-FLO (tf-insns tf-sub)))))
+
+(test* "fixnum mul" 6 (tf-repeat tf-mul '(2) '(3)))
+(test* "specialized to fixnum" #t (boolean (memq 'NUMMUL2-FIX (tf-insns tf-mul))))
+(test* "fixnum mul overflow" (* (greatest-fixnum) 4)
+       (tf-mul `(,(greatest-fixnum)) '(4)))
+(test* "fixnum mul overflow" (* (least-fixnum) (least-fixnum))
+       (tf-mul `(,(least-fixnum)) `(,(least-fixnum))))
+
+(test* "flonum branch" 'yes (tf-repeat tf-lt '(1.0) '(2.0)))
+(test* "specialized to flonum" #t (boolean (memq 'BNLT-FLO (tf-insns tf-lt))))
+(test* "deoptimize" '(no yes no)
+       (list (tf-lt '(2) '(1)) (tf-lt '(1/2) '(1)) (tf-lt '(+inf.0) '(1))))
+
 (test-end)
 
@@ -567,4 +567,57 @@
                                              (cut read x) (cut read y)))
                  (^_ r)))
 
+;;-------------------------------------------------------------------
+(test-section "profiler")
+
+(let ()
+  (define (pfib n) (if (< n 2) n (+ (pfib (- n 1)) (pfib (- n 2)))))
+  (define (run) (pfib 22))
+  (profiler-reset)
+  (profiler-start :sampling-rate 1000 :stack-depth 4)
+  (let loop ([i 0])
+    (run)
+    (when (< i 100) (loop (+ i 1))))
+  (profiler-stop)
+  (let1 r (profiler-get-stack-result)
+    (test* "stack result" #t
+           (and (pair? r)
+                (every (^e (and (exact-integer? (car e))
+                                (<= 1 (length (cdr e)) 5)))
+                       r)))
+    (test* "collapsed output" #t
+           (every #/^.+ \d+$/
+                  (call-with-input-string
+                      (with-output-to-string
+                        (cut profiler-write-collapsed :results r))
+                    port->string-list)))
+    (test* "pprof output" #t
+           (let1 s (with-output-to-string
+                     (cut profiler-write-pprof :results r))
+             ;; the first field is sample_type (field 1, length-delimited)
+             (and (> (string-size s) 0)
+                  (= (string-byte-ref s 0) #x0a)))))
+  (profiler-reset))
+
+;; The sampler walks the continuation frames while the VM is pushing
+;; them, or moving them to the heap for call/cc.  Sample often to hit
+;; those windows.
+(let ()
+  (define (deep n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))
+  (define (deep/cc n)
+    (if (= n 0)
+      (call/cc (^k (k 0)))
+      (+ 1 (call/cc (^k (k (deep/cc (- n 1))))))))
+  (profiler-reset)
+  (profiler-start :sampling-rate 10000 :stack-depth 64)
+  (dotimes [i 200]
+    (deep 10000)
+    (deep/cc 300))
+  (profiler-stop)
+  (test* "stack result (deep recursion and call/cc)" #t
+         (every (^e (and (exact-integer? (car e))
+                         (<= 1 (length (cdr e)) 65)))
+                (profiler-get-stack-result)))
+  (profiler-reset))
+
 (test-end)
@@ -686,6 +686,40 @@
 (test-parse "()(?(1" (test-error))
 (test-parse "()(?(1)b|c|d)" (test-error))
 
+;;-------------------------------------------------------------------------
+(test-section "linear-time matcher")
+
+;; These would take exponential time with the backtracking matcher.
+(let ([as (make-string 5000 #\a)])
+  (test-re #/(a|aa)*b/ as '())
+  (test-re #/(a|aa)*b/ (string-append as "b")
+           `(,(string-append as "b") "a"))
+  (test-re #/(a*)*b/ as '())
+  (test-re #/^(a+a+)+$/ (string-append as "!") '()))
+(test-re #/(x+x+)+y/ (make-string 100 #\x) '())
+
+;; Submatches should be the same as the backtracking matcher.
+(test-re #/(a|ab)(c|bcd)(d*)/ "abcd" '("abcd" "a" "bcd" ""))
+(test-re #/(a+?)(a*)/ "aaa" '("aaa" "a" "aa"))
+(test-re #/(a|b)*c/ "xabbac" '("abbac" "a"))
+(test-re #/(?:(a)|b)*/ "ab" '("ab" "a"))
+(test-re #/(a)?(b)?c/ "xbc" '("bc" #f "b"))
+(test-re #/(\d{1,3})(\d{2,})/ "a1234b" '("1234" "12" "34"))
+(test-re #/b?$/ "cccc" '(""))
+(test-re #/\bc+\b/ "ab cc d" '("cc"))
+(test-re #/(?i:ab)+c/ "xAbaBc" '("AbaBc"))
+(cond-expand
+ [gauche.ces.none #f]
+ [else
+  (test-re #/(\u3042|\u3044)+\u3046/ "x\u3044\u3042\u3044\u3046"
+           '("\u3044\u3042\u3044\u3046" "\u3044"))])
+
+;; The same regexp reuses the states built by the previous matches.
+(let1 rx #/([a-c]+)(\d+)$/
+  (test* "reuse" '(("abc12" "abc" "12") () ("c9" "c" "9"))
+         (map (^s (rxmatch-substrings (rxmatch rx s)))
+              '("xabc12" "abc12x" "bac c9"))))
+
 ;;-------------------------------------------------------------------------
 (test-section "regexp macros")
 
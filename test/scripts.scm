@@ -621,5 +621,45 @@
   )
 
 (wrap-with-test-directory static-test-1)
+;;=======================================================================
+(test-section "image")
+
+(define (image-test)
+  ;; We use a copy of the library so that we can touch it.
+  (define gosh `("../../src/gosh" "-ftest" "-Iprecomp"))
+  (define (run . args)
+    (process-output->string `(,@gosh ,@args "-Eexit")
+                            :directory "test.o" :redirects '((>& 2 1))))
+  (copy-directory* (build-path *top-srcdir* "test/test-precomp")
+                   "test.o/precomp")
+  (test* "dump image" #t
+         ($ do-process
+            `(,@gosh "-ugauche.image"
+                     "-e" ,(write-to-string
+                            `(image-build-options
+                              '(:gauche-builddir ,*top-builddir*
+                                :cppflags
+                                ,#"-I~|*top-srcdir*|/src -I~|*top-srcdir*|/gc/include")))
+                     "-ufoo" "-Dfoo.img")
+            :directory "test.o"))
+  (test* "load image" (run "-ufoo" "-Eprint (foo-master 3)")
+         (run "-Pfoo.img" "-ufoo" "-Eprint (foo-master 3)"))
+  (test* "sources aren't loaded" #f
+         (#/precomp\/foo/ (run "-fload-verbose" "-Pfoo.img" "-ufoo"
+                               "-Eprint (foo-master 3)")))
+  (let1 t (+ (sys-time) 10)
+    (sys-utime "test.o/precomp/foo.scm" t t))
+  (let1 out (run "-fload-verbose" "-Pfoo.img" "-ufoo"
+                 "-Eprint (foo-master 3)")
+    (test* "stale image warning" #t
+           (boolean (#/image .*foo\.img is stale: .*foo\.scm has been changed/
+                     out)))
+    (test* "stale library is loaded from source" #t
+           (boolean (#/precomp\/foo\.scm/ out)))
+    (test* "stale library works" #t
+           (string-suffix? (run "-ufoo" "-Eprint (foo-master 3)") out)))
+  )
+
+(wrap-with-test-directory image-test)
 
 (test-end)
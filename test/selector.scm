@@ -97,4 +97,46 @@
          (selector-select *sel* 0)
          (list *x* *y*)))
 
+;; NB: (aaa) is left in the pipe by the previous test.
+(test* "selector-add! (replace)" '((aaa) #f)
+       (let ([sel (make <selector>)]
+             [z #f])
+         (set! *x* #f)
+         (selector-add! sel *p0* (^[p f] (set! z (read p))) '(r))
+         (selector-add! sel *p0* set-x '(r))
+         (write '(xxx) *p1*) (flush *p1*)
+         (selector-select sel 0)
+         (list *x* z)))
+
+;; The handler doesn't read, so the pipe stays readable.  An edge-triggered
+;; registration reports it again only after new data arrives.
+(test* "selector-add! (edge)" (cond-expand
+                                [gauche.sys.epoll '(1 0 1)]
+                                [else '(1 1 1)]) ; edge is ignored
+       (let ([sel (make <selector>)])
+         (selector-add! sel *q0* (^[p f] #f) '(r edge))
+         (write '(aaa) *q1*) (flush *q1*)
+         (let* ([a (selector-select sel 0)]
+                [b (selector-select sel 0)])
+           (write '(bbb) *q1*) (flush *q1*)
+           (let1 c (selector-select sel 0)
+             (read *q0*) (read *q0*)
+             (list a b c)))))
+
+(test* "selector-add-timer!" '(0 (a b a) #t)
+       (let ([sel (make <selector>)]
+             [r '()])
+         (define (push x) (^[] (set! r (cons x r))))
+         (let* ([t0 (sys-time)]
+                [ta (selector-add-timer! sel 0.05 (push 'a) 0.1)]
+                [tb (selector-add-timer! sel 0.1 (push 'b))]
+                [tc (selector-add-timer! sel 0.12 (push 'c))]
+                [n (selector-select sel)])
+           (selector-delete-timer! sel tc)
+           (until (= (length r) 3)
+             (selector-select sel '(1 0)))
+           (selector-delete-timer! sel ta)
+           (selector-select sel 200000)
+           (list n (reverse r) (< (- (sys-time) t0) 3)))))
+
 (test-end)
@@ -196,6 +196,74 @@
   (test-string-scan2 #*"abcd" #*"fghi" #*"abcdefghi" #\e 'both)
   )
 
+;; Random access to long multibyte strings uses the character index.
+(unless (eq? (gauche-character-encoding) 'none)
+  (let* ([cs (list-tabulate 1000 (^i (if (odd? (quotient i 7))
+                                        (integer->char (+ #x3042 (modulo i 80)))
+                                        (integer->char (+ 97 (modulo i 26))))))]
+         [v  (list->vector cs)]
+         [s  (list->string cs)])
+    (test* "string-ref (long multibyte)" #t
+           (let loop ([i 999])
+             (or (< i 0)
+                 (and (eqv? (string-ref s i) (vector-ref v i))
+                      (loop (- i 1))))))
+    (test* "substring (long multibyte)" (list->string (take (drop cs 130) 500))
+           (substring s 130 630))
+    (let1 s2 (substring s 70 900)
+      (test* "string-ref (substring of indexed string)" #t
+             (let loop ([i 0])
+               (or (= i 830)
+                   (and (eqv? (string-ref s2 i) (vector-ref v (+ i 70)))
+                        (loop (+ i 1))))))
+      (test* "substring of substring" (list->string (take (drop cs 333) 400))
+             (substring (substring s2 200 800) 63 463))
+      ;; this may replace the string's content with a NUL-terminated copy
+      (test* "string-ref after copying" (vector-ref v 871)
+             (begin (string->symbol s2) (string-ref s2 801))))))
+
+;; Large concatenations are represented as ropes internally.
+(let* ([pieces (list-tabulate 500 (^i (if (odd? i)
+                                        (format "~d\u3042," i)
+                                        (format "~d," i))))]
+       [flat (apply string-append pieces)]
+       [rope (fold (^[p s] (string-append s p)) "" pieces)])
+  (test* "string-append (rope)" flat rope)
+  (test* "string-length (rope)" (string-length flat)
+         (string-length (fold (^[p s] (string-append s p)) "" pieces)))
+  (test* "string-size (rope)" (string-size flat)
+         (string-size (fold (^[p s] (string-append s p)) "" pieces)))
+  (test* "string-append (rope, prepend)" (apply string-append (reverse pieces))
+         (fold string-append "" pieces))
+  (test* "substring (rope)" (substring flat 1000 2500)
+         (substring (fold (^[p s] (string-append s p)) "" pieces) 1000 2500))
+  (test* "substring of substring (rope)" (substring flat 1700 1750)
+         (substring (substring (fold (^[p s] (string-append s p)) "" pieces)
+                               700 2500)
+                    1000 1050))
+  (test* "string-ref (rope)" (string-ref flat 1234)
+         (string-ref (fold (^[p s] (string-append s p)) "" pieces) 1234))
+  (test* "hashing (rope)" 1
+         (let1 h (make-hash-table 'equal?)
+           (hash-table-put! h flat 1)
+           (hash-table-get h (fold (^[p s] (string-append s p)) "" pieces) #f)))
+  (test* "string-append of ropes" (string-append flat flat flat)
+         (string-append rope (string-append rope rope)))
+  (test* "string-set! (rope)" (string-append "X" (substring flat 1 (string-length flat)))
+         (let1 s (fold (^[p s] (string-append s p)) "" pieces)
+           (string-set! s 0 #\X)
+           s))
+  (test* "string-join (rope)" (string-append flat "/" "x" "/" flat)
+         (string-join (list (fold (^[p s] (string-append s p)) "" pieces)
+                            "x"
+                            (fold (^[p s] (string-append s p)) "" pieces))
+                      "/"))
+  (test* "string-append (rope, incomplete)" #t
+         (let1 s (string-append rope #*"\xff")
+           (and (string-incomplete? s)
+                (= (string-size s) (+ (string-size flat) 1))
+                (= (string-length s) (string-size s))))))
+
 ;;-------------------------------------------------------------------
 (test-section "string-split")
 
@@ -212,6 +280,19 @@
 (test* "string-split (char)" '("" "")
        (string-split "*" #\*))
 
+(test* "string-split (multibyte char)" '("\u3042\u3044" "" "abc\u3046" "")
+       (string-split "\u3042\u3044\u3001\u3001abc\u3046\u3001" #\u3001))
+(let* ([piece (string-append (make-string 20 #\x) (make-string 30 #\u3042))]
+       [s (string-join (make-list 10 piece) "\u3001")])
+  (test* "string-split (long multibyte)" (make-list 10 50)
+         (map string-length (string-split s #\u3001)))
+  (test* "string-length (long multibyte)" 509 (string-length s))
+  (test* "string-incomplete->complete (long, invalid)" #f
+         (string-incomplete->complete
+          (string-append (string-complete->incomplete s) #*"\xe3\x81abc")))
+  (test* "string-incomplete->complete (long, valid)" s
+         (string-incomplete->complete (string-complete->incomplete s))))
+
 (test* "string-split (1-char string)" '("aa" "bbb" "c")
        (string-split "aa*bbb*c" "*"))
 
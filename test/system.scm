@@ -760,6 +760,62 @@
   ]
  [else]) ; cond-expand gauche.sys.select
 
+(cond-expand
+ [gauche.sys.poller
+  (test* "sys-poller" '(() ((r . 1)) ((r . 1) (w . 2)) ((w . 2)) ())
+         (let-values ([(in out) (sys-pipe)]
+                      [(poller) (make <sys-poller>)])
+           (define (wait)
+             (map (^[fd&ev]
+                    (cons (cond [(eqv? (car fd&ev) (port-file-number in)) 'r]
+                                [(eqv? (car fd&ev) (port-file-number out)) 'w]
+                                [else (car fd&ev)])
+                          (cdr fd&ev)))
+                  (sort (sys-poller-wait poller 0)
+                        (^[a b] (< (cdr a) (cdr b))))))
+           (sys-poller-set! poller in SYS_POLL_READ)
+           (let* ([a (wait)]
+                  [b (begin (display "x" out) (flush out) (wait))]
+                  [c (begin (sys-poller-set! poller out SYS_POLL_WRITE)
+                            (wait))]
+                  [d (begin (sys-poller-set! poller in 0) (wait))]
+                  [e (begin (sys-poller-set! poller out 0) (wait))])
+             (sys-poller-close poller)
+             (list a b c d e))))
+
+  (test* "sys-poller (many descriptors)" 200
+         (let ([poller (make <sys-poller>)]
+               [pipes (map (^_ (receive p (sys-pipe) p)) (iota 200))])
+           (dolist [p pipes]
+             (sys-poller-set! poller (car p) SYS_POLL_READ)
+             (display "x" (cadr p))
+             (flush (cadr p)))
+           (begin0 (length (sys-poller-wait poller 0))
+             (dolist [p pipes]
+               (close-port (car p))
+               (close-port (cadr p))))))
+
+  ;; epoll doesn't accept regular files, but they're always ready.
+  (test* "sys-poller (regular file)" '((#t . 1) (#t . 1) ())
+         (let ([poller (make <sys-poller>)]
+               [in (begin (with-output-to-file "test.o" (cut display "x"))
+                          (open-input-file "test.o"))])
+           (sys-poller-set! poller in SYS_POLL_READ)
+           (let* ([wait (^[] (map (^[fd&ev]
+                                    (cons (eqv? (car fd&ev)
+                                                (port-file-number in))
+                                          (cdr fd&ev)))
+                                  (sys-poller-wait poller 1)))]
+                  [a (wait)]
+                  [b (wait)]
+                  [c (begin (sys-poller-set! poller in 0) (wait))])
+             (sys-poller-close poller)
+             (close-port in)
+             (sys-unlink "test.o")
+             (cons (car a) (cons (car b) c)))))
+  ]
+ [else])
+
 ;;-------------------------------------------------------------------
 (test-section "signal handling")
 
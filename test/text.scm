@@ -10,131 +10,6 @@
 (use text.console)
 (test-module 'text.console)
 
-;;-------------------------------------------------------------------
-(test-section "csv")
-(use text.csv)
-(test-module 'text.csv)
-
-(test* "csv-reader" '("abc" "def" "" "ghi")
-       (call-with-input-string "abc  ,  def  ,, ghi  "
-         (make-csv-reader #\,)))
-
-(test* "csv-reader" '("abc" "def" "" ", ghi")
-       (call-with-input-string "abc  :  def  :: , ghi  "
-         (make-csv-reader #\:)))
-
-(test* "csv-reader" '("abc" "def" "ghi")
-       (call-with-input-string "abc  ,  \"def\"  , \"ghi\"  "
-         (make-csv-reader #\,)))
-
-(test* "csv-reader" '("abc" " de,f " "gh\ni" "jkl")
-       (call-with-input-string "   abc,  \" de,f \"  , \"gh\ni\", \"jkl\""
-         (make-csv-reader #\,)))
-
-(test* "csv-reader" '("ab\nc" "de \n\n \nf " "" "" "gh\"\n\"i")
-       (call-with-input-string "   \"ab\nc\" ,  \"de \n\n \nf \"  ,  , \"\" , \"gh\"\"\n\"\"i\""
-         (make-csv-reader #\,)))
-
-(test* "csv-reader" '(("" "") ("a" "") ("" "b"))
-       (let1 r (make-csv-reader #\,)
-         (call-with-input-string ",\na,  \n  ,b"
-           (^p (let* ([a (r p)] [b (r p)] [c (r p)] [d (r p)])
-                 (and (eof-object? d)
-                      (list a b c)))))))
-
-(test* "csv-reader" (test-error)
-       (call-with-input-string " abc,  def , \"ghi\"\"\n\n"
-         (make-csv-reader #\,)))
-
-(test* "csv-reader" #t
-       (eof-object?
-        (call-with-input-string "" (make-csv-reader #\,))))
-
-(test* "csv-writer"
-       "abc,def,123,\"what's up?\",\"he said, \"\"nothing new.\"\"\"\n"
-       (call-with-output-string
-         (lambda (out)
-           ((make-csv-writer #\,)
-            out
-            '("abc" "def" "123" "what's up?" "he said, \"nothing new.\""))))
-       )
-
-(test* "csv-writer"
-       "abc,def,123,\"what's up?\",\"he said, \"\"nothing new.\"\"\"\r\n"
-       (call-with-output-string
-         (lambda (out)
-           ((make-csv-writer #\, "\r\n")
-            out
-            '("abc" "def" "123" "what's up?" "he said, \"nothing new.\""))))
-       )
-
-(test* "csv-writer" "\n"
-       (call-with-output-string
-         (lambda (out)
-           ((make-csv-writer #\,) out '()))))
-
-;; middle-level API
-
-(let ([data '(("" "" "" "" "" "" "" "" "")
-              ("Exported data" "" "" "" "" "" "" "" "")
-              ("" "" "" "" "" "" "" "" "")
-              ("" "" "Year" "Country" "" "Population" "GDP" "" "Note")
-              ("" "" "1958" "Land of Lisp" "" "39994" "551,435,453" "" "")
-              ("" "" "1957" "United States of Formula Translators" "" "115333"
-               "4,343,225,434" "" "Estimated")
-              ("" "" "1959" "People's Republic of COBOL" ""
-               "82524" "3,357,551,143" "" "")
-              ("" "" "1970" "Kingdom of Pascal" "" "3785" "" "" "GDP missing")
-              ("" "" "" "" "" "" "" "" "")
-              ("" "" "1962" "APL Republic" "" "1545" "342,335,151" "" ""))]
-      [header-slots1  '("Country" "Year" "GDP" "Population")]
-      [header-slots2 '(#/country/i #/year/i #/gdp/i #/popu/i)])
-  (test* "make-csv-header-parser (strings)" '#(3 2 6 5)
-         (any (make-csv-header-parser header-slots1) data))
-
-  (test* "make-csv-header-parser (regexps)" '#(3 2 6 5)
-         (any (make-csv-header-parser header-slots2) data))
-  
-  (test* "make-csv-record-parser (strings)"
-         '(("Land of Lisp" "1958" "551,435,453" "39994")
-           ("United States of Formula Translators" "1957" "4,343,225,434"
-            "115333")
-           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
-           ("APL Republic" "1962" "342,335,151" "1545"))
-         (filter-map (make-csv-record-parser header-slots1 '#(3 2 6 5)
-                                             '(("Year" #/^\d+$/)
-                                               "Country" "Population" "GDP"))
-                     data))
-
-  (test* "make-csv-record-parser (regexps)"
-         '(("Land of Lisp" "1958" "551,435,453" "39994")
-           ("United States of Formula Translators" "1957" "4,343,225,434"
-            "115333")
-           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
-           ("APL Republic" "1962" "342,335,151" "1545"))
-         (filter-map (make-csv-record-parser header-slots2 '#(3 2 6 5)
-                                             '((#/year/i #/^\d+$/)
-                                               #/country/i #/popu/i #/gdp/i))
-                     data))
-  
-  (test* "csv-rows->tuples (allow-gap? #f)"
-         '(("Land of Lisp" "1958" "551,435,453" "39994")
-           ("United States of Formula Translators" "1957" "4,343,225,434"
-            "115333")
-           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
-           ("Kingdom of Pascal" "1970" "" "3785"))
-         (csv-rows->tuples data header-slots1))
-
-  (test* "csv-rows->tuples (allow-gap? #t)"
-         '(("Land of Lisp" "1958" "551,435,453" "39994")
-           ("United States of Formula Translators" "1957" "4,343,225,434"
-            "115333")
-           ("People's Republic of COBOL" "1959" "3,357,551,143" "82524")
-           ("Kingdom of Pascal" "1970" "" "3785")
-           ("APL Republic" "1962" "342,335,151" "1545"))
-         (csv-rows->tuples data header-slots1 :allow-gap? #t))
-  )
-
 ;;-------------------------------------------------------------------
 (test-section "diff")
 (use text.diff)